@@ -0,0 +1,111 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <iostream>
+#include <pcl/io/ply_io.h>
+
+#include "common_lib.h"
+#include "cloud_codec.h"
+
+/* 点云压缩的带宽和耗时测试。
+cloud_codec_bench [scan.ply] [resolution] [points_per_scan]
+不指定 ply 时生成模拟的 Livox 花瓣形扫描（10m x 8m x 3m 房间），ply 中的点按原顺序切成多帧。*/
+
+// 花瓣形扫描打在房间墙面上，LiDAR 位于房间中间
+static void simulate_scan(const int num_points, const int seed, PointCloudXYZI &cloud) {
+
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    const float half[3] = {5.0f, 4.0f, 1.5f};
+    const float fov = 0.61f;  // 视场角半径 35 度
+    cloud.clear();
+    for (int i = 0; i < num_points; i++) {
+        float t = (i + seed * num_points) * 1e-4f;
+        float r = fov * std::sin(7.0f * t);
+        V3F dir(1.0f, r * std::cos(t * 3.1f), r * std::sin(t * 3.1f));
+        dir.normalize();
+        // 射线与房间的交点
+        float range = 1e9f;
+        for (int j = 0; j < 3; j++) {
+            if (std::fabs(dir(j)) > 1e-6f) {
+                range = std::min(range, half[j] / std::fabs(dir(j)));
+            }
+        }
+        range += noise(rng);
+        PointType p;
+        p.getVector3fMap() = dir * range;
+        p.intensity = 20.0f + 10.0f * std::floor(p.z * 2.0f);
+        cloud.push_back(p);
+    }
+}
+
+int main(int argc, char **argv) {
+
+    const std::string file = argc > 1 ? argv[1] : "";
+    const float resolution = argc > 2 ? std::stof(argv[2]) : 0.01f;
+    const int scan_points = argc > 3 ? std::stoi(argv[3]) : 10000;
+
+    std::vector<PointCloudXYZI> scans;
+    if (!file.empty()) {
+        PointCloudXYZI all;
+        pcl::PLYReader reader;
+        if (reader.read(file, all) != 0) {
+            std::cerr << "cannot read " << file << std::endl;
+            return 1;
+        }
+        for (size_t i = 0; i < all.size(); i += scan_points) {
+            PointCloudXYZI scan;
+            scan.points.assign(all.points.begin() + i, all.points.begin() + std::min(all.size(), i + scan_points));
+            scans.push_back(scan);
+        }
+    }
+    else {
+        scans.resize(100);
+        for (size_t i = 0; i < scans.size(); i++) {
+            simulate_scan(scan_points, i, scans[i]);
+        }
+    }
+
+    CloudEncoder encoder(resolution);
+    std::vector<uint8_t> data;
+    std::vector<CodecPoint> decoded;
+    size_t raw_bytes = 0, xyzi_bytes = 0, compressed_bytes = 0, num_points = 0;
+    double encode_time = 0.0, decode_time = 0.0, max_error = 0.0;
+    for (const PointCloudXYZI &scan : scans) {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        encoder.reset();
+        for (const PointType &p : scan.points) {
+            encoder.add_point(p.x, p.y, p.z, p.intensity);
+        }
+        encoder.finish(data);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        if (!decode_cloud(data.data(), data.size(), scan.size(), resolution, decoded)) {
+            std::cerr << "decode failed" << std::endl;
+            return 1;
+        }
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+        encode_time += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        decode_time += std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+        for (size_t i = 0; i < scan.size(); i++) {
+            const PointType &p = scan.points[i];
+            max_error = std::max(max_error, static_cast<double>(std::max(std::fabs(p.x - decoded[i].x),
+                std::max(std::fabs(p.y - decoded[i].y), std::fabs(p.z - decoded[i].z)))));
+        }
+        raw_bytes += scan.size() * sizeof(PointType);  // /cloud_registered 的 PointCloud2，每个点 48 字节
+        xyzi_bytes += scan.size() * 16;               // 只保留 xyz 和反射率的 float
+        compressed_bytes += data.size();
+        num_points += scan.size();
+    }
+
+    const double n = scans.size();
+    std::cout << "scans: " << scans.size() << ", points: " << num_points << ", resolution: " << resolution << "m" << std::endl;
+    std::cout << "PointCloud2 (XYZINormal): " << raw_bytes / n / 1024.0 << " KB/scan" << std::endl;
+    std::cout << "PointCloud2 (XYZI):       " << xyzi_bytes / n / 1024.0 << " KB/scan" << std::endl;
+    std::cout << "compressed:               " << compressed_bytes / n / 1024.0 << " KB/scan, "
+              << 8.0 * compressed_bytes / num_points << " bits/point, ratio " << double(raw_bytes) / compressed_bytes
+              << std::endl;
+    std::cout << "encode: " << encode_time / n << " ms/scan, decode: " << decode_time / n << " ms/scan" << std::endl;
+    std::cout << "max quantization error: " << max_error << "m" << std::endl;
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+
+#include "common_lib.h"
+#include "compact_map.h"
+
+/* CompactMap 量化误差的检查。
+compact_map_bench [num_points] [num_queries] [tile_size] [extent]
+默认在边长 20m、以原点为中心的立方体内随机生成 100000 个点，建图后随机查询 2000 次 kNN（k = NUM_MATCH_POINTS），
+与原始点云上的暴力搜索比较：
+1. 位置误差：返回的每个点到原始点云中最近点的距离；
+2. 距离误差：第 j 个最近邻的距离与暴力搜索第 j 个最近邻的距离之差（三角不等式，也不超过单点误差）。
+输出实测的最大误差和 quantization_error_bound()，超出时返回 1。
+extent 超过 tile_size * 256 时 float 本身的精度低于量化步长，误差会超出上界。*/
+
+// 误差用 double 计算，避免检查本身的舍入误差
+static double dist2_d(const PointType &a, const PointType &b) {
+
+    const double dx = static_cast<double>(a.x) - b.x;
+    const double dy = static_cast<double>(a.y) - b.y;
+    const double dz = static_cast<double>(a.z) - b.z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+static double nearest_raw(const PointVector &points, const PointType &p) {
+
+    double best = std::numeric_limits<double>::max();
+    for (const PointType &q : points) {
+        best = std::min(best, dist2_d(p, q));
+    }
+    return std::sqrt(best);
+}
+
+int main(int argc, char **argv) {
+
+    const int num_points = argc > 1 ? std::stoi(argv[1]) : 100000;
+    const int num_queries = argc > 2 ? std::stoi(argv[2]) : 2000;
+    const float tile_size = argc > 3 ? std::stof(argv[3]) : 0.5f;
+    const float extent = argc > 4 ? std::stof(argv[4]) : 20.0f;
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> u(-0.5f * extent, 0.5f * extent);
+    PointVector points(num_points);
+    for (PointType &p : points) {
+        p.x = u(rng);
+        p.y = u(rng);
+        p.z = u(rng);
+        p.intensity = static_cast<float>(rng() % 256);
+    }
+
+    CompactMap map;
+    map.set_tile_size(tile_size);
+    auto t0 = std::chrono::steady_clock::now();
+    map.build(points);
+    auto t1 = std::chrono::steady_clock::now();
+
+    // 搜索半径覆盖 k 个最近邻：点密度下 k 个点的期望半径的 3 倍
+    const float density = num_points / (extent * extent * extent);
+    const float radius = 3.0f * std::cbrt(NUM_MATCH_POINTS / density);
+    const float max_dist2 = radius * radius;
+    PointVector nearest;
+    std::vector<float> dist2;
+    std::vector<double> raw_dist2;
+    double max_position_error = 0.0, max_distance_error = 0.0;
+    int missing = 0;
+    double search_time = 0.0;
+    for (int i = 0; i < num_queries; i++) {
+        PointType query;
+        query.x = u(rng);
+        query.y = u(rng);
+        query.z = u(rng);
+        auto s0 = std::chrono::steady_clock::now();
+        map.nearest_search(query, NUM_MATCH_POINTS, nearest, dist2, max_dist2);
+        auto s1 = std::chrono::steady_clock::now();
+        search_time += std::chrono::duration<double, std::micro>(s1 - s0).count();
+
+        // 暴力搜索原始点云的 k 个最近邻
+        raw_dist2.clear();
+        for (const PointType &p : points) {
+            const double d2 = dist2_d(p, query);
+            if (d2 <= max_dist2) {
+                raw_dist2.push_back(d2);
+            }
+        }
+        const size_t k = std::min<size_t>(NUM_MATCH_POINTS, raw_dist2.size());
+        std::partial_sort(raw_dist2.begin(), raw_dist2.begin() + k, raw_dist2.end());
+        // 半径边界上的点可能因为量化进出搜索范围，个数只允许差 1
+        if (nearest.size() + 1 < k || nearest.size() > k + 1) {
+            missing++;
+            continue;
+        }
+        for (size_t j = 0; j < nearest.size(); j++) {
+            max_position_error = std::max(max_position_error, nearest_raw(points, nearest[j]));
+            if (j < k) {
+                max_distance_error = std::max(max_distance_error,
+                    std::fabs(std::sqrt(dist2_d(nearest[j], query)) - std::sqrt(raw_dist2[j])));
+            }
+        }
+    }
+
+    const float bound = map.quantization_error_bound();
+    std::cout << "points: " << num_points << ", queries: " << num_queries << ", tile size: " << tile_size <<
+        "m, extent: " << extent << "m\n";
+    std::cout << "build: " << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms, search: " <<
+        search_time / num_queries << "us/query\n";
+    std::cout << "max position error: " << max_position_error << "m, max distance error: " << max_distance_error <<
+        "m, bound: " << bound << "m\n";
+    if (missing > 0) {
+        std::cout << "FAIL: " << missing << " queries returned a different number of neighbors\n";
+        return 1;
+    }
+    if (max_position_error > bound || max_distance_error > bound) {
+        std::cout << "FAIL: quantization error exceeds the bound\n";
+        return 1;
+    }
+    std::cout << "ok\n";
+    return 0;
+}
@@ -0,0 +1,326 @@
+#include <cmath>
+#include <memory>
+#include <random>
+#include <benchmark/benchmark.h>
+
+#include "common_lib.h"
+#include "preprocess.h"
+#include "IMU_Processing.h"
+#include "use-ikfom.h"
+#include "lidar_map.h"
+#include "voxel_filter.h"
+
+/* 热点函数的微基准测试（Google Benchmark），不需要 ROS master。
+lio_bench [--benchmark_filter=<regex>] [--benchmark_format=csv] ...
+输入为合成数据：Mid-70 的花瓣形扫描打在 10m x 8m x 3m 的房间内，IMU 200Hz，LiDAR 10Hz，
+每个测试在 10000、24000、100000 点（去畸变、降采样前）上运行。
+h_share_model 和 map_incremental 直接测试 lio_node 使用的 LidarMap（不开启由粗到精匹配和平面 patch），
+地图分别用 ikd-Tree 和 CompactMap。*/
+
+#define BENCH_MAP_RES     (0.05f)  // 与 mid70.yaml 的 filter_size_map 一致
+#define BENCH_SURF_RES    (0.5f)  // 与 mid70.yaml 的 filter_size_surf 一致
+#define BENCH_SCAN_TIME   (0.1)
+#define BENCH_IMU_RATE    (200.0)
+#define BENCH_TILE_SIZE   (0.5f)  // 与 mid70.yaml 的 compact_tile_size 一致
+
+static void point_counts(benchmark::internal::Benchmark *b) {
+
+    b->Arg(10000)->Arg(24000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+}
+
+static void point_counts_maps(benchmark::internal::Benchmark *b) {
+
+    for (int map = 0; map < 2; map++) {
+        for (int n : {10000, 24000, 100000}) {
+            b->Args({n, map});
+        }
+    }
+    b->ArgNames({"points", "compact"})->Unit(benchmark::kMicrosecond);
+}
+
+/* 合成数据。*/
+
+// LiDAR 系下一帧扫描，curvature 为点在帧内的时间（ms），与 Preprocess 的输出一致
+static void make_scan(const int num_points, const int seed, PointCloudXYZI &cloud) {
+
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    const V3F half(5.0f, 4.0f, 1.5f);
+    const V3F origin(-2.0f, 0.0f, 0.0f);
+    const float fov = 0.61f;
+    cloud.clear();
+    cloud.reserve(num_points);
+    for (int i = 0; i < num_points; i++) {
+        float t = i * 1e-3f + seed * 0.37f;
+        float r = fov * std::sin(7.0f * t);
+        V3F dir(1.0f, r * std::cos(t * 3.1f), r * std::sin(t * 3.1f));
+        dir.normalize();
+        float range = 1e9f;
+        for (int j = 0; j < 3; j++) {
+            if (std::fabs(dir(j)) > 1e-6f) {
+                range = std::min(range, ((dir(j) > 0 ? half(j) : -half(j)) - origin(j)) / dir(j));
+            }
+        }
+        PointType p;
+        p.getVector3fMap() = dir * (range + noise(rng));
+        p.intensity = 100.0f;
+        p.curvature = BENCH_SCAN_TIME * 1000.0 * i / num_points;
+        cloud.push_back(p);
+    }
+}
+
+// 一帧的 LiDAR 和 IMU 数据，第 frame 帧从 frame * BENCH_SCAN_TIME 开始，缓慢旋转。
+// 与 sync_packages 一致，IMU 为上一帧结束之后、本帧结束之前的测量
+static void make_measure(const PointCloudXYZI &scan, const int frame, MeasureGroup &meas) {
+
+    meas.lidar_beg_time = frame * BENCH_SCAN_TIME;
+    meas.lidar_end_time = meas.lidar_beg_time + BENCH_SCAN_TIME;
+    *meas.lidar = scan;
+    meas.imu.clear();
+    const int num_imu = static_cast<int>(BENCH_SCAN_TIME * BENCH_IMU_RATE);
+    ImuSample imu;
+    imu.acc << 0.0, 0.0, 1.0;
+    imu.gyr << 0.01, 0.0, 0.02;
+    for (int i = 1; i <= num_imu; i++) {
+        imu.time = meas.lidar_beg_time + BENCH_SCAN_TIME * (i - 0.5) / num_imu;
+        meas.imu.push_back(imu);
+    }
+}
+
+// 与 lio_node 相同的降采样，缓冲区在调用之间复用
+static void downsample(const PointCloudXYZI::Ptr &in, PointCloudXYZI &out, const float leaf) {
+
+    static VoxelFilter filter;
+    filter.set_leaf_size(leaf);
+    filter.filter(*in, out);
+}
+
+/* 与 lio_node 相同的地图和观测模型（LidarMap），每个测试重新建图。*/
+
+static std::unique_ptr<LidarMap> bench_map;
+static PointCloudXYZI::Ptr bench_body(new PointCloudXYZI());
+
+// init_dyn_share 需要函数指针
+static void bench_h_share_model(state_ikfom &st, esekfom::dyn_share_datastruct<double> &ekfom_data) {
+
+    bench_map->h_share_model(st, ekfom_data);
+}
+
+// 初始化滤波器，并用同一位置的一帧扫描建图，之后每个测试都在这个地图上匹配
+static void bench_setup(const int num_points, const bool compact, esekfom::esekf<state_ikfom, 12, input_ikfom> &kf) {
+
+    double epsi[23];
+    std::fill(epsi, epsi + 23, 0.001);
+    kf.init_dyn_share(get_f, df_dx, df_dw, bench_h_share_model, 4, epsi);
+    state_ikfom init_state = kf.get_x();
+    init_state.grav = S2(V3D(0.0, 0.0, -G_m_s2));
+    kf.change_x(init_state);
+
+    bench_map.reset(new LidarMap());
+    bench_map->set_filter_size(BENCH_MAP_RES);
+    bench_map->set_compact(compact, BENCH_TILE_SIZE);
+    PointCloudXYZI::Ptr scan(new PointCloudXYZI());
+    make_scan(num_points, 0, *scan);
+    downsample(scan, *bench_body, BENCH_SURF_RES);
+    bench_map->set_scan(bench_body);
+    bench_map->build_from_scan(kf.get_x());
+    // 用另一帧扫描匹配
+    make_scan(num_points, 1, *scan);
+    downsample(scan, *bench_body, BENCH_SURF_RES);
+    bench_map->set_scan(bench_body);
+}
+
+/* 基准测试。*/
+
+static void BM_Preprocess(benchmark::State &state) {
+
+    const int n = state.range(0);
+    livox_ros_driver::CustomMsg::Ptr msg(new livox_ros_driver::CustomMsg());
+    PointCloudXYZI scan;
+    make_scan(n, 0, scan);
+    msg->point_num = n;
+    msg->points.resize(n);
+    for (int i = 0; i < n; i++) {
+        livox_ros_driver::CustomPoint &cp = msg->points[i];
+        cp.x = scan.points[i].x;
+        cp.y = scan.points[i].y;
+        cp.z = scan.points[i].z;
+        cp.reflectivity = 100;
+        cp.tag = 0x10;
+        cp.line = i % 6;
+        cp.offset_time = static_cast<uint32_t>(scan.points[i].curvature * 1e6f);
+    }
+    Preprocess pre;
+    PointCloudXYZI::Ptr out(new PointCloudXYZI());
+    for (auto _ : state) {
+        pre.process(msg, out);
+        benchmark::DoNotOptimize(out->points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Preprocess)->Apply(point_counts);
+
+static void BM_EstiPlane(benchmark::State &state) {
+
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    PointVector points(NUM_MATCH_POINTS);
+    for (PointType &p : points) {
+        p.x = 1.0f + noise(rng) * 20.0f;
+        p.y = 2.0f + noise(rng) * 20.0f;
+        p.z = 0.3f * p.x - 0.2f * p.y + noise(rng);
+    }
+    VF(4) pabcd;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(esti_plane(pabcd, points, 0.1f));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_EstiPlane);
+
+static void BM_Exp(benchmark::State &state) {
+
+    V3D ang_vel(0.1, -0.2, 0.3);
+    double dt = 0.005;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Exp(ang_vel, dt));
+        ang_vel(0) += 1e-9;
+    }
+}
+BENCHMARK(BM_Exp);
+
+static void BM_Predict(benchmark::State &state) {
+
+    esekfom::esekf<state_ikfom, 12, input_ikfom> kf;
+    double epsi[23];
+    std::fill(epsi, epsi + 23, 0.001);
+    kf.init_dyn_share(get_f, df_dx, df_dw, bench_h_share_model, 4, epsi);
+    Eigen::Matrix<double, 12, 12> Q = process_noise_cov();
+    input_ikfom in;
+    in.acc << 0.0, 0.0, G_m_s2;
+    in.gyro << 0.01, 0.0, 0.02;
+    double dt = 1.0 / BENCH_IMU_RATE;
+    for (auto _ : state) {
+        kf.predict(dt, Q, in);
+    }
+}
+BENCHMARK(BM_Predict);
+
+// IMU 前向传播和点云去畸变（UndistortPcl），初始化用的帧不计时
+static void BM_ImuProcess(benchmark::State &state) {
+
+    const int n = state.range(0);
+    PointCloudXYZI scan;
+    make_scan(n, 0, scan);
+    esekfom::esekf<state_ikfom, 12, input_ikfom> kf;
+    double epsi[23];
+    std::fill(epsi, epsi + 23, 0.001);
+    kf.init_dyn_share(get_f, df_dx, df_dw, bench_h_share_model, 4, epsi);
+    ImuProcess imu;
+    MeasureGroup meas;
+    PointCloudXYZI::Ptr undistort(new PointCloudXYZI());
+    int frame = 0;
+    for (; frame <= IMU_MAX_INI_COUNT; frame++) {
+        make_measure(scan, frame, meas);
+        imu.Process(meas, kf, undistort);
+    }
+    for (auto _ : state) {
+        state.PauseTiming();
+        make_measure(scan, frame++, meas);
+        state.ResumeTiming();
+        imu.Process(meas, kf, undistort);
+        benchmark::DoNotOptimize(undistort->points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ImuProcess)->Apply(point_counts);
+
+static void BM_VoxelDownsample(benchmark::State &state) {
+
+    const int n = state.range(0);
+    PointCloudXYZI::Ptr scan(new PointCloudXYZI());
+    make_scan(n, 0, *scan);
+    PointCloudXYZI out;
+    for (auto _ : state) {
+        downsample(scan, out, BENCH_SURF_RES);
+        benchmark::DoNotOptimize(out.points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_VoxelDownsample)->Apply(point_counts);
+
+// 一次观测模型的计算：坐标变换、kNN、平面拟合、雅可比
+static void BM_HShareModel(benchmark::State &state) {
+
+    esekfom::esekf<state_ikfom, 12, input_ikfom> kf;
+    bench_setup(state.range(0), state.range(1) != 0, kf);
+    state_ikfom st = kf.get_x();
+    esekfom::dyn_share_datastruct<double> data;
+    for (auto _ : state) {
+        data.valid = true;
+        bench_map->h_share_model(st, data);
+        benchmark::DoNotOptimize(data.h.data());
+    }
+    state.counters["points"] = bench_body->points.size();
+    state.counters["matched"] = bench_map->last_effective();
+}
+BENCHMARK(BM_HShareModel)->Apply(point_counts_maps);
+
+// 迭代卡尔曼滤波更新，每次从同一个先验状态开始
+static void BM_UpdateIterated(benchmark::State &state) {
+
+    esekfom::esekf<state_ikfom, 12, input_ikfom> kf;
+    bench_setup(state.range(0), state.range(1) != 0, kf);
+    long iterations = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        esekfom::esekf<state_ikfom, 12, input_ikfom> kf_iter = kf;
+        state.ResumeTiming();
+        kf_iter.update_iterated_dyn_share_modified(0.001);
+        iterations += kf_iter.get_last_iter();
+    }
+    state.counters["iterations"] = benchmark::Counter(iterations, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_UpdateIterated)->Apply(point_counts_maps);
+
+// 地图增量更新，地图逐帧增长（体素降采样限制了增长）。
+// 每次迭代换一帧扫描并沿房间内的网格移动位置，否则同一帧在同一位置重复加入时所有点都落在已有体素内，
+// 测到的只是不插入的路径。最近邻在 h_share_model 中计算，不计时
+static void BM_MapIncremental(benchmark::State &state) {
+
+    const int num_scans = 8;
+    esekfom::esekf<state_ikfom, 12, input_ikfom> kf;
+    bench_setup(state.range(0), state.range(1) != 0, kf);
+    std::vector<PointCloudXYZI::Ptr> scans;
+    PointCloudXYZI::Ptr scan(new PointCloudXYZI());
+    for (int i = 0; i < num_scans; i++) {
+        make_scan(state.range(0), 2 + i, *scan);
+        scans.emplace_back(new PointCloudXYZI());
+        downsample(scan, *scans.back(), BENCH_SURF_RES);
+    }
+    esekfom::dyn_share_datastruct<double> data;
+    const state_ikfom init_state = kf.get_x();
+    long iteration = 0;
+    size_t candidates = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        // 上一次迭代加入地图的候选点（降采样的和直接加入的）
+        if (iteration > 0) {
+            candidates += bench_map->points_to_add().size() + bench_map->points_no_downsample().size();
+        }
+        // 40 x 20 个位置，间距 0.1m（地图分辨率的两倍），位置用完之前每帧都有新的体素
+        state_ikfom st = init_state;
+        st.pos += V3D(0.1 * (iteration % 40) - 2.0, 0.1 * ((iteration / 40) % 20) - 1.0, 0.0);
+        bench_map->set_scan(scans[iteration % num_scans]);
+        data.valid = true;
+        bench_map->h_share_model(st, data);
+        state.ResumeTiming();
+        bench_map->incremental(st, true);
+        iteration++;
+    }
+    candidates += bench_map->points_to_add().size() + bench_map->points_no_downsample().size();
+    state.counters["candidates"] = benchmark::Counter(candidates, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_MapIncremental)->Apply(point_counts_maps);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,97 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <cstdio>
+#include <iostream>
+
+#include "common_lib.h"
+#include "map_io.h"
+#include "compact_map.h"
+
+/* 先验地图加载（load_prior_map）的耗时测试。
+map_io_bench [num_points] [file]
+默认在 100m x 100m x 10m 的范围内随机生成 2000000 个点，用 TiledMapWriter 写到 /tmp/map_io_bench.lim，
+再测 TiledMapReader 的 open（mmap 和读取索引）、load（全部点）、load_box（20m 的包围盒），
+以及用加载的点构建 CompactMap 的耗时，输出每一步的时间和吞吐量。运行前清空页缓存可以测冷启动：
+    sync && echo 3 | sudo tee /proc/sys/vm/drop_caches*/
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed_ms(const Clock::time_point &t0) {
+
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+static void report(const char *name, const double ms, const size_t points) {
+
+    std::cout << name << ": " << ms << "ms";
+    if (points > 0 && ms > 0.0) {
+        std::cout << ", " << points / ms / 1000.0 << "M points/s";
+    }
+    std::cout << "\n";
+}
+
+int main(int argc, char **argv) {
+
+    const int num_points = argc > 1 ? std::stoi(argv[1]) : 2000000;
+    const std::string path = argc > 2 ? argv[2] : "/tmp/map_io_bench.lim";
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> uxy(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> uz(0.0f, 10.0f);
+    PointVector points(num_points);
+    for (PointType &p : points) {
+        p.x = uxy(rng);
+        p.y = uxy(rng);
+        p.z = uz(rng);
+        p.intensity = static_cast<float>(rng() % 256);
+    }
+
+    Clock::time_point t0 = Clock::now();
+    {
+        TiledMapWriter writer;
+        if (!writer.open(path, 10.0f, LIM_FRAME_WORLD)) {
+            std::cerr << "cannot write " << path << std::endl;
+            return 1;
+        }
+        writer.add_points(points);
+        writer.close();
+        if (writer.failed()) {
+            std::cerr << "failed to write " << path << std::endl;
+            return 1;
+        }
+    }
+    report("write", elapsed_ms(t0), num_points);
+
+    t0 = Clock::now();
+    TiledMapReader reader;
+    if (!reader.open(path)) {
+        std::cerr << "cannot read " << path << std::endl;
+        return 1;
+    }
+    report("open", elapsed_ms(t0), 0);
+    std::cout << "chunks: " << reader.num_chunks() << ", points: " << reader.num_points() << "\n";
+
+    PointVector loaded;
+    t0 = Clock::now();
+    reader.load(loaded);
+    report("load", elapsed_ms(t0), loaded.size());
+    if (loaded.size() != points.size()) {
+        std::cerr << "loaded " << loaded.size() << " points, expected " << points.size() << std::endl;
+        return 1;
+    }
+
+    PointVector box;
+    t0 = Clock::now();
+    reader.load_box(V3F(-10.0f, -10.0f, 0.0f), V3F(10.0f, 10.0f, 10.0f), box);
+    report("load_box (20m)", elapsed_ms(t0), box.size());
+
+    CompactMap map;
+    t0 = Clock::now();
+    map.build(loaded);
+    report("compact map build", elapsed_ms(t0), loaded.size());
+
+    reader.close();
+    std::remove(path.c_str());
+    return 0;
+}
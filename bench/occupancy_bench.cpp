@@ -0,0 +1,140 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <iostream>
+
+#include "common_lib.h"
+#include "occupancy_grid.h"
+#include "esdf_map.h"
+
+/* 占据栅格射线更新和 ESDF 增量更新的耗时测试。
+occupancy_bench [points_per_scan] [num_threads] [resolution]
+默认每帧 10000 点（Mid-70 每秒 10 万点，10Hz），模拟 LiDAR 在 10m x 8m x 3m 的房间中沿 x 轴移动，
+前一半帧里有一个人站在 LiDAR 前方，之后离开，检查人所在的体素是否被射线清除。*/
+
+// 房间中间一个 0.4m x 0.4m x 1.7m 的人
+static const V3F person_min(2.0f, -0.2f, -1.5f), person_max(2.4f, 0.2f, 0.2f);
+
+// 射线与轴对齐盒子的交点距离，不相交时返回 -1
+static float ray_box(const V3F &o, const V3F &dir, const V3F &lo, const V3F &hi) {
+
+    float t0 = 0.0f, t1 = 1e9f;
+    for (int a = 0; a < 3; a++) {
+        if (std::fabs(dir(a)) < 1e-9f) {
+            if (o(a) < lo(a) || o(a) > hi(a)) {
+                return -1.0f;
+            }
+            continue;
+        }
+        float ta = (lo(a) - o(a)) / dir(a), tb = (hi(a) - o(a)) / dir(a);
+        t0 = std::max(t0, std::min(ta, tb));
+        t1 = std::min(t1, std::max(ta, tb));
+    }
+    return t0 <= t1 ? t0 : -1.0f;
+}
+
+// 花瓣形扫描打在房间墙面（和人）上
+static void simulate_scan(const int num_points, const int seed, const V3F &origin, const bool person,
+    PointVector &points) {
+
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    const V3F half(5.0f, 4.0f, 1.5f);
+    const float fov = 0.61f;
+    points.clear();
+    for (int i = 0; i < num_points; i++) {
+        // 每帧覆盖整个视场，相邻帧错开
+        float t = i * 1e-3f + seed * 0.37f;
+        float r = fov * std::sin(7.0f * t);
+        V3F dir(1.0f, r * std::cos(t * 3.1f), r * std::sin(t * 3.1f));
+        dir.normalize();
+        float range = 1e9f;
+        for (int j = 0; j < 3; j++) {
+            if (std::fabs(dir(j)) > 1e-6f) {
+                range = std::min(range, ((dir(j) > 0 ? half(j) : -half(j)) - origin(j)) / dir(j));
+            }
+        }
+        if (person) {
+            float hit = ray_box(origin, dir, person_min, person_max);
+            if (hit > 0.0f) {
+                range = std::min(range, hit);
+            }
+        }
+        range += noise(rng);
+        PointType p;
+        p.getVector3fMap() = origin + dir * range;
+        points.push_back(p);
+    }
+}
+
+int main(int argc, char **argv) {
+
+    const int scan_points = argc > 1 ? std::stoi(argv[1]) : 10000;
+    const int threads = argc > 2 ? std::stoi(argv[2]) : 2;
+    const float resolution = argc > 3 ? std::stof(argv[3]) : 0.1f;
+    const int num_scans = 100;
+
+    std::vector<PointVector> scans(num_scans);
+    std::vector<V3D> origins(num_scans);
+    for (int i = 0; i < num_scans; i++) {
+        origins[i] = V3D(-3.0 + 0.01 * i, 0.0, 0.0);
+        simulate_scan(scan_points, i, origins[i].cast<float>(), i < num_scans / 2, scans[i]);
+    }
+
+    OccupancyGrid grid;
+    grid.set_resolution(resolution);
+    grid.set_num_threads(threads);
+    grid.set_track_voxels(true);
+    EsdfMap esdf;
+    esdf.set_resolution(resolution);
+    esdf.set_max_distance(2.0f);
+    std::vector<VoxelKey> occupied, freed;
+    // 人所在的体素中被占据的个数，不含地面那一层
+    auto count_person = [&grid, resolution]() {
+        const VoxelKey lo = voxel_key(person_min(0), person_min(1), person_min(2) + resolution, 1.0f / resolution);
+        const VoxelKey hi = voxel_key(person_max(0), person_max(1), person_max(2), 1.0f / resolution);
+        int n = 0;
+        for (int32_t x = lo.x; x <= hi.x; x++) {
+            for (int32_t y = lo.y; y <= hi.y; y++) {
+                for (int32_t z = lo.z; z <= hi.z; z++) {
+                    VoxelKey v = {x, y, z};
+                    n += grid.is_occupied(v);
+                }
+            }
+        }
+        return n;
+    };
+    int occupied_with_person = 0;
+    double total_time = 0.0, max_time = 0.0, esdf_time = 0.0, esdf_max_time = 0.0;
+    for (int i = 0; i < num_scans; i++) {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        grid.integrate_scan(scans[i], origins[i]);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        total_time += ms;
+        max_time = std::max(max_time, ms);
+        grid.clear_changed();
+
+        t0 = std::chrono::steady_clock::now();
+        grid.take_voxel_changes(occupied, freed);
+        esdf.update(occupied, freed);
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        esdf_time += ms;
+        esdf_max_time = std::max(esdf_max_time, ms);
+        if (i == num_scans / 2 - 1) {
+            occupied_with_person = count_person();
+        }
+    }
+
+    const double rays_per_second = 1000.0 * num_scans * scan_points / total_time;
+    std::cout << "scans: " << num_scans << ", points/scan: " << scan_points << ", threads: " << threads
+              << ", resolution: " << resolution << "m" << std::endl;
+    std::cout << "integrate_scan: " << total_time / num_scans << " ms/scan (max " << max_time << " ms), "
+              << rays_per_second / 1e6 << " M rays/s, " << rays_per_second / 1e5 << "x Mid-70 rate" << std::endl;
+    std::cout << "blocks: " << grid.num_blocks() << ", memory: " << grid.memory_bytes() / 1024 << " KB" << std::endl;
+    std::cout << "esdf update: " << esdf_time / num_scans << " ms/scan (max " << esdf_max_time << " ms), blocks: "
+              << esdf.num_blocks() << ", memory: " << esdf.memory_bytes() / 1024 << " KB, pending: "
+              << esdf.pending_updates() << std::endl;
+    std::cout << "occupied person voxels: " << occupied_with_person << " -> " << count_person()
+              << " after the person left" << std::endl;
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <iostream>
+
+#include "common_lib.h"
+#include "plane_map.h"
+
+/* 平面提取的压缩率和耗时测试。
+plane_map_bench [num_scans] [points_per_scan] [voxel_size]
+默认 200 帧，每帧 5000 点（降采样后），模拟 2m 宽、2.5m 高、30m 长的走廊：地面、两侧墙面、天花板，
+外加每隔 5m 一个 0.5m 的箱子作为非平面区域。输出 patch 数、落在 patch 上的点的比例、
+地图内存（点云按 PointType 存储）与 PlaneMap 内存的对比，以及每帧更新和匹配的耗时。*/
+
+static void simulate_scan(const int num_points, const int seed, PointVector &points) {
+
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    points.clear();
+    // LiDAR 沿 x 轴前进，每帧看到前方 10m
+    const float x0 = std::fmod(seed * 0.15f, 20.0f);
+    for (int i = 0; i < num_points; i++) {
+        PointType p;
+        const float x = x0 + u(rng) * 10.0f;
+        switch (rng() % 10) {
+            case 0: case 1: case 2:
+                p.x = x; p.y = u(rng) * 2.0f; p.z = noise(rng); break;
+            case 3: case 4:
+                p.x = x; p.y = noise(rng); p.z = u(rng) * 2.5f; break;
+            case 5: case 6:
+                p.x = x; p.y = 2.0f + noise(rng); p.z = u(rng) * 2.5f; break;
+            case 7: case 8:
+                p.x = x; p.y = u(rng) * 2.0f; p.z = 2.5f + noise(rng); break;
+            default:
+                p.x = std::floor(x / 5.0f) * 5.0f + u(rng) * 0.5f;
+                p.y = 0.5f + u(rng) * 0.5f;
+                p.z = u(rng) * 0.5f;
+        }
+        p.intensity = 0.0f;
+        points.push_back(p);
+    }
+}
+
+int main(int argc, char **argv) {
+
+    const int num_scans = argc > 1 ? std::stoi(argv[1]) : 200;
+    const int num_points = argc > 2 ? std::stoi(argv[2]) : 5000;
+    const float voxel_size = argc > 3 ? std::stof(argv[3]) : 0.5f;
+
+    PlaneMap plane_map;
+    plane_map.set_voxel_size(voxel_size);
+
+    PointVector scan;
+    size_t total_points = 0, stored_points = 0, matched_points = 0;
+    double update_time = 0.0, match_time = 0.0;
+    for (int s = 0; s < num_scans; s++) {
+        simulate_scan(num_points, s, scan);
+        total_points += scan.size();
+
+        // 与 map_incremental 相同：匹配到 patch 的点只累积矩，其他点加入地图
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<int> patch(scan.size());
+        for (size_t i = 0; i < scan.size(); i++) {
+            patch[i] = plane_map.match(scan[i]);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        PointVector residual;
+        for (size_t i = 0; i < scan.size(); i++) {
+            if (patch[i] >= 0) {
+                plane_map.absorb_point(scan[i]);
+                matched_points++;
+            }
+            else {
+                residual.push_back(scan[i]);
+            }
+        }
+        plane_map.add_points(residual);
+        plane_map.update();
+        auto t2 = std::chrono::steady_clock::now();
+        stored_points += residual.size();
+        match_time += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        update_time += std::chrono::duration<double, std::milli>(t2 - t1).count();
+    }
+
+    std::cout << "scans: " << num_scans << ", points per scan: " << num_points << ", voxel size: " << voxel_size << "m\n";
+    std::cout << "patches: " << plane_map.num_patches() << ", planar voxels: " << plane_map.num_planar_voxels() << "\n";
+    std::cout << "points matched to patches: " << 100.0 * matched_points / total_points << "%\n";
+    std::cout << "map points: " << total_points << " -> " << stored_points << " (" <<
+        total_points * sizeof(PointType) / 1024 << "KB -> " << stored_points * sizeof(PointType) / 1024 <<
+        "KB + plane map " << plane_map.memory_bytes() / 1024 << "KB)\n";
+    std::cout << "match: " << match_time / num_scans << "ms/scan, update: " << update_time / num_scans << "ms/scan\n";
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include "common_lib.h"
+#include "tsdf_map.h"
+
+/* TsdfMap 融合和网格提取的耗时测试，以及球面重建精度的检查。
+tsdf_bench [points_per_scan] [voxel_size] [radius]
+默认 LiDAR 在半径 1m 的球形房间内沿 x 轴移动，每帧 10000 点均匀打在球面上（带 5mm 噪声），融合 20 帧后提取网格，
+检查每个网格顶点到球面的距离（|‖v‖ - radius|）：平均误差不超过 0.1 个体素、最大误差不超过 1 个体素，超出时返回 1。
+同时检查三角形的朝向：表面前方（LiDAR 一侧，球心方向）为正面。*/
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed_ms(const Clock::time_point &t0) {
+
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// 从 origin 出发的均匀方向的射线打在球心为原点的球面上
+static void simulate_scan(const int num_points, const float radius, const V3F &origin, std::mt19937 &rng,
+    PointVector &points) {
+
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    std::normal_distribution<float> noise(0.0f, 0.005f);
+    points.clear();
+    for (int i = 0; i < num_points; i++) {
+        V3F dir(gauss(rng), gauss(rng), gauss(rng));
+        dir.normalize();
+        // |origin + t * dir| = radius 的正根，origin 在球内
+        const float b = origin.dot(dir);
+        const float t = -b + std::sqrt(b * b - origin.squaredNorm() + radius * radius);
+        PointType p;
+        p.getVector3fMap() = origin + dir * (t + noise(rng));
+        points.push_back(p);
+    }
+}
+
+int main(int argc, char **argv) {
+
+    const int scan_points = argc > 1 ? std::stoi(argv[1]) : 10000;
+    const float voxel_size = argc > 2 ? std::stof(argv[2]) : 0.05f;
+    const float radius = argc > 3 ? std::stof(argv[3]) : 1.0f;
+    const int num_scans = 20;
+
+    TsdfMap tsdf;
+    tsdf.set_voxel_size(voxel_size);
+    tsdf.set_truncation(4.0f * voxel_size);
+    tsdf.set_max_range(2.0f * radius + 1.0f);
+
+    std::mt19937 rng(0);
+    PointVector points;
+    double integrate_time = 0.0, max_time = 0.0;
+    for (int i = 0; i < num_scans; i++) {
+        const V3F origin(0.2f * radius * (static_cast<float>(i) / num_scans - 0.5f), 0.0f, 0.0f);
+        simulate_scan(scan_points, radius, origin, rng, points);
+        Clock::time_point t0 = Clock::now();
+        tsdf.integrate(points, origin.cast<double>());
+        const double ms = elapsed_ms(t0);
+        integrate_time += ms;
+        max_time = std::max(max_time, ms);
+    }
+
+    std::vector<VoxelKey> changed;
+    Clock::time_point t0 = Clock::now();
+    tsdf.update_mesh(changed);
+    const double mesh_time = elapsed_ms(t0);
+
+    size_t num_vertices = 0, num_triangles = 0, flipped = 0;
+    double max_error = 0.0, sum_error = 0.0;
+    for (const auto &block : tsdf.get_mesh()) {
+        const TsdfMap::BlockMesh &mesh = block.second;
+        for (const V3F &v : mesh.vertices) {
+            const double error = std::fabs(v.cast<double>().norm() - radius);
+            max_error = std::max(max_error, error);
+            sum_error += error;
+        }
+        num_vertices += mesh.vertices.size();
+        for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3) {
+            const V3F &a = mesh.vertices[mesh.triangles[i]];
+            const V3F &b = mesh.vertices[mesh.triangles[i + 1]];
+            const V3F &c = mesh.vertices[mesh.triangles[i + 2]];
+            // 正面朝向球心
+            flipped += (b - a).cross(c - a).dot(a) > 0.0f;
+        }
+        num_triangles += mesh.triangles.size() / 3;
+    }
+    const double mean_error = num_vertices > 0 ? sum_error / num_vertices : 0.0;
+
+    std::cout << "scans: " << num_scans << ", points/scan: " << scan_points << ", voxel size: " << voxel_size
+              << "m, radius: " << radius << "m" << std::endl;
+    std::cout << "integrate: " << integrate_time / num_scans << " ms/scan (max " << max_time << " ms), blocks: "
+              << tsdf.num_blocks() << ", memory: " << tsdf.memory_bytes() / 1024 << " KB" << std::endl;
+    std::cout << "update_mesh: " << mesh_time << " ms, changed blocks: " << changed.size() << ", vertices: "
+              << num_vertices << ", triangles: " << num_triangles << std::endl;
+    std::cout << "vertex error: mean " << mean_error << "m, max " << max_error << "m, flipped triangles: "
+              << flipped << std::endl;
+    if (num_triangles == 0) {
+        std::cout << "FAIL: empty mesh" << std::endl;
+        return 1;
+    }
+    if (mean_error > 0.1 * voxel_size || max_error > voxel_size) {
+        std::cout << "FAIL: surface error exceeds the bound" << std::endl;
+        return 1;
+    }
+    if (flipped > 0) {
+        std::cout << "FAIL: triangles facing away from the sensor" << std::endl;
+        return 1;
+    }
+    std::cout << "ok" << std::endl;
+    return 0;
+}
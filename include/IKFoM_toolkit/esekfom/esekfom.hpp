@@ -81,6 +81,9 @@ struct dyn_share_datastruct
 {
 	bool valid;
 	bool converge;
+	int iter_num;  // 当前迭代次数，由 update 填入
+	bool coarse;   // 观测模型是否使用了低分辨率数据，由观测模型填入
+	int num_rows;  // h_x 和 h 中有效的行数，由观测模型填入；小于 0 时使用全部行。矩阵可以按最大行数分配，迭代之间复用
 	Eigen::Matrix<T, Eigen::Dynamic, 1> z;
 	Eigen::Matrix<T, Eigen::Dynamic, 1> h;
 	Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> h_v;
@@ -162,7 +165,8 @@ public:
 
 		Matrix<scalar_type, m, process_noise_dof> f_w_ = f_w(x_, i_in);  // 24x12
 		Matrix<scalar_type, n, process_noise_dof> f_w_final;             // 23x12
-		state x_before = x_;
+		state &x_before = x_before_;  // 复用成员，避免每次复制状态时分配内存
+		x_before = x_;
 		x_.oplus(f_, dt);
 
         // 用 f_x_ 和 f_w_ 给 f_x_final 和 f_w_final 赋值，先赋 vect 部分。
@@ -275,11 +279,13 @@ public:
 	点云的协方差，函数耗时。*/
 	void update_iterated_dyn_share_modified(const double& R) {
 		  
-		dyn_share_datastruct<scalar_type> dyn_share;
+		// 观测模型的输出和传播后的状态都复用成员，稳态下不分配内存
+		dyn_share_datastruct<scalar_type> &dyn_share = dyn_share_;
 		dyn_share.valid = true;
 		dyn_share.converge = true;
 		// 获取最后一次的状态和协方差矩阵
-		state x_propagated = x_;        // hat(x_k)
+		state &x_propagated = x_propagated_;
+		x_propagated = x_;              // hat(x_k)
 		cov P_propagated = P_;          // hat(P_k)
 		Matrix<scalar_type, n, 1> K_h;  // 23x1
 		Matrix<scalar_type, n, n> K_x;  // 23x23
@@ -289,6 +295,10 @@ public:
 		// 最多进行 maximum_iter 次迭代优化
 		for(int i = 0; i < maximum_iter; i ++) {
 			dyn_share.valid = true;
+			dyn_share.iter_num = i;
+			dyn_share.coarse = false;
+			dyn_share.num_rows = -1;
+			last_iter = i + 1;
 			// 计算观测模型的 h 和 h_x
 			h_dyn_share(x_, dyn_share);
 
@@ -296,10 +306,10 @@ public:
 				continue; 
 			}
 
-			// 获取观测模型的 h_x
-			Eigen::Matrix<scalar_type, Eigen::Dynamic, 12> h_x_ = dyn_share.h_x;
-
-			dof_Measurement = h_x_.rows();  // 观测方程个数
+			// 观测方程个数，h_x 和 h 只取有效的行，不复制
+			dof_Measurement = dyn_share.num_rows >= 0 ? dyn_share.num_rows : dyn_share.h_x.rows();
+			const auto h_x_ = dyn_share.h_x.template block<Eigen::Dynamic, 12>(0, 0, dof_Measurement, 12);
+			const auto h_ = dyn_share.h.head(dof_Measurement);
 			vectorized_state dx;            // 误差状态 23x1
 			x_.boxminus(dx, x_propagated);  // dx = hat(x_k^k) - hat(x_k)
 			dx_new = dx;                    // 
@@ -359,16 +369,17 @@ public:
 				h_x_cur.topLeftCorner(dof_Measurement, 12) = h_x_;  // h_x_cur = H
 				Matrix<scalar_type, Eigen::Dynamic, Eigen::Dynamic> K_ = P_ * h_x_cur.transpose() * (h_x_cur * P_ * h_x_cur.transpose()/R + 
 					Eigen::Matrix<double, Dynamic, Dynamic>::Identity(dof_Measurement, dof_Measurement)).inverse()/R;
-				K_h = K_ * dyn_share.h;  // K * -z
+				K_h = K_ * h_;           // K * -z
 				K_x = K_ * h_x_cur;      // K * H
 			}
 			else {
 				/* 下列计算等价于：K = (H^T * R^-1 * H + P^-1)^-1 * H^T * R^-1。*/
 				cov P_temp = (P_/R).inverse();
 				Eigen::Matrix<scalar_type, 12, 12> HTH = h_x_.transpose() * h_x_;
+				Eigen::Matrix<scalar_type, 12, 1> HTz = h_x_.transpose() * h_;  // 先乘 h，中间结果为固定大小
 				P_temp. template block<12, 12>(0, 0) += HTH;
 				cov P_inv = P_temp.inverse();
-				K_h = P_inv. template block<n, 12>(0, 0) * h_x_.transpose() * dyn_share.h;    // K_h = K * -z
+				K_h = P_inv. template block<n, 12>(0, 0) * HTz;                  // K_h = K * -z
 				K_x.setZero();
 				K_x. template block<n, 12>(0, 0) = P_inv. template block<n, 12>(0, 0) * HTH;  // K_x = K * H
 			}
@@ -385,6 +396,10 @@ public:
 					break;
 				}
 			}
+			// 低分辨率迭代不算收敛，至少再做一次全分辨率迭代
+			if(dyn_share.coarse) {
+				dyn_share.converge = false;
+			}
 
             /* 迭代完成后，更新协方差矩阵：bar(P_k) = (I - KH)P。*/
 			if(dyn_share.converge || i == (maximum_iter - 1)) {
@@ -460,6 +475,10 @@ public:
 	const cov& get_P() const {
 		return P_;
 	}
+	// 上一次 update 的迭代次数
+	int get_last_iter() const {
+		return last_iter;
+	}
 private:
 	state x_;
 	measurement m_;
@@ -470,6 +489,9 @@ private:
 	cov F_x1 = cov::Identity();
 	cov F_x2 = cov::Identity();
 	cov L_ = cov::Identity();
+	state x_before_;
+	state x_propagated_;
+	dyn_share_datastruct<scalar_type> dyn_share_;
 
 	processModel *f;
 	processMatrix1 *f_x;
@@ -487,6 +509,7 @@ private:
 	measurementModel_dyn_share *h_dyn_share;
 
 	int maximum_iter = 0;
+	int last_iter = 0;
 	scalar_type limit[n];
 	
 	template <typename T>
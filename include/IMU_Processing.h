@@ -11,6 +11,7 @@
 
 #include "common_lib.h"
 #include "use-ikfom.h"
+#include "async_logger.h"
 
 #define IMU_MAX_INI_COUNT (10)
 
@@ -53,12 +54,17 @@ private:
     V3D cov_gyr;                      // （set），协方差
     Eigen::Matrix<double, 12, 12> Q;  // 噪声 w 的协方差矩阵
 
-    sensor_msgs::ImuConstPtr last_imu_;  // 上一包末尾的 IMU
+    ImuSample last_imu_;                 // 上一包末尾的 IMU
     V3D acc_s_last;                      // 上一帧加速度
     V3D angvel_last;                     // 上一帧角速度
     double last_lidar_end_time_;         // 上一包雷达结束时间戳
 
     M3D R_W_G;  // 计算 G^R_W，用于储存地图时，地图能够平行于 ground
+
+    // UndistortPcl 中每帧复用的缓冲区，容量保留，稳态下不分配内存
+    std::vector<ImuSample> v_imu;                   // 上一包末尾的 IMU 和当前帧的 IMU
+    std::vector<Pose6D> IMUpose;                    // 每个 IMU 时刻的位姿
+    state_ikfom imu_state;
 };
 
 
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* 进程内的内存分配统计，给回放和回归测试使用。
+编译时定义 ALLOC_STATS（CMake 选项 ALLOC_STATS）并且使用 glibc 时，替换 malloc 系列函数，
+对分配次数和字节数做 relaxed 原子累加（operator new、Eigen 和 PCL 的分配都经过 malloc），否则计数恒为 0。*/
+
+struct AllocCounts {
+    uint64_t count;
+    uint64_t bytes;
+};
+
+// 是否在统计分配
+bool alloc_stats_enabled();
+// 进程启动以来的累计分配（所有线程）
+AllocCounts alloc_counts();
+// 调用线程的累计分配次数，用于统计一段代码中的分配，不受其他线程影响
+uint64_t thread_alloc_count();
+// 进程的峰值常驻内存（KB）
+size_t peak_rss_kb();
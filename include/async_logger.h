@@ -0,0 +1,152 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <condition_variable>
+
+/* 热路径中使用的异步日志。
+1. 调用处只记录二进制事件：时间戳、调用点（格式串和级别）、最多 4 个数值参数，写入本线程的环形队列，
+   单生产者单消费者，无锁，不分配内存；队列满时丢弃并计数，不阻塞；
+2. 后台线程定期取出所有线程的事件，按时间排序后格式化，交给 neal::logger 写文件；
+3. 每个调用点限流：每个周期最多 burst 条，多出的只计数，下一条输出时附带被抑制的条数；
+4. 后台线程启动之前（以及停止之后）直接同步格式化输出，工具和基准测试中也能看到日志。
+格式串中的 {} 依次替换为参数，整数按十进制，浮点数与 std::to_string 相同（%f）。
+只能传数值，字符串需要在调用处拼好后用 neal::logger。*/
+
+#define LOG_MAX_ARGS   (4)
+#define LOG_RING_BITS  (10)                // 每个线程 1024 个事件，64KB
+#define LOG_RING_SIZE  (1 << LOG_RING_BITS)
+
+// 调用点，ASYNC_LOG 中定义为静态变量，同时保存限流状态
+struct LogSite {
+    LogSite(const char *f, const int l) : fmt(f), level(l), window_start(0), window_count(0), suppressed(0) {};
+
+    const char *fmt;
+    const int level;
+    std::atomic<uint64_t> window_start;
+    std::atomic<uint32_t> window_count;
+    std::atomic<uint32_t> suppressed;
+};
+
+struct LogEvent {
+    uint64_t time_ns;
+    const LogSite *site;
+    uint32_t suppressed;     // 上一条输出之后被限流抑制的条数
+    uint8_t num_args;
+    char types[LOG_MAX_ARGS]; // 'i' 有符号，'u' 无符号，'d' 浮点
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    } args[LOG_MAX_ARGS];
+};
+
+// 单生产者（所属线程）单消费者（后台线程）的环形队列
+struct LogRing {
+    LogRing() : head(0), tail(0), dropped(0), retired(false) {};
+
+    LogEvent events[LOG_RING_SIZE];
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> retired;  // 线程已退出，取完后释放
+};
+
+class AsyncLogger {
+public:
+    AsyncLogger();
+    ~AsyncLogger() {stop();};
+
+    // 每个调用点每 period 秒最多输出 burst 条
+    void set_rate_limit(const int burst, const double period) {
+        rate_burst = burst;
+        rate_period_ns = static_cast<uint64_t>(period * 1e9);
+    };
+    void set_flush_period(const int ms) {flush_period_ms = ms;};
+
+    void start();
+    // 取完所有事件后停止，之后的日志同步输出。与 stop 同时写入的事件也会输出，不会丢失
+    void stop();
+    bool is_running() const {return running.load(std::memory_order_acquire);};
+
+    template <typename... Args>
+    void log(LogSite &site, const Args &... args) {
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many arguments for ASYNC_LOG");
+        LogEvent ev;
+        ev.time_ns = now_ns();
+        if (!admit(site, ev.time_ns, ev.suppressed)) {
+            return;
+        }
+        ev.site = &site;
+        ev.num_args = sizeof...(Args);
+        set_args(ev, 0, args...);
+        push(ev);
+    };
+
+    uint64_t events_dropped() const {return num_dropped.load(std::memory_order_relaxed);};
+    uint64_t events_suppressed() const {return num_suppressed.load(std::memory_order_relaxed);};
+
+    static uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    };
+    static std::string format(const LogEvent &ev);
+
+private:
+    bool admit(LogSite &site, const uint64_t now, uint32_t &suppressed);
+    void push(const LogEvent &ev);
+    LogRing *local_ring();
+    void run();
+    void drain(std::vector<LogEvent> &events);
+    void output(const LogEvent &ev);
+
+    static void set_args(LogEvent &, const int) {};
+    template <typename T, typename... Rest>
+    static void set_args(LogEvent &ev, const int i, const T &v, const Rest &... rest) {
+        static_assert(std::is_arithmetic<T>::value, "ASYNC_LOG only takes numeric arguments");
+        if (std::is_floating_point<T>::value) {
+            ev.types[i] = 'd';
+            ev.args[i].d = static_cast<double>(v);
+        }
+        else if (std::is_signed<T>::value) {
+            ev.types[i] = 'i';
+            ev.args[i].i = static_cast<int64_t>(v);
+        }
+        else {
+            ev.types[i] = 'u';
+            ev.args[i].u = static_cast<uint64_t>(v);
+        }
+        set_args(ev, i + 1, rest...);
+    };
+
+    int rate_burst;
+    uint64_t rate_period_ns;
+    int flush_period_ms;
+
+    std::mutex mtx_rings;
+    std::vector<std::shared_ptr<LogRing>> rings;
+
+    std::atomic<bool> running;
+    std::atomic<int> pushing;  // 已经看到 running 为 true、还没有写完队列的 push 数
+    std::mutex mtx_wait;
+    std::condition_variable cv_stop;
+    std::thread worker;
+
+    std::atomic<uint64_t> num_dropped;
+    std::atomic<uint64_t> num_suppressed;
+    uint64_t dropped_reported;
+};
+
+extern AsyncLogger async_logger;
+
+#define ASYNC_LOG(level, fmt, ...) do { \
+    static LogSite async_log_site(fmt, level); \
+    async_logger.log(async_log_site, ##__VA_ARGS__); \
+} while (0)
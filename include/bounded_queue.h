@@ -0,0 +1,106 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+/* 线程间传递数据的有界队列，多生产者多消费者。
+队列满时 try_push 直接返回 false，生产者（主循环）不会被阻塞；离线回放时用 push 等待空位，不丢数据。
+close 之后不再接收数据，消费者取完剩余数据后 pop 返回 false。*/
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(const size_t cap = 100) : capacity(cap), closed(false) {};
+
+    void set_capacity(const size_t cap) {
+
+        std::lock_guard<std::mutex> lock(mtx);
+        capacity = cap;
+    }
+
+    bool try_push(T item) {
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (closed || items.size() >= capacity) {
+                return false;
+            }
+            items.push_back(std::move(item));
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    // 队列满时等待，队列已关闭时返回 false
+    bool push(T item) {
+
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv_space.wait(lock, [this] {return closed || items.size() < capacity;});
+            if (closed) {
+                return false;
+            }
+            items.push_back(std::move(item));
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    // 最多等待 timeout，超时或者队列已关闭且为空时返回 false
+    template <typename Rep, typename Period>
+    bool pop(T &item, const std::chrono::duration<Rep, Period> &timeout) {
+
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            if (!cv.wait_for(lock, timeout, [this] {return closed || !items.empty();})) {
+                return false;
+            }
+            if (items.empty()) {
+                return false;
+            }
+            item = std::move(items.front());
+            items.pop_front();
+        }
+        cv_space.notify_one();
+        return true;
+    }
+
+    // 清空并重新接收数据
+    void reopen() {
+
+        std::lock_guard<std::mutex> lock(mtx);
+        items.clear();
+        closed = false;
+    }
+
+    void close() {
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+        cv_space.notify_all();
+    }
+
+    bool is_closed() const {
+
+        std::lock_guard<std::mutex> lock(mtx);
+        return closed;
+    }
+
+    size_t size() const {
+
+        std::lock_guard<std::mutex> lock(mtx);
+        return items.size();
+    }
+
+private:
+    mutable std::mutex mtx;
+    std::condition_variable cv;        // 有数据或已关闭
+    std::condition_variable cv_space;  // 有空位或已关闭
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+};
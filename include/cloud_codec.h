@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/* 点云压缩编解码，用于带宽受限的远程监控，不依赖 ROS 和 PCL。
+1. 坐标相对扫描位姿（LiDAR 系）按 resolution 量化成整数，反射率截断成一个字节；
+2. 相邻点坐标做差分，zigzag 后按变长整数（varint）存储，同一帧内相邻点距离很近，大部分差分只占 1~2 字节；
+3. 坐标流和反射率流拼接后再用 zlib（deflate）做熵编码。
+数据格式：uint8 版本号 | uint32 原始长度（小端）| zlib 数据*/
+
+#define CLOUD_CODEC_VERSION (1)
+
+struct CodecPoint {
+
+    float x, y, z;
+    uint8_t intensity;
+};
+
+class CloudEncoder {
+public:
+    explicit CloudEncoder(const float resolution = 0.01f);
+
+    void set_resolution(const float resolution) {res = resolution; inv_res = 1.0f / resolution;};
+    float get_resolution() const {return res;};
+
+    // 开始新的一帧
+    void reset();
+    void add_point(const float x, const float y, const float z, const float intensity) {
+
+        int32_t q[3] = {static_cast<int32_t>(std::lround(x * inv_res)),
+                        static_cast<int32_t>(std::lround(y * inv_res)),
+                        static_cast<int32_t>(std::lround(z * inv_res))};
+        for (int j = 0; j < 3; j++) {
+            put_varint(zigzag(q[j] - last[j]));
+            last[j] = q[j];
+        }
+        intensities.push_back(static_cast<uint8_t>(intensity < 0.0f ? 0.0f : (intensity > 255.0f ? 255.0f : intensity)));
+    }
+    uint32_t size() const {return intensities.size();};
+
+    // 压缩成最终数据，level 为 zlib 压缩等级（1 最快，9 最小）
+    bool finish(std::vector<uint8_t> &out, const int level = 1);
+
+private:
+    static uint32_t zigzag(const int32_t v) {return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);};
+    void put_varint(uint32_t v) {
+
+        while (v >= 0x80) {
+            coords.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        coords.push_back(static_cast<uint8_t>(v));
+    }
+
+    float res;
+    float inv_res;
+    int32_t last[3];
+    std::vector<uint8_t> coords;
+    std::vector<uint8_t> intensities;
+};
+
+// 解码 num_points 个点（LiDAR 系），数据损坏或原始长度与点数不符时返回 false（在分配内存之前检查）
+bool decode_cloud(const uint8_t *data, const size_t size, const uint32_t num_points, const float resolution,
+    std::vector<CodecPoint> &out);
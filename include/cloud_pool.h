@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include "common_lib.h"
+
+/* 每帧点云的对象池，点云的容量在帧之间保留，稳态下不再向系统申请内存。
+点云交给其他线程（数据队列、发布、保存、飞行记录仪）之后，在所有使用者释放之前（引用计数不为 1）不会再被取出，
+因此交出去的点云仍然不能再修改。池满（max_size）时新建的点云不放回池中，使用者释放后直接回收。
+只能在一个线程中调用 acquire。*/
+class CloudPool {
+public:
+    explicit CloudPool(const size_t max_size = 64) : max_size(max_size), next(0) {};
+
+    void set_max_size(const size_t size) {max_size = size;};
+
+    // 取一个空的点云；keep_points 为 true 时保留上次的点数，调用者覆盖所有点的全部字段，
+    // 点数不变时 resize 不再逐个重新构造点
+    PointCloudXYZI::Ptr acquire(const bool keep_points = false);
+
+    size_t size() const {return clouds.size();};
+    size_t memory_bytes() const;
+
+private:
+    size_t max_size;
+    size_t next;  // 下一次查找的起点，轮流使用
+    std::vector<PointCloudXYZI::Ptr> clouds;
+};
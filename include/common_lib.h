@@ -36,6 +36,15 @@ typedef Eigen::Matrix3f M3F;
 // 打个括号就报错了。
 #define SKEW_SYM_MATRX(v) 0.0,-v[2],v[1],v[2],0.0,-v[0],-v[1],v[0],0.0
 
+// IMU 测量，只保留 IMU 处理用到的字段。ROS 回调和 .lsr 回放都转换成这个结构，按值放在队列中，
+// 不像 sensor_msgs::Imu 那样每个样本分配一次（消息还带有姿态和三个协方差矩阵）
+struct ImuSample {
+
+    double time;
+    V3D acc;  // 与 IMU 消息相同的单位
+    V3D gyr;
+};
+
 // Lidar data and imu dates for the curent process
 struct MeasureGroup {
 
@@ -46,9 +55,34 @@ struct MeasureGroup {
     double lidar_beg_time;
     double lidar_end_time;
     PointCloudXYZI::Ptr lidar;
-    std::deque<sensor_msgs::Imu::ConstPtr> imu;
+    std::deque<ImuSample> imu;
+};
+
+// 体素（或 tile）的整数索引，用作哈希表的键
+struct VoxelKey {
+
+    int32_t x, y, z;
+    bool operator==(const VoxelKey &other) const {return x == other.x && y == other.y && z == other.z;};
 };
 
+struct VoxelKeyHash {
+
+    size_t operator()(const VoxelKey &k) const {
+        return (static_cast<size_t>(k.x) * 73856093) ^ (static_cast<size_t>(k.y) * 19349663) ^
+            (static_cast<size_t>(k.z) * 83492791);
+    }
+};
+
+// 边长为 1/inv_size 的体素中，坐标 (x, y, z) 所在体素的索引
+inline VoxelKey voxel_key(const float x, const float y, const float z, const float inv_size) {
+
+    VoxelKey k;
+    k.x = static_cast<int32_t>(std::floor(x * inv_size));
+    k.y = static_cast<int32_t>(std::floor(y * inv_size));
+    k.z = static_cast<int32_t>(std::floor(z * inv_size));
+    return k;
+}
+
 
 Pose6D set_pose6d(const double t, const Eigen::Matrix<double, 3, 1> &a, const Eigen::Matrix<double, 3, 1> &g,
     const Eigen::Matrix<double, 3, 1> &v, const Eigen::Matrix<double, 3, 1> &p, const Eigen::Matrix<double, 3, 3> &R);
@@ -57,6 +91,9 @@ Eigen::Matrix<double, 3, 3> Exp(const Eigen::Matrix<double, 3, 1> &ang_vel, cons
 
 bool esti_plane(Eigen::Matrix<float, 4, 1> &pca_result, const PointVector &point, const float &threshold);
 
+// 点按 Morton（Z-order）曲线排序后的下标，cell_size 为量化尺寸，相邻下标的点在空间上也相邻
+void morton_order(const PointVector &points, const float cell_size, std::vector<int> &order);
+
 float calc_dist(PointType p1, PointType p2);
 
 
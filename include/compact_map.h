@@ -0,0 +1,156 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "common_lib.h"
+
+/* 量化存储的地图，ikd-Tree 的省内存替代。
+地图按边长 tile_size 的 tile 做哈希，tile 内的点只存相对 tile 原点的 16 位定点偏移和 8 位反射率，
+每个点 8 字节（PointXYZINormal 为 48 字节）。kNN 搜索时在线解码，
+量化误差每个轴不超过 tile_size / 65535 / 2。
+
+地图带版本号，读写分离：
+1. 写线程（主循环）调用 add_points 修改待发布版本，publish 后生效，已发布的版本不再修改；
+2. 其他线程调用 snapshot 拿到当前版本的只读快照，之后的查询和导出不加锁，不会阻塞主循环。
+   交接本身不是无锁的：shared_ptr 的 atomic_load/atomic_store 在 libstdc++ 中用内部的互斥锁池实现，
+   临界区只有一次指针复制和引用计数的修改，主循环 publish 时最多等待这样一次复制；
+3. 修改时写时复制，tile 按 8x8x8 分块，块再按 8x8x8 分成区（tile_size 为 0.5m 时一个区 32m），
+   三层都是按局部索引排序的数组，一次只复制被修改的区、块和 tile，未修改的部分在版本之间共享。
+   每个版本只复制顶层的区表（每个区一个指针，室外 1km x 1km 的地图约 1000 个），
+   每帧的复制量取决于这一帧修改的区数，与地图中的点数和块数无关。*/
+
+// tile 内的量化点
+struct QuantizedPoint {
+
+    uint16_t x, y, z;
+    uint8_t intensity;
+    uint8_t reserved;
+};
+
+class CompactMap {
+private:
+    struct Tile {
+        std::vector<QuantizedPoint> points;
+    };
+    // 8x8x8 个 tile 组成一块，块内按局部索引排序
+    struct TileEntry {
+        uint16_t local;
+        std::shared_ptr<const Tile> tile;
+    };
+    struct Block {
+        std::vector<TileEntry> tiles;
+    };
+    // 8x8x8 个块组成一个区，区内按局部索引排序
+    struct BlockEntry {
+        uint16_t local;
+        std::shared_ptr<const Block> block;
+    };
+    struct Chunk {
+        std::vector<BlockEntry> blocks;
+    };
+    // 顶层的区表，按区索引排序
+    struct ChunkEntry {
+        VoxelKey key;
+        std::shared_ptr<const Chunk> chunk;
+    };
+    typedef std::vector<ChunkEntry> ChunkTable;
+
+public:
+    // 地图某个版本的只读快照，持有期间内容不变，可以在任意线程使用
+    class Snapshot {
+    public:
+        uint64_t version() const {return version_;};
+        size_t size() const {return num_points;};
+        float get_tile_size() const {return tile_size;};
+        size_t memory_bytes() const;
+
+        // 在平方距离 max_dist2 内搜索最近的 k 个点，按距离升序输出
+        void nearest_search(const PointType &point, const int k, PointVector &nearest, std::vector<float> &dist2,
+            const float max_dist2) const;
+        /* 批量搜索，nearest[i]、dist2[i] 对应 points[i]，nearest 和 dist2 只增不减（可能比 points 长），内层容量在调用之间保留。
+        查询按 Morton 序执行，相邻的查询访问相同的 tile，tile 查找结果在查询之间复用。*/
+        void nearest_search_batch(const PointVector &points, const int k, std::vector<PointVector> &nearest,
+            std::vector<std::vector<float>> &dist2, const float max_dist2) const;
+        // 解码所有点
+        void get_points(PointVector &out) const;
+
+    private:
+        friend class CompactMap;
+
+        // 最近访问过的 tile（包括不存在的），按索引哈希直接映射
+        struct TileCache {
+            static const int SIZE = 512;
+            VoxelKey keys[SIZE];
+            const Tile *tiles[SIZE];
+            bool valid[SIZE];
+        };
+
+        const Tile *find_tile(const VoxelKey &key) const;
+        const Tile *find_tile(const VoxelKey &key, TileCache &cache) const;
+        void search(const PointType &point, const int k, PointVector &nearest, std::vector<float> &dist2,
+            const float max_dist2, TileCache *cache) const;
+        void decode(const QuantizedPoint &q, const VoxelKey &key, PointType &p) const;
+
+        ChunkTable chunks;
+        uint64_t version_;
+        size_t num_points;
+        size_t num_tiles;
+        float tile_size;
+        float step;  // 量化步长
+    };
+    typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+
+    CompactMap();
+    ~CompactMap() {};
+
+    // 只能在建图前设置
+    void set_tile_size(const float ts);
+    void set_downsample_param(const float ds) {downsample_size = ds;};
+
+    float get_tile_size() const {return tile_size;};
+    // 单点最大量化误差（欧氏距离），坐标绝对值不超过 tile_size * 128 时成立，更远处 float 的精度低于量化步长
+    // bench/compact_map_bench 与暴力搜索对比检查
+    float quantization_error_bound() const {return 0.5f * step * std::sqrt(3.0f);};
+    size_t size() const {return current->num_points;};
+    size_t num_tiles() const {return current->num_tiles;};
+    size_t memory_bytes() const {return current->memory_bytes();};
+    bool empty() const {return current->num_points == 0;};
+    uint64_t version() const {return current->version_;};
+
+    /* 以下函数只能在写线程调用。*/
+    void clear();
+    void build(const PointVector &points);
+    // downsample 为 true 时，每个 downsample_size 体素只保留离体素中心最近的点（与 ikd-Tree 一致）
+    void add_points(const PointVector &points, const bool downsample);
+    // 发布 add_points 的修改，生成新版本
+    void publish();
+    // 在当前版本上搜索
+    void nearest_search(const PointType &point, const int k, PointVector &nearest, std::vector<float> &dist2,
+        const float max_dist2) const {
+        current->nearest_search(point, k, nearest, dist2, max_dist2);
+    };
+    void nearest_search_batch(const PointVector &points, const int k, std::vector<PointVector> &nearest,
+        std::vector<std::vector<float>> &dist2, const float max_dist2) const {
+        current->nearest_search_batch(points, k, nearest, dist2, max_dist2);
+    };
+
+    /* 任意线程可调用。atomic_load 会短暂持有 libstdc++ 锁池中的互斥锁（只复制 shared_ptr），
+    拿到的快照不再修改，查询时不加锁。*/
+    SnapshotPtr snapshot() const {return std::atomic_load(&published);};
+
+private:
+    QuantizedPoint encode(const PointType &p, const VoxelKey &key) const;
+    std::vector<QuantizedPoint> &writable_tile(const VoxelKey &key);
+    void add_point(const PointType &p, const bool downsample);
+
+    float tile_size;
+    float inv_tile_size;
+    float step;
+    float inv_step;
+    float downsample_size;
+
+    SnapshotPtr current;                // 写线程使用的最新版本
+    SnapshotPtr published;              // 其他线程通过 atomic_load 读取
+    std::shared_ptr<Snapshot> pending;  // 正在修改、尚未发布的版本
+};
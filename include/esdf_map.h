@@ -0,0 +1,142 @@
+#pragma once
+
+#include <queue>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include "common_lib.h"
+
+#define ESDF_BLOCK_BITS    (3)      // 一块 8x8x8 个体素
+#define ESDF_BLOCK_SIZE    (1 << ESDF_BLOCK_BITS)
+#define ESDF_BLOCK_VOXELS  (ESDF_BLOCK_SIZE * ESDF_BLOCK_SIZE * ESDF_BLOCK_SIZE)
+#define ESDF_FAR           (0xffff) // 没有 max_distance 内的障碍物
+#define ESDF_MAX_VOXELS    (120)    // 障碍物相对坐标用 int8 存储，最大距离不超过 120 个体素
+
+/* 增量欧氏距离场（ESDF），体素与 OccupancyGrid 相同，在 ground 系下。
+1. 每个体素记录最近障碍物体素的相对坐标和平方距离（体素单位），只在 max_distance 内有值；
+2. 输入为占据栅格变化的体素，按 Lau 等人的动态距离变换增量更新：
+   新增的障碍物发出 lower 波；删除的障碍物发出 raise 波，清除以它为最近障碍物的体素，再由 raise 波的边界重新 lower。
+   波前按平方距离用优先队列传播，只访问受影响的体素，传播的是障碍物坐标，距离为精确的欧氏距离；
+3. 每次 update 最多处理 max_updates 个体素，剩余的留到下次，单帧更新时间有上界；
+4. 与 CompactMap 相同的版本化快照：块再按 8x8x8 分区，区和块写时复制，每个版本只复制顶层的区表和修改过的区，
+   波前处理完就发布，其他线程拿快照查询距离和梯度，查询不加锁
+   （取快照和发布时 shared_ptr 的 atomic_load/atomic_store 会短暂持有 libstdc++ 锁池中的互斥锁，只复制一个指针）；
+   地图持续变化时波前可能一直处理不完，因此距离上次发布超过 publish_updates 次 update 或 publish_period 秒时，
+   波前没有处理完也发布（is_complete() 为 false）：删除的障碍物附近还在 raise 波中的体素暂时没有距离，
+   新增的障碍物只传播到了波前处，查询结果可能偏大，下一个版本继续更新。*/
+class EsdfMap {
+public:
+    struct Voxel {
+        uint16_t dist2;    // 到最近障碍物的平方距离（体素单位），ESDF_FAR 表示没有
+        int8_t offset[3];  // 最近障碍物体素减去本体素
+        uint8_t raise;     // 在 raise 波中，等待重新计算
+    };
+    struct Block {
+        Voxel voxels[ESDF_BLOCK_VOXELS];
+    };
+    // 8x8x8 个块组成一个区，区内按局部索引排序
+    struct BlockEntry {
+        uint16_t local;
+        std::shared_ptr<const Block> block;
+    };
+    struct Chunk {
+        std::vector<BlockEntry> blocks;
+    };
+    // 顶层的区表，按区索引排序
+    struct ChunkEntry {
+        VoxelKey key;
+        std::shared_ptr<const Chunk> chunk;
+    };
+    typedef std::vector<ChunkEntry> ChunkTable;
+
+    // 距离场某个版本的只读快照，持有期间内容不变，可以在任意线程使用
+    class Snapshot {
+    public:
+        uint64_t version() const {return version_;};
+        // 波前已经处理完，距离是精确的
+        bool is_complete() const {return complete;};
+        float get_resolution() const {return resolution;};
+        float get_max_distance() const {return max_distance;};
+        size_t num_blocks() const {return num_blocks_;};
+
+        // 体素中心到最近障碍物的距离（m），没有障碍物或未观测时为 max_distance
+        float voxel_distance(const VoxelKey &voxel) const;
+        // 点 p（ground 系）到最近障碍物的距离，由周围 8 个体素三线性插值
+        float distance(const V3D &p) const;
+        // 同时输出距离的梯度，指向远离障碍物的方向
+        float distance(const V3D &p, V3D &gradient) const;
+
+    private:
+        friend class EsdfMap;
+
+        const Voxel *find_voxel(const VoxelKey &voxel) const;
+
+        ChunkTable chunks;
+        size_t num_blocks_;
+        uint64_t version_;
+        bool complete;
+        float resolution;
+        float max_distance;
+    };
+    typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+
+    EsdfMap();
+
+    // 只能在更新之前设置
+    void set_resolution(const float res);
+    void set_max_distance(const float dist);
+    void set_max_updates(const size_t n) {max_updates = n;};
+    // 波前没有处理完时，最多间隔 updates 次 update 或 seconds 秒发布一次，0 表示不限制
+    void set_publish_interval(const size_t updates, const double seconds) {
+        publish_updates = updates;
+        publish_period = seconds;
+    };
+
+    /* 以下函数只能在写线程调用。*/
+    void clear();
+    // 输入变为占据和变为空闲的体素并更新距离场，返回本次处理的体素数
+    size_t update(const std::vector<VoxelKey> &occupied, const std::vector<VoxelKey> &freed);
+    // 还没有处理的波前
+    size_t pending_updates() const {return queue.size();};
+    size_t num_blocks() const {return current->num_blocks_;};
+    size_t memory_bytes() const;
+
+    /* 任意线程可调用，与 CompactMap::snapshot 相同，只在复制 shared_ptr 时短暂加锁。*/
+    SnapshotPtr snapshot() const {return std::atomic_load(&published);};
+
+private:
+    struct QueueEntry {
+        uint32_t dist2;
+        VoxelKey voxel;
+        bool operator>(const QueueEntry &other) const {return dist2 > other.dist2;};
+    };
+
+    Voxel *writable_voxel(const VoxelKey &voxel, const bool create);
+    bool is_obstacle(const VoxelKey &voxel);
+    void push(const uint32_t dist2, const VoxelKey &voxel);
+    void lower(const VoxelKey &voxel);
+    void raise(const VoxelKey &voxel);
+    void publish();
+
+    float resolution;
+    float max_distance;
+    int max_voxels;
+    uint32_t max_dist2;
+    size_t max_updates;
+    size_t publish_updates;
+    double publish_period;
+    size_t updates_since_publish;
+    std::chrono::steady_clock::time_point last_publish;
+
+    SnapshotPtr current;                // 写线程使用的最新版本
+    SnapshotPtr published;              // 其他线程通过 atomic_load 读取
+    std::shared_ptr<Snapshot> pending;  // 正在修改、尚未发布的版本
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+
+    // 最近访问的可写块，按块索引哈希直接映射，每次 update 开始时清空
+    static const int CACHE_SIZE = 64;
+    VoxelKey cached_keys[CACHE_SIZE];
+    Block *cached_blocks[CACHE_SIZE];
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+
+#include "common_lib.h"
+#include "use-ikfom.h"
+
+// 传感器数据按到达顺序保存，scan 为空时是 IMU 样本
+struct FlightEntry {
+    double time;
+    PointCloudXYZI::Ptr scan;
+    ImuSample imu;
+};
+
+// 每帧更新后的滤波状态
+struct FlightState {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    double time;
+    state_ikfom x;
+    esekfom::esekf<state_ikfom, 12, input_ikfom>::cov P;
+    int effective;   // 有效特征点数
+    int iterations;
+};
+
+typedef std::vector<FlightState, Eigen::aligned_allocator<FlightState>> FlightStates;
+
+/* 飞行记录仪：内存中保存最近 window 秒预处理后的点云、IMU 和滤波状态，出现异常时写到文件，事后回放复现。
+1. 点云只保存指针（与数据队列共享，入队之后不再修改），IMU 按值保存，固定容量的环形缓存，稳态下不分配内存；
+2. trigger 之后再等 post_time 秒，把异常之后的数据也包含进来，然后把缓存的指针交给后台线程写文件，
+   主循环不等待 I/O；两次写出之间至少间隔 cooldown 秒，一次运行最多写 max_dumps 次；
+3. 输出 PCD/flight_<序号>_<原因>.lsr（传感器记录，可以直接用 replay/bag_file 回放）
+   和 PCD/flight_<序号>_<原因>_states.txt（每帧的状态和协方差）。*/
+class FlightRecorder {
+public:
+    FlightRecorder();
+    ~FlightRecorder() {stop();};
+
+    // 以下只能在 start 之前设置
+    // max_rate 为 IMU 和 LiDAR 的总频率上限，决定缓存的容量；max_lidar_rate 为 LiDAR 的频率上限，决定滤波状态的容量
+    void set_window(const double seconds, const double max_rate = 1000.0, const double max_lidar_rate = 50.0);
+    void set_trigger_param(const double post_seconds, const double cooldown_seconds, const int dumps) {
+        post_time = post_seconds;
+        cooldown = cooldown_seconds;
+        max_dumps = dumps;
+    };
+    void set_preprocess(const int point_filter_num, const int scan_line, const int reflect_thresh, const double blind) {
+        pre_filter_num = point_filter_num;
+        pre_scan_line = scan_line;
+        pre_reflect_thresh = reflect_thresh;
+        pre_blind = blind;
+    };
+
+    // dir 为输出目录，以 / 结尾
+    void start(const std::string &dir);
+    // 先写出还在等待的记录，再退出
+    void stop();
+    bool is_running() const {return running;};
+
+    void add_scan(const double time, const PointCloudXYZI::Ptr &scan);
+    void add_imu(const ImuSample &imu);
+    void add_state(const double time, const state_ikfom &x, const esekfom::esekf<state_ikfom, 12, input_ikfom>::cov &P,
+        const int effective, const int iterations);
+    // reason 只能包含字母、数字和下划线，用于文件名
+    void trigger(const char *reason, const double time);
+
+    size_t dumps_written() const {return num_written;};
+    size_t triggers_ignored() const {return num_ignored;};
+
+private:
+    struct Dump {
+        int index;
+        std::string reason;
+        double trigger_time;
+        std::vector<FlightEntry> entries;
+        FlightStates states;
+    };
+
+    void push_entry(const double time, FlightEntry &&entry);
+    void check_pending(const double time);
+    void run();
+    void write(const Dump &dump);
+
+    std::string out_dir;
+    double window;
+    double post_time;
+    double cooldown;
+    int max_dumps;
+    int pre_filter_num;
+    int pre_scan_line;
+    int pre_reflect_thresh;
+    double pre_blind;
+
+    std::mutex mtx;
+    // 环形缓存
+    std::vector<FlightEntry> entries;
+    size_t entry_head;
+    size_t entry_count;
+    FlightStates states;
+    size_t state_head;
+    size_t state_count;
+    double latest_time;
+
+    bool pending;
+    std::string pending_reason;
+    double pending_time;
+    double last_dump_time;
+    int num_dumps;
+
+    std::condition_variable cv;
+    std::deque<Dump> dumps;
+    bool running;
+    bool stopped;
+    std::thread worker;
+
+    std::atomic<size_t> num_written;
+    std::atomic<size_t> num_ignored;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+// 主循环中计时的阶段，END_TO_END 为 LiDAR 帧结束时间戳到发布（交给发布线程）的延迟
+enum LatencyStage {
+    LATENCY_SYNC = 0,
+    LATENCY_IMU_PROCESS,
+    LATENCY_DOWNSAMPLE,
+    LATENCY_H_SHARE,
+    LATENCY_UPDATE,
+    LATENCY_MAP_INCREMENTAL,
+    LATENCY_PUBLISH,
+    LATENCY_END_TO_END,
+    LATENCY_NUM_STAGES
+};
+
+#define LATENCY_SUB_BITS  (4)                     // 每个 2 的幂区间分 16 个桶，相对误差不超过 1/16
+#define LATENCY_SUB_COUNT (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_EXP   (40)                    // 最大约 2^40 ns（18 分钟），更大的值计入最后一个桶
+#define LATENCY_BUCKETS   (2 * LATENCY_SUB_COUNT + (LATENCY_MAX_EXP - LATENCY_SUB_BITS - 1) * LATENCY_SUB_COUNT)
+
+/* 无锁的延迟直方图，单位 ns。
+桶按对数-线性划分：小于 2^(SUB_BITS+1) 的值每个 ns 一个桶，之后每个 2 的幂区间等分为 SUB_COUNT 个桶。
+record 只有几次 relaxed 原子加，可以在任意线程调用；读取时不加锁，统计值可能包含正在写入的一次记录。*/
+class LatencyHistogram {
+public:
+    LatencyHistogram() {reset();};
+
+    void record(const uint64_t ns);
+    void reset();
+
+    uint64_t count() const {return num.load(std::memory_order_relaxed);};
+    uint64_t max() const {return max_ns.load(std::memory_order_relaxed);};
+    double mean() const;
+    // 分位数（0 到 1），返回所在桶的上界，与真实值的相对误差不超过 1/SUB_COUNT
+    uint64_t percentile(const double q) const;
+
+private:
+    static int bucket_of(const uint64_t ns);
+    static uint64_t bucket_upper(const int bucket);
+
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+    std::atomic<uint64_t> num;
+    std::atomic<uint64_t> sum_ns;
+    std::atomic<uint64_t> max_ns;
+};
+
+/* 各阶段的延迟统计。
+编译时定义 LATENCY_STATS 才会计时（CMake 选项 LATENCY_STATS），否则计时宏为空；
+运行时可以用 set_enabled 关闭记录。*/
+class LatencyStats {
+public:
+    LatencyStats() : enabled(true) {};
+
+    void set_enabled(const bool en) {enabled.store(en, std::memory_order_relaxed);};
+    bool is_enabled() const {return enabled.load(std::memory_order_relaxed);};
+
+    void record(const LatencyStage stage, const uint64_t ns) {
+        if (is_enabled()) {
+            hist[stage].record(ns);
+        }
+    };
+    const LatencyHistogram &get(const LatencyStage stage) const {return hist[stage];};
+    void reset();
+
+    static const char *stage_name(const LatencyStage stage);
+    // 每个阶段一行：stage,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms
+    bool write_csv(const std::string &path) const;
+    // 一行文本汇总，用于日志
+    std::string summary() const;
+
+private:
+    LatencyHistogram hist[LATENCY_NUM_STAGES];
+    std::atomic<bool> enabled;
+};
+
+extern LatencyStats latency_stats;
+
+inline uint64_t latency_now_ns() {
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 作用域计时，析构时记录
+class ScopedLatency {
+public:
+    explicit ScopedLatency(const LatencyStage s) : stage(s), start(latency_now_ns()) {};
+    ~ScopedLatency() {latency_stats.record(stage, latency_now_ns() - start);};
+
+private:
+    const LatencyStage stage;
+    const uint64_t start;
+};
+
+#define LATENCY_CONCAT_INNER(a, b) a##b
+#define LATENCY_CONCAT(a, b) LATENCY_CONCAT_INNER(a, b)
+
+#ifdef LATENCY_STATS
+// 计时到当前作用域结束
+#define LATENCY_SCOPE(stage) ScopedLatency LATENCY_CONCAT(latency_scope_, __LINE__)(stage)
+// 成对使用，只在需要记录的分支调用 LATENCY_END
+#define LATENCY_BEGIN(name) const uint64_t name = latency_now_ns()
+#define LATENCY_END(name, stage) latency_stats.record(stage, latency_now_ns() - (name))
+#define LATENCY_RECORD(stage, ns) latency_stats.record(stage, ns)
+#else
+#define LATENCY_SCOPE(stage) ((void)0)
+#define LATENCY_BEGIN(name) ((void)0)
+#define LATENCY_END(name, stage) ((void)0)
+#define LATENCY_RECORD(stage, ns) ((void)0)
+#endif
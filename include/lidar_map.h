@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <ikd_Tree.h>
+
+#include "common_lib.h"
+#include "use-ikfom.h"
+#include "compact_map.h"
+#include "plane_map.h"
+#include "voxel_filter.h"
+
+#define MAX_MATCH_DIST2 (5.0)  // 最近邻的最大平方距离
+
+// LiDAR 系到 world 系（world 系是第一帧 IMU 系）的变换：rot * (offset_R_L_I * p + offset_T_L_I) + pos
+Eigen::Matrix4f body_to_world(const state_ikfom &s);
+
+/* 地图和 LiDAR 观测模型，lio_node 和 lio_bench 共用同一份实现。
+1. 地图根据 set_compact 选择 ikd-Tree 或 CompactMap；开启由粗到精匹配时同时维护一份低分辨率地图，
+   前 coarse_iterations 次迭代在低分辨率的点云和地图上匹配；开启平面提取时，落在 patch 上的点直接使用 patch 的平面；
+2. 每帧先 set_scan 设置降采样后的 LiDAR 系点云，迭代更新中调用 h_share_model，更新之后调用 incremental；
+3. 中间结果保存在成员缓冲区中，只改变大小不释放容量，稳态下不分配内存；
+   地图本身仍有分配：ikd-Tree 每次查询和插入，CompactMap 发布新版本时复制区表和修改过的区、块、tile。
+只能在主循环一个线程中使用，CompactMap 的快照（compact().snapshot()）可以在其他线程中读取。*/
+class LidarMap {
+public:
+    LidarMap();
+
+    // 以下只能在建图之前设置
+    void set_filter_size(const float size) {filter_size = size;};
+    void set_compact(const bool en, const float tile_size);
+    // scan_leaf 为全分辨率点云的降采样尺寸，低分辨率点云和地图使用 scale 倍的尺寸
+    void set_coarse_to_fine(const bool en, const float scan_leaf, const float scale, const int iterations);
+    void set_plane_map(const bool en) {plane_en = en;};
+
+    bool compact_enabled() const {return compact_en;};
+    bool plane_enabled() const {return plane_en;};
+    CompactMap &compact() {return compact_map;};
+    PlaneMap &planes() {return plane_map;};
+
+    /* 地图。*/
+    bool initialized() const;
+    void build(const PointVector &points);
+    // 用 set_scan 设置的点云建图，位姿为 st
+    void build_from_scan(const state_ikfom &st);
+    // 地图中的所有点（world 系）
+    void get_points(PointVector &out);
+
+    /* 每帧的匹配和地图更新。*/
+    // body 为降采样后的 LiDAR 系点云，本帧内不能修改；同时生成由粗到精的低分辨率点云
+    void set_scan(const PointCloudXYZI::Ptr &body);
+    // 本帧是否使用由粗到精匹配，可以临时关闭（与单分辨率结果对比）
+    bool coarse_active() const {return coarse_on;};
+    void set_coarse_active(const bool active) {coarse_on = active && coarse_en;};
+    // 观测模型，计算观测雅可比矩阵 H 和观测向量 h
+    void h_share_model(state_ikfom &st, esekfom::dyn_share_datastruct<double> &ekfom_data);
+    // 最后一次迭代的有效特征点数
+    int last_effective() const {return last_effect_num;};
+    // 按更新后的位姿 st 把本帧的点加入地图；ekf_inited 为 false 时全部加入，不使用平面 patch
+    void incremental(const state_ikfom &st, const bool ekf_inited);
+
+    // incremental 之后有效：world 系下本帧的点，降采样加入、直接加入、被平面 patch 吸收的点。
+    // 降采样加入的点是候选点，地图的降采样（体素中已有点时保留离中心近的）和删除不反映在这里，
+    // 按这些点增量保存的地图是地图的超集
+    const PointCloudXYZI &scan_world() const {return *down_world;};
+    const PointVector &points_to_add() const {return PointToAdd;};
+    const PointVector &points_no_downsample() const {return PointNoNeedDownsample;};
+    const PointVector &points_absorbed() const {return PointAbsorbed;};
+
+private:
+    void nearest_search_batch(const PointVector &points, std::vector<PointVector> &nearest,
+        std::vector<std::vector<float>> &dist2, const bool coarse);
+    void add_points(PointVector &points, const bool downsample, const bool to_plane_map = true);
+
+    float filter_size;    // 地图的最小分辨率
+    bool compact_en;
+    bool coarse_en;
+    float coarse_scale;
+    int coarse_iterations;
+    bool plane_en;
+
+    KD_TREE<PointType> ikdtree;
+    CompactMap compact_map;
+    PlaneMap plane_map;
+    // 由粗到精匹配使用的低分辨率地图和点云
+    KD_TREE<PointType> ikdtree_coarse;
+    CompactMap compact_map_coarse;
+    VoxelFilter coarse_filter;
+    bool coarse_on;  // 本帧是否启用由粗到精
+
+    PointCloudXYZI::Ptr down_body;
+    PointCloudXYZI::Ptr down_world;
+    PointCloudXYZI::Ptr coarse_body;
+    PointCloudXYZI::Ptr coarse_world;
+    std::vector<PointVector> Nearest_Points;
+    std::vector<PointVector> Nearest_Points_coarse;
+    int last_effect_num;
+
+    // h_share_model 和 incremental 的中间结果，每次迭代复用
+    PointCloudXYZI::Ptr laserCloudOri;  // cloud_body 中的有效点
+    PointCloudXYZI::Ptr corr_normvect;  // laserCloudOri 对应的法向量
+    PointCloudXYZI::Ptr normvec;        // 特征点在地图中对应点的局部平面参数，w 系
+    std::vector<bool> point_selected_surf;  // 是否为平面特征点
+    std::vector<int> point_patch;           // 点落在的平面 patch，-1 表示没有
+    std::vector<std::vector<float>> pointSearchSqDis;
+    PointVector search_points;              // 没有落在 patch 上、需要搜索最近邻的点
+    std::vector<int> search_index;
+    std::vector<PointVector> search_nearest;
+    std::vector<int> search_order;          // 最近邻搜索的 Morton 顺序
+    PointVector PointToAdd;
+    PointVector PointNoNeedDownsample;
+    PointVector PointAbsorbed;              // 落在平面 patch 上的点，只更新 patch，不加入地图
+    PointVector PointReleased;              // 解散的 patch 交还给地图的点
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "common_lib.h"
+#include "mapped_file.h"
+
+/* 分块（tile）二进制地图文件，后缀 .lim。
+文件结构：MapFileHeader | [MapChunkHeader + MapPoint * n] ... | MapChunkIndex * m | MapFileFooter
+1. 点按 tile 分桶，每个桶攒够一批就写成一个 chunk，因此可以边建图边增量写入；
+2. 关闭文件时写入 chunk 索引（含包围盒），读取端 mmap 后直接按索引访问，无需解析；
+3. 如果没有 footer（进程异常退出），读取端顺序扫描 chunk 重建索引，已写入的数据不会丢失。*/
+
+#define LIM_VERSION        (1)
+#define LIM_CHUNK_MAGIC    (0x4b4e4843)  // "CHNK"
+#define LIM_FRAME_WORLD    (0)           // 第一帧 IMU 系，即 ikd-Tree 所在坐标系
+#define LIM_FRAME_GROUND   (1)           // ground 系，垂直地面
+#define LIM_FLAG_R_W_G     (1)           // 文件头中的 R_W_G 有效
+
+struct MapFileHeader {
+
+    char magic[8];      // "LIMMAP\0\0"
+    uint32_t version;
+    uint32_t frame;     // LIM_FRAME_WORLD 或 LIM_FRAME_GROUND
+    float tile_size;    // tile 边长，单位 m
+    uint32_t flags;     // LIM_FLAG_*
+    double R_W_G[9];    // 行优先，world 系到 ground 系的旋转
+};
+
+struct MapPoint {
+
+    float x, y, z;
+    float intensity;
+};
+
+struct MapChunkHeader {
+
+    uint32_t magic;
+    int32_t key[3];      // tile 索引
+    uint32_t num_points;
+    uint32_t reserved;
+};
+
+// 空间索引，一个 chunk 一项
+struct MapChunkIndex {
+
+    int32_t key[3];
+    uint32_t num_points;
+    uint64_t offset;     // 第一个点相对文件头的字节偏移
+    float min[3];        // chunk 内点的包围盒
+    float max[3];
+};
+
+struct MapFileFooter {
+
+    uint64_t index_offset;
+    uint64_t num_chunks;
+    uint64_t num_points;
+    char magic[8];       // "LIMEND\0\0"
+};
+
+/* 增量写入 .lim 文件。
+每个 tile 缓存最多 chunk_points 个点，缓存满即落盘；所有 tile 缓存的总点数
+超过 max_buffered_points 时全部落盘，内存占用有上界。
+写入失败（磁盘满等）时记录一次错误，之后的数据不再写入，close 时报告文件不完整。
+R_W_G 在打开之后设置时立即写入文件头，进程异常退出后恢复的文件也能转到 ground 系。*/
+class TiledMapWriter {
+public:
+    TiledMapWriter();
+    ~TiledMapWriter() {close();};
+    // 持有 FILE*，不能复制
+    TiledMapWriter(const TiledMapWriter &) = delete;
+    TiledMapWriter &operator=(const TiledMapWriter &) = delete;
+
+    void set_chunk_points(const int n) {chunk_points = n;};
+    void set_max_buffered_points(const size_t n) {max_buffered_points = n;};
+    void set_R_W_G(const M3D &R);
+
+    bool open(const std::string &path, const float tile, const uint32_t frame);
+    void add_point(const PointType &p);
+    void add_points(const PointVector &points);
+    void add_points(const PointCloudXYZI &cloud);
+    // 所有缓存写成 chunk，并刷新到磁盘
+    void flush();
+    // 写入索引和 footer，关闭文件
+    void close();
+
+    bool is_open() const {return fp != nullptr;};
+    // 打开之后是否有写入失败
+    bool failed() const {return write_failed;};
+    size_t points_written() const {return num_points_written;};
+
+private:
+    void write_chunk(const VoxelKey &key, std::vector<MapPoint> &points);
+    // fwrite 的封装，写入不完整时记录错误并返回 false
+    bool write(const void *data, const size_t size, const size_t count);
+    // 回写文件头，之后回到文件末尾
+    bool write_header();
+
+    FILE *fp;
+    bool write_failed;
+    std::string file_path;
+    MapFileHeader header;
+    M3D R_W_G;
+    bool has_R_W_G;
+
+    float tile_size;
+    float inv_tile_size;
+    int chunk_points;
+    size_t max_buffered_points;
+    size_t num_buffered;
+
+    std::unordered_map<VoxelKey, std::vector<MapPoint>, VoxelKeyHash> tiles;
+    std::vector<MapChunkIndex> index;
+    uint64_t file_offset;
+    size_t num_points_written;
+};
+
+/* mmap 读取 .lim 文件，点数据零拷贝。
+footer 中的索引检查过每个 chunk 的范围才使用，否则顺序扫描 chunk 重建索引。*/
+class TiledMapReader {
+public:
+    TiledMapReader() : index(nullptr), num_chunks_(0), num_points_(0), recovered(false) {};
+
+    bool open(const std::string &path);
+    void close();
+
+    const MapFileHeader &get_header() const {return *reinterpret_cast<const MapFileHeader *>(file.data());};
+    M3D get_R_W_G() const;
+    // 文件头中的 R_W_G 是否有效（恢复的文件可能在写入 R_W_G 之前中断）
+    bool has_R_W_G() const;
+    size_t num_chunks() const {return num_chunks_;};
+    size_t num_points() const {return num_points_;};
+    // 文件没有 footer，索引是扫描 chunk 重建的
+    bool is_recovered() const {return recovered;};
+
+    const MapChunkIndex &chunk(const size_t i) const {return index[i];};
+    const MapPoint *chunk_points(const size_t i) const {
+        return reinterpret_cast<const MapPoint *>(file.data() + index[i].offset);
+    };
+
+    // 全部点转换成 PointVector
+    void load(PointVector &out) const;
+    // 只读取与包围盒相交的 chunk 中、落在包围盒内的点
+    void load_box(const V3F &box_min, const V3F &box_max, PointVector &out) const;
+
+private:
+    bool check_index(const MapFileFooter &footer) const;
+    bool rebuild_index();
+
+    MappedFile file;
+    const MapChunkIndex *index;
+    std::vector<MapChunkIndex> rebuilt_index;
+    size_t num_chunks_;
+    size_t num_points_;
+    bool recovered;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 只读 mmap 映射整个文件，析构时自动解除映射
+class MappedFile {
+public:
+    MappedFile() : data_(nullptr), size_(0) {};
+    ~MappedFile() {close();};
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path) {
+
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // 映射建立后即可关闭文件描述符
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+        // 顺序读取为主，提示内核预读
+        madvise(ptr, st.st_size, MADV_WILLNEED);
+        data_ = static_cast<const uint8_t *>(ptr);
+        size_ = static_cast<size_t>(st.st_size);
+        return true;
+    }
+
+    void close() {
+        if (data_ != nullptr) {
+            munmap(const_cast<uint8_t *>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const uint8_t *data() const {return data_;};
+    size_t size() const {return size_;};
+    bool is_open() const {return data_ != nullptr;};
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+#include "common_lib.h"
+
+#define OCC_BLOCK_BITS     (3)    // 一块 8x8x8 个体素
+#define OCC_BLOCK_SIZE     (1 << OCC_BLOCK_BITS)
+#define OCC_BLOCK_VOXELS   (OCC_BLOCK_SIZE * OCC_BLOCK_SIZE * OCC_BLOCK_SIZE)
+#define OCC_UNKNOWN        (-128)  // 未观测体素的 log-odds
+#define OCC_SHARDS         (16)    // 块按哈希分片，每个分片只由一个线程更新
+
+/* 稀疏三维占据栅格，在 ground 系（垂直地面）下增量更新。
+1. 体素按 8x8x8 分块存储，只为观测到的空间分配内存；
+2. 每个体素存一个 int8 的 log-odds，命中加 hit，射线穿过加 miss（负数），大于 0 为占据；
+   同一帧内每个体素最多更新一次，命中优先于穿过；
+3. 射线从 LiDAR 原点用三维 DDA 走到点所在体素，多线程并行：
+   先按射线分给各线程生成体素序列，再按块所在分片分给各线程更新，每个分片只有一个线程写，不需要加锁；
+   工作线程在第一次更新时创建，之后每帧只用条件变量分派两个阶段，析构时退出；
+4. 记录自上次取走以来发生变化的块，用于增量发布；
+5. 在 [min_z, max_z] 高度范围内把体素投影到二维，给导航使用，同样只重算变化的列。*/
+class OccupancyGrid {
+public:
+    struct Block {
+        int8_t logodds[OCC_BLOCK_VOXELS];
+        uint32_t scan_id;                        // visited 对应的帧
+        uint64_t visited[OCC_BLOCK_VOXELS / 64]; // 当前帧已更新的体素
+    };
+    // 二维投影的一列（8x8 个格子），取值与 nav_msgs/OccupancyGrid 相同：-1 未知，0 空闲，100 占据
+    struct Column {
+        int8_t cells[OCC_BLOCK_SIZE * OCC_BLOCK_SIZE];
+    };
+    typedef std::unordered_map<VoxelKey, Block, VoxelKeyHash> BlockMap;
+    typedef std::unordered_map<VoxelKey, Column, VoxelKeyHash> ColumnMap;
+
+    OccupancyGrid();
+    ~OccupancyGrid();
+    OccupancyGrid(const OccupancyGrid &) = delete;
+    OccupancyGrid &operator=(const OccupancyGrid &) = delete;
+
+    // 只能在更新之前设置
+    void set_resolution(const float res) {resolution = res; inv_resolution = 1.0f / res;};
+    void set_log_odds(const int hit, const int miss, const int min, const int max) {
+        log_hit = hit; log_miss = miss; log_min = min; log_max = max;
+    };
+    // 射线最长走 range 米，更远的点只清除这段距离内的空间，不标记占据
+    void set_max_range(const float range) {max_range = range;};
+    // 只能在更新之前设置，工作线程在第一次更新时按这个数量创建
+    void set_num_threads(const int n) {num_threads = std::max(1, n);};
+    // 记录体素占据状态的变化，供 ESDF 增量更新
+    void set_track_voxels(const bool en) {track_voxels = en;};
+    void set_projection(const float min_z, const float max_z) {project_min_z = min_z; project_max_z = max_z;};
+
+    float get_resolution() const {return resolution;};
+    size_t num_blocks() const;
+    size_t memory_bytes() const;
+
+    // 用一帧 ground 系点云更新，只标记命中
+    void integrate_hits(const PointVector &points);
+    // 用一帧 ground 系点云更新，origin 为 LiDAR 原点（ground 系），射线经过的体素标记为空闲
+    void integrate_scan(const PointVector &points, const V3D &origin);
+
+    bool is_occupied(const VoxelKey &voxel) const;
+    // 块内占据体素的位图（64 字节），体素按 x + 8y + 64z 的顺序
+    void block_bits(const VoxelKey &block, uint8_t *bits) const;
+
+    std::vector<VoxelKey> all_blocks() const;
+    // 上次 clear_changed 之后变化的块
+    const std::unordered_set<VoxelKey, VoxelKeyHash> &changed_blocks() const {return changed;};
+    void clear_changed() {changed.clear();};
+    // 取走上次调用之后变为占据和变为空闲的体素（按当前状态去重）
+    void take_voxel_changes(std::vector<VoxelKey> &occupied, std::vector<VoxelKey> &freed);
+
+    // 重算变化的块所在的列，返回二维投影；changed_columns 为变化的列
+    const ColumnMap &update_projection(std::vector<VoxelKey> *changed_columns = nullptr);
+
+private:
+    void integrate(const PointVector &points, const V3D &origin, const bool raycast);
+    void cast_rays(const PointVector &points, const size_t begin, const size_t end, const V3F &origin,
+        const bool raycast, std::vector<uint64_t> *out) const;
+    void update_shard(const int shard);
+    // 当前阶段中第 t 个线程的工作
+    void run_job(const int t);
+    // 主调线程做第 0 份，工作线程做其余 threads - 1 份，全部完成后返回
+    void run_parallel(const int threads);
+    void worker_loop(const int t);
+    const Block *find_block(const VoxelKey &bk) const;
+    void compute_column(const VoxelKey &column, Column &out) const;
+
+    float resolution;
+    float inv_resolution;
+    int log_hit;
+    int log_miss;
+    int log_min;
+    int log_max;
+    float project_min_z;
+    float project_max_z;
+    float max_range;
+    int num_threads;
+    bool track_voxels;
+    uint32_t scan_id;
+
+    BlockMap blocks[OCC_SHARDS];
+    ColumnMap columns;
+    std::unordered_set<VoxelKey, VoxelKeyHash> changed;          // 变化的块，供增量发布
+    std::unordered_set<VoxelKey, VoxelKeyHash> changed_project;  // 变化的块，供二维投影
+    // 射线生成的体素，按 [线程][分片] 存放，编码见 occupancy_grid.cpp
+    std::vector<std::vector<uint64_t>> ray_voxels;
+    std::vector<VoxelKey> shard_changed[OCC_SHARDS];             // 各分片本帧变化的块
+    std::vector<VoxelKey> shard_flipped[OCC_SHARDS];             // 各分片本帧占据状态变化的体素
+    std::vector<VoxelKey> flipped;                               // 上次 take_voxel_changes 之后占据状态变化的体素
+
+    // 工作线程，第 t 个（从 1 开始）存在 workers[t - 1]
+    enum JobPhase {JOB_CAST_RAYS, JOB_UPDATE_SHARDS};
+    std::vector<std::thread> workers;
+    std::mutex pool_mutex;
+    std::condition_variable cv_work;
+    std::condition_variable cv_done;
+    uint64_t job_id;                 // 每分派一次加 1
+    int job_pending;                 // 还没有完成的工作线程数
+    bool pool_stop;
+    // 当前阶段的参数，在 pool_mutex 下写入后分派
+    JobPhase job_phase;
+    int job_threads;
+    const PointVector *job_points;
+    V3F job_origin;
+    bool job_raycast;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "common_lib.h"
+
+/* 增量平面提取，压缩室内地图中的墙面、地面和天花板。
+1. 地图点按 voxel_size 体素累积一阶和二阶矩，不保存点本身；
+2. 点数足够且拟合残差（最小特征值的平方根，即到平面距离的 RMS）不超过 max_rms 的体素为平面体素；
+3. 平面体素与相邻的共面 patch 合并：法向量夹角小于 max_angle，合并后残差不超过 max_rms，
+   平面内的尺寸不超过 max_extent；加入体素后与其他相邻 patch 也满足条件时，两个 patch 合并；
+4. patch 的残差超过界限时解散，体素重新判断；
+5. 匹配时落在 patch 体素中、到平面距离不超过 max_point_dist 的点直接使用 patch 的平面，
+   不需要 kNN 和逐点拟合；这些点只累积到 patch 的矩中，不再加入 ikd-Tree，地图只存非平面区域的点；
+6. 每个体素保留最多 max_kept 个间隔不小于 kept_spacing 的吸收点，patch 解散时交还给地图（take_released），
+   解散区域仍然有最近邻可以匹配。*/
+class PlaneMap {
+public:
+    // 点的矩，用于增量拟合平面
+    struct Moments {
+        uint32_t n;
+        V3D sum;
+        M3D sum_sq;
+
+        Moments() : n(0), sum(V3D::Zero()), sum_sq(M3D::Zero()) {};
+        void add(const V3D &p) {n++; sum += p; sum_sq += p * p.transpose();};
+        void add(const Moments &m) {n += m.n; sum += m.sum; sum_sq += m.sum_sq;};
+    };
+    struct Plane {
+        V3D normal;     // 单位法向量
+        double d;       // normal · p + d = 0
+        V3D center;
+        double rms;     // 到平面距离的 RMS
+        double extent;  // 平面内最长方向的尺寸（按均匀分布估计）
+        double width;   // 平面内另一方向的尺寸
+        V3D axis;       // 最长方向
+    };
+    struct Patch {
+        Moments moments;
+        Plane plane;
+        std::vector<VoxelKey> voxels;
+        bool alive;
+    };
+
+    PlaneMap();
+
+    // 只能在建图之前设置
+    void set_voxel_size(const float size) {
+        voxel_size = size;
+        inv_voxel_size = 1.0f / size;
+        kept_spacing2 = size * size / 16.0f;  // 间隔为体素边长的 1/4
+    };
+    void set_min_points(const int n) {min_points = n;};
+    void set_max_rms(const double rms) {max_rms = rms;};
+    void set_max_angle(const double deg);
+    void set_max_extent(const double extent) {max_extent = extent;};
+    void set_max_point_dist(const float dist) {max_point_dist = dist;};
+    void set_max_kept(const int n) {max_kept = n;};
+
+    // 加入地图的点，累积到所在体素（和 patch）的矩中
+    void add_points(const PointVector &points);
+    // 匹配到 patch 的点，只累积矩，不加入地图
+    void absorb_point(const PointType &p);
+    // 处理本帧变化的体素：判断平面、合并 patch、检查 patch 残差；每帧地图更新后调用一次
+    void update();
+    // 取出解散的 patch 保留的吸收点，需要加入地图（不要再调用 add_points，矩已经累积过）
+    void take_released(PointVector &out);
+
+    // 点所在体素的 patch，点到平面的距离超过 max_point_dist 时返回 -1
+    int match(const PointType &p) const;
+    const Plane &plane(const int patch) const {return patches[patch].plane;};
+    bool in_patch(const PointType &p) const;
+
+    size_t num_patches() const {return num_alive;};
+    size_t num_planar_voxels() const;
+    size_t points_absorbed() const {return num_absorbed;};
+    size_t memory_bytes() const;
+
+    // 写出所有 patch（world 系），每行一个：中心、法向量、最长方向、两个方向的尺寸、点数、RMS
+    bool save(const std::string &path, const M3D &R_W_G) const;
+
+private:
+    struct Voxel {
+        Moments moments;
+        int patch;         // -1 为不属于 patch
+        PointVector kept;  // 保留的吸收点，解散时加入地图
+    };
+    typedef std::unordered_map<VoxelKey, Voxel, VoxelKeyHash> VoxelMap;
+
+    bool fit(const Moments &m, Plane &plane) const;
+    bool compatible(const Plane &a, const Plane &b) const;
+    Voxel &add_point(const V3D &p, const VoxelKey &key);
+    void try_join(const VoxelKey &key);
+    void merge_patches(const int into, const int from);
+    void dissolve(const int patch);
+
+    float voxel_size;
+    float inv_voxel_size;
+    int min_points;
+    double max_rms;
+    double min_cos;
+    double max_extent;
+    float max_point_dist;
+    int max_kept;
+    float kept_spacing2;  // 保留点之间的最小平方距离
+
+    VoxelMap voxels;
+    std::vector<Patch> patches;
+    std::vector<int> free_patches;                          // 已解散的 patch 编号，可以复用
+    std::unordered_set<VoxelKey, VoxelKeyHash> dirty;       // 本帧变化、不属于 patch 的体素
+    std::unordered_set<int> dirty_patches;                  // 本帧变化的 patch
+    PointVector released;                                   // 解散的 patch 保留的吸收点
+    size_t num_alive;
+    size_t num_absorbed;
+};
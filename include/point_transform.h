@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common_lib.h"
+
+/* 批量点云坐标变换。
+整条变换链（如 rot * (offset_R_L_I * p + offset_T_L_I) + pos）在调用前合并成一个 4x4 float 仿射矩阵，
+逐点只做一次 4x4 矩阵乘 4 维向量：PointType 的 xyz 后面有 1 个 float 的填充并且 16 字节对齐，
+用 getVector4fMap 按对齐的 4 维向量读写，Eigen 会展开成 SIMD 指令。*/
+
+// 旋转 R、平移 t 组成的仿射矩阵，在 double 下合并后再转成 float
+inline Eigen::Matrix4f make_transform(const M3D &R, const V3D &t) {
+
+    Eigen::Matrix4d T = Eigen::Matrix4d::Identity();
+    T.block<3, 3>(0, 0) = R;
+    T.block<3, 1>(0, 3) = t;
+    return T.cast<float>();
+}
+
+// 变换 n 个点的坐标并复制反射率，法向量和曲率不复制，in 和 out 可以相同
+inline void transform_points(const PointType *in, PointType *out, const size_t n, const Eigen::Matrix4f &T) {
+
+    for (size_t i = 0; i < n; i++) {
+        Eigen::Vector4f p = in[i].getVector4fMap();
+        p(3) = 1.0f;
+        out[i].getVector4fMap() = T * p;
+        out[i].intensity = in[i].intensity;
+    }
+}
+
+// out 的大小调整为与 in 相同
+template <typename VecIn, typename VecOut>
+inline void transform_points(const VecIn &in, VecOut &out, const Eigen::Matrix4f &T) {
+
+    out.resize(in.size());
+    transform_points(in.data(), out.data(), in.size(), T);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <mutex>
+#include <cstdio>
+#include <string>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <ros/ros.h>
+#include <nav_msgs/Path.h>
+#include <nav_msgs/Odometry.h>
+
+#include "common_lib.h"
+#include "scan_writer.h"
+#include "cloud_codec.h"
+
+// 一帧的 IMU 位姿，用于发布里程计、TF 和轨迹
+struct PoseFrame {
+
+    double time;
+    V3D pos;                       // world 系下 IMU 的位置
+    Eigen::Quaterniond rot;        // world 系下 IMU 的姿态
+    Eigen::Matrix<double, 6, 6> cov;  // 先位置后旋转
+};
+
+/* 发布线程，主循环只交出位姿和不再修改的点云，消息转换和发布都在这里完成。
+1. 位姿按顺序全部发布（队列有上界，超出时丢弃最旧的；离线回放时 set_blocking 改为等待）；
+2. 点云只保留最新的一帧，上一帧还没发布就被新的一帧覆盖；
+3. 没有订阅者时不做坐标转换和序列化。
+轨迹：每个位姿单独发布到 /pose；/path 只保留最近 path_max_poses 个位姿（环形队列），消息大小有上界；
+完整轨迹按 TUM 格式（time x y z qx qy qz qw）写入文件，使用单独的队列，从不丢弃，
+发布队列满时丢弃的位姿也会写入。
+压缩点云：LiDAR 系点云用 CloudEncoder 压缩后发布到 /cloud_compressed，附带扫描位姿。*/
+class PublishStage {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    PublishStage();
+    ~PublishStage() {stop();};
+
+    // 以下只能在 start 之前设置
+    // 每隔 step 个位姿向 /path 添加一个，最多保留 max_poses 个
+    void set_path_param(const int step, const size_t max_poses) {path_step = step; path_max_poses = max_poses;};
+    bool open_trajectory(const std::string &file);
+    void set_blocking(const bool b) {blocking = b;};
+    // 压缩点云的发布器和量化步长
+    void set_compressed(const ros::Publisher &pub, const float resolution) {
+        pub_compressed = pub;
+        encoder.set_resolution(resolution);
+    };
+
+    // 不需要发布的话题传入空的 ros::Publisher
+    void start(const ros::Publisher &pub_cloud, const ros::Publisher &pub_odom, const ros::Publisher &pub_path,
+        const ros::Publisher &pub_pose);
+    // 发布完剩余的位姿后退出
+    void stop();
+
+    void push_pose(const PoseFrame &pose);
+    // frame.rot、frame.pos 为 LiDAR 系到 world 系的变换
+    void push_scan(const ScanFrame &frame);
+    // 点云是否有订阅者，没有时主循环可以不提交点云
+    bool scan_wanted() const {
+        return (pub_cloud && pub_cloud.getNumSubscribers() > 0) ||
+            (pub_compressed && pub_compressed.getNumSubscribers() > 0);
+    };
+
+    size_t scans_published() const {return num_published;};
+    size_t scans_dropped() const {return num_dropped;};
+    size_t poses_dropped() const {return num_poses_dropped;};
+
+private:
+    void run();
+    void publish_pose(const PoseFrame &pose);
+    void write_trajectory(const PoseFrame &pose);
+    void publish_scan(const ScanFrame &frame);
+    void publish_compressed(const ScanFrame &frame);
+
+    ros::Publisher pub_cloud;
+    ros::Publisher pub_odom;
+    ros::Publisher pub_path;
+    ros::Publisher pub_pose;
+    ros::Publisher pub_compressed;
+    CloudEncoder encoder;
+    std::vector<uint8_t> encoded;
+    nav_msgs::Path path;
+    std::deque<geometry_msgs::PoseStamped> path_poses;  // 最近 path_max_poses 个位姿，发布时复制到 path
+    int path_count;
+    int path_step;
+    size_t path_max_poses;
+    FILE *traj_fp;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable cv_space;  // 位姿队列有空位
+    bool blocking;
+    std::deque<PoseFrame, Eigen::aligned_allocator<PoseFrame>> poses;
+    std::deque<PoseFrame, Eigen::aligned_allocator<PoseFrame>> traj_poses;  // 写入轨迹文件，不丢弃
+    ScanFrame latest_scan;
+    bool has_scan;
+    bool stopped;
+    std::thread worker;
+
+    std::atomic<size_t> num_published;
+    std::atomic<size_t> num_dropped;
+    std::atomic<size_t> num_poses_dropped;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <string>
+
+#include "common_lib.h"
+#include "map_io.h"
+#include "bounded_queue.h"
+#include "voxel_accumulator.h"
+
+// 一帧待处理的点云及其位姿，在线程之间传递
+struct ScanFrame {
+
+    double time;
+    PointCloudXYZI::Ptr cloud;  // LiDAR 系，交给队列后不能再修改
+    M3D rot;                    // LiDAR 系到目标坐标系的旋转
+    V3D pos;                    // LiDAR 系到目标坐标系的平移
+};
+
+/* 后台线程把每帧点云转换到 ground 系，增量写入 .lim 文件。
+1. 主循环只把点云指针放入有界队列，转换和写盘都在后台线程完成，不影响实时性；
+2. 写盘缓存有上界（TiledMapWriter），每隔 flush_period 秒刷新一次，异常退出时最多丢失一个周期的数据；
+3. 队列满（磁盘跟不上）时丢弃新的帧并计数，内存占用有上界；离线回放时 set_blocking 改为等待，不丢帧。
+设置 voxel_size 后改为体素去重模式：点累积到 VoxelAccumulator，每隔 checkpoint_period 秒
+把整个体素地图写一次文件，关闭时写最终结果，文件大小只与探索过的空间有关。*/
+class ScanStreamWriter {
+public:
+    ScanStreamWriter();
+    ~ScanStreamWriter() {close();};
+
+    void set_queue_size(const size_t n) {queue.set_capacity(n);};
+    void set_flush_period(const double period) {flush_period = period;};
+    void set_blocking(const bool b) {blocking = b;};
+    // 以下只能在 open 之前设置，voxel_size <= 0 表示不去重
+    void set_voxel_size(const float size) {voxel_size = size;};
+    void set_min_hits(const uint32_t n) {min_hits = n;};
+    void set_checkpoint_period(const double period) {checkpoint_period = period;};
+
+    bool open(const std::string &path, const float tile_size);
+    // 主循环调用，队列满时返回 false（blocking 时等待）
+    bool push(const ScanFrame &frame);
+    // 写完队列中剩余的帧，写入索引并关闭文件；R_W_G 记录在文件头中
+    void close(const M3D &R_W_G = M3D::Identity());
+
+    bool is_open() const {return running;};
+    size_t frames_dropped() const {return num_dropped;};
+
+private:
+    void run();
+
+    BoundedQueue<ScanFrame> queue;
+    TiledMapWriter writer;
+    VoxelAccumulator voxels;
+    std::string file_path;
+    float tile_size;
+    float voxel_size;
+    uint32_t min_hits;
+    double checkpoint_period;
+    std::thread worker;
+    std::atomic<bool> running;
+    bool blocking;
+    std::atomic<size_t> num_dropped;
+    double flush_period;
+};
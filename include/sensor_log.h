@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common_lib.h"
+#include "mapped_file.h"
+
+/* 预处理后的传感器数据记录文件，后缀 .lsr。
+文件结构：SensorLogHeader | [SensorLogChunkHeader + 数据] ... | SensorLogIndex * m | SensorLogFooter
+1. 扫描 chunk 保存 Preprocess 输出的点（时间偏移在 curvature 中，单位 ms），回放时不需要反序列化和预处理；
+2. IMU 样本攒成一批写成一个 chunk，每次写扫描前先写出已缓存的 IMU，文件中的 chunk 与到达顺序一致；
+3. 关闭文件时写入 chunk 索引，读取端 mmap 后零拷贝访问，并按时间二分查找；
+4. 如果没有 footer（进程异常退出），读取端顺序扫描 chunk 重建索引。*/
+
+#define LSR_VERSION      (1)
+#define LSR_CHUNK_MAGIC  (0x43455253)  // "SREC"
+#define LSR_CHUNK_SCAN   (0)
+#define LSR_CHUNK_IMU    (1)
+
+// 记录时的预处理参数，回放时只能使用相同的预处理结果
+struct SensorLogHeader {
+
+    char magic[8];            // "LSRLOG\0\0"
+    uint32_t version;
+    int32_t point_filter_num;
+    int32_t scan_line;
+    int32_t reflect_thresh;
+    double blind;
+};
+
+struct SensorLogPoint {
+
+    float x, y, z;
+    float intensity;
+    float curvature;          // 相对扫描起始时间的偏移，单位 ms
+};
+
+/* 时间是绝对时间（秒），需要 double；加速度和角速度用 float，有效位数约 7 位，
+舍入误差（1e-7 量级的相对误差）比 IMU 的噪声低几个数量级，每个样本 32 字节，比 double 少 12 字节。*/
+struct SensorLogImu {
+
+    double time;
+    float acc[3];             // 与 IMU 消息相同的单位，不做换算
+    float gyr[3];
+};
+
+struct SensorLogChunkHeader {
+
+    uint32_t magic;
+    uint32_t type;            // LSR_CHUNK_SCAN 或 LSR_CHUNK_IMU
+    uint32_t count;           // 点数或 IMU 样本数
+    uint32_t reserved;
+    double time;              // 扫描起始时间，或第一个 IMU 样本的时间
+};
+
+struct SensorLogIndex {
+
+    uint32_t type;
+    uint32_t count;
+    double time;
+    double seek_time;         // 到这个 chunk 为止的最大时间，单调不减，用于二分查找
+    uint64_t offset;          // 数据相对文件头的字节偏移
+};
+
+struct SensorLogFooter {
+
+    uint64_t index_offset;
+    uint64_t num_chunks;
+    uint64_t num_scans;
+    uint64_t num_imu;
+    char magic[8];            // "LSREND\0\0"
+};
+
+/* 记录 .lsr 文件。
+由回调线程调用，写入走 stdio 缓冲；IMU 样本最多缓存 imu_chunk_samples 个。*/
+class SensorLogWriter {
+public:
+    SensorLogWriter();
+    ~SensorLogWriter() {close();};
+
+    void set_imu_chunk_samples(const int n) {imu_chunk_samples = n;};
+    void set_preprocess(const int point_filter_num, const int scan_line, const int reflect_thresh, const double blind);
+
+    bool open(const std::string &path);
+    void add_imu(const double time, const V3D &acc, const V3D &gyr);
+    void add_scan(const double time, const PointCloudXYZI &cloud);
+    // 缓存的 IMU 写成 chunk，并刷新到磁盘
+    void flush();
+    // 写入索引和 footer，关闭文件
+    void close();
+
+    bool is_open() const {return fp != nullptr;};
+    size_t scans_written() const {return num_scans;};
+    size_t imu_written() const {return num_imu;};
+
+private:
+    void write_chunk(const uint32_t type, const uint32_t count, const double time, const void *data, const size_t bytes);
+    void flush_imu();
+
+    FILE *fp;
+    std::string file_path;
+    SensorLogHeader header;
+    int imu_chunk_samples;
+
+    std::vector<SensorLogImu> imu_pending;
+    std::vector<SensorLogPoint> scan_buffer;
+    std::vector<SensorLogIndex> index;
+    uint64_t file_offset;
+    double seek_time;
+    size_t num_scans;
+    size_t num_imu;
+};
+
+/* mmap 读取 .lsr 文件，点和 IMU 数据零拷贝。
+footer 中的索引检查过每个 chunk 的范围和类型才使用，否则顺序扫描 chunk 重建索引。*/
+class SensorLogReader {
+public:
+    SensorLogReader() : index(nullptr), num_chunks_(0), num_scans_(0), num_imu_(0), recovered(false) {};
+
+    bool open(const std::string &path);
+    void close();
+
+    bool is_open() const {return file.is_open();};
+    const SensorLogHeader &get_header() const {return *reinterpret_cast<const SensorLogHeader *>(file.data());};
+    size_t num_chunks() const {return num_chunks_;};
+    size_t num_scans() const {return num_scans_;};
+    size_t num_imu() const {return num_imu_;};
+    // 文件没有 footer，索引是扫描 chunk 重建的
+    bool is_recovered() const {return recovered;};
+    double begin_time() const {return num_chunks_ > 0 ? index[0].time : 0.0;};
+    double end_time() const {return num_chunks_ > 0 ? index[num_chunks_ - 1].seek_time : 0.0;};
+
+    const SensorLogIndex &chunk(const size_t i) const {return index[i];};
+    const SensorLogPoint *scan_points(const size_t i) const {
+        return reinterpret_cast<const SensorLogPoint *>(file.data() + index[i].offset);
+    };
+    const SensorLogImu *imu_samples(const size_t i) const {
+        return reinterpret_cast<const SensorLogImu *>(file.data() + index[i].offset);
+    };
+    /* 扫描 chunk 转换成 Preprocess 输出的点云，覆盖 out 中每个点的全部字段。
+    out 的点数与 chunk 相同时不重新构造点（CloudPool::acquire(true) 取出的点云），只做一遍转换。*/
+    void load_scan(const size_t i, PointCloudXYZI &out) const;
+    // 第一个时间不早于 time 的 chunk，都早于 time 时返回 num_chunks()
+    size_t seek(const double time) const;
+
+private:
+    bool check_index(const SensorLogFooter &footer) const;
+    bool rebuild_index();
+
+    MappedFile file;
+    const SensorLogIndex *index;
+    std::vector<SensorLogIndex> rebuilt_index;
+    size_t num_chunks_;
+    size_t num_scans_;
+    size_t num_imu_;
+    bool recovered;
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+
+#include "common_lib.h"
+
+/* 合成的室内 LiDAR-惯导数据，用于基准测试和回归测试，不依赖实际采集的 bag。
+1. SimScene：稠密占据栅格（z 轴向上，重力沿 -z），可以程序生成房间，也可以读取 back_up/occupy.txt 格式的体素房间；
+   射线用三维 DDA 求与第一个占据体素的交点，交点在体素表面上，轴对齐的墙面没有量化误差；
+2. SimTrajectory：脚本化的 IMU 轨迹，开头静止 still_time 秒（用于 IMU 初始化），之后平滑加速到设定速度；
+3. SimLidar：Livox Mid-70 的花瓣形扫描，两个反向旋转的光楔叠加，圆形视场；
+4. SimImu：由轨迹的二阶导数和角速度生成比力和角速度测量，含白噪声和随机游走的零偏。*/
+
+class SimScene {
+public:
+    SimScene() : resolution(0.1f), inv_resolution(10.0f) {dims[0] = dims[1] = dims[2] = 0;};
+
+    // 清空场景，栅格覆盖 origin 开始的 size 米
+    void reset(const V3D &origin, const V3D &size, const float res);
+    // 把包围盒内的体素标记为占据（fill = false 时挖空）
+    void fill_box(const V3D &box_min, const V3D &box_max, const bool fill = true);
+    /* 程序生成房间：size 为内部尺寸（原点在房间一角的地面上），墙厚 0.2m；沿墙摆放 num_boxes 个家具，
+    房间内部 keep_out 米以外随机放 num_pillars 根柱子，柱子不进入中间区域，轨迹在中间区域内运动。*/
+    void make_room(const V3D &size, const float res, const int num_boxes, const int num_pillars, const double keep_out,
+        const int seed);
+    /* 读取 occupy.txt：第一行 "# dim_x dim_y dim_z"，之后 dim_x * dim_y 行，每行 dim_z 个逗号分隔的 0/1，
+    res 为体素边长，原点在栅格的一角。*/
+    bool load_occupy(const std::string &path, const float res);
+    bool save_occupy(const std::string &path) const;
+
+    bool is_occupied(const int x, const int y, const int z) const;
+    bool is_occupied(const V3D &p) const;
+    // 射线与第一个占据体素的交点，max_range 内没有命中时返回 false
+    bool raycast(const V3D &origin, const V3D &dir, const double max_range, double &range, uint32_t &voxel) const;
+
+    V3D get_origin() const {return origin;};
+    V3D get_size() const {return V3D(dims[0], dims[1], dims[2]) * resolution;};
+    V3D get_center() const {return origin + 0.5 * get_size();};
+    float get_resolution() const {return resolution;};
+    size_t num_occupied() const;
+
+private:
+    size_t index(const int x, const int y, const int z) const {
+        return (static_cast<size_t>(x) * dims[1] + y) * dims[2] + z;
+    };
+
+    V3D origin;
+    float resolution;
+    float inv_resolution;
+    int dims[3];
+    std::vector<uint8_t> occupied;
+};
+
+enum SimTrajectoryType {
+    SIM_STATIC = 0,
+    SIM_CIRCLE,     // 水平圆周，朝向切线方向
+    SIM_FIGURE8,    // 水平 8 字，朝向来回摆动
+    SIM_HANDHELD    // 手持行走：多个不可公约频率的正弦叠加，含步态起伏
+};
+
+class SimTrajectory {
+public:
+    SimTrajectory();
+
+    static bool parse_type(const std::string &name, SimTrajectoryType &type);
+
+    void set_type(const SimTrajectoryType t) {type = t;};
+    // 运动的中心和水平方向的幅度（m）
+    void set_center(const V3D &c) {center = c;};
+    void set_amplitude(const double a) {amplitude = a;};
+    // 沿路径的平均速度（m/s）
+    void set_speed(const double v) {speed = v;};
+    void set_still_time(const double t) {still_time = t;};
+    void set_ramp_time(const double t) {ramp_time = t;};
+
+    // world 系下 IMU 的位姿，t 为相对起始时刻的时间
+    void pose(const double t, M3D &rot, V3D &pos) const;
+    // 数值微分：world 系加速度，body 系角速度
+    void derivatives(const double t, V3D &acc, V3D &gyr) const;
+
+private:
+    // 加速段平滑过渡的运动时间，静止时为 0
+    double motion_time(const double t) const;
+
+    SimTrajectoryType type;
+    V3D center;
+    double amplitude;
+    double speed;
+    double still_time;
+    double ramp_time;
+};
+
+// 一个 LiDAR 点，LiDAR 系，offset 为相对扫描起始时间的偏移（s）
+struct SimPoint {
+    V3F p;
+    float intensity;
+    float offset;
+};
+
+class SimLidar {
+public:
+    SimLidar();
+
+    // 每秒的点数，与扫描频率无关
+    void set_point_rate(const double r) {point_rate = r;};
+    void set_fov(const double deg) {half_fov = deg / 360.0 * M_PI;};
+    // 两个光楔的旋转频率（Hz），频率不可公约时图案不重复
+    void set_prism_rates(const double f1, const double f2) {prism_rate[0] = f1; prism_rate[1] = f2;};
+    void set_range(const double min, const double max) {min_range = min; max_range = max;};
+    void set_range_noise(const double sigma) {range_noise = sigma;};
+    void set_extrinsic(const M3D &R_I_L, const V3D &t_I_L) {R_IL = R_I_L; t_IL = t_I_L;};
+    double get_point_rate() const {return point_rate;};
+
+    // LiDAR 系下 t 时刻（绝对时间，图案在帧之间连续）的光束方向
+    V3D direction(const double t) const;
+    // 生成 [t0, t0 + duration) 的一帧，t0 为相对轨迹起始时刻的时间，时间偏移保存在 offset 中
+    void scan(const SimScene &scene, const SimTrajectory &traj, const double t0, const double duration,
+        std::mt19937 &rng, std::vector<SimPoint> &out) const;
+
+private:
+    double point_rate;
+    double half_fov;
+    double prism_rate[2];
+    double min_range;
+    double max_range;
+    double range_noise;
+    M3D R_IL;
+    V3D t_IL;
+};
+
+struct SimImuSample {
+    double time;
+    V3D acc;
+    V3D gyr;
+};
+
+class SimImu {
+public:
+    SimImu();
+
+    // 每个样本的白噪声标准差，零偏随机游走的标准差（每 sqrt(s)）
+    void set_noise(const double acc, const double gyr) {acc_noise = acc; gyr_noise = gyr;};
+    void set_bias_walk(const double acc, const double gyr) {acc_walk = acc; gyr_walk = gyr;};
+    void set_bias(const V3D &acc, const V3D &gyr) {acc_bias = acc; gyr_bias = gyr;};
+
+    // t 时刻的测量，dt 为与上一个样本的间隔，用于零偏的随机游走
+    SimImuSample sample(const SimTrajectory &traj, const double t, const double dt, std::mt19937 &rng);
+
+private:
+    double acc_noise;
+    double gyr_noise;
+    double acc_walk;
+    double gyr_walk;
+    V3D acc_bias;
+    V3D gyr_bias;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "common_lib.h"
+
+#define TSDF_BLOCK_BITS    (3)  // 一块 8x8x8 个体素
+#define TSDF_BLOCK_SIZE    (1 << TSDF_BLOCK_BITS)
+#define TSDF_BLOCK_VOXELS  (TSDF_BLOCK_SIZE * TSDF_BLOCK_SIZE * TSDF_BLOCK_SIZE)
+
+/* 体素哈希的 TSDF（截断符号距离场），用于室内表面重建。
+1. 体素按 8x8x8 分块哈希存储，只为表面附近分配内存；
+2. 每个点沿射线在表面前后 truncation 范围内更新体素，符号距离为体素中心到点沿射线方向的距离，
+   表面前方为正，按权重做滑动平均；
+3. 按块增量提取网格：记录更新过的块，只重新提取这些块及其邻居（网格依赖相邻块边界上的体素）；
+4. 网格用 surface nets 提取：每个跨越表面的体素格子生成一个顶点（各条边上过零点的平均），
+   每条跨越表面的体素边生成一个四边形（两个三角形），不需要 marching cubes 的查找表。*/
+class TsdfMap {
+public:
+    struct Voxel {
+        float sdf;
+        float weight;
+    };
+    struct Block {
+        Voxel voxels[TSDF_BLOCK_VOXELS];
+    };
+    // 一块的网格，triangles 每 3 个为一个三角形的顶点索引
+    struct BlockMesh {
+        std::vector<V3F> vertices;
+        std::vector<uint32_t> triangles;
+    };
+    typedef std::unordered_map<VoxelKey, Block, VoxelKeyHash> BlockMap;
+    typedef std::unordered_map<VoxelKey, BlockMesh, VoxelKeyHash> MeshMap;
+
+    TsdfMap();
+
+    // 只能在融合之前设置，截断距离至少为 1 个体素
+    void set_voxel_size(const float size);
+    void set_truncation(const float trunc) {truncation = trunc;};
+    void set_max_range(const float range) {max_range = range;};
+    void set_max_weight(const float weight) {max_weight = weight;};
+
+    float get_voxel_size() const {return voxel_size;};
+    size_t num_blocks() const {return blocks.size();};
+    size_t memory_bytes() const;
+
+    // 融合一帧点云，points 和 origin（LiDAR 原点）在同一坐标系下
+    void integrate(const PointVector &points, const V3D &origin);
+    // 重新提取更新过的块的网格，changed 为网格变化的块
+    void update_mesh(std::vector<VoxelKey> &changed);
+    const MeshMap &get_mesh() const {return meshes;};
+    // 所有块的网格写成二进制 PLY，顶点左乘旋转 R
+    bool save_mesh(const std::string &path, const M3D &R) const;
+
+private:
+    const Voxel *find_voxel(const VoxelKey &voxel) const;
+    Voxel &writable_voxel(const VoxelKey &voxel);
+    void extract_block(const VoxelKey &block, BlockMesh &mesh) const;
+
+    float voxel_size;
+    float inv_voxel_size;
+    float truncation;
+    float max_range;
+    float max_weight;
+
+    BlockMap blocks;
+    MeshMap meshes;
+    std::unordered_set<VoxelKey, VoxelKeyHash> dirty;  // 上次提取网格之后更新过的块
+};
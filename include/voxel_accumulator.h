@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "common_lib.h"
+
+/* 体素去重的点云累积，用于保存地图。
+每个体素只保存质心、平均反射率和命中次数，静止时重复扫描同一位置不会增加点数，
+内存占用只与探索过的空间大小有关。*/
+class VoxelAccumulator {
+public:
+    struct Voxel {
+        V3F centroid;      // 体素内所有点的均值
+        float intensity;   // 平均反射率
+        uint32_t hits;     // 落入体素的点数
+    };
+
+    VoxelAccumulator() : voxel_size(0.1f), inv_voxel_size(10.0f) {};
+
+    // 只能在累积之前设置
+    void set_voxel_size(const float size) {voxel_size = size; inv_voxel_size = 1.0f / size;};
+    float get_voxel_size() const {return voxel_size;};
+
+    void add_point(const PointType &p);
+    void clear() {voxels.clear();};
+
+    size_t size() const {return voxels.size();};
+    size_t memory_bytes() const;
+    const std::unordered_map<VoxelKey, Voxel, VoxelKeyHash> &get_voxels() const {return voxels;};
+
+    // 输出命中次数不少于 min_hits 的体素质心
+    void get_points(PointVector &out, const uint32_t min_hits = 1) const;
+    // 写入 .lim 文件（ground 系），先写临时文件再重命名，写到一半退出不会破坏已有文件
+    bool save(const std::string &path, const float tile_size, const M3D &R_W_G, const uint32_t min_hits = 1) const;
+
+private:
+    float voxel_size;
+    float inv_voxel_size;
+    std::unordered_map<VoxelKey, Voxel, VoxelKeyHash> voxels;
+};
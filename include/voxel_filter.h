@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "common_lib.h"
+
+/* 体素降采样，替代 pcl::VoxelGrid。
+1. 与 pcl::VoxelGrid（downsample_all_data 默认开启）结果相同：体素边界为 leaf 的整数倍，
+   每个体素输出所有点各字段（坐标、反射率、法向量、curvature 即时间偏移）的平均，
+   输出按体素的 (z, y, x) 排序，非有限的点丢弃；
+2. pcl::VoxelGrid 每次调用都新建索引数组，这里排序缓冲区在调用之间保留，
+   out 是复用的点云（CloudPool）时，稳态下不分配内存；
+3. 体素索引每个轴 21 位，坐标绝对值不超过 leaf * 2^20（leaf 为 0.5m 时约 500km）。*/
+class VoxelFilter {
+public:
+    VoxelFilter() : leaf(0.5f), inv_leaf(2.0f) {};
+
+    void set_leaf_size(const float size) {leaf = size; inv_leaf = 1.0f / size;};
+    float get_leaf_size() const {return leaf;};
+
+    // out 不能与 in 是同一个点云
+    void filter(const PointCloudXYZI &in, PointCloudXYZI &out);
+
+private:
+    struct Entry {
+        uint64_t key;    // 体素索引，z、y、x 各 21 位
+        uint32_t index;  // 点在 in 中的下标
+    };
+
+    float leaf;
+    float inv_leaf;
+    std::vector<Entry> entries;
+};
@@ -16,7 +16,9 @@ ImuProcess::ImuProcess()
     Lidar_T_wrt_IMU = V3D(0.0 ,0.0 ,0.0);
     Lidar_R_wrt_IMU = M3D::Identity();
     R_W_G           = M3D::Identity();
-    last_imu_.reset(new sensor_msgs::Imu());
+    last_imu_.time = 0.0;
+    last_imu_.acc.setZero();
+    last_imu_.gyr.setZero();
 }
 
 /* 更新 mean_acc, mean_gyr，初始化 kf_state，更新 last_imu_, last_lidar_end_time_, Q。*/
@@ -24,10 +26,8 @@ void ImuProcess::IMU_init(const MeasureGroup &meas, esekfom::esekf<state_ikfom,
 
     V3D cur_acc, cur_gyr;
     for (const auto &imu : meas.imu) {
-        const auto &imu_acc = imu->linear_acceleration;
-        const auto &gyr_acc = imu->angular_velocity;
-        cur_acc << imu_acc.x, imu_acc.y, imu_acc.z;
-        cur_gyr << gyr_acc.x, gyr_acc.y, gyr_acc.z;
+        cur_acc = imu.acc;
+        cur_gyr = imu.gyr;
         // 均值更新
         mean_acc += (cur_acc - mean_acc) / init_iter_num;
         mean_gyr += (cur_gyr - mean_gyr) / init_iter_num;
@@ -81,9 +81,10 @@ void ImuProcess::IMU_init(const MeasureGroup &meas, esekfom::esekf<state_ikfom,
 void ImuProcess::UndistortPcl(const MeasureGroup &meas, 
     esekfom::esekf<state_ikfom, 12, input_ikfom> &kf_state, PointCloudXYZI &pcl_out) {
 
-    std::deque<sensor_msgs::Imu::ConstPtr> v_imu = meas.imu;         // 拿到当前的 IMU 数据
-    v_imu.push_front(last_imu_);                                     // 将上一包末尾的 IMU 添加到当前帧头部
-    const double imu_end_time = v_imu.back()->header.stamp.toSec();  // 拿到当前帧尾部的 IMU 的时间
+    v_imu.clear();
+    v_imu.push_back(last_imu_);                                      // 将上一包末尾的 IMU 添加到当前帧头部
+    v_imu.insert(v_imu.end(), meas.imu.begin(), meas.imu.end());     // 拿到当前的 IMU 数据
+    const double imu_end_time = v_imu.back().time;                   // 拿到当前帧尾部的 IMU 的时间
     const double pcl_end_time = meas.lidar_end_time;                 // pcl 结束的时间戳
 
     // 把点云数据赋值给 pcl_out
@@ -92,8 +93,6 @@ void ImuProcess::UndistortPcl(const MeasureGroup &meas,
     auto time_list = [](PointType &x, PointType &y) {return (x.curvature < y.curvature);};
     std::sort(pcl_out.points.begin(), pcl_out.points.end(), time_list);
     // pose6d 包含：相对雷达起始时刻 offset_time，上一帧加速度，上一帧角速度，上一帧速度，上一帧位置，上一帧旋转矩阵
-    std::vector<Pose6D> IMUpose;
-    IMUpose.reserve(v_imu.size());
     IMUpose.clear();
 
     // 平均角速度，平均加速度，IMU 加速度，IMU 速度，IMU 位置
@@ -106,19 +105,19 @@ void ImuProcess::UndistortPcl(const MeasureGroup &meas,
     // 经检验确实存在 situation1
     {
         auto &imuSecond = *(v_imu.begin() + 1);
-        if (imuSecond->header.stamp.toSec() < meas.lidar_beg_time) {
+        if (imuSecond.time < meas.lidar_beg_time) {
 
             // std::string strout;
             // strout = "situation 1 occur! v_imu time stamp: " + std::to_string((*v_imu.begin())->header.stamp.toSec())
             //     + "; " + std::to_string((*(v_imu.begin()+1))->header.stamp.toSec()) +
             //     + "; " + std::to_string((*(v_imu.begin()+2))->header.stamp.toSec());
             // neal::logger(neal::LOG_TEST, strout);
-            v_imu.pop_front();
+            v_imu.erase(v_imu.begin());
         }
     }
 
     // 补上第一帧
-    state_ikfom imu_state = kf_state.get_x();
+    imu_state = kf_state.get_x();
     IMUpose.push_back(set_pose6d(0.0, acc_s_last, angvel_last, imu_state.vel, imu_state.pos, imu_state.rot.toRotationMatrix()));
 
     /* 前向传播：遍历本次估计的所有 IMU 测量并且进行积分*/
@@ -126,32 +125,28 @@ void ImuProcess::UndistortPcl(const MeasureGroup &meas,
         auto &head = *(it_imu);      // 拿到当前帧的 IMU 数据
         auto &tail = *(it_imu + 1);  // 拿到下一帧的 IMU 数据
         // 判断时间先后顺序，不符合直接 continue
-        if (tail->header.stamp.toSec() < last_lidar_end_time_) {
-            neal::logger(neal::LOG_ERROR, "imu begin time error, should not happen.");
+        if (tail.time < last_lidar_end_time_) {
+            ASYNC_LOG(neal::LOG_ERROR, "imu begin time error, should not happen.");
             continue;
         }
 
         // 如果 head 时刻早于这一包雷达开始时刻，第一次
-        if (head->header.stamp.toSec() < meas.lidar_beg_time) {
+        if (head.time < meas.lidar_beg_time) {
             // std::string strout;
             // strout = "lastlidar end time: " + std::to_string(last_lidar_end_time_)
             //     + "; lidar beg time: " + std::to_string(meas.lidar_beg_time);
             // neal::logger(neal::LOG_INFO, strout);
             // 从上次雷达结束时刻开始传播
-            dt = tail->header.stamp.toSec() - last_lidar_end_time_;
+            dt = tail.time - last_lidar_end_time_;
         }
         else {
             // 正常情况，除第一次
-            dt = tail->header.stamp.toSec() - head->header.stamp.toSec();
+            dt = tail.time - head.time;
         }
 
         // 离散中值积分
-        angvel_avr << 0.5 * (head->angular_velocity.x + tail->angular_velocity.x),
-                      0.5 * (head->angular_velocity.y + tail->angular_velocity.y),
-                      0.5 * (head->angular_velocity.z + tail->angular_velocity.z);
-        acc_avr << 0.5 * (head->linear_acceleration.x + tail->linear_acceleration.x),
-                   0.5 * (head->linear_acceleration.y + tail->linear_acceleration.y),
-                   0.5 * (head->linear_acceleration.z + tail->linear_acceleration.z);
+        angvel_avr = 0.5 * (head.gyr + tail.gyr);
+        acc_avr = 0.5 * (head.acc + tail.acc);
         // 通过重力数值对加速度进行一下微调，等比缩放。
         acc_avr = acc_avr * G_m_s2 / mean_acc.norm();
         // 原始测量的中值作为系统输入
@@ -168,23 +163,19 @@ void ImuProcess::UndistortPcl(const MeasureGroup &meas,
         for (int i = 0; i < 3; i++) {
             acc_s_last[i] += imu_state.grav[i];                 // 加上重力得到真正的加速度，世界坐标系下
         }
-        double offs_t = tail->header.stamp.toSec() - meas.lidar_beg_time;  // 后一个 IMU 时刻距离此次雷达开始的时间间隔
+        double offs_t = tail.time - meas.lidar_beg_time;  // 后一个 IMU 时刻距离此次雷达开始的时间间隔
         // 保存 IMU 预测过程的状态
         IMUpose.push_back(set_pose6d(offs_t, acc_s_last, angvel_last, imu_state.vel, imu_state.pos, imu_state.rot.toRotationMatrix()));
     }
 
     // 把最后一帧 IMU 测量也补上
     if (imu_end_time > pcl_end_time) {
-        neal::logger(neal::LOG_ERROR, "imu end time error, why?");
+        ASYNC_LOG(neal::LOG_ERROR, "imu end time error, why?");
     }
     dt = (pcl_end_time - imu_end_time);
     // 离散中值积分
-    angvel_avr << v_imu.back()->angular_velocity.x,
-                  v_imu.back()->angular_velocity.y,
-                  v_imu.back()->angular_velocity.z;
-    acc_avr << v_imu.back()->linear_acceleration.x,
-               v_imu.back()->linear_acceleration.y,
-               v_imu.back()->linear_acceleration.z;
+    angvel_avr = v_imu.back().gyr;
+    acc_avr = v_imu.back().acc;
     // 通过重力数值对加速度进行一下微调，等比缩放。
     acc_avr = acc_avr * G_m_s2 / mean_acc.norm();
     // 原始测量的中值作为系统输入
@@ -197,7 +188,7 @@ void ImuProcess::UndistortPcl(const MeasureGroup &meas,
 
     /* 反向传播，去畸变*/
     if (pcl_out.points.begin() == pcl_out.points.end()) {
-        neal::logger(neal::LOG_ERROR, "pcl_out begin == end...");
+        ASYNC_LOG(neal::LOG_ERROR, "pcl_out begin == end...");
         return;
     }
     auto it_kp = IMUpose.end() - 2;  // 指向最后第二个元素的迭代器
@@ -206,7 +197,7 @@ void ImuProcess::UndistortPcl(const MeasureGroup &meas,
         while (it_kp->offset_time > (it_pcl->curvature / 1000.0)) {
             it_kp --;
             if (it_kp < IMUpose.begin()) {
-                neal::logger(neal::LOG_ERROR, "imupose reaches the top left, should not happen!");
+                ASYNC_LOG(neal::LOG_ERROR, "imupose reaches the top left, should not happen!");
             }
         }
         auto head = it_kp;
@@ -249,11 +240,11 @@ void ImuProcess::UndistortPcl(const MeasureGroup &meas,
 void ImuProcess::Process(const MeasureGroup &meas, esekfom::esekf<state_ikfom, 12, input_ikfom> &kf_state, PointCloudXYZI::Ptr cur_pcl_un_) {
 
     if (meas.imu.empty() || meas.imu.size() < 5) {  // 当前帧的 IMU 测量为空，则直接返回
-        neal::logger(neal::LOG_WARN, "imu data is empty!");
+        ASYNC_LOG(neal::LOG_WARN, "imu data is empty!");
         return;
     }
     if (meas.lidar == nullptr || meas.lidar->size() < 5) {
-        neal::logger(neal::LOG_ERROR, "lidar pointer is null!");
+        ASYNC_LOG(neal::LOG_ERROR, "lidar pointer is null!");
         return;
     }
 
@@ -0,0 +1,115 @@
+#include "alloc_stats.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/resource.h>
+
+#if defined(ALLOC_STATS) && defined(__GLIBC__)
+
+static std::atomic<uint64_t> alloc_count(0);
+static std::atomic<uint64_t> alloc_bytes(0);
+// 平凡类型的 __thread 变量不需要构造，访问时不会调用 malloc
+static __thread uint64_t thread_count = 0;
+
+static inline void count_alloc(const size_t size) {
+
+    thread_count++;
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+// glibc 的实现，替换后的函数只计数再转发，free 不需要替换
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) {
+    count_alloc(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    count_alloc(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count_alloc(size);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    count_alloc(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    count_alloc(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    count_alloc(size);
+    void *p = __libc_memalign(alignment, size);
+    if (p == nullptr && size > 0) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+}
+
+bool alloc_stats_enabled() {
+
+    return true;
+}
+
+AllocCounts alloc_counts() {
+
+    AllocCounts c;
+    c.count = alloc_count.load(std::memory_order_relaxed);
+    c.bytes = alloc_bytes.load(std::memory_order_relaxed);
+    return c;
+}
+
+uint64_t thread_alloc_count() {
+
+    return thread_count;
+}
+
+#else
+
+bool alloc_stats_enabled() {
+
+    return false;
+}
+
+AllocCounts alloc_counts() {
+
+    AllocCounts c;
+    c.count = 0;
+    c.bytes = 0;
+    return c;
+}
+
+uint64_t thread_alloc_count() {
+
+    return 0;
+}
+
+#endif
+
+size_t peak_rss_kb() {
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return static_cast<size_t>(usage.ru_maxrss);  // Linux 上单位为 KB
+}
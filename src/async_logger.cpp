@@ -0,0 +1,197 @@
+#include "async_logger.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <file_logger.h>
+
+AsyncLogger async_logger;
+
+namespace {
+
+// 线程退出时标记本线程的队列，由后台线程取完后释放
+struct LocalRing {
+    std::shared_ptr<LogRing> ring;
+
+    ~LocalRing() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    };
+};
+
+thread_local LocalRing local;
+
+} // namespace
+
+AsyncLogger::AsyncLogger() : rate_burst(10), rate_period_ns(1000000000ULL), flush_period_ms(10),
+    running(false), pushing(0), num_dropped(0), num_suppressed(0), dropped_reported(0) {
+
+}
+
+void AsyncLogger::start() {
+
+    if (running.exchange(true)) {
+        return;
+    }
+    worker = std::thread(&AsyncLogger::run, this);
+}
+
+void AsyncLogger::stop() {
+
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx_wait);
+    }
+    cv_stop.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+    // push 可能在 running 变为 false 之前检查、在后台线程最后一次取事件之后才写入队列，
+    // 等这样的 push 写完，再在本线程取一次
+    while (pushing.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+    std::vector<LogEvent> events;
+    drain(events);
+    for (const LogEvent &ev : events) {
+        output(ev);
+    }
+}
+
+bool AsyncLogger::admit(LogSite &site, const uint64_t now, uint32_t &suppressed) {
+
+    // 窗口切换时的竞争最多多放过几条，不影响限流的效果
+    uint64_t start = site.window_start.load(std::memory_order_relaxed);
+    if (now - start >= rate_period_ns &&
+        site.window_start.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        site.window_count.store(0, std::memory_order_relaxed);
+    }
+    if (site.window_count.fetch_add(1, std::memory_order_relaxed) < static_cast<uint32_t>(rate_burst)) {
+        suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    num_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+LogRing *AsyncLogger::local_ring() {
+
+    if (!local.ring) {
+        local.ring = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> lock(mtx_rings);
+        rings.push_back(local.ring);
+    }
+    return local.ring.get();
+}
+
+void AsyncLogger::push(const LogEvent &ev) {
+
+    // 先登记再检查 running（都是 seq_cst），与 stop 中先清 running 再检查 pushing 配对：
+    // 要么这里看到 running 为 false，要么 stop 等这次写入完成后再取一次
+    pushing.fetch_add(1);
+    // 后台线程没有运行时同步输出
+    if (!running.load()) {
+        pushing.fetch_sub(1, std::memory_order_release);
+        output(ev);
+        return;
+    }
+    LogRing *ring = local_ring();
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_SIZE) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        num_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        ring->events[head & (LOG_RING_SIZE - 1)] = ev;
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+    pushing.fetch_sub(1, std::memory_order_release);
+}
+
+void AsyncLogger::drain(std::vector<LogEvent> &events) {
+
+    events.clear();
+    std::lock_guard<std::mutex> lock(mtx_rings);
+    for (auto iter = rings.begin(); iter != rings.end();) {
+        LogRing &ring = **iter;
+        // 先读 retired，保证之后读到的 head 包含线程退出前写入的所有事件
+        const bool retired = ring.retired.load(std::memory_order_acquire);
+        const uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        const uint64_t head = ring.head.load(std::memory_order_acquire);
+        for (uint64_t i = tail; i < head; i++) {
+            events.push_back(ring.events[i & (LOG_RING_SIZE - 1)]);
+        }
+        ring.tail.store(head, std::memory_order_release);
+        iter = retired ? rings.erase(iter) : iter + 1;
+    }
+    std::stable_sort(events.begin(), events.end(), [](const LogEvent &a, const LogEvent &b) {
+        return a.time_ns < b.time_ns;
+    });
+}
+
+void AsyncLogger::run() {
+
+    std::vector<LogEvent> events;
+    events.reserve(LOG_RING_SIZE);
+    bool stopping = false;
+    while (!stopping) {
+        {
+            std::unique_lock<std::mutex> lock(mtx_wait);
+            cv_stop.wait_for(lock, std::chrono::milliseconds(flush_period_ms), [this] {
+                return !running.load(std::memory_order_acquire);
+            });
+        }
+        stopping = !running.load(std::memory_order_acquire);
+        drain(events);
+        for (const LogEvent &ev : events) {
+            output(ev);
+        }
+        const uint64_t dropped = num_dropped.load(std::memory_order_relaxed);
+        if (dropped != dropped_reported) {
+            neal::logger(neal::LOG_WARN, "async logger queue full, dropped " +
+                std::to_string(dropped - dropped_reported) + " messages");
+            dropped_reported = dropped;
+        }
+    }
+}
+
+void AsyncLogger::output(const LogEvent &ev) {
+
+    neal::logger(ev.site->level, format(ev));
+}
+
+std::string AsyncLogger::format(const LogEvent &ev) {
+
+    std::string out;
+    const char *fmt = ev.site->fmt;
+    int arg = 0;
+    char buf[64];
+    for (const char *c = fmt; *c != '\0'; c++) {
+        if (c[0] == '{' && c[1] == '}' && arg < ev.num_args) {
+            switch (ev.types[arg]) {
+            case 'd':
+                snprintf(buf, sizeof(buf), "%f", ev.args[arg].d);
+                break;
+            case 'i':
+                snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(ev.args[arg].i));
+                break;
+            default:
+                snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(ev.args[arg].u));
+                break;
+            }
+            out += buf;
+            arg++;
+            c++;
+        }
+        else {
+            out += *c;
+        }
+    }
+    if (ev.suppressed > 0) {
+        out += " (suppressed " + std::to_string(ev.suppressed) + " similar messages)";
+    }
+    return out;
+}
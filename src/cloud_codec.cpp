@@ -0,0 +1,94 @@
+#include "cloud_codec.h"
+
+#include <zlib.h>
+
+CloudEncoder::CloudEncoder(const float resolution) {
+
+    set_resolution(resolution);
+    reset();
+}
+
+void CloudEncoder::reset() {
+
+    last[0] = last[1] = last[2] = 0;
+    coords.clear();
+    intensities.clear();
+}
+
+bool CloudEncoder::finish(std::vector<uint8_t> &out, const int level) {
+
+    // 坐标流后接反射率流
+    coords.insert(coords.end(), intensities.begin(), intensities.end());
+    const uint32_t raw_size = coords.size();
+
+    uLongf bound = compressBound(raw_size);
+    out.resize(5 + bound);
+    out[0] = CLOUD_CODEC_VERSION;
+    for (int i = 0; i < 4; i++) {
+        out[1 + i] = static_cast<uint8_t>(raw_size >> (8 * i));
+    }
+    if (compress2(out.data() + 5, &bound, coords.data(), raw_size, level) != Z_OK) {
+        out.clear();
+        return false;
+    }
+    out.resize(5 + bound);
+    // 恢复坐标流，允许继续添加点
+    coords.resize(raw_size - intensities.size());
+    return true;
+}
+
+bool decode_cloud(const uint8_t *data, const size_t size, const uint32_t num_points, const float resolution,
+    std::vector<CodecPoint> &out) {
+
+    out.clear();
+    if (size < 5 || data[0] != CLOUD_CODEC_VERSION) {
+        return false;
+    }
+    uint32_t raw_size = 0;
+    for (int i = 0; i < 4; i++) {
+        raw_size |= static_cast<uint32_t>(data[1 + i]) << (8 * i);
+    }
+    // 分配内存之前检查原始长度：每个点的三个坐标各占 1~5 字节，反射率 1 字节；
+    // deflate 的压缩率不超过 1032:1，原始长度也不会超过压缩数据长度的 1032 倍
+    const uint64_t points = num_points;
+    if (raw_size < 4 * points || raw_size > 16 * points || raw_size > 1032 * static_cast<uint64_t>(size - 5)) {
+        return false;
+    }
+    std::vector<uint8_t> raw(raw_size);
+    uLongf dest_size = raw_size;
+    if (raw_size > 0 && (uncompress(raw.data(), &dest_size, data + 5, size - 5) != Z_OK || dest_size != raw_size)) {
+        return false;
+    }
+
+    // 反射率流在最后 num_points 个字节
+    const uint8_t *p = raw.data();
+    const uint8_t *coord_end = raw.data() + raw_size - num_points;
+    const uint8_t *intensity = coord_end;
+    int32_t last[3] = {0, 0, 0};
+    out.resize(num_points);
+    for (uint32_t i = 0; i < num_points; i++) {
+        for (int j = 0; j < 3; j++) {
+            uint32_t v = 0;
+            int shift = 0;
+            while (true) {
+                if (p >= coord_end || shift > 28) {
+                    out.clear();
+                    return false;
+                }
+                const uint8_t b = *p++;
+                v |= static_cast<uint32_t>(b & 0x7f) << shift;
+                if (!(b & 0x80)) {
+                    break;
+                }
+                shift += 7;
+            }
+            // zigzag 解码
+            last[j] += static_cast<int32_t>((v >> 1) ^ (~(v & 1) + 1));
+        }
+        out[i].x = last[0] * resolution;
+        out[i].y = last[1] * resolution;
+        out[i].z = last[2] * resolution;
+        out[i].intensity = intensity[i];
+    }
+    return p == coord_end;
+}
@@ -0,0 +1,34 @@
+#include "cloud_pool.h"
+
+#include <atomic>
+
+PointCloudXYZI::Ptr CloudPool::acquire(const bool keep_points) {
+
+    const size_t n = clouds.size();
+    for (size_t k = 0; k < n; k++) {
+        const size_t i = (next + k) % n;
+        // 只有池持有时才能复用；其他线程释放时的写入在此之前可见
+        if (clouds[i].use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            next = (i + 1) % n;
+            if (!keep_points) {
+                clouds[i]->clear();
+            }
+            return clouds[i];
+        }
+    }
+    PointCloudXYZI::Ptr cloud(new PointCloudXYZI());
+    if (n < max_size) {
+        clouds.push_back(cloud);
+    }
+    return cloud;
+}
+
+size_t CloudPool::memory_bytes() const {
+
+    size_t bytes = clouds.capacity() * sizeof(PointCloudXYZI::Ptr);
+    for (const PointCloudXYZI::Ptr &cloud : clouds) {
+        bytes += sizeof(PointCloudXYZI) + cloud->points.capacity() * sizeof(PointType);
+    }
+    return bytes;
+}
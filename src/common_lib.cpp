@@ -1,5 +1,8 @@
 #include "common_lib.h"
 
+#include <limits>
+#include <algorithm>
+
 Pose6D set_pose6d(const double t, const Eigen::Matrix<double, 3, 1> &a, const Eigen::Matrix<double, 3, 1> &g,
     const Eigen::Matrix<double, 3, 1> &v, const Eigen::Matrix<double, 3, 1> &p, const Eigen::Matrix<double, 3, 3> &R) {
 
@@ -68,6 +71,50 @@ bool esti_plane(Eigen::Matrix<float, 4, 1> &pca_result, const PointVector &point
     return true;
 }
 
+// 21 位整数的每一位之间插入两个 0
+static inline uint64_t morton_spread(uint64_t v) {
+
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+}
+
+void morton_order(const PointVector &points, const float cell_size, std::vector<int> &order) {
+
+    const int n = points.size();
+    order.resize(n);
+    if (n == 0) {
+        return;
+    }
+    // 以包围盒最小角为原点，保证坐标非负
+    float min_x = std::numeric_limits<float>::max();
+    float min_y = min_x, min_z = min_x;
+    for (const PointType &p : points) {
+        min_x = std::min(min_x, p.x);
+        min_y = std::min(min_y, p.y);
+        min_z = std::min(min_z, p.z);
+    }
+    const float inv_size = 1.0f / cell_size;
+    // 每个线程复用一个缓冲区，容量保留
+    static thread_local std::vector<std::pair<uint64_t, int>> codes;
+    codes.resize(n);
+    for (int i = 0; i < n; i++) {
+        uint64_t x = static_cast<uint64_t>((points[i].x - min_x) * inv_size);
+        uint64_t y = static_cast<uint64_t>((points[i].y - min_y) * inv_size);
+        uint64_t z = static_cast<uint64_t>((points[i].z - min_z) * inv_size);
+        codes[i].first = morton_spread(x) | (morton_spread(y) << 1) | (morton_spread(z) << 2);
+        codes[i].second = i;
+    }
+    std::sort(codes.begin(), codes.end());
+    for (int i = 0; i < n; i++) {
+        order[i] = codes[i].second;
+    }
+}
+
 float calc_dist(PointType p1, PointType p2) {
 
     float d = (p1.x - p2.x) * (p1.x - p2.x) + (p1.y - p2.y) * (p1.y - p2.y) + (p1.z - p2.z) * (p1.z - p2.z);
@@ -0,0 +1,383 @@
+#include "compact_map.h"
+
+#include <algorithm>
+
+#define BLOCK_BITS (3)  // 一块 8x8x8 个 tile，一个区 8x8x8 个块
+
+// tile 索引所在的块（块索引所在的区），算术右移即向下取整
+static inline VoxelKey block_key(const VoxelKey &key) {
+
+    VoxelKey b = {key.x >> BLOCK_BITS, key.y >> BLOCK_BITS, key.z >> BLOCK_BITS};
+    return b;
+}
+
+// tile 在块内（块在区内）的局部索引
+static inline uint16_t local_index(const VoxelKey &key) {
+
+    const int32_t mask = (1 << BLOCK_BITS) - 1;
+    return static_cast<uint16_t>((key.x & mask) | ((key.y & mask) << BLOCK_BITS) | ((key.z & mask) << (2 * BLOCK_BITS)));
+}
+
+// local_index 的逆运算
+static inline VoxelKey child_key(const VoxelKey &parent, const uint16_t local) {
+
+    const int32_t mask = (1 << BLOCK_BITS) - 1;
+    VoxelKey key = {(parent.x << BLOCK_BITS) | (local & mask), (parent.y << BLOCK_BITS) | ((local >> BLOCK_BITS) & mask),
+        (parent.z << BLOCK_BITS) | ((local >> (2 * BLOCK_BITS)) & mask)};
+    return key;
+}
+
+// 按局部索引排序的数组（块内的 tile、区内的块）中查找
+template <typename Vec>
+static inline auto lower_local(Vec &entries, const uint16_t local) -> decltype(entries.begin()) {
+
+    return std::lower_bound(entries.begin(), entries.end(), local,
+        [](const typename Vec::value_type &e, const uint16_t l) {return e.local < l;});
+}
+
+// 区表按区索引排序
+template <typename Vec>
+static inline auto lower_chunk(Vec &chunks, const VoxelKey &key) -> decltype(chunks.begin()) {
+
+    return std::lower_bound(chunks.begin(), chunks.end(), key,
+        [](const typename Vec::value_type &e, const VoxelKey &k) {
+            return e.key.x != k.x ? e.key.x < k.x : (e.key.y != k.y ? e.key.y < k.y : e.key.z < k.z);
+        });
+}
+
+CompactMap::CompactMap()
+    : downsample_size(0.0f) {
+
+    set_tile_size(0.5f);
+}
+
+void CompactMap::set_tile_size(const float ts) {
+
+    tile_size = ts;
+    inv_tile_size = 1.0f / ts;
+    // 16 位偏移覆盖整个 tile
+    step = ts / 65535.0f;
+    inv_step = 65535.0f / ts;
+    clear();
+}
+
+void CompactMap::clear() {
+
+    // 版本号保持递增
+    std::shared_ptr<Snapshot> empty_map(new Snapshot());
+    empty_map->version_ = current ? current->version_ + 1 : 0;
+    empty_map->num_points = 0;
+    empty_map->num_tiles = 0;
+    empty_map->tile_size = tile_size;
+    empty_map->step = step;
+    current = empty_map;
+    std::atomic_store(&published, current);
+    pending.reset();
+}
+
+QuantizedPoint CompactMap::encode(const PointType &p, const VoxelKey &key) const {
+
+    QuantizedPoint q;
+    float ox = (p.x - key.x * tile_size) * inv_step + 0.5f;
+    float oy = (p.y - key.y * tile_size) * inv_step + 0.5f;
+    float oz = (p.z - key.z * tile_size) * inv_step + 0.5f;
+    // 浮点误差可能让偏移略微越界
+    q.x = static_cast<uint16_t>(std::min(std::max(ox, 0.0f), 65535.0f));
+    q.y = static_cast<uint16_t>(std::min(std::max(oy, 0.0f), 65535.0f));
+    q.z = static_cast<uint16_t>(std::min(std::max(oz, 0.0f), 65535.0f));
+    q.intensity = static_cast<uint8_t>(std::min(std::max(p.intensity, 0.0f), 255.0f));
+    q.reserved = 0;
+    return q;
+}
+
+void CompactMap::build(const PointVector &points) {
+
+    clear();
+    add_points(points, false);
+    publish();
+}
+
+void CompactMap::add_points(const PointVector &points, const bool downsample) {
+
+    if (points.empty()) {
+        return;
+    }
+    // 第一次修改时从当前版本复制顶层的区表，区、块和 tile 本身仍然共享
+    if (!pending) {
+        pending.reset(new Snapshot(*current));
+        pending->version_ = current->version_ + 1;
+    }
+    for (const PointType &p : points) {
+        add_point(p, downsample);
+    }
+}
+
+void CompactMap::publish() {
+
+    if (!pending) {
+        return;
+    }
+    current = pending;
+    pending.reset();
+    std::atomic_store(&published, current);
+}
+
+/* 拿到 pending 版本中可以修改的 tile，必要时复制区、块和 tile。
+只被 pending 引用（use_count 为 1）的区、块和 tile 是本版本新建的，其他线程不可见，可以直接修改。*/
+std::vector<QuantizedPoint> &CompactMap::writable_tile(const VoxelKey &key) {
+
+    const VoxelKey bkey = block_key(key);
+    const VoxelKey ckey = block_key(bkey);
+    ChunkTable &chunks = pending->chunks;
+    auto chunk_iter = lower_chunk(chunks, ckey);
+    if (chunk_iter == chunks.end() || !(chunk_iter->key == ckey)) {
+        ChunkEntry entry;
+        entry.key = ckey;
+        entry.chunk.reset(new Chunk());
+        chunk_iter = chunks.insert(chunk_iter, entry);
+    }
+    else if (chunk_iter->chunk.use_count() > 1) {
+        chunk_iter->chunk.reset(new Chunk(*chunk_iter->chunk));
+    }
+    Chunk &chunk = const_cast<Chunk &>(*chunk_iter->chunk);
+
+    const uint16_t block_local = local_index(bkey);
+    auto block_iter = lower_local(chunk.blocks, block_local);
+    if (block_iter == chunk.blocks.end() || block_iter->local != block_local) {
+        BlockEntry entry;
+        entry.local = block_local;
+        entry.block.reset(new Block());
+        block_iter = chunk.blocks.insert(block_iter, entry);
+    }
+    else if (block_iter->block.use_count() > 1) {
+        block_iter->block.reset(new Block(*block_iter->block));
+    }
+    Block &block = const_cast<Block &>(*block_iter->block);
+
+    const uint16_t local = local_index(key);
+    auto iter = lower_local(block.tiles, local);
+    if (iter == block.tiles.end() || iter->local != local) {
+        TileEntry entry;
+        entry.local = local;
+        entry.tile.reset(new Tile());
+        iter = block.tiles.insert(iter, entry);
+        pending->num_tiles ++;
+    }
+    else if (iter->tile.use_count() > 1) {
+        iter->tile.reset(new Tile(*iter->tile));
+    }
+    return const_cast<Tile &>(*iter->tile).points;
+}
+
+void CompactMap::add_point(const PointType &p, const bool downsample) {
+
+    VoxelKey key = voxel_key(p.x, p.y, p.z, inv_tile_size);
+    std::vector<QuantizedPoint> &tile_points = writable_tile(key);
+
+    if (downsample && downsample_size > 0.0f) {
+        // 降采样体素及其中心
+        float inv_ds = 1.0f / downsample_size;
+        VoxelKey ds_key = voxel_key(p.x, p.y, p.z, inv_ds);
+        PointType center;
+        center.x = (ds_key.x + 0.5f) * downsample_size;
+        center.y = (ds_key.y + 0.5f) * downsample_size;
+        center.z = (ds_key.z + 0.5f) * downsample_size;
+        float new_dist = calc_dist(p, center);
+        PointType old;
+        for (QuantizedPoint &q : tile_points) {
+            pending->decode(q, key, old);
+            if (voxel_key(old.x, old.y, old.z, inv_ds) == ds_key) {
+                // 体素内已有点，保留离中心更近的
+                if (new_dist < calc_dist(old, center)) {
+                    q = encode(p, key);
+                }
+                return;
+            }
+        }
+    }
+
+    tile_points.push_back(encode(p, key));
+    pending->num_points ++;
+}
+
+size_t CompactMap::Snapshot::memory_bytes() const {
+
+    // 只统计本版本可见的数据，与其他版本共享的部分也计算在内
+    size_t bytes = chunks.capacity() * sizeof(ChunkEntry);
+    for (const ChunkEntry &chunk : chunks) {
+        bytes += sizeof(Chunk) + chunk.chunk->blocks.capacity() * sizeof(BlockEntry);
+        for (const BlockEntry &block : chunk.chunk->blocks) {
+            bytes += sizeof(Block) + block.block->tiles.capacity() * sizeof(TileEntry);
+            for (const TileEntry &entry : block.block->tiles) {
+                bytes += sizeof(Tile) + entry.tile->points.capacity() * sizeof(QuantizedPoint);
+            }
+        }
+    }
+    return bytes;
+}
+
+const CompactMap::Tile *CompactMap::Snapshot::find_tile(const VoxelKey &key) const {
+
+    const VoxelKey bkey = block_key(key);
+    const VoxelKey ckey = block_key(bkey);
+    auto chunk_iter = lower_chunk(chunks, ckey);
+    if (chunk_iter == chunks.end() || !(chunk_iter->key == ckey)) {
+        return nullptr;
+    }
+    const std::vector<BlockEntry> &blocks = chunk_iter->chunk->blocks;
+    const uint16_t block_local = local_index(bkey);
+    auto block_iter = lower_local(blocks, block_local);
+    if (block_iter == blocks.end() || block_iter->local != block_local) {
+        return nullptr;
+    }
+    const std::vector<TileEntry> &tiles = block_iter->block->tiles;
+    const uint16_t local = local_index(key);
+    auto iter = lower_local(tiles, local);
+    if (iter == tiles.end() || iter->local != local) {
+        return nullptr;
+    }
+    return iter->tile.get();
+}
+
+const CompactMap::Tile *CompactMap::Snapshot::find_tile(const VoxelKey &key, TileCache &cache) const {
+
+    const int slot = VoxelKeyHash()(key) & (TileCache::SIZE - 1);
+    if (cache.valid[slot] && cache.keys[slot] == key) {
+        return cache.tiles[slot];
+    }
+    const Tile *tile = find_tile(key);
+    cache.keys[slot] = key;
+    cache.tiles[slot] = tile;
+    cache.valid[slot] = true;
+    return tile;
+}
+
+void CompactMap::Snapshot::decode(const QuantizedPoint &q, const VoxelKey &key, PointType &p) const {
+
+    p.x = key.x * tile_size + q.x * step;
+    p.y = key.y * tile_size + q.y * step;
+    p.z = key.z * tile_size + q.z * step;
+    p.intensity = q.intensity;
+}
+
+void CompactMap::Snapshot::nearest_search(const PointType &point, const int k, PointVector &nearest,
+    std::vector<float> &dist2, const float max_dist2) const {
+
+    search(point, k, nearest, dist2, max_dist2, nullptr);
+}
+
+void CompactMap::Snapshot::nearest_search_batch(const PointVector &points, const int k,
+    std::vector<PointVector> &nearest, std::vector<std::vector<float>> &dist2, const float max_dist2) const {
+
+    const int n = points.size();
+    // 只增不减，保留内层 vector 的容量
+    if (static_cast<int>(nearest.size()) < n) {
+        nearest.resize(n);
+    }
+    if (static_cast<int>(dist2.size()) < n) {
+        dist2.resize(n);
+    }
+    static thread_local std::vector<int> order;  // 每个线程复用，容量保留
+    morton_order(points, tile_size, order);
+
+    TileCache cache;
+    std::fill(cache.valid, cache.valid + TileCache::SIZE, false);
+    for (int i : order) {
+        search(points[i], k, nearest[i], dist2[i], max_dist2, &cache);
+    }
+}
+
+void CompactMap::Snapshot::search(const PointType &point, const int k, PointVector &nearest,
+    std::vector<float> &dist2, const float max_dist2, TileCache *cache) const {
+
+    nearest.clear();
+    dist2.clear();
+    if (num_points == 0 || k <= 0) {
+        return;
+    }
+
+    const float inv_tile_size = 1.0f / tile_size;
+    const VoxelKey center = voxel_key(point.x, point.y, point.z, inv_tile_size);
+    const int max_shell = static_cast<int>(std::ceil(std::sqrt(max_dist2) * inv_tile_size));
+    PointType decoded;
+
+    // 由内向外逐层（切比雪夫距离为 shell）访问 tile
+    for (int shell = 0; shell <= max_shell; shell++) {
+        for (int dx = -shell; dx <= shell; dx++) {
+            for (int dy = -shell; dy <= shell; dy++) {
+                for (int dz = -shell; dz <= shell; dz++) {
+                    if (std::max(std::abs(dx), std::max(std::abs(dy), std::abs(dz))) != shell) {
+                        continue;
+                    }
+                    VoxelKey key = {center.x + dx, center.y + dy, center.z + dz};
+
+                    // tile 包围盒到查询点的最近距离超过当前上界，跳过
+                    float bound = static_cast<int>(dist2.size()) == k ? dist2.back() : max_dist2;
+                    float bx = std::max(0.0f, std::max(key.x * tile_size - point.x, point.x - (key.x + 1) * tile_size));
+                    float by = std::max(0.0f, std::max(key.y * tile_size - point.y, point.y - (key.y + 1) * tile_size));
+                    float bz = std::max(0.0f, std::max(key.z * tile_size - point.z, point.z - (key.z + 1) * tile_size));
+                    if (bx * bx + by * by + bz * bz > bound) {
+                        continue;
+                    }
+                    const Tile *tile = cache ? find_tile(key, *cache) : find_tile(key);
+                    if (tile == nullptr) {
+                        continue;
+                    }
+
+                    for (const QuantizedPoint &q : tile->points) {
+                        decode(q, key, decoded);
+                        float d = calc_dist(decoded, point);
+                        if (d > max_dist2) {
+                            continue;
+                        }
+                        // 插入排序，保持升序
+                        if (static_cast<int>(dist2.size()) < k) {
+                            nearest.push_back(decoded);
+                            dist2.push_back(d);
+                        }
+                        else if (d < dist2.back()) {
+                            nearest.back() = decoded;
+                            dist2.back() = d;
+                        }
+                        else {
+                            continue;
+                        }
+                        for (int j = static_cast<int>(dist2.size()) - 1; j > 0 && dist2[j] < dist2[j - 1]; j--) {
+                            std::swap(dist2[j], dist2[j - 1]);
+                            std::swap(nearest[j], nearest[j - 1]);
+                        }
+                    }
+                }
+            }
+        }
+
+        // 已访问立方体之外的点，到查询点的距离下界
+        float lower = std::min(
+            std::min(std::min(point.x - (center.x - shell) * tile_size, (center.x + shell + 1) * tile_size - point.x),
+                     std::min(point.y - (center.y - shell) * tile_size, (center.y + shell + 1) * tile_size - point.y)),
+            std::min(point.z - (center.z - shell) * tile_size, (center.z + shell + 1) * tile_size - point.z));
+        float bound = static_cast<int>(dist2.size()) == k ? dist2.back() : max_dist2;
+        if (lower * lower >= bound) {
+            break;
+        }
+    }
+}
+
+void CompactMap::Snapshot::get_points(PointVector &out) const {
+
+    out.clear();
+    out.reserve(num_points);
+    PointType p;
+    for (const ChunkEntry &chunk : chunks) {
+        for (const BlockEntry &block : chunk.chunk->blocks) {
+            const VoxelKey bkey = child_key(chunk.key, block.local);
+            for (const TileEntry &entry : block.block->tiles) {
+                const VoxelKey key = child_key(bkey, entry.local);
+                for (const QuantizedPoint &q : entry.tile->points) {
+                    decode(q, key, p);
+                    out.push_back(p);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,358 @@
+#include "esdf_map.h"
+
+#include <cmath>
+#include <algorithm>
+
+// 6 邻域
+static const int NEIGHBORS[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+
+// 体素所在的块（块所在的区），算术右移即向下取整
+static inline VoxelKey block_of(const VoxelKey &voxel) {
+
+    VoxelKey b = {voxel.x >> ESDF_BLOCK_BITS, voxel.y >> ESDF_BLOCK_BITS, voxel.z >> ESDF_BLOCK_BITS};
+    return b;
+}
+
+// 体素在块内（块在区内）的索引，x + 8y + 64z
+static inline int local_index(const VoxelKey &voxel) {
+
+    const int32_t mask = ESDF_BLOCK_SIZE - 1;
+    return (voxel.x & mask) | ((voxel.y & mask) << ESDF_BLOCK_BITS) | ((voxel.z & mask) << (2 * ESDF_BLOCK_BITS));
+}
+
+// 区内按局部索引排序的块
+template <typename Vec>
+static inline auto lower_local(Vec &blocks, const uint16_t local) -> decltype(blocks.begin()) {
+
+    return std::lower_bound(blocks.begin(), blocks.end(), local,
+        [](const typename Vec::value_type &e, const uint16_t l) {return e.local < l;});
+}
+
+// 区表按区索引排序
+template <typename Vec>
+static inline auto lower_chunk(Vec &chunks, const VoxelKey &key) -> decltype(chunks.begin()) {
+
+    return std::lower_bound(chunks.begin(), chunks.end(), key,
+        [](const typename Vec::value_type &e, const VoxelKey &k) {
+            return e.key.x != k.x ? e.key.x < k.x : (e.key.y != k.y ? e.key.y < k.y : e.key.z < k.z);
+        });
+}
+
+EsdfMap::EsdfMap()
+    : max_updates(100000), publish_updates(10), publish_period(0.5), updates_since_publish(0) {
+
+    resolution = 0.1f;
+    set_max_distance(2.0f);
+}
+
+void EsdfMap::set_resolution(const float res) {
+
+    resolution = res;
+    set_max_distance(max_distance);
+}
+
+void EsdfMap::set_max_distance(const float dist) {
+
+    max_voxels = std::min(std::max(1, static_cast<int>(std::ceil(dist / resolution))), ESDF_MAX_VOXELS);
+    max_distance = max_voxels * resolution;
+    max_dist2 = max_voxels * max_voxels;
+    clear();
+}
+
+void EsdfMap::clear() {
+
+    // 版本号保持递增
+    std::shared_ptr<Snapshot> empty_map(new Snapshot());
+    empty_map->version_ = current ? current->version_ + 1 : 0;
+    empty_map->num_blocks_ = 0;
+    empty_map->complete = true;
+    empty_map->resolution = resolution;
+    empty_map->max_distance = max_distance;
+    current = empty_map;
+    std::atomic_store(&published, current);
+    pending.reset();
+    queue = decltype(queue)();
+    updates_since_publish = 0;
+    last_publish = std::chrono::steady_clock::now();
+}
+
+void EsdfMap::publish() {
+
+    pending->complete = queue.empty();
+    current = pending;
+    pending.reset();
+    std::atomic_store(&published, current);
+    updates_since_publish = 0;
+    last_publish = std::chrono::steady_clock::now();
+}
+
+size_t EsdfMap::memory_bytes() const {
+
+    size_t bytes = current->chunks.capacity() * sizeof(ChunkEntry);
+    for (const ChunkEntry &chunk : current->chunks) {
+        bytes += sizeof(Chunk) + chunk.chunk->blocks.capacity() * sizeof(BlockEntry);
+    }
+    return bytes + current->num_blocks_ * sizeof(Block);
+}
+
+/* 拿到 pending 版本中可以修改的体素，必要时复制区和块。
+只被 pending 引用（use_count 为 1）的区和块是本版本新建的，其他线程不可见，可以直接修改。
+create 为 false 时不存在的块返回 nullptr。*/
+EsdfMap::Voxel *EsdfMap::writable_voxel(const VoxelKey &voxel, const bool create) {
+
+    const VoxelKey bk = block_of(voxel);
+    const int slot = VoxelKeyHash()(bk) & (CACHE_SIZE - 1);
+    if (cached_blocks[slot] != nullptr && cached_keys[slot] == bk) {
+        return &cached_blocks[slot]->voxels[local_index(voxel)];
+    }
+
+    const VoxelKey ck = block_of(bk);
+    ChunkTable &chunks = pending->chunks;
+    auto chunk_iter = lower_chunk(chunks, ck);
+    const bool chunk_found = chunk_iter != chunks.end() && chunk_iter->key == ck;
+    if (!chunk_found && !create) {
+        return nullptr;
+    }
+    const uint16_t local = local_index(bk);
+    if (chunk_found) {
+        // 区中没有这个块时不复制区
+        const std::vector<BlockEntry> &blocks = chunk_iter->chunk->blocks;
+        auto found = lower_local(blocks, local);
+        if (!create && (found == blocks.end() || found->local != local)) {
+            return nullptr;
+        }
+        if (chunk_iter->chunk.use_count() > 1) {
+            chunk_iter->chunk.reset(new Chunk(*chunk_iter->chunk));
+        }
+    }
+    else {
+        ChunkEntry entry;
+        entry.key = ck;
+        entry.chunk.reset(new Chunk());
+        chunk_iter = chunks.insert(chunk_iter, entry);
+    }
+    std::vector<BlockEntry> &blocks = const_cast<Chunk &>(*chunk_iter->chunk).blocks;
+    auto iter = lower_local(blocks, local);
+    if (iter == blocks.end() || iter->local != local) {
+        std::shared_ptr<Block> block(new Block());
+        for (Voxel &v : block->voxels) {
+            v.dist2 = ESDF_FAR;
+            v.offset[0] = v.offset[1] = v.offset[2] = 0;
+            v.raise = 0;
+        }
+        BlockEntry entry;
+        entry.local = local;
+        entry.block = block;
+        iter = blocks.insert(iter, entry);
+        pending->num_blocks_++;
+    }
+    else if (iter->block.use_count() > 1) {
+        iter->block.reset(new Block(*iter->block));
+    }
+    Block *block = const_cast<Block *>(iter->block.get());
+    cached_keys[slot] = bk;
+    cached_blocks[slot] = block;
+    return &block->voxels[local_index(voxel)];
+}
+
+bool EsdfMap::is_obstacle(const VoxelKey &voxel) {
+
+    const Voxel *v = writable_voxel(voxel, false);
+    return v != nullptr && v->dist2 == 0;
+}
+
+void EsdfMap::push(const uint32_t dist2, const VoxelKey &voxel) {
+
+    QueueEntry entry;
+    entry.dist2 = dist2;
+    entry.voxel = voxel;
+    queue.push(entry);
+}
+
+size_t EsdfMap::update(const std::vector<VoxelKey> &occupied, const std::vector<VoxelKey> &freed) {
+
+    // 第一次修改时从当前版本复制顶层的区表，区和块本身仍然共享
+    if (!pending) {
+        pending.reset(new Snapshot(*current));
+        pending->version_ = current->version_ + 1;
+    }
+    std::fill(cached_blocks, cached_blocks + CACHE_SIZE, nullptr);
+
+    for (const VoxelKey &voxel : occupied) {
+        Voxel *v = writable_voxel(voxel, true);
+        if (v->dist2 != 0 || v->raise) {
+            v->dist2 = 0;
+            v->offset[0] = v->offset[1] = v->offset[2] = 0;
+            v->raise = 0;
+            push(0, voxel);
+        }
+    }
+    for (const VoxelKey &voxel : freed) {
+        Voxel *v = writable_voxel(voxel, false);
+        if (v != nullptr && v->dist2 == 0) {
+            v->dist2 = ESDF_FAR;
+            v->raise = 1;
+            push(0, voxel);
+        }
+    }
+
+    size_t n = 0;
+    while (!queue.empty() && n < max_updates) {
+        const QueueEntry entry = queue.top();
+        queue.pop();
+        n++;
+        const Voxel *v = writable_voxel(entry.voxel, false);
+        if (v == nullptr) {
+            continue;
+        }
+        if (v->raise) {
+            raise(entry.voxel);
+        }
+        // 距离已经被更新过的是过期的队列项
+        else if (v->dist2 == entry.dist2 && v->dist2 != ESDF_FAR) {
+            VoxelKey obstacle = {entry.voxel.x + v->offset[0], entry.voxel.y + v->offset[1], entry.voxel.z + v->offset[2]};
+            if (is_obstacle(obstacle)) {
+                lower(entry.voxel);
+            }
+        }
+    }
+
+    // 波前处理完就发布；没处理完时按次数和时间限制发布的间隔，快照不会一直停在旧版本
+    updates_since_publish++;
+    if (queue.empty() || (publish_updates > 0 && updates_since_publish >= publish_updates) ||
+        (publish_period > 0.0 &&
+         std::chrono::duration<double>(std::chrono::steady_clock::now() - last_publish).count() >= publish_period)) {
+        publish();
+    }
+    return n;
+}
+
+// 最近障碍物已经不存在的邻居加入 raise 波，其他邻居作为边界重新 lower
+void EsdfMap::raise(const VoxelKey &voxel) {
+
+    for (int i = 0; i < 6; i++) {
+        VoxelKey nk = {voxel.x + NEIGHBORS[i][0], voxel.y + NEIGHBORS[i][1], voxel.z + NEIGHBORS[i][2]};
+        Voxel *n = writable_voxel(nk, false);
+        if (n == nullptr || n->raise || n->dist2 == ESDF_FAR) {
+            continue;
+        }
+        VoxelKey obstacle = {nk.x + n->offset[0], nk.y + n->offset[1], nk.z + n->offset[2]};
+        if (!is_obstacle(obstacle)) {
+            const uint32_t old_dist2 = n->dist2;
+            n->dist2 = ESDF_FAR;
+            n->raise = 1;
+            push(old_dist2, nk);
+        }
+        else {
+            push(n->dist2, nk);
+        }
+    }
+    writable_voxel(voxel, false)->raise = 0;
+}
+
+// 用本体素的最近障碍物更新邻居
+void EsdfMap::lower(const VoxelKey &voxel) {
+
+    const Voxel *v = writable_voxel(voxel, false);
+    const VoxelKey obstacle = {voxel.x + v->offset[0], voxel.y + v->offset[1], voxel.z + v->offset[2]};
+    for (int i = 0; i < 6; i++) {
+        VoxelKey nk = {voxel.x + NEIGHBORS[i][0], voxel.y + NEIGHBORS[i][1], voxel.z + NEIGHBORS[i][2]};
+        const int32_t dx = obstacle.x - nk.x, dy = obstacle.y - nk.y, dz = obstacle.z - nk.z;
+        const uint32_t dist2 = dx * dx + dy * dy + dz * dz;
+        if (dist2 >= max_dist2) {
+            continue;
+        }
+        Voxel *n = writable_voxel(nk, true);
+        if (n->raise || dist2 >= n->dist2) {
+            continue;
+        }
+        n->dist2 = dist2;
+        n->offset[0] = dx;
+        n->offset[1] = dy;
+        n->offset[2] = dz;
+        push(dist2, nk);
+    }
+}
+
+const EsdfMap::Voxel *EsdfMap::Snapshot::find_voxel(const VoxelKey &voxel) const {
+
+    const VoxelKey bk = block_of(voxel);
+    const VoxelKey ck = block_of(bk);
+    auto chunk_iter = lower_chunk(chunks, ck);
+    if (chunk_iter == chunks.end() || !(chunk_iter->key == ck)) {
+        return nullptr;
+    }
+    const std::vector<BlockEntry> &blocks = chunk_iter->chunk->blocks;
+    const uint16_t local = local_index(bk);
+    auto iter = lower_local(blocks, local);
+    if (iter == blocks.end() || iter->local != local) {
+        return nullptr;
+    }
+    return &iter->block->voxels[local_index(voxel)];
+}
+
+float EsdfMap::Snapshot::voxel_distance(const VoxelKey &voxel) const {
+
+    const Voxel *v = find_voxel(voxel);
+    if (v == nullptr || v->dist2 == ESDF_FAR) {
+        return max_distance;
+    }
+    return std::min(std::sqrt(static_cast<float>(v->dist2)) * resolution, max_distance);
+}
+
+float EsdfMap::Snapshot::distance(const V3D &p) const {
+
+    V3D gradient;
+    return distance(p, gradient);
+}
+
+float EsdfMap::Snapshot::distance(const V3D &p, V3D &gradient) const {
+
+    // 以体素中心为格点三线性插值
+    const V3D u = p / resolution - V3D(0.5, 0.5, 0.5);
+    const VoxelKey base = {static_cast<int32_t>(std::floor(u(0))), static_cast<int32_t>(std::floor(u(1))),
+        static_cast<int32_t>(std::floor(u(2)))};
+    const V3D f = u - V3D(base.x, base.y, base.z);
+
+    float c[2][2][2];
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            for (int k = 0; k < 2; k++) {
+                VoxelKey v = {base.x + i, base.y + j, base.z + k};
+                c[i][j][k] = voxel_distance(v);
+            }
+        }
+    }
+    double d = 0.0;
+    gradient.setZero();
+    for (int i = 0; i < 2; i++) {
+        const double wx = i ? f(0) : 1.0 - f(0);
+        for (int j = 0; j < 2; j++) {
+            const double wy = j ? f(1) : 1.0 - f(1);
+            for (int k = 0; k < 2; k++) {
+                const double wz = k ? f(2) : 1.0 - f(2);
+                d += wx * wy * wz * c[i][j][k];
+            }
+        }
+    }
+    for (int j = 0; j < 2; j++) {
+        for (int k = 0; k < 2; k++) {
+            const double wy = j ? f(1) : 1.0 - f(1), wz = k ? f(2) : 1.0 - f(2);
+            gradient(0) += wy * wz * (c[1][j][k] - c[0][j][k]);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        for (int k = 0; k < 2; k++) {
+            const double wx = i ? f(0) : 1.0 - f(0), wz = k ? f(2) : 1.0 - f(2);
+            gradient(1) += wx * wz * (c[i][1][k] - c[i][0][k]);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            const double wx = i ? f(0) : 1.0 - f(0), wy = j ? f(1) : 1.0 - f(1);
+            gradient(2) += wx * wy * (c[i][j][1] - c[i][j][0]);
+        }
+    }
+    gradient /= resolution;
+    return static_cast<float>(d);
+}
@@ -0,0 +1,236 @@
+#include "flight_recorder.h"
+
+#include <cmath>
+#include <cstdio>
+#include <file_logger.h>
+
+#include "sensor_log.h"
+
+FlightRecorder::FlightRecorder() : window(5.0), post_time(1.0), cooldown(10.0), max_dumps(10),
+    pre_filter_num(1), pre_scan_line(1), pre_reflect_thresh(10), pre_blind(0.0),
+    entry_head(0), entry_count(0), state_head(0), state_count(0), latest_time(0.0),
+    pending(false), pending_time(0.0), last_dump_time(-1e30), num_dumps(0),
+    running(false), stopped(false), num_written(0), num_ignored(0) {
+
+    set_window(window);
+}
+
+void FlightRecorder::set_window(const double seconds, const double max_rate, const double max_lidar_rate) {
+
+    window = seconds;
+    entries.assign(static_cast<size_t>(std::ceil(seconds * max_rate)) + 1, FlightEntry());
+    // 滤波状态每帧一个
+    states.resize(static_cast<size_t>(std::ceil(seconds * max_lidar_rate)) + 1);
+    entry_head = entry_count = 0;
+    state_head = state_count = 0;
+}
+
+void FlightRecorder::start(const std::string &dir) {
+
+    if (running) {
+        return;
+    }
+    out_dir = dir;
+    running = true;
+    stopped = false;
+    worker = std::thread(&FlightRecorder::run, this);
+}
+
+void FlightRecorder::stop() {
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!running) {
+            return;
+        }
+        // 退出时数据不会再增加，等待中的记录直接写出
+        if (pending) {
+            check_pending(pending_time + post_time);
+        }
+        running = false;
+        stopped = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void FlightRecorder::push_entry(const double time, FlightEntry &&entry) {
+
+    const size_t cap = entries.size();
+    latest_time = std::max(latest_time, time);
+    // 超出时间窗口的数据释放掉
+    while (entry_count > 0 && entries[entry_head].time < latest_time - window) {
+        entries[entry_head] = FlightEntry();
+        entry_head = (entry_head + 1) % cap;
+        entry_count--;
+    }
+    // 缓存满时覆盖最旧的
+    if (entry_count == cap) {
+        entry_head = (entry_head + 1) % cap;
+        entry_count--;
+    }
+    entries[(entry_head + entry_count) % cap] = std::move(entry);
+    entry_count++;
+}
+
+void FlightRecorder::add_scan(const double time, const PointCloudXYZI::Ptr &scan) {
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!running) {
+        return;
+    }
+    FlightEntry entry;
+    entry.time = time;
+    entry.scan = scan;
+    push_entry(time, std::move(entry));
+    check_pending(time);
+}
+
+void FlightRecorder::add_imu(const ImuSample &imu) {
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!running) {
+        return;
+    }
+    FlightEntry entry;
+    entry.time = imu.time;
+    entry.imu = imu;
+    push_entry(imu.time, std::move(entry));
+}
+
+void FlightRecorder::add_state(const double time, const state_ikfom &x,
+    const esekfom::esekf<state_ikfom, 12, input_ikfom>::cov &P, const int effective, const int iterations) {
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!running) {
+        return;
+    }
+    const size_t cap = states.size();
+    while (state_count > 0 && states[state_head].time < time - window) {
+        state_head = (state_head + 1) % cap;
+        state_count--;
+    }
+    if (state_count == cap) {
+        state_head = (state_head + 1) % cap;
+        state_count--;
+    }
+    FlightState &s = states[(state_head + state_count) % cap];
+    s.time = time;
+    s.x = x;
+    s.P = P;
+    s.effective = effective;
+    s.iterations = iterations;
+    state_count++;
+    check_pending(time);
+}
+
+void FlightRecorder::trigger(const char *reason, const double time) {
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!running || pending) {
+        return;
+    }
+    if (num_dumps >= max_dumps || std::fabs(time - last_dump_time) < cooldown) {
+        num_ignored++;
+        return;
+    }
+    pending = true;
+    pending_reason = reason;
+    pending_time = time;
+}
+
+// 调用时已经持有 mtx
+void FlightRecorder::check_pending(const double time) {
+
+    if (!pending || time < pending_time + post_time) {
+        return;
+    }
+    pending = false;
+    last_dump_time = pending_time;
+
+    // 只复制指针，写文件在后台线程中完成
+    Dump dump;
+    dump.index = num_dumps++;
+    dump.reason = pending_reason;
+    dump.trigger_time = pending_time;
+    dump.entries.reserve(entry_count);
+    for (size_t i = 0; i < entry_count; i++) {
+        dump.entries.push_back(entries[(entry_head + i) % entries.size()]);
+    }
+    dump.states.reserve(state_count);
+    for (size_t i = 0; i < state_count; i++) {
+        dump.states.push_back(states[(state_head + i) % states.size()]);
+    }
+    dumps.push_back(std::move(dump));
+    cv.notify_one();
+}
+
+void FlightRecorder::run() {
+
+    while (true) {
+        Dump dump;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] {return stopped || !dumps.empty();});
+            if (dumps.empty()) {
+                break;
+            }
+            dump = std::move(dumps.front());
+            dumps.pop_front();
+        }
+        write(dump);
+    }
+}
+
+void FlightRecorder::write(const Dump &dump) {
+
+    const std::string base = out_dir + "flight_" + std::to_string(dump.index) + "_" + dump.reason;
+
+    /* 传感器数据，按到达顺序写入。*/
+    SensorLogWriter writer;
+    writer.set_preprocess(pre_filter_num, pre_scan_line, pre_reflect_thresh, pre_blind);
+    if (!writer.open(base + ".lsr")) {
+        return;
+    }
+    for (const FlightEntry &e : dump.entries) {
+        if (e.scan != nullptr) {
+            writer.add_scan(e.time, *e.scan);
+        }
+        else {
+            writer.add_imu(e.time, e.imu.acc, e.imu.gyr);
+        }
+    }
+    const size_t num_scans = writer.scans_written();
+    const size_t num_imu = writer.imu_written();
+    writer.close();
+
+    /* 滤波状态，协方差按行展开。*/
+    FILE *fp = fopen((base + "_states.txt").c_str(), "w");
+    if (fp == nullptr) {
+        neal::logger(neal::LOG_ERROR, "cannot open " + base + "_states.txt");
+        return;
+    }
+    fprintf(fp, "# trigger: %s at %.6f\n", dump.reason.c_str(), dump.trigger_time);
+    fprintf(fp, "# time x y z qx qy qz qw vx vy vz bgx bgy bgz bax bay baz gx gy gz effective iterations P(%d x %d)\n",
+        state_ikfom::DOF, state_ikfom::DOF);
+    for (const FlightState &s : dump.states) {
+        const state_ikfom &x = s.x;
+        fprintf(fp, "%.6f %.6f %.6f %.6f %.9f %.9f %.9f %.9f %.6f %.6f %.6f %.9f %.9f %.9f %.9f %.9f %.9f %.6f %.6f %.6f %d %d",
+            s.time, x.pos(0), x.pos(1), x.pos(2), x.rot.coeffs()[0], x.rot.coeffs()[1], x.rot.coeffs()[2],
+            x.rot.coeffs()[3], x.vel(0), x.vel(1), x.vel(2), x.bg(0), x.bg(1), x.bg(2), x.ba(0), x.ba(1), x.ba(2),
+            x.grav[0], x.grav[1], x.grav[2], s.effective, s.iterations);
+        for (int r = 0; r < s.P.rows(); r++) {
+            for (int c = 0; c < s.P.cols(); c++) {
+                fprintf(fp, " %.6e", s.P(r, c));
+            }
+        }
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+    num_written++;
+    neal::logger(neal::LOG_WARN, "flight recorder: " + dump.reason + " at " + std::to_string(dump.trigger_time) +
+        ", saved " + std::to_string(num_scans) + " scans, " + std::to_string(num_imu) + " imu, " +
+        std::to_string(dump.states.size()) + " states to " + base + ".lsr");
+}
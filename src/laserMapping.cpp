@@ -4,17 +4,24 @@
 #include <deque>
 #include <string>
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include <Eigen/Core>
 #include <condition_variable>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/io/ply_io.h>
 #include <pcl_conversions/pcl_conversions.h>
 #include <ros/ros.h>
 #include <nav_msgs/Path.h>
 #include <nav_msgs/Odometry.h>
+#include <nav_msgs/OccupancyGrid.h>
 #include <sensor_msgs/PointCloud2.h>
-#include <geometry_msgs/Quaternion.h>
 #include <tf/transform_broadcaster.h>
+#include <lio/CompressedCloud.h>
+#include <lio/OccupancyBlocks.h>
+#include <lio/QueryDistance.h>
+#include <visualization_msgs/MarkerArray.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
 #include <ikd_Tree.h>
 #include <file_logger.h>
 
@@ -22,6 +29,21 @@
 #include "IMU_Processing.h"
 #include "preprocess.h"
 #include "use-ikfom.h"
+#include "map_io.h"
+#include "lidar_map.h"
+#include "scan_writer.h"
+#include "publish_stage.h"
+#include "point_transform.h"
+#include "occupancy_grid.h"
+#include "esdf_map.h"
+#include "tsdf_map.h"
+#include "latency_stats.h"
+#include "async_logger.h"
+#include "sensor_log.h"
+#include "alloc_stats.h"
+#include "voxel_filter.h"
+#include "flight_recorder.h"
+#include "cloud_pool.h"
 
 // #define _MOV_THRESHOLD   (1.5)  // 当前雷达系中心到各个地图边缘的权重
 #define _LASER_POINT_COV (0.001)
@@ -29,16 +51,95 @@
 
 // 是否发布里程计，是否发布轨迹
 bool pub_odometry_en = false, pub_path_en = false;
+// 每隔多少个位姿向 /path 添加一个，/path 最多保留的位姿数；是否把完整轨迹写入 PCD/trajectory.txt
+int path_step = 10, path_max_poses = 1000;
+bool traj_save_en = false;
+// 发布压缩点云 /cloud_compressed（远程监控），坐标量化步长
+bool compressed_pub_en = false;
+double compressed_resolution = 0.01;
 // 发布当前正在扫描的点云数据，将点云地图保存到 PCD 文件
 bool scan_pub_en = false, pcd_save_en = false;
 // 发布经过运动畸变校正注册到 IMU 坐标系的点云数据
 bool dense_pub_en = false;
+// 后台线程把每帧点云（ground 系）写入 PCD/scans.lim，队列长度（帧）和刷新周期（秒）
+int pcd_save_queue_size = 100;
+double pcd_save_flush_period = 1.0;
+// 保存点云的体素去重分辨率（与 filter_size_map 无关），<= 0 表示保存原始点云；体素最少命中次数；检查点周期（秒）
+double pcd_save_voxel_size = 0.0;
+int pcd_save_min_hits = 1;
+double pcd_save_checkpoint_period = 30.0;
+ScanStreamWriter scan_writer;
+// 后台线程按周期发布整张地图（需要 compact_map_en）
+bool map_pub_en = false;
+double map_pub_period = 1.0;
 // 立方体长度，当前雷达系中心到各个地图边缘的距离
 // float cube_len = 0.0;
 // float det_range = 0.0;
 // 地图的最小分辨率
 double filter_size_map_min = 0.0;
 double filter_size_surf_min = 0.0;  // 非常重要的一个参数，取 0.5，太小会导致崩溃
+// 先验地图（.lim 文件），启动时用来初始化地图
+std::string prior_map_file;
+// 是否把加入地图的点增量写入 .lim 文件，以及 tile 边长
+bool map_save_en = false;
+double map_tile_size = 10.0;
+TiledMapWriter map_writer;
+// 是否用量化存储的 CompactMap 代替 ikd-Tree，以及 CompactMap 的 tile 边长
+bool compact_map_en = false;
+double compact_tile_size = 0.5;
+// 占据栅格（ground 系）：分辨率，二维投影的高度范围（ground 系 z），二维栅格的发布周期
+bool occupancy_en = false;
+double occupancy_resolution = 0.1;
+double occupancy_min_z = -0.5, occupancy_max_z = 1.0;
+double occupancy_2d_period = 1.0;
+double occupancy_max_range = 30.0;
+int occupancy_threads = 2;
+// 在占据栅格上增量维护 ESDF：最大距离，每帧最多处理的体素数（更新时间的上界），波前未处理完时快照的最长发布间隔（帧数，秒）
+bool esdf_en = false;
+double esdf_max_distance = 2.0;
+int esdf_max_updates = 100000;
+int esdf_publish_updates = 10;
+double esdf_publish_period = 0.5;
+EsdfMap esdf_map;
+// TSDF 表面重建（ground 系）：体素边长，截断距离，最大距离，网格发布周期，结束时是否保存 PCD/mesh.ply
+bool tsdf_en = false, tsdf_save_en = false;
+double tsdf_voxel_size = 0.05, tsdf_truncation = 0.15, tsdf_max_range = 10.0;
+double tsdf_mesh_period = 2.0;
+int tsdf_queue_size = 5;
+// 平面提取（world 系）：体素边长，平面体素和 patch 的最大残差，法向量最大夹角（度），patch 最大尺寸，
+// 平面体素的最少点数，每个体素保留的吸收点数，结束时是否保存 PCD/planes.txt 和 PCD/plane_residual.lim
+bool plane_map_en = false, plane_save_en = false;
+double plane_voxel_size = 0.5, plane_max_rms = 0.02, plane_max_angle = 10.0, plane_max_extent = 5.0;
+int plane_min_points = 10, plane_max_kept = 10;
+// 各阶段延迟统计（需要编译选项 LATENCY_STATS）：发布到 /diagnostics 的周期（秒），结束时是否写入 PCD/latency.csv
+bool latency_en = true, latency_save_en = false;
+double latency_pub_period = 1.0;
+// 异步日志：热路径中的警告写入线程本地队列，后台线程每 log_flush_period 毫秒输出一次；
+// 每个调用点每 log_rate_period 秒最多输出 log_rate_burst 条
+bool log_async_en = true;
+int log_flush_period = 10, log_rate_burst = 10;
+double log_rate_period = 1.0;
+// 离线回放：bag 文件不为空时直接读取 bag，以最快速度同步处理，不订阅 topic；
+// 后缀为 .lsr 时读取传感器记录，跳过反序列化和预处理，可以从 replay_start_time（相对记录开始，秒）开始
+std::string replay_bag_file;
+bool replay_en = false;
+double replay_start_time = 0.0;
+// 传感器记录：把预处理后的点云和 IMU 写入 PCD/sensors.lsr
+bool record_en = false;
+// 飞行记录仪：内存中保存最近 flight_window 秒的数据，出现异常时写入 PCD/flight_*.lsr；
+// 触发条件为有效特征点数少于 flight_min_effective、时间戳回退、LiDAR 帧间隔超过 flight_max_scan_gap 秒、
+// IMU 间隔超过 flight_max_imu_gap 秒、单帧处理时间超过 flight_max_scan_ms 毫秒
+bool flight_en = true;
+double flight_window = 5.0, flight_post_time = 1.0, flight_cooldown = 10.0;
+int flight_max_dumps = 10, flight_min_effective = 20;
+double flight_max_scan_gap = 0.5, flight_max_imu_gap = 0.1, flight_max_scan_ms = 200.0;
+double flight_max_lidar_rate = 20.0;  // LiDAR 的最高帧率，决定飞行记录仪和点云池保存的帧数
+// 由粗到精匹配：前 coarse_iterations 次迭代使用 coarse_scale 倍降采样尺寸的点云和地图
+bool coarse_to_fine_en = false;
+int coarse_iterations = 1;
+double coarse_scale = 2.0;
+// 每隔多少帧与单分辨率迭代的结果对比一次，0 表示不对比
+int coarse_check_interval = 0;
 
 /* 回调函数中使用的全局变量。*/
 std::shared_ptr<Preprocess> p_pre(new Preprocess());
@@ -48,24 +149,35 @@ double last_timestamp_lidar = 0.0;
 double last_timestamp_imu = -1.0;
 std::deque<double> time_buffer;
 std::deque<PointCloudXYZI::Ptr> lidar_buffer;
-std::deque<sensor_msgs::Imu::ConstPtr> imu_buffer;
+std::deque<ImuSample> imu_buffer;
+CloudPool lidar_pool;  // 预处理后的点云，在数据队列和飞行记录仪中使用，释放后复用
+SensorLogWriter sensor_log;
+FlightRecorder flight_recorder;
 
 /* 中断函数中使用的全局变量。*/
-bool flg_exit = false;
+std::atomic<bool> flg_exit(false);
 
-/* h_share_mode 中使用的全局变量。*/
+/* 地图和观测模型，h_share_model 和 map_incremental 的实现在 LidarMap 中。*/
 PointCloudXYZI::Ptr feats_down_body(new PointCloudXYZI());
-PointCloudXYZI::Ptr feats_down_world(new PointCloudXYZI());
-std::vector<PointVector>  Nearest_Points;
-KD_TREE<PointType> ikdtree;
+LidarMap lidar_map;
 
 /* 发布消息时使用的全局变量。*/
 double lidar_end_time = 0.0;
-nav_msgs::Path path;
 PointCloudXYZI::Ptr feats_undistort(new PointCloudXYZI());
-PointCloudXYZI::Ptr pcl_wait_save(new PointCloudXYZI());
+// 去畸变和降采样后的点云每帧从池中取，上一帧可能还在发布线程和保存线程中使用
+CloudPool undistort_pool;
+CloudPool down_pool;
 state_ikfom state_point;
-geometry_msgs::Quaternion geoQuat;  // 四元数
+PublishStage publish_stage;
+// 占据栅格和 TSDF 线程的输入，点云为 LiDAR 系，位姿为 LiDAR 系到 ground 系
+struct GroundFrame {
+    ScanFrame scan;
+    M3D R_W_G;
+};
+BoundedQueue<GroundFrame> occupancy_queue(10);
+BoundedQueue<GroundFrame> tsdf_queue(5);
+std::atomic<size_t> occupancy_dropped(0);  // 主循环累加，占据栅格线程退出时读取
+std::atomic<size_t> tsdf_dropped(0);  // 主循环累加，TSDF 线程退出时读取
 
 // 收到中断信号后，会唤醒所有等待队列中阻塞的线程
 // 线程被唤醒后，会通过轮询方式获得锁，获得锁前也一直处理运行状态，不会被再次阻塞
@@ -76,31 +188,6 @@ void SigHandle(int sig) {
     sig_buffer.notify_all();
 }
 
-// 把点从 LiDar 系转到 world 系（world 系是第一帧 IMU 系）
-void pointBodyToWorld(PointType const * const pi, PointType * const po) {
-
-    V3D p_body(pi->x, pi->y, pi->z);
-    V3D p_global(state_point.rot * (state_point.offset_R_L_I*p_body + state_point.offset_T_L_I) + state_point.pos);
-
-    po->x = p_global(0);
-    po->y = p_global(1);
-    po->z = p_global(2);
-    po->intensity = pi->intensity;
-}
-
-// 把点从 LiDar 系转到 ground 系（ground 系垂直地面）
-void pointBodyToGround(PointType const * const pi, PointType * const po, const M3D& R_W_G) {
-    
-    V3D p_body(pi->x, pi->y, pi->z);
-    V3D p_ground(R_W_G * (state_point.rot * (state_point.offset_R_L_I*p_body+state_point.offset_T_L_I)
-        + state_point.pos));
-
-    po->x = p_ground(0);
-    po->y = p_ground(1);
-    po->z = p_ground(2);
-    po->intensity = pi->intensity;
-}
-
 // 动态调整地图区域，防止地图过大而内存溢出。
 // 室内建图空间小，可以不调整局部地图
 // void lasermap_fov_segment(const V3D& pos_LiD) {
@@ -167,61 +254,91 @@ void pointBodyToGround(PointType const * const pi, PointType * const po, const M
 //     }
 // }
 
-/* 订阅器 sub_pcl 的回调函数。
-接收 Livox 的点云数据，对点云数据进行预处理，并将处理后的数据保存到激光雷达数据队列中*/
-void livox_pcl_cbk(const livox_ros_driver::CustomMsg::ConstPtr &msg) 
+/* 把预处理后的一帧点云放入激光雷达数据队列，time 为扫描起始时间。*/
+void push_lidar(const double time, const PointCloudXYZI::Ptr &ptr)
 {
     std::unique_lock<std::mutex> locker(mtx_buffer, std::defer_lock);
 
     locker.lock();
     // 如果当前帧 LiDAR 数据的时间戳比上一帧 LiDAR 数据的时间戳早，需要将激光雷达数据缓存队列清空
-    if (msg->header.stamp.toSec() < last_timestamp_lidar) {
-        neal::logger(neal::LOG_ERROR, "lidar loop back, clear buffer");
+    if (time < last_timestamp_lidar) {
+        ASYNC_LOG(neal::LOG_ERROR, "lidar loop back, clear buffer");
         lidar_buffer.clear();
+        flight_recorder.trigger("lidar_loop_back", time);
+    }
+    else if (last_timestamp_lidar > 0.0 && time - last_timestamp_lidar > flight_max_scan_gap) {
+        flight_recorder.trigger("lidar_gap", time);
     }
-    last_timestamp_lidar = msg->header.stamp.toSec();
+    last_timestamp_lidar = time;
     
     // 如果不需要进行时间同步，而 IMU 时间戳和雷达时间戳相差大于 10s，则输出错误信息
     if (fabs(last_timestamp_lidar - last_timestamp_imu) > 10.0 && !imu_buffer.empty() && !lidar_buffer.empty()) {
-        std::string strout;
-        strout = "IMU and LiDAR not Synced, IMU time: " + std::to_string(last_timestamp_imu) +
-            ", lidar scan end time: " + std::to_string(last_timestamp_lidar) + '.';
-        neal::logger(neal::LOG_ERROR, strout);
+        ASYNC_LOG(neal::LOG_ERROR, "IMU and LiDAR not Synced, IMU time: {}, lidar scan end time: {}.",
+            last_timestamp_imu, last_timestamp_lidar);
     }
 
-    // 用 pcl 点云格式保存接收到的激光雷达数据
-    PointCloudXYZI::Ptr ptr(new PointCloudXYZI());
-    // 对激光雷达数据进行预处理
-    p_pre->process(msg, ptr);
     lidar_buffer.push_back(ptr);
     time_buffer.push_back(last_timestamp_lidar);
+    flight_recorder.add_scan(time, ptr);
     locker.unlock();
     sig_buffer.notify_all();  // 唤醒阻塞的线程
 }
 
-/* 订阅器 sub_imu 的回调函数。
-接收 IMU 数据，将 IMU 数据保存到 IMU 数据缓存队列中*/
-void imu_cbk(const sensor_msgs::Imu::ConstPtr &msg_in) {
-    
+/* 把一个 IMU 数据放入 IMU 数据缓存队列。*/
+void push_imu(const ImuSample &imu)
+{
     std::unique_lock<std::mutex> locker(mtx_buffer, std::defer_lock);
-    sensor_msgs::Imu::Ptr msg(new sensor_msgs::Imu(*msg_in));
 
-    double timestamp = msg->header.stamp.toSec();  // IMU 起始时间戳
+    double timestamp = imu.time;  // IMU 起始时间戳
     locker.lock();
     // 如果当前 IMU 的时间戳小于上一个时刻 IMU 的时间戳，则 IMU 数据有误，将 IMU 数据缓存队列清空
     if (timestamp < last_timestamp_imu) {
-        std::string strout = "imu loop back, clear buffer";
-        neal::logger(neal::LOG_ERROR, strout);
+        ASYNC_LOG(neal::LOG_ERROR, "imu loop back, clear buffer");
         imu_buffer.clear();
+        flight_recorder.trigger("imu_loop_back", timestamp);
+    }
+    else if (last_timestamp_imu > 0.0 && timestamp - last_timestamp_imu > flight_max_imu_gap) {
+        flight_recorder.trigger("imu_gap", timestamp);
     }
     last_timestamp_imu = timestamp;
 
     // 将当前的 IMU 数据保存到 IMU 数据缓存队列中
-    imu_buffer.push_back(msg);
+    imu_buffer.push_back(imu);
+    flight_recorder.add_imu(imu);
     locker.unlock();
     sig_buffer.notify_all();  // 唤醒阻塞的线程
 }
 
+/* 订阅器 sub_pcl 的回调函数。
+接收 Livox 的点云数据，对点云数据进行预处理，并将处理后的数据保存到激光雷达数据队列中；
+记录模式下同时写入传感器记录文件*/
+void livox_pcl_cbk(const livox_ros_driver::CustomMsg::ConstPtr &msg) 
+{
+    // 用 pcl 点云格式保存接收到的激光雷达数据
+    PointCloudXYZI::Ptr ptr = lidar_pool.acquire();
+    // 对激光雷达数据进行预处理
+    p_pre->process(msg, ptr);
+    const double time = msg->header.stamp.toSec();
+    if (sensor_log.is_open()) {
+        sensor_log.add_scan(time, *ptr);
+    }
+    push_lidar(time, ptr);
+}
+
+/* 订阅器 sub_imu 的回调函数。
+接收 IMU 数据，将 IMU 数据保存到 IMU 数据缓存队列中*/
+void imu_cbk(const sensor_msgs::Imu::ConstPtr &msg) {
+
+    ImuSample imu;
+    imu.time = msg->header.stamp.toSec();
+    imu.acc << msg->linear_acceleration.x, msg->linear_acceleration.y, msg->linear_acceleration.z;
+    imu.gyr << msg->angular_velocity.x, msg->angular_velocity.y, msg->angular_velocity.z;
+    if (sensor_log.is_open()) {
+        sensor_log.add_imu(imu.time, imu.acc, imu.gyr);
+    }
+    push_imu(imu);
+}
+
 /* 将第一帧 LiDAR 数据，和这段时间内的 IMU 数据从缓存队列中取出，并保存到 meas 中*/
 bool sync_packages(MeasureGroup &meas) {
 
@@ -246,12 +363,12 @@ bool sync_packages(MeasureGroup &meas) {
         // 如果该数据没有点云
         if (meas.lidar->points.size() <= 1) {
             lidar_end_time = meas.lidar_beg_time + 0.0;
-            neal::logger(neal::LOG_WARN, "Too few input point cloud!");
+            ASYNC_LOG(neal::LOG_WARN, "Too few input point cloud!");
         }
         // 如果扫描用时不正常
         else if (duration < 0.5 * lidar_mean_scantime) {
             lidar_end_time = meas.lidar_beg_time + duration;
-            neal::logger(neal::LOG_WARN, "Too short scan time!");
+            ASYNC_LOG(neal::LOG_WARN, "Too short scan time!");
         }
         // 正常情况
         else {
@@ -272,7 +389,7 @@ bool sync_packages(MeasureGroup &meas) {
     /* 拿出 lidar_beg_time 到 lidar_end_time 之间的所有 IMU 数据*/
     meas.imu.clear();
     while ((!imu_buffer.empty())) {
-        double imu_time = imu_buffer.front()->header.stamp.toSec();
+        double imu_time = imu_buffer.front().time;
         if (imu_time > lidar_end_time) {
             break;
         }
@@ -289,261 +406,602 @@ bool sync_packages(MeasureGroup &meas) {
     return true;
 }
 
-void map_incremental(const bool flg_EKF_inited) {
+/* 离线回放。
+按 bag 中的时间顺序把 LiDAR 和 IMU 消息交给回调函数，直到凑齐一帧；不经过 ROS 的消息队列，
+处理顺序与回调时机无关，结果可以复现。传感器记录（.lsr）按 chunk 顺序直接放入缓存队列。*/
+rosbag::Bag replay_bag;
+std::unique_ptr<rosbag::View> replay_view;
+rosbag::View::iterator replay_iter;
+SensorLogReader replay_log;
+size_t replay_log_chunk = 0;
 
-    int feats_down_size = feats_down_body->points.size();
-
-    PointVector PointToAdd;
-    PointVector PointNoNeedDownsample;
-    PointToAdd.reserve(feats_down_size);
-    PointNoNeedDownsample.reserve(feats_down_size);
-    for (int i = 0; i < feats_down_size; i++) {
-        /* transform to world frame */
-        pointBodyToWorld(&(feats_down_body->points[i]), &(feats_down_world->points[i]));
-        /* decide if need add to map */
-        if (!Nearest_Points[i].empty() && flg_EKF_inited) {
-            const PointVector &points_near = Nearest_Points[i];
-            bool need_add = true;
-            BoxPointType Box_of_Point;
-            PointType downsample_result, mid_point; 
-            mid_point.x = floor(feats_down_world->points[i].x/filter_size_map_min)*filter_size_map_min + 0.5 * filter_size_map_min;
-            mid_point.y = floor(feats_down_world->points[i].y/filter_size_map_min)*filter_size_map_min + 0.5 * filter_size_map_min;
-            mid_point.z = floor(feats_down_world->points[i].z/filter_size_map_min)*filter_size_map_min + 0.5 * filter_size_map_min;
-            float dist  = calc_dist(feats_down_world->points[i],mid_point);
-            if (fabs(points_near[0].x - mid_point.x) > 0.5 * filter_size_map_min &&
-                fabs(points_near[0].y - mid_point.y) > 0.5 * filter_size_map_min &&
-                fabs(points_near[0].z - mid_point.z) > 0.5 * filter_size_map_min){
-                
-                PointNoNeedDownsample.push_back(feats_down_world->points[i]);
-                continue;
-            }
-            for (int readd_i = 0; readd_i < NUM_MATCH_POINTS; readd_i ++) {
-                if (points_near.size() < NUM_MATCH_POINTS) {
-                    break;
-                }
-                if (calc_dist(points_near[readd_i], mid_point) < dist) {
-                    need_add = false;
-                    break;
-                }
-            }
-            if (need_add) {
-                PointToAdd.push_back(feats_down_world->points[i]);
+bool replay_is_log(const std::string &file) {
+
+    return file.size() > 4 && file.compare(file.size() - 4, 4, ".lsr") == 0;
+}
+
+bool replay_open(const std::string &file, const std::string &lid_topic, const std::string &imu_topic) {
+
+    if (replay_is_log(file)) {
+        if (!replay_log.open(file)) {
+            return false;
+        }
+        const SensorLogHeader &header = replay_log.get_header();
+        replay_log_chunk = replay_log.seek(replay_log.begin_time() + replay_start_time);
+        neal::logger(neal::LOG_INFO, "replaying " + file + ", scans: " + std::to_string(replay_log.num_scans()) +
+            ", imu samples: " + std::to_string(replay_log.num_imu()) + ", duration: " +
+            std::to_string(replay_log.end_time() - replay_log.begin_time()) + "s, start chunk: " +
+            std::to_string(replay_log_chunk) + ", recorded with blind: " + std::to_string(header.blind) +
+            ", point_filter_num: " + std::to_string(header.point_filter_num));
+        return replay_log_chunk < replay_log.num_chunks();
+    }
+
+    try {
+        replay_bag.open(file, rosbag::bagmode::Read);
+    }
+    catch (const rosbag::BagException &e) {
+        neal::logger(neal::LOG_ERROR, "cannot open bag " + file + ": " + e.what());
+        return false;
+    }
+    replay_view.reset(new rosbag::View(replay_bag, rosbag::TopicQuery(std::vector<std::string>{lid_topic, imu_topic})));
+    if (replay_view->size() == 0) {
+        neal::logger(neal::LOG_ERROR, "no " + lid_topic + " or " + imu_topic + " messages in " + file);
+        return false;
+    }
+    replay_iter = replay_view->begin();
+    neal::logger(neal::LOG_INFO, "replaying " + file + ", messages: " + std::to_string(replay_view->size()) +
+        ", duration: " + std::to_string((replay_view->getEndTime() - replay_view->getBeginTime()).toSec()) + "s");
+    return true;
+}
+
+// 传感器记录中的下一个 chunk，读完时返回 false
+bool replay_log_next() {
+
+    if (replay_log_chunk >= replay_log.num_chunks()) {
+        return false;
+    }
+    const size_t i = replay_log_chunk++;
+    const SensorLogIndex &chunk = replay_log.chunk(i);
+    if (chunk.type == LSR_CHUNK_SCAN) {
+        // 池中的点云保留上次的点数，扫描的点数基本不变，load_scan 直接覆盖
+        PointCloudXYZI::Ptr ptr = lidar_pool.acquire(true);
+        replay_log.load_scan(i, *ptr);
+        push_lidar(chunk.time, ptr);
+        return true;
+    }
+    // IMU 样本从映射的文件中直接读取，按值放入队列
+    const SensorLogImu *samples = replay_log.imu_samples(i);
+    ImuSample imu;
+    for (uint32_t k = 0; k < chunk.count; k++) {
+        imu.time = samples[k].time;
+        imu.acc << samples[k].acc[0], samples[k].acc[1], samples[k].acc[2];
+        imu.gyr << samples[k].gyr[0], samples[k].gyr[1], samples[k].gyr[2];
+        push_imu(imu);
+    }
+    return true;
+}
+
+// bag 或传感器记录读完时返回 false
+bool replay_next(MeasureGroup &meas) {
+
+    while (!sync_packages(meas)) {
+        if (replay_log.is_open()) {
+            if (!replay_log_next()) {
+                return false;
             }
+            continue;
         }
-        else {
-            PointToAdd.push_back(feats_down_world->points[i]);
+        if (replay_iter == replay_view->end()) {
+            return false;
+        }
+        const rosbag::MessageInstance &m = *replay_iter;
+        livox_ros_driver::CustomMsg::ConstPtr lidar = m.instantiate<livox_ros_driver::CustomMsg>();
+        sensor_msgs::Imu::ConstPtr imu = m.instantiate<sensor_msgs::Imu>();
+        ++replay_iter;
+        if (lidar != nullptr) {
+            livox_pcl_cbk(lidar);
+        }
+        else if (imu != nullptr) {
+            imu_cbk(imu);
         }
     }
-    ikdtree.Add_Points(PointToAdd, true);
-    ikdtree.Add_Points(PointNoNeedDownsample, false); 
+    return true;
 }
 
-void publish_frame_world(const ros::Publisher & pubLaserCloudFull, const M3D& R_W_G) {
-    
-    // 判断是否发布稠密数据
-    PointCloudXYZI::Ptr laserCloudFullRes(dense_pub_en ? feats_undistort : feats_down_body);
-    // 获取待转换点云的大小
-    int size = laserCloudFullRes->points.size();
+void map_incremental(const bool flg_EKF_inited) {
 
-    if(scan_pub_en) {
-        // 转换到世界坐标系的点云
-        PointCloudXYZI::Ptr laserCloudWorld(new PointCloudXYZI(size, 1));
-        for (int i = 0; i < size; i++) {
-            pointBodyToWorld(&laserCloudFullRes->points[i], &laserCloudWorld->points[i]);
-        }
-        sensor_msgs::PointCloud2 laserCloudmsg;
-        pcl::toROSMsg(*laserCloudWorld, laserCloudmsg);
-        laserCloudmsg.header.stamp = ros::Time().fromSec(lidar_end_time);
-        laserCloudmsg.header.frame_id = "camera_init";
-        pubLaserCloudFull.publish(laserCloudmsg);
+    lidar_map.incremental(state_point, flg_EKF_inited);
+    // 增量保存地图
+    if (map_writer.is_open()) {
+        map_writer.add_points(lidar_map.points_to_add());
+        map_writer.add_points(lidar_map.points_no_downsample());
+        map_writer.add_points(lidar_map.points_absorbed());
     }
+}
 
-    /* save map:
-    1. make sure you have enough memories;
-    2. pcd save will largely influence the real-time performences.*/
-    if (pcd_save_en) {
-        PointCloudXYZI::Ptr laserCloudGround(new PointCloudXYZI(size, 1));
-        for (int i = 0; i < size; i++) {
-            pointBodyToGround(&laserCloudFullRes->points[i], &laserCloudGround->points[i], R_W_G);
+/* 平面压缩后的地图导出：patch 写入 PCD/planes.txt（PlaneMap::save），不在 patch 中的地图点（残差点）
+写入 path（.lim，world 系），两者合起来表示整张地图。*/
+bool save_plane_residual(const std::string &path, const M3D &R_W_G) {
+
+    PointVector points;
+    lidar_map.get_points(points);
+    TiledMapWriter writer;
+    if (!writer.open(path, map_tile_size, LIM_FRAME_WORLD)) {
+        return false;
+    }
+    for (const PointType &p : points) {
+        if (!lidar_map.planes().in_patch(p)) {
+            writer.add_point(p);
         }
-        *pcl_wait_save += *laserCloudGround;
     }
+    writer.set_R_W_G(R_W_G);
+    writer.close();
+    if (writer.failed()) {
+        return false;
+    }
+    neal::logger(neal::LOG_INFO, "plane residual points saved: " + path + ", points: " +
+        std::to_string(writer.points_written()) + " / " + std::to_string(points.size()));
+    return true;
 }
 
-// 在 publish_odometry 和 publish_path 中调用
-template<typename T>
-void set_posestamp(T & out) {
-
-    out.pose.position.x = state_point.pos(0);  // 将 esekf 求得的位置传入
-    out.pose.position.y = state_point.pos(1);
-    out.pose.position.z = state_point.pos(2);
-    out.pose.orientation.x = geoQuat.x;  // 将 esekf 求得的姿态传入
-    out.pose.orientation.y = geoQuat.y;
-    out.pose.orientation.z = geoQuat.z;
-    out.pose.orientation.w = geoQuat.w;
+/* 从 .lim 文件读取先验地图并构建地图。
+先验地图在 world 系下，要求本次启动时的第一帧 IMU 系与保存地图时一致（在同一位置重启）。*/
+bool load_prior_map(const std::string &file) {
+
+    ros::WallTime t_start = ros::WallTime::now();
+    TiledMapReader reader;
+    if (!reader.open(file)) {
+        return false;
+    }
+    if (reader.get_header().frame != LIM_FRAME_WORLD) {
+        neal::logger(neal::LOG_ERROR, "prior map is not in world frame: " + file);
+        return false;
+    }
+    PointVector prior_points;
+    reader.load(prior_points);
+    if (prior_points.empty()) {
+        return false;
+    }
+    lidar_map.build(prior_points);
+    // 先验地图也写入新的地图文件，保证保存的地图是完整的
+    if (map_writer.is_open()) {
+        map_writer.add_points(prior_points);
+    }
+    neal::logger(neal::LOG_INFO, "prior map loaded: " + file + ", points: " + std::to_string(prior_points.size()) +
+        ", time: " + std::to_string((ros::WallTime::now() - t_start).toSec()) + "s");
+    return true;
 }
 
-// 发布里程计
-void publish_odometry(const ros::Publisher & pubOdomAftMapped,
-    const Eigen::Matrix<double, 23, 23>& P) {
+/* 把本帧点云交给发布线程和保存线程。
+点云每帧从 CloudPool 取，交出去之后主循环不再修改，所有使用者释放之前不会再被取出，线程之间共享同一份数据，不需要复制。*/
+void publish_frame_world(const M3D& R_W_G) {
+    
+    // 判断是否发布稠密数据
+    PointCloudXYZI::Ptr laserCloudFullRes(dense_pub_en ? feats_undistort : feats_down_body);
+    // LiDAR 系到 world 系的变换，与 body_to_world 相同
+    M3D rot_world = state_point.rot.toRotationMatrix() * state_point.offset_R_L_I.toRotationMatrix();
+    V3D pos_world = state_point.rot * state_point.offset_T_L_I + state_point.pos;
+
+    // 没有订阅者时不提交，发布线程里也会再检查一次
+    if ((scan_pub_en || compressed_pub_en) && publish_stage.scan_wanted()) {
+        ScanFrame frame;
+        frame.time = lidar_end_time;
+        frame.cloud = laserCloudFullRes;
+        frame.rot = rot_world;
+        frame.pos = pos_world;
+        publish_stage.push_scan(frame);
+    }
+
+    /* 占据栅格和 TSDF：使用稠密点云*/
+    if (occupancy_en || tsdf_en) {
+        GroundFrame frame;
+        frame.scan.time = lidar_end_time;
+        frame.scan.cloud = feats_undistort;
+        frame.scan.rot = R_W_G * rot_world;
+        frame.scan.pos = R_W_G * pos_world;
+        frame.R_W_G = R_W_G;
+        // 队列满时丢掉这一帧，不阻塞主循环；离线回放时等待
+        if (occupancy_en && !(replay_en ? occupancy_queue.push(frame) : occupancy_queue.try_push(frame))) {
+            occupancy_dropped++;
+        }
+        if (tsdf_en && !(replay_en ? tsdf_queue.push(frame) : tsdf_queue.try_push(frame))) {
+            tsdf_dropped++;
+        }
+    }
 
-    nav_msgs::Odometry odomAftMapped;  // 只包含了一个位姿
+    /* 保存点云：坐标转换和写盘在后台线程完成*/
+    if (pcd_save_en && scan_writer.is_open()) {
+        ScanFrame frame;
+        frame.time = lidar_end_time;
+        frame.cloud = laserCloudFullRes;
+        // LiDAR 系到 ground 系
+        frame.rot = R_W_G * rot_world;
+        frame.pos = R_W_G * pos_world;
+        scan_writer.push(frame);
+    }
+}
 
-    odomAftMapped.header.frame_id = "camera_init";
-    odomAftMapped.child_frame_id = "body";
-    odomAftMapped.header.stamp = ros::Time().fromSec(lidar_end_time);
-    set_posestamp(odomAftMapped.pose);
-    pubOdomAftMapped.publish(odomAftMapped);
+// 把本帧位姿交给发布线程，发布里程计、TF 和轨迹
+void publish_odometry(const Eigen::Matrix<double, 23, 23>& P) {
 
+    PoseFrame pose;
+    pose.time = lidar_end_time;
+    pose.pos = state_point.pos;
+    pose.rot = Eigen::Quaterniond(state_point.rot.coeffs()[3], state_point.rot.coeffs()[0],
+        state_point.rot.coeffs()[1], state_point.rot.coeffs()[2]);
+    // 协方差 P 里先是旋转后是位置，这个 POSE 里先是位置后是旋转，所以对应的协方差要对调一下
     for (int i = 0; i < 6; i ++) {
         int k = i < 3 ? i + 3 : i - 3;
-        // 协方差 P 里先是旋转后是位置，这个 POSE 里先是位置后是旋转，所以对应的协方差要对调一下
-        odomAftMapped.pose.covariance[i*6 + 0] = P(k, 3);
-        odomAftMapped.pose.covariance[i*6 + 1] = P(k, 4);
-        odomAftMapped.pose.covariance[i*6 + 2] = P(k, 5);
-        odomAftMapped.pose.covariance[i*6 + 3] = P(k, 0);
-        odomAftMapped.pose.covariance[i*6 + 4] = P(k, 1);
-        odomAftMapped.pose.covariance[i*6 + 5] = P(k, 2);
-    }
-
-    static tf::TransformBroadcaster br;
-    tf::Transform transform;
-    tf::Quaternion q;
-    transform.setOrigin(tf::Vector3(odomAftMapped.pose.pose.position.x, \
-                                    odomAftMapped.pose.pose.position.y, \
-                                    odomAftMapped.pose.pose.position.z));
-    q.setW(odomAftMapped.pose.pose.orientation.w);
-    q.setX(odomAftMapped.pose.pose.orientation.x);
-    q.setY(odomAftMapped.pose.pose.orientation.y);
-    q.setZ(odomAftMapped.pose.pose.orientation.z);
-    transform.setRotation(q);
-    br.sendTransform(tf::StampedTransform(transform, odomAftMapped.header.stamp, "camera_init", "body"));
+        pose.cov.block<1, 3>(i, 0) = P.block<1, 3>(k, 3);
+        pose.cov.block<1, 3>(i, 3) = P.block<1, 3>(k, 0);
+    }
+    publish_stage.push_pose(pose);
 }
 
-// 每隔 10 个发布一下位姿
-void publish_path(const ros::Publisher pubPath) {
+/* 各阶段延迟的 p50、p99 和最大值（ms）发布到 /diagnostics，每个阶段一个 DiagnosticStatus。
+统计从启动开始累计，rqt_runtime_monitor 可以直接查看。*/
+void publish_latency(const ros::Publisher &pub) {
+
+    if (pub.getNumSubscribers() == 0) {
+        return;
+    }
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = ros::Time::now();
+    for (int i = 0; i < LATENCY_NUM_STAGES; i++) {
+        const LatencyStage stage = static_cast<LatencyStage>(i);
+        const LatencyHistogram &h = latency_stats.get(stage);
+        diagnostic_msgs::DiagnosticStatus status;
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.name = std::string("lio: ") + LatencyStats::stage_name(stage);
+        status.hardware_id = "lio";
+        status.message = "latency";
+        const std::pair<const char *, double> values[] = {
+            {"count", static_cast<double>(h.count())}, {"mean_ms", h.mean() * 1e-6},
+            {"p50_ms", h.percentile(0.5) * 1e-6}, {"p99_ms", h.percentile(0.99) * 1e-6}, {"max_ms", h.max() * 1e-6}
+        };
+        for (const auto &v : values) {
+            diagnostic_msgs::KeyValue kv;
+            kv.key = v.first;
+            kv.value = std::to_string(v.second);
+            status.values.push_back(kv);
+        }
+        msg.status.push_back(status);
+    }
+    pub.publish(msg);
+}
 
-    geometry_msgs::PoseStamped msg_body_pose;  // 位姿
+/* 地图发布线程。
+读取 CompactMap 的快照，与主循环并发运行，不需要加锁；地图版本没有变化或者没有订阅者时不发布。*/
+void publish_map_thread(const ros::Publisher pubLaserMap) {
 
-    set_posestamp(msg_body_pose);
-    msg_body_pose.header.stamp = ros::Time().fromSec(lidar_end_time);
-    msg_body_pose.header.frame_id = "camera_init";
+    uint64_t last_version = 0;
+    PointVector points;
+    ros::WallTime last_pub = ros::WallTime::now();
+    while (!flg_exit) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if ((ros::WallTime::now() - last_pub).toSec() < map_pub_period) {
+            continue;
+        }
+        last_pub = ros::WallTime::now();
 
-    /*** if path is too large, the rvis will crash ***/
-    static int jjj = 0;
-    jjj++;
-    if (jjj % 10 == 0) {
-        path.poses.push_back(msg_body_pose);
-        pubPath.publish(path);
+        CompactMap::SnapshotPtr snap = lidar_map.compact().snapshot();
+        if (snap->version() == last_version || snap->size() == 0 || pubLaserMap.getNumSubscribers() == 0) {
+            continue;
+        }
+        snap->get_points(points);
+        PointCloudXYZI laserCloudMap;
+        laserCloudMap.points.assign(points.begin(), points.end());
+        laserCloudMap.width = laserCloudMap.points.size();
+        laserCloudMap.height = 1;
+        sensor_msgs::PointCloud2 laserCloudmsg;
+        pcl::toROSMsg(laserCloudMap, laserCloudmsg);
+        laserCloudmsg.header.stamp = ros::Time::now();
+        laserCloudmsg.header.frame_id = "camera_init";
+        pubLaserMap.publish(laserCloudmsg);
+        last_version = snap->version();
     }
 }
 
-// 对应 fast-lio2 公式 12 和 13。fast-lio 公式 14。
-void h_share_model(state_ikfom &st, esekfom::dyn_share_datastruct<double> &ekfom_data) {
-
-    int feats_down_size = feats_down_body->points.size();
-
-    // feats_down_body 中的有效点  
-    PointCloudXYZI::Ptr laserCloudOri(new PointCloudXYZI());
-    laserCloudOri->resize(feats_down_size);
-    // laserCloudOri 对应的法相量
-    PointCloudXYZI::Ptr corr_normvect(new PointCloudXYZI());
-    corr_normvect->resize(feats_down_size);
-    // 是否为平面特征点
-    std::vector<bool> point_selected_surf;
-    point_selected_surf.resize(feats_down_size);
-    // 特征点在地图中对应点的，局部平面参数，w 系
-    PointCloudXYZI::Ptr normvec(new PointCloudXYZI());
-    normvec->resize(feats_down_size);
-
-    /* 最近邻曲面搜索和残差计算*/
-    for (int i = 0; i < feats_down_size; i++) {
-        /* 将点云坐标转换至世界坐标系下*/
-        const PointType &point_body = feats_down_body->points[i];  // 降采样后点云的 LiDAR 坐标
-        PointType &point_world = feats_down_world->points[i];      // 降采样后点云的世界坐标
-        V3D p_body(point_body.x, point_body.y, point_body.z);
-        V3D p_global(st.rot * (st.offset_R_L_I * p_body + st.offset_T_L_I) + st.pos);
-        point_world.x = p_global(0);
-        point_world.y = p_global(1);
-        point_world.z = p_global(2);
-        point_world.intensity = point_body.intensity;
-
-        /* 寻找最近邻点*/
-        std::vector<float> pointSearchSqDis(NUM_MATCH_POINTS);
-        PointVector &points_near = Nearest_Points[i];  // 点云的最近点序列
-        // 在 ikd-Tree 上查找特征点的最近邻
-        ikdtree.Nearest_Search(point_world, NUM_MATCH_POINTS, points_near, pointSearchSqDis);
-
-        // 如果最近邻的点数小于 NUM_MATCH_POINTS 或者最近邻的点到特征点的距离大于 5m，则认为该点不是有效点
-        point_selected_surf[i] = points_near.size() < NUM_MATCH_POINTS ? false :
-            (pointSearchSqDis[NUM_MATCH_POINTS - 1] > 5.0 ? false: true);
-        if (!point_selected_surf[i]) {  // 如果不是有效点
+/* 占据栅格线程。
+每帧点云转到 ground 系后用射线增量更新 OccupancyGrid，发布变化的块 /occupancy_blocks；
+按 occupancy_2d_period 发布二维投影 /occupancy_2d。ground 系作为 camera_init 的子坐标系发布到 TF。*/
+void occupancy_thread(const ros::Publisher pubBlocks, const ros::Publisher pubGrid) {
+
+    OccupancyGrid grid;
+    grid.set_resolution(occupancy_resolution);
+    grid.set_projection(occupancy_min_z, occupancy_max_z);
+    grid.set_max_range(occupancy_max_range);
+    grid.set_num_threads(occupancy_threads);
+    grid.set_track_voxels(esdf_en);
+    std::vector<VoxelKey> occupied_voxels, freed_voxels;
+    // ESDF 每帧的更新时间
+    double esdf_total_ms = 0.0, esdf_max_ms = 0.0;
+    size_t esdf_count = 0;
+    tf::TransformBroadcaster br;
+    GroundFrame frame;
+    PointVector points;
+    uint32_t last_subscribers = 0;
+    ros::WallTime last_2d = ros::WallTime::now();
+    while (true) {
+        if (!occupancy_queue.pop(frame, std::chrono::milliseconds(100))) {
+            if (occupancy_queue.is_closed()) {
+                break;
+            }
             continue;
         }
+        transform_points(frame.scan.cloud->points, points, make_transform(frame.scan.rot, frame.scan.pos));
+        frame.scan.cloud.reset();
+        // 从 LiDAR 原点到每个点做射线，清除穿过的空间
+        grid.integrate_scan(points, frame.scan.pos);
+        if (esdf_en) {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            grid.take_voxel_changes(occupied_voxels, freed_voxels);
+            esdf_map.update(occupied_voxels, freed_voxels);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            esdf_total_ms += ms;
+            esdf_max_ms = std::max(esdf_max_ms, ms);
+            esdf_count++;
+        }
 
-        /* 拟合平面方程 ax+by+cz+d=0 并求解点到平面距离*/
-        VF(4) pabcd;                     // 平面点信息
-        point_selected_surf[i] = false;  // 先设为无效点
-        // common_lib.h 函数，寻找法向量
-        if (esti_plane(pabcd, points_near, 0.1f)) {
-            // 计算点到平面的距离
-            float pd2 = pabcd(0) * point_world.x + pabcd(1) * point_world.y + pabcd(2) * point_world.z + pabcd(3);
-            float s = 1 - 0.9 * fabs(pd2) / sqrt(p_body.norm());
-            // 如果 s>0.9，则认为找到平面
-            if (s > 0.9) {
-                point_selected_surf[i] = true;       // 再次设为有效点
-                normvec->points[i].x = pabcd(0);     // 存储法向量
-                normvec->points[i].y = pabcd(1);
-                normvec->points[i].z = pabcd(2);
-                normvec->points[i].intensity = pd2;  // 存储点到平面的距离
+        const ros::Time stamp = ros::Time().fromSec(frame.scan.time);
+        // ground 系到 camera_init 系的旋转为 R_W_G 的转置
+        Eigen::Quaterniond q(frame.R_W_G.transpose());
+        br.sendTransform(tf::StampedTransform(tf::Transform(tf::Quaternion(q.x(), q.y(), q.z(), q.w()),
+            tf::Vector3(0, 0, 0)), stamp, "camera_init", "ground"));
+
+        // 变化的块，新的订阅者加入时发送全部块
+        const uint32_t subscribers = pubBlocks.getNumSubscribers();
+        if (subscribers > 0) {
+            lio::OccupancyBlocks msg;
+            msg.header.stamp = stamp;
+            msg.header.frame_id = "ground";
+            msg.resolution = grid.get_resolution();
+            std::vector<VoxelKey> keys;
+            if (subscribers > last_subscribers) {
+                keys = grid.all_blocks();
+            }
+            else {
+                keys.assign(grid.changed_blocks().begin(), grid.changed_blocks().end());
+            }
+            msg.keys.reserve(keys.size() * 3);
+            msg.occupancy.resize(keys.size() * OCC_BLOCK_VOXELS / 8);
+            for (size_t i = 0; i < keys.size(); i++) {
+                msg.keys.push_back(keys[i].x);
+                msg.keys.push_back(keys[i].y);
+                msg.keys.push_back(keys[i].z);
+                grid.block_bits(keys[i], &msg.occupancy[i * OCC_BLOCK_VOXELS / 8]);
             }
+            if (!keys.empty()) {
+                pubBlocks.publish(msg);
+            }
+        }
+        last_subscribers = subscribers;
+        grid.clear_changed();
+
+        // 二维投影，只重算变化的列
+        if ((ros::WallTime::now() - last_2d).toSec() < occupancy_2d_period || pubGrid.getNumSubscribers() == 0) {
+            continue;
+        }
+        last_2d = ros::WallTime::now();
+        const OccupancyGrid::ColumnMap &columns = grid.update_projection();
+        if (columns.empty()) {
+            continue;
+        }
+        int32_t min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+        for (const auto &column : columns) {
+            min_x = std::min(min_x, column.first.x);
+            min_y = std::min(min_y, column.first.y);
+            max_x = std::max(max_x, column.first.x);
+            max_y = std::max(max_y, column.first.y);
         }
+        nav_msgs::OccupancyGrid msg;
+        msg.header.stamp = stamp;
+        msg.header.frame_id = "ground";
+        msg.info.map_load_time = stamp;
+        msg.info.resolution = grid.get_resolution();
+        msg.info.width = (max_x - min_x + 1) * OCC_BLOCK_SIZE;
+        msg.info.height = (max_y - min_y + 1) * OCC_BLOCK_SIZE;
+        msg.info.origin.position.x = min_x * OCC_BLOCK_SIZE * grid.get_resolution();
+        msg.info.origin.position.y = min_y * OCC_BLOCK_SIZE * grid.get_resolution();
+        msg.info.origin.position.z = 0.0;
+        msg.info.origin.orientation.w = 1.0;
+        msg.data.assign(msg.info.width * msg.info.height, -1);
+        for (const auto &column : columns) {
+            const int x0 = (column.first.x - min_x) * OCC_BLOCK_SIZE;
+            const int y0 = (column.first.y - min_y) * OCC_BLOCK_SIZE;
+            for (int cy = 0; cy < OCC_BLOCK_SIZE; cy++) {
+                memcpy(&msg.data[(y0 + cy) * msg.info.width + x0], &column.second.cells[cy * OCC_BLOCK_SIZE],
+                    OCC_BLOCK_SIZE);
+            }
+        }
+        pubGrid.publish(msg);
     }
+    neal::logger(neal::LOG_INFO, "occupancy grid blocks: " + std::to_string(grid.num_blocks()) +
+        ", memory: " + std::to_string(grid.memory_bytes() / 1024) + "KB, dropped scans: " +
+        std::to_string(occupancy_dropped.load()));
+    if (esdf_count > 0) {
+        neal::logger(neal::LOG_INFO, "esdf blocks: " + std::to_string(esdf_map.num_blocks()) +
+            ", memory: " + std::to_string(esdf_map.memory_bytes() / 1024) + "KB, update time mean: " +
+            std::to_string(esdf_total_ms / esdf_count) + "ms, max: " + std::to_string(esdf_max_ms) + "ms");
+    }
+}
 
-    /* 数据准备*/
-    int effct_feat_num = 0;  // 有效特征点数
-    for (int i = 0; i < feats_down_size; i++) {
-        // 如果是有效点
-        if (point_selected_surf[i]) {
-            // 将点云的 LiDAR 坐标存到 laserCloudOri 中
-            laserCloudOri->points[effct_feat_num] = feats_down_body->points[i];
-            // 将拟合平面法向量存到 corr_normvect 中
-            corr_normvect->points[effct_feat_num] = normvec->points[i];
-            effct_feat_num ++;  // 有效特征点数 ++
+/* TSDF 线程。
+每帧点云转到 ground 系后融合进 TsdfMap，按 tsdf_mesh_period 重新提取变化的块的网格，
+每块一个 TRIANGLE_LIST 发布到 /mesh（MarkerArray，camera_init 系，用 marker 的姿态把 ground 系转过去），
+结束时把整个网格写入 PCD/mesh.ply（ground 系）。*/
+void tsdf_thread(const ros::Publisher pubMesh) {
+
+    TsdfMap tsdf;
+    tsdf.set_voxel_size(tsdf_voxel_size);
+    tsdf.set_truncation(tsdf_truncation);
+    tsdf.set_max_range(tsdf_max_range);
+    GroundFrame frame;
+    PointVector points;
+    std::vector<VoxelKey> changed;
+    std::unordered_map<VoxelKey, int, VoxelKeyHash> marker_ids;
+    double total_ms = 0.0;
+    size_t count = 0;
+    ros::WallTime last_mesh = ros::WallTime::now();
+    while (true) {
+        if (!tsdf_queue.pop(frame, std::chrono::milliseconds(100))) {
+            if (tsdf_queue.is_closed()) {
+                break;
+            }
+            continue;
+        }
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        transform_points(frame.scan.cloud->points, points, make_transform(frame.scan.rot, frame.scan.pos));
+        frame.scan.cloud.reset();
+        tsdf.integrate(points, frame.scan.pos);
+        total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        count++;
+
+        if ((ros::WallTime::now() - last_mesh).toSec() < tsdf_mesh_period || pubMesh.getNumSubscribers() == 0) {
+            continue;
+        }
+        last_mesh = ros::WallTime::now();
+        tsdf.update_mesh(changed);
+
+        visualization_msgs::MarkerArray markers;
+        const Eigen::Quaterniond q(frame.R_W_G.transpose());
+        for (const VoxelKey &bk : changed) {
+            const TsdfMap::BlockMesh &mesh = tsdf.get_mesh().at(bk);
+            auto id = marker_ids.emplace(bk, static_cast<int>(marker_ids.size())).first->second;
+            visualization_msgs::Marker marker;
+            marker.header.stamp = ros::Time().fromSec(frame.scan.time);
+            marker.header.frame_id = "camera_init";
+            marker.ns = "mesh";
+            marker.id = id;
+            if (mesh.triangles.empty()) {
+                marker.action = visualization_msgs::Marker::DELETE;
+                markers.markers.push_back(marker);
+                continue;
+            }
+            marker.type = visualization_msgs::Marker::TRIANGLE_LIST;
+            marker.action = visualization_msgs::Marker::ADD;
+            marker.pose.orientation.x = q.x();
+            marker.pose.orientation.y = q.y();
+            marker.pose.orientation.z = q.z();
+            marker.pose.orientation.w = q.w();
+            marker.scale.x = marker.scale.y = marker.scale.z = 1.0;
+            marker.color.a = 1.0;
+            marker.points.resize(mesh.triangles.size());
+            marker.colors.resize(mesh.triangles.size());
+            for (size_t i = 0; i < mesh.triangles.size(); i += 3) {
+                const V3F &a = mesh.vertices[mesh.triangles[i]];
+                const V3F &b = mesh.vertices[mesh.triangles[i + 1]];
+                const V3F &c = mesh.vertices[mesh.triangles[i + 2]];
+                // 按法向量着色
+                const V3F n = (b - a).cross(c - a).normalized();
+                for (int j = 0; j < 3; j++) {
+                    const V3F &v = j == 0 ? a : (j == 1 ? b : c);
+                    marker.points[i + j].x = v(0);
+                    marker.points[i + j].y = v(1);
+                    marker.points[i + j].z = v(2);
+                    marker.colors[i + j].r = 0.5f + 0.5f * n(0);
+                    marker.colors[i + j].g = 0.5f + 0.5f * n(1);
+                    marker.colors[i + j].b = 0.5f + 0.5f * n(2);
+                    marker.colors[i + j].a = 1.0f;
+                }
+            }
+            markers.markers.push_back(marker);
+        }
+        if (!markers.markers.empty()) {
+            pubMesh.publish(markers);
         }
     }
 
-    if (effct_feat_num < 1) {
-        ekfom_data.valid = false;
-        ROS_WARN("No Effective Points! \n");
-        neal::logger(neal::LOG_WARN, "No Effective Points!");
-        return;
+    if (count > 0) {
+        neal::logger(neal::LOG_INFO, "tsdf blocks: " + std::to_string(tsdf.num_blocks()) +
+            ", memory: " + std::to_string(tsdf.memory_bytes() / 1024) + "KB, mean integrate time: " +
+            std::to_string(total_ms / count) + "ms, dropped scans: " + std::to_string(tsdf_dropped.load()));
+    }
+    if (tsdf_save_en) {
+        tsdf.update_mesh(changed);
+        tsdf.save_mesh(std::string(ROOT_DIR) + "PCD/mesh.ply", M3D::Identity());
     }
+}
+
+// ESDF 查询服务，在快照上查询，不阻塞占据栅格线程
+bool query_distance(lio::QueryDistance::Request &req, lio::QueryDistance::Response &res) {
+
+    EsdfMap::SnapshotPtr snapshot = esdf_map.snapshot();
+    res.distances.resize(req.points.size());
+    res.gradients.resize(req.points.size());
+    V3D gradient;
+    for (size_t i = 0; i < req.points.size(); i++) {
+        res.distances[i] = snapshot->distance(V3D(req.points[i].x, req.points[i].y, req.points[i].z), gradient);
+        res.gradients[i].x = gradient(0);
+        res.gradients[i].y = gradient(1);
+        res.gradients[i].z = gradient(2);
+    }
+    res.version = snapshot->version();
+    return true;
+}
 
-    /* 求解观测雅可比矩阵 H 和观测向量 h*/
-    ekfom_data.h_x = Eigen::MatrixXd::Zero(effct_feat_num, 12);  // 观测雅可比矩阵 H
-    ekfom_data.h.resize(effct_feat_num);                         // 观测向量 h
-    for (int i = 0; i < effct_feat_num; i++) {
-        // 拿到有效点云的 LiDAR 坐标
-        const PointType &laser_p = laserCloudOri->points[i];
-        V3D point_this_be(laser_p.x, laser_p.y, laser_p.z);
-        M3D point_be_crossmat;  // LiDAR 中，点云的 ^ 矩阵
-        point_be_crossmat << SKEW_SYM_MATRX(point_this_be);
-        // 转换到 IMU 坐标系下
-        V3D point_this = st.offset_R_L_I * point_this_be + st.offset_T_L_I;
-        M3D point_crossmat;  // IMU 中，点云的 ^ 矩阵
-        point_crossmat << SKEW_SYM_MATRX(point_this);
-        // 拿到拟合平面的法向量，Global 系下。
-        const PointType &norm_p = corr_normvect->points[i];
-        V3D norm_vec(norm_p.x, norm_p.y, norm_p.z);
-        // 更新观测雅可比矩阵 H
-        V3D C(st.rot.conjugate() * norm_vec);                        // (G^R_I)^T * norm_vec，IMU 系下的法向量
-        V3D A(point_crossmat * C);                                   // IMU 系下，点叉乘法向量
-        V3D B(point_be_crossmat * st.offset_R_L_I.conjugate() * C);  // LiDAR 系下，点叉乘法向量
-        ekfom_data.h_x.block<1, 12>(i, 0) << norm_p.x, norm_p.y, norm_p.z, VEC_FROM_ARRAY(A), VEC_FROM_ARRAY(B), VEC_FROM_ARRAY(C);
-        // 更新观测向量 h = -z
-        ekfom_data.h(i) = -norm_p.intensity;
+// 对应 fast-lio2 公式 12 和 13。fast-lio 公式 14。kf 的观测模型只能是普通函数，转给 lidar_map
+void h_share_model(state_ikfom &st, esekfom::dyn_share_datastruct<double> &ekfom_data) {
+
+    lidar_map.h_share_model(st, ekfom_data);
+}
+
+/* 离线回放的汇总，一行一项（key: value），给回归测试读取。*/
+void write_replay_summary(const std::string &path, std::vector<double> scan_ms, const double data_time,
+    const double wall_time, const double mean_update_time, const uint64_t allocs, const uint64_t update_allocs,
+    const size_t update_alloc_scans, const std::vector<uint64_t> &main_allocs) {
+
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == nullptr) {
+        neal::logger(neal::LOG_ERROR, "cannot open " + path);
+        return;
+    }
+    const size_t n = scan_ms.size();
+    std::sort(scan_ms.begin(), scan_ms.end());
+    auto percentile = [&scan_ms, n](const double q) {
+        return n > 0 ? scan_ms[std::min(n - 1, static_cast<size_t>(q * n))] : 0.0;
+    };
+    double sum = 0.0;
+    for (const double t : scan_ms) {
+        sum += t;
     }
+    fprintf(fp, "scans: %zu\n", n);
+    fprintf(fp, "data_time: %.3f\n", data_time);
+    fprintf(fp, "wall_time: %.3f\n", wall_time);
+    fprintf(fp, "speed: %.3f\n", wall_time > 0.0 ? data_time / wall_time : 0.0);
+    fprintf(fp, "scan_ms_mean: %.3f\n", n > 0 ? sum / n : 0.0);
+    fprintf(fp, "scan_ms_p50: %.3f\n", percentile(0.5));
+    fprintf(fp, "scan_ms_p99: %.3f\n", percentile(0.99));
+    fprintf(fp, "scan_ms_max: %.3f\n", n > 0 ? scan_ms.back() : 0.0);
+    fprintf(fp, "update_ms_mean: %.3f\n", mean_update_time * 1000.0);
+    fprintf(fp, "peak_rss_mb: %.1f\n", peak_rss_kb() / 1024.0);
+    // 没有编译 ALLOC_STATS 时为 -1
+    if (alloc_stats_enabled()) {
+        fprintf(fp, "allocs: %lu\n", static_cast<unsigned long>(allocs));
+        fprintf(fp, "allocs_per_scan: %.1f\n", n > 0 ? static_cast<double>(allocs) / n : 0.0);
+        // 迭代更新中的分配，只在缓冲区容量增长时出现
+        fprintf(fp, "update_allocs_per_scan: %.3f\n", n > 0 ? static_cast<double>(update_allocs) / n : 0.0);
+        fprintf(fp, "update_alloc_scans: %zu\n", update_alloc_scans);
+        // 主线程每帧的分配：全部的均值，以及第二个和最后一个四分之一的均值（第一个四分之一是缓冲区扩容的预热），
+        // 后者明显大于前者说明每帧的分配随地图增长
+        const size_t m = main_allocs.size();
+        auto mean_allocs = [&main_allocs](const size_t begin, const size_t end) {
+            double s = 0.0;
+            for (size_t i = begin; i < end; i++) {
+                s += main_allocs[i];
+            }
+            return end > begin ? s / (end - begin) : 0.0;
+        };
+        fprintf(fp, "main_allocs_per_scan: %.1f\n", mean_allocs(0, m));
+        fprintf(fp, "main_allocs_early: %.1f\n", mean_allocs(m / 4, m / 2));
+        fprintf(fp, "main_allocs_late: %.1f\n", mean_allocs(3 * m / 4, m));
+    }
+    else {
+        fprintf(fp, "allocs: -1\nallocs_per_scan: -1\nupdate_allocs_per_scan: -1\nupdate_alloc_scans: -1\n"
+            "main_allocs_per_scan: -1\nmain_allocs_early: -1\nmain_allocs_late: -1\n");
+    }
+    fclose(fp);
+    neal::logger(neal::LOG_INFO, "replay summary saved: " + path);
 }
 
 int main(int argc, char** argv) {
@@ -574,14 +1032,83 @@ int main(int argc, char** argv) {
     // 从文件读取参数
     nh.param<bool>("publish/pub_odometry_en",pub_odometry_en,true);
     nh.param<bool>("publish/pub_path_en",pub_path_en,true);
+    nh.param<int>("publish/path_step",path_step,10);
+    nh.param<int>("publish/path_max_poses",path_max_poses,1000);
+    nh.param<bool>("publish/trajectory_save_en",traj_save_en,false);
+    nh.param<bool>("publish/compressed_publish_en",compressed_pub_en,false);
+    nh.param<double>("publish/compressed_resolution",compressed_resolution,0.01);
     nh.param<bool>("publish/scan_publish_en",scan_pub_en,true);
     nh.param<bool>("publish/pcd_save_en",pcd_save_en,false);
+    nh.param<int>("publish/pcd_save_queue_size",pcd_save_queue_size,100);
+    nh.param<double>("publish/pcd_save_flush_period",pcd_save_flush_period,1.0);
+    nh.param<double>("publish/pcd_save_voxel_size",pcd_save_voxel_size,0.0);
+    nh.param<int>("publish/pcd_save_min_hits",pcd_save_min_hits,1);
+    nh.param<double>("publish/pcd_save_checkpoint_period",pcd_save_checkpoint_period,30.0);
     nh.param<bool>("publish/dense_publish_en",dense_pub_en,true);
+    nh.param<bool>("publish/map_publish_en",map_pub_en,false);
+    nh.param<double>("publish/map_publish_period",map_pub_period,1.0);
     nh.param<int>("max_iteration",num_max_iterations,4);
     nh.param<std::string>("common/lid_topic",lid_topic,"/livox/lidar");
     nh.param<std::string>("common/imu_topic",imu_topic,"/livox/imu");
     nh.param<double>("mapping/filter_size_map",filter_size_map_min,0.05);
     nh.param<double>("mapping/filter_size_surf",filter_size_surf_min,0.5);  // 取 0.5，太小会崩溃
+    nh.param<std::string>("mapping/prior_map",prior_map_file,"");
+    nh.param<bool>("mapping/map_save_en",map_save_en,false);
+    nh.param<double>("mapping/map_tile_size",map_tile_size,10.0);
+    nh.param<bool>("mapping/compact_map_en",compact_map_en,false);
+    nh.param<double>("mapping/compact_tile_size",compact_tile_size,0.5);
+    nh.param<bool>("occupancy/enable",occupancy_en,false);
+    nh.param<double>("occupancy/resolution",occupancy_resolution,0.1);
+    nh.param<double>("occupancy/project_min_z",occupancy_min_z,-0.5);
+    nh.param<double>("occupancy/project_max_z",occupancy_max_z,1.0);
+    nh.param<double>("occupancy/publish_2d_period",occupancy_2d_period,1.0);
+    nh.param<double>("occupancy/max_range",occupancy_max_range,30.0);
+    nh.param<int>("occupancy/num_threads",occupancy_threads,2);
+    nh.param<bool>("tsdf/enable",tsdf_en,false);
+    nh.param<double>("tsdf/voxel_size",tsdf_voxel_size,0.05);
+    nh.param<double>("tsdf/truncation",tsdf_truncation,0.15);
+    nh.param<double>("tsdf/max_range",tsdf_max_range,10.0);
+    nh.param<double>("tsdf/mesh_period",tsdf_mesh_period,2.0);
+    nh.param<int>("tsdf/queue_size",tsdf_queue_size,5);
+    nh.param<bool>("tsdf/save_mesh_en",tsdf_save_en,false);
+    nh.param<bool>("plane/enable",plane_map_en,false);
+    nh.param<double>("plane/voxel_size",plane_voxel_size,0.5);
+    nh.param<double>("plane/max_rms",plane_max_rms,0.02);
+    nh.param<double>("plane/max_angle",plane_max_angle,10.0);
+    nh.param<double>("plane/max_extent",plane_max_extent,5.0);
+    nh.param<int>("plane/min_points",plane_min_points,10);
+    nh.param<int>("plane/max_kept",plane_max_kept,10);
+    nh.param<bool>("plane/save_en",plane_save_en,false);
+    nh.param<bool>("occupancy/esdf_en",esdf_en,false);
+    nh.param<double>("occupancy/esdf_max_distance",esdf_max_distance,2.0);
+    nh.param<int>("occupancy/esdf_max_updates",esdf_max_updates,100000);
+    nh.param<int>("occupancy/esdf_publish_updates",esdf_publish_updates,10);
+    nh.param<double>("occupancy/esdf_publish_period",esdf_publish_period,0.5);
+    nh.param<std::string>("replay/bag_file",replay_bag_file,"");
+    nh.param<double>("replay/start_time",replay_start_time,0.0);
+    nh.param<bool>("record/enable",record_en,false);
+    nh.param<bool>("flight_recorder/enable",flight_en,true);
+    nh.param<double>("flight_recorder/window",flight_window,5.0);
+    nh.param<double>("flight_recorder/post_time",flight_post_time,1.0);
+    nh.param<double>("flight_recorder/cooldown",flight_cooldown,10.0);
+    nh.param<int>("flight_recorder/max_dumps",flight_max_dumps,10);
+    nh.param<int>("flight_recorder/min_effective",flight_min_effective,20);
+    nh.param<double>("flight_recorder/max_scan_gap",flight_max_scan_gap,0.5);
+    nh.param<double>("flight_recorder/max_imu_gap",flight_max_imu_gap,0.1);
+    nh.param<double>("flight_recorder/max_scan_ms",flight_max_scan_ms,200.0);
+    nh.param<double>("flight_recorder/max_lidar_rate",flight_max_lidar_rate,20.0);
+    nh.param<bool>("diagnostics/latency_en",latency_en,true);
+    latency_stats.set_enabled(latency_en);  // 关闭时 LATENCY_SCOPE 等不再记录
+    nh.param<double>("diagnostics/publish_period",latency_pub_period,1.0);
+    nh.param<bool>("diagnostics/save_csv_en",latency_save_en,false);
+    nh.param<bool>("diagnostics/log_async_en",log_async_en,true);
+    nh.param<int>("diagnostics/log_flush_period",log_flush_period,10);
+    nh.param<int>("diagnostics/log_rate_burst",log_rate_burst,10);
+    nh.param<double>("diagnostics/log_rate_period",log_rate_period,1.0);
+    nh.param<bool>("mapping/coarse_to_fine_en",coarse_to_fine_en,false);
+    nh.param<int>("mapping/coarse_iterations",coarse_iterations,1);
+    nh.param<double>("mapping/coarse_scale",coarse_scale,2.0);
+    nh.param<int>("mapping/coarse_check_interval",coarse_check_interval,0);
     // nh.param<float>("mapping/cube_side_length",cube_len,100.0);
     // nh.param<float>("mapping/det_range",det_range,260.0);
     nh.param<double>("mapping/gyr_cov",gyr_cov,0.5);
@@ -602,12 +1129,15 @@ int main(int argc, char** argv) {
     p_pre->set_point_filter_num(param_filters);
     p_pre->set_reflect_thresh(param_reflect);
     
-    // 初始化输出路径
-    path.header.stamp = ros::Time::now();
-    path.header.frame_id ="camera_init";
-    // VoxelGrid 用来执行降采样操作，PointType = pcl::PointXYZINormal
-    pcl::VoxelGrid<PointType> downSizeFilterSurf;
-    downSizeFilterSurf.setLeafSize(filter_size_surf_min, filter_size_surf_min, filter_size_surf_min);
+    // 降采样，结果与 pcl::VoxelGrid 相同，缓冲区在帧之间复用
+    VoxelFilter downSizeFilterSurf;
+    downSizeFilterSurf.set_leaf_size(filter_size_surf_min);
+    // 由粗到精匹配的低分辨率点云，最后至少一次迭代使用全分辨率
+    coarse_iterations = std::min(coarse_iterations, num_max_iterations - 1);
+    if (coarse_to_fine_en && coarse_iterations <= 0) {
+        neal::logger(neal::LOG_WARN, "max_iteration too small for coarse-to-fine matching, disabled.");
+        coarse_to_fine_en = false;
+    }
     // 设置 IMU 的参数，对 p_imu 进行初始化
     V3D Lidar_T_wrt_IMU(V3D(0.0,0.0,0.0));
     M3D Lidar_R_wrt_IMU(M3D::Identity());
@@ -620,6 +1150,87 @@ int main(int argc, char** argv) {
     p_imu->set_gyr_bias_cov(V3D(b_gyr_cov, b_gyr_cov, b_gyr_cov));
     p_imu->set_acc_bias_cov(V3D(b_acc_cov, b_acc_cov, b_acc_cov));
 
+    // 地图，需要在建图之前设置
+    lidar_map.set_filter_size(filter_size_map_min);
+    lidar_map.set_coarse_to_fine(coarse_to_fine_en, filter_size_surf_min, coarse_scale, coarse_iterations);
+    // 量化存储的地图
+    lidar_map.set_compact(compact_map_en, compact_tile_size);
+    if (compact_map_en) {
+        neal::logger(neal::LOG_INFO, "compact map enabled, tile size: " + std::to_string(compact_tile_size) +
+            ", quantization error bound: " + std::to_string(lidar_map.compact().quantization_error_bound()) + "m");
+    }
+    // 平面提取
+    lidar_map.set_plane_map(plane_map_en);
+    if (plane_map_en) {
+        PlaneMap &plane_map = lidar_map.planes();
+        plane_map.set_voxel_size(plane_voxel_size);
+        plane_map.set_max_rms(plane_max_rms);
+        plane_map.set_max_angle(plane_max_angle);
+        plane_map.set_max_extent(plane_max_extent);
+        plane_map.set_min_points(plane_min_points);
+        plane_map.set_max_kept(plane_max_kept);
+    }
+    // 离线回放：轨迹和延迟统计总是保存，后台队列满时等待，不丢数据
+    if (!replay_bag_file.empty()) {
+        if (!replay_open(replay_bag_file, lid_topic, imu_topic)) {
+            return 1;
+        }
+        // .lsr 保存的是预处理之后的点，回放时配置中的预处理参数不起作用，不一致时提示
+        if (replay_log.is_open()) {
+            const SensorLogHeader &header = replay_log.get_header();
+            if (header.point_filter_num != param_filters || header.scan_line != param_scans ||
+                header.reflect_thresh != param_reflect || std::fabs(header.blind - param_blind) > 1e-6) {
+                neal::logger(neal::LOG_WARN, "preprocess params differ from the recording, using the recorded ones: "
+                    "point_filter_num " + std::to_string(header.point_filter_num) + " vs " + std::to_string(param_filters) +
+                    ", scan_line " + std::to_string(header.scan_line) + " vs " + std::to_string(param_scans) +
+                    ", reflect_thresh " + std::to_string(header.reflect_thresh) + " vs " + std::to_string(param_reflect) +
+                    ", blind " + std::to_string(header.blind) + " vs " + std::to_string(param_blind));
+                ROS_WARN("preprocess params differ from the recording, see the log");
+            }
+        }
+        replay_en = true;
+        traj_save_en = true;
+        latency_save_en = true;
+        publish_stage.set_blocking(true);
+        scan_writer.set_blocking(true);
+    }
+    // 传感器记录，回放 .lsr 时不需要再记录
+    if (record_en && !replay_log.is_open()) {
+        sensor_log.set_preprocess(param_filters, param_scans, param_reflect, param_blind);
+        sensor_log.open(std::string(ROOT_DIR) + "PCD/sensors.lsr");
+    }
+    // 飞行记录仪持有最近 flight_window 秒的点云，点云池按 LiDAR 的最高帧率留出空间
+    flight_max_lidar_rate = std::max(flight_max_lidar_rate, 1.0);
+    lidar_pool.set_max_size(32 + (flight_en ? static_cast<size_t>(std::ceil(flight_window * flight_max_lidar_rate)) : 0));
+    // 飞行记录仪，回放 .lsr 时预处理参数以记录的文件头为准
+    if (flight_en) {
+        if (replay_log.is_open()) {
+            const SensorLogHeader &header = replay_log.get_header();
+            flight_recorder.set_preprocess(header.point_filter_num, header.scan_line, header.reflect_thresh, header.blind);
+        }
+        else {
+            flight_recorder.set_preprocess(param_filters, param_scans, param_reflect, param_blind);
+        }
+        flight_recorder.set_window(flight_window, 1000.0, flight_max_lidar_rate);
+        flight_recorder.set_trigger_param(flight_post_time, flight_cooldown, flight_max_dumps);
+        flight_recorder.start(std::string(ROOT_DIR) + "PCD/");
+    }
+    // 增量保存地图，先验地图
+    if (map_save_en) {
+        map_writer.open(std::string(ROOT_DIR) + "PCD/map.lim", map_tile_size, LIM_FRAME_WORLD);
+    }
+    if (pcd_save_en) {
+        scan_writer.set_queue_size(pcd_save_queue_size);
+        scan_writer.set_flush_period(pcd_save_flush_period);
+        scan_writer.set_voxel_size(pcd_save_voxel_size);
+        scan_writer.set_min_hits(std::max(pcd_save_min_hits, 1));
+        scan_writer.set_checkpoint_period(pcd_save_checkpoint_period);
+        scan_writer.open(std::string(ROOT_DIR) + "PCD/scans.lim", map_tile_size);
+    }
+    if (!prior_map_file.empty() && load_prior_map(prior_map_file)) {
+        ROS_INFO("map initialized from prior map!");
+    }
+
     /* ikfom 第六步，初始化。*/
     esekfom::esekf<state_ikfom, 12, input_ikfom> kf;  // 状态，噪声维度，输入
     /* ikfom 第七步，发布 kf。*/
@@ -629,15 +1240,82 @@ int main(int argc, char** argv) {
 
     /* ROS 订阅器和发布器的定义和初始化*/
     // 雷达点云的订阅器 sub_pcl，订阅点云的 topic
-    ros::Subscriber sub_pcl = nh.subscribe(lid_topic, 200000, livox_pcl_cbk);
-    // IMU 的订阅器 sub_imu，订阅 IMU 的 topic
-    ros::Subscriber sub_imu = nh.subscribe(imu_topic, 200000, imu_cbk);
+    // IMU 的订阅器 sub_imu，订阅 IMU 的 topic；离线回放时不订阅
+    ros::Subscriber sub_pcl, sub_imu;
+    if (!replay_en) {
+        sub_pcl = nh.subscribe(lid_topic, 200000, livox_pcl_cbk);
+        sub_imu = nh.subscribe(imu_topic, 200000, imu_cbk);
+    }
     // 发布当前正在扫描的点云，topic 名字为 cloud_registered
     ros::Publisher pubLaserCloudFull = nh.advertise<sensor_msgs::PointCloud2>("/cloud_registered", 100000);
     // 发布当前里程计信息，topic 名字为 Odometry
     ros::Publisher pubOdomAftMapped = nh.advertise<nav_msgs::Odometry>("/Odometry", 100000);
     // 发布里程计总的路径，topic 名字为 path
     ros::Publisher pubPath = nh.advertise<nav_msgs::Path>("/path", 100000);
+    // 发布整张地图，topic 名字为 Laser_map
+    ros::Publisher pubLaserMap = nh.advertise<sensor_msgs::PointCloud2>("/Laser_map", 10);
+    // 增量发布位姿，topic 名字为 pose
+    ros::Publisher pubPose = nh.advertise<geometry_msgs::PoseStamped>("/pose", 100);
+    // 发布压缩点云，topic 名字为 cloud_compressed
+    if (compressed_pub_en) {
+        publish_stage.set_compressed(nh.advertise<lio::CompressedCloud>("/cloud_compressed", 10), compressed_resolution);
+    }
+    // 里程计、轨迹和点云在发布线程中发布
+    publish_stage.set_path_param(std::max(path_step, 1), std::max(path_max_poses, 1));
+    if (traj_save_en) {
+        publish_stage.open_trajectory(std::string(ROOT_DIR) + "PCD/trajectory.txt");
+    }
+    publish_stage.start(scan_pub_en ? pubLaserCloudFull : ros::Publisher(),
+        pub_odometry_en ? pubOdomAftMapped : ros::Publisher(), pub_path_en ? pubPath : ros::Publisher(),
+        pub_path_en ? pubPose : ros::Publisher());
+    std::thread map_pub_thread;
+    if (map_pub_en && compact_map_en) {
+        map_pub_thread = std::thread(publish_map_thread, pubLaserMap);
+    }
+    else if (map_pub_en) {
+        neal::logger(neal::LOG_WARN, "map publishing needs compact_map_en, disabled.");
+    }
+    // ESDF 查询服务 /query_distance，需要在占据栅格线程启动前设置
+    esdf_en = esdf_en && occupancy_en;
+    ros::ServiceServer srvDistance;
+    if (esdf_en) {
+        esdf_map.set_resolution(occupancy_resolution);
+        esdf_map.set_max_distance(esdf_max_distance);
+        esdf_map.set_max_updates(esdf_max_updates);
+        esdf_map.set_publish_interval(std::max(esdf_publish_updates, 0), esdf_publish_period);
+        srvDistance = nh.advertiseService("/query_distance", query_distance);
+    }
+    // 发布占据栅格变化的块和二维投影，topic 名字为 occupancy_blocks 和 occupancy_2d
+    std::thread occ_thread;
+    if (occupancy_en) {
+        ros::Publisher pubOccBlocks = nh.advertise<lio::OccupancyBlocks>("/occupancy_blocks", 10);
+        ros::Publisher pubOccGrid = nh.advertise<nav_msgs::OccupancyGrid>("/occupancy_2d", 1, true);
+        occ_thread = std::thread(occupancy_thread, pubOccBlocks, pubOccGrid);
+    }
+    // TSDF 网格，topic 名字为 mesh
+    std::thread tsdf_worker;
+    if (tsdf_en) {
+        tsdf_queue.set_capacity(tsdf_queue_size);
+        ros::Publisher pubMesh = nh.advertise<visualization_msgs::MarkerArray>("/mesh", 1, true);
+        tsdf_worker = std::thread(tsdf_thread, pubMesh);
+    }
+    // 各阶段延迟统计，topic 名字为 diagnostics
+#ifndef LATENCY_STATS
+    if (latency_en) {
+        neal::logger(neal::LOG_WARN, "latency statistics not compiled in (LATENCY_STATS), disabled.");
+        latency_en = false;
+    }
+#endif
+    ros::Publisher pubDiagnostics;
+    if (latency_en) {
+        pubDiagnostics = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+    }
+    // 异步日志，关闭时热路径中的日志同步输出（仍然限流）
+    async_logger.set_rate_limit(log_rate_burst, log_rate_period);
+    async_logger.set_flush_period(log_flush_period);
+    if (log_async_en) {
+        async_logger.start();
+    }
 
     // 中断处理函数，第一个参数 SIGINT 代表中断（interrupt）
     // 如果有中断信号（比如 Ctrl+C），则执行第二个参数里面的 SigHandle 函数
@@ -651,6 +1329,33 @@ int main(int argc, char** argv) {
     double first_lidar_time = 0.0;
     // sync_packages 中使用的变量
     MeasureGroup measures;
+    // 迭代次数和 update 耗时统计
+    int scan_count = 0;
+    long total_iterations = 0;
+    double total_update_time = 0.0;
+    ros::WallTime last_latency_pub = ros::WallTime::now();
+    // 离线回放的耗时报告：每帧一行，allocs 为这一帧内（所有线程）的内存分配次数，
+    // main_allocs 为主线程处理这一帧（同步之后到发布）的分配次数，不受其他线程影响
+    ros::WallTime t_replay = ros::WallTime::now();
+    double last_lidar_time = 0.0;
+    FILE *replay_fp = nullptr;
+    std::vector<double> replay_scan_ms;
+    std::vector<uint64_t> replay_main_allocs;
+    const AllocCounts replay_allocs = alloc_counts();
+    // 迭代更新（h_share_model 和 update）中的分配次数，缓冲区的容量稳定之后应该为 0
+    uint64_t update_allocs = 0;
+    size_t update_alloc_scans = 0;
+    esekfom::esekf<state_ikfom, 12, input_ikfom> kf_ref;  // 由粗到精的对比，在循环外定义，避免每帧构造
+    if (replay_en) {
+        replay_fp = fopen((std::string(ROOT_DIR) + "PCD/replay_timing.csv").c_str(), "w");
+        if (replay_fp != nullptr) {
+            fprintf(replay_fp, "time,points,down_points,iterations,update_ms,scan_ms,allocs,update_allocs,main_allocs\n");
+        }
+        else {
+            // 逐帧的 CSV 不写，回放照常全速运行，汇总照常输出
+            neal::logger(neal::LOG_ERROR, "failed to open " + std::string(ROOT_DIR) + "PCD/replay_timing.csv");
+        }
+    }
     while (status) {
         if (flg_exit) {  // 有中断产生
             break;
@@ -658,22 +1363,39 @@ int main(int argc, char** argv) {
         // 订阅器的回调函数处理一次
         ros::spinOnce();
         // 将第一帧 LiDAR 数据，和这段时间内的 IMU 数据从缓存队列中取出，并保存到 meas 中
-        if(!sync_packages(measures)) {
+        // 只统计取到数据的调用，等待数据的空转不计入；回放时包含读取 bag 和预处理的时间
+        LATENCY_BEGIN(t_sync);
+        if (replay_en) {
+            if (!replay_next(measures)) {
+                break;
+            }
+        }
+        else if(!sync_packages(measures)) {
             status = ros::ok();
             rate.sleep();
             continue;
         }
+        LATENCY_END(t_sync, LATENCY_SYNC);
+        ros::WallTime t_scan = ros::WallTime::now();
+        const uint64_t scan_allocs = alloc_counts().count;
+        const uint64_t main_allocs_begin = thread_alloc_count();
+        last_lidar_time = measures.lidar_end_time;
         // 第一次 while 循环，进行初始化
         if (flg_first_scan) {
             first_lidar_time = measures.lidar_beg_time;
             flg_first_scan = false;
             continue;
         }
+        // 点云每帧从池中取，上一帧可能还在发布线程和保存线程中使用
+        feats_undistort = undistort_pool.acquire();
+        feats_down_body = down_pool.acquire();
         // 对 IMU 数据进行预处理，包含了前向传播和反向传播
+        LATENCY_BEGIN(t_imu);
         p_imu->Process(measures, kf, feats_undistort);
+        LATENCY_END(t_imu, LATENCY_IMU_PROCESS);
         // 如果点云数据为空，代表激光雷达没有完成去畸变，此时还不能初始化成功
         if (feats_undistort->empty() || (feats_undistort == NULL)) {
-            ROS_WARN("No point, skip this scan!(1)\n");
+            ASYNC_LOG(neal::LOG_WARN, "No point, skip this scan!(1)");
             continue;
         }
         // 获取 kf 预测的全局状态
@@ -684,80 +1406,230 @@ int main(int argc, char** argv) {
         // lasermap_fov_segment(pos_lid);
 
         // 对一次 scan 内的特征点云降采样
-        downSizeFilterSurf.setInputCloud(feats_undistort);     // 输入去畸变后的点云数据
-        downSizeFilterSurf.filter(*feats_down_body);           // 输出降采样后的点云数据
+        LATENCY_BEGIN(t_down);
+        downSizeFilterSurf.filter(*feats_undistort, *feats_down_body);  // 去畸变后的点云降采样
+        LATENCY_END(t_down, LATENCY_DOWNSAMPLE);
         int feats_down_size = feats_down_body->points.size();  // 降采样后的点云数量
         // neal::logger(neal::LOG_INFO, "size before down sample: " + std::to_string(feats_undistort->points.size())
         //     + "; size after down sample: " + std::to_string(feats_down_size));
         if (feats_down_size <= 5) {
-            ROS_WARN("No point, skip this scan!(2)\n");
+            ASYNC_LOG(neal::LOG_WARN, "No point, skip this scan!(2)");
             continue;
         }
 
-        // 构建 ikd-Tree
-        if(ikdtree.Root_Node == nullptr) {
-            // 设置 ikd-Tree 的降采样参数
-            ikdtree.set_downsample_param(filter_size_map_min);
-            // 世界坐标系下，降采样的点云数据
-            feats_down_world->resize(feats_down_size);
-            for(int i = 0; i < feats_down_size; i++) {
-                // 将降采样得到的点云数据，转换到世界坐标系下
-                pointBodyToWorld(&(feats_down_body->points[i]), &(feats_down_world->points[i]));
+        // 本帧的点云，同时生成由粗到精匹配的低分辨率点云
+        lidar_map.set_scan(feats_down_body);
+        // 构建地图
+        if(!lidar_map.initialized()) {
+            // 降采样的点云转换到世界坐标系下，构建地图
+            lidar_map.build_from_scan(state_point);
+            if (map_writer.is_open()) {
+                // IMU 初始化之后 R_W_G 已知，立即写入文件头
+                map_writer.set_R_W_G(p_imu->get_R_W_G());
+                map_writer.add_points(lidar_map.scan_world());
             }
-            // 构建 ikd-Tree
-            ikdtree.Build(feats_down_world->points);
-            ROS_INFO("ikd-Tree initialized!");
+            ROS_INFO("map initialized!");
 
             continue;
         }
 
         /* 迭代卡尔曼滤波更新地图信息*/
-        feats_down_world->resize(feats_down_size);
-        Nearest_Points.resize(feats_down_size);
+        scan_count ++;
+
+        // 与单分辨率迭代对比，参考结果在 kf 的副本上计算，不影响正常流程
+        bool coarse_check = lidar_map.coarse_active() && coarse_check_interval > 0 && scan_count % coarse_check_interval == 0;
+        double ref_update_time = 0.0;
+        if (coarse_check) {
+            kf_ref = kf;
+            lidar_map.set_coarse_active(false);
+            ros::WallTime t_ref = ros::WallTime::now();
+            kf_ref.update_iterated_dyn_share_modified(_LASER_POINT_COV);
+            ref_update_time = (ros::WallTime::now() - t_ref).toSec();
+            lidar_map.set_coarse_active(true);
+        }
+
         /* ikfom 第九步，更新*/
+        ros::WallTime t_update = ros::WallTime::now();
+        // 只统计主线程，发布、保存等线程同时的分配不计入
+        const uint64_t update_allocs_begin = thread_alloc_count();
         kf.update_iterated_dyn_share_modified(_LASER_POINT_COV);
+        const uint64_t scan_update_allocs = thread_alloc_count() - update_allocs_begin;
+        double update_time = (ros::WallTime::now() - t_update).toSec();
+        update_allocs += scan_update_allocs;
+        update_alloc_scans += scan_update_allocs > 0 ? 1 : 0;
+        total_update_time += update_time;
+        LATENCY_RECORD(LATENCY_UPDATE, static_cast<uint64_t>(update_time * 1e9));
+        total_iterations += kf.get_last_iter();
+
+        if (coarse_check) {
+            const state_ikfom &x_ref = kf_ref.get_x();
+            const state_ikfom &x_c2f = kf.get_x();
+            std::string strout;
+            strout = "coarse-to-fine check, iterations: " + std::to_string(kf.get_last_iter()) + " vs " +
+                std::to_string(kf_ref.get_last_iter()) + ", update time: " + std::to_string(update_time * 1000.0) +
+                "ms vs " + std::to_string(ref_update_time * 1000.0) + "ms, pos diff: " +
+                std::to_string((x_c2f.pos - x_ref.pos).norm()) + "m, rot diff: " +
+                std::to_string(x_c2f.rot.angularDistance(x_ref.rot) * 57.3) + "deg";
+            neal::logger(neal::LOG_INFO, strout);
+        }
         
         /* 发布里程计*/
         state_point = kf.get_x();
         pos_lid = state_point.pos + state_point.rot * state_point.offset_T_L_I;
-        geoQuat.x = state_point.rot.coeffs()[0];
-        geoQuat.y = state_point.rot.coeffs()[1];
-        geoQuat.z = state_point.rot.coeffs()[2];
-        geoQuat.w = state_point.rot.coeffs()[3];
-        if (pub_odometry_en) {
-            publish_odometry(pubOdomAftMapped, kf.get_P());
+        if (flight_en) {
+            flight_recorder.add_state(lidar_end_time, state_point, kf.get_P(), lidar_map.last_effective(),
+                kf.get_last_iter());
+            if (lidar_map.last_effective() < flight_min_effective) {
+                flight_recorder.trigger("degenerate", lidar_end_time);
+            }
+        }
+        if (pub_odometry_en || pub_path_en || traj_save_en) {
+            publish_odometry(kf.get_P());
+        }
+        // 端到端延迟：帧结束时间戳到位姿交给发布线程，离线回放时没有意义
+        if (!replay_en) {
+            LATENCY_RECORD(LATENCY_END_TO_END, static_cast<uint64_t>(std::max(0.0, ros::Time::now().toSec() - lidar_end_time) * 1e9));
         }
 
         /* 向 ikd-Tree 添加特征点*/
         bool flg_EKF_inited = (measures.lidar_beg_time - first_lidar_time) < _INIT_TIME ? false : true;
         map_incremental(flg_EKF_inited);
 
-        /* 发布轨迹和点*/
-        if (pub_path_en) {
-            publish_path(pubPath);
+        /* 发布点云*/
+        if (scan_pub_en || compressed_pub_en || pcd_save_en || occupancy_en || tsdf_en) {
+            LATENCY_BEGIN(t_pub);
+            publish_frame_world(p_imu->get_R_W_G());
+            LATENCY_END(t_pub, LATENCY_PUBLISH);
         }
-        if (scan_pub_en || pcd_save_en) {
-            publish_frame_world(pubLaserCloudFull, p_imu->get_R_W_G());
+        if (latency_en && (ros::WallTime::now() - last_latency_pub).toSec() >= latency_pub_period) {
+            publish_latency(pubDiagnostics);
+            last_latency_pub = ros::WallTime::now();
         }
 
         status = ros::ok();
-        rate.sleep();
+        const double scan_ms = (ros::WallTime::now() - t_scan).toSec() * 1000.0;
+        if (flight_en && scan_ms > flight_max_scan_ms) {
+            flight_recorder.trigger("latency", lidar_end_time);
+        }
+        // 回放时全速运行，是否限速只由 replay_en 决定，与 CSV 能否打开无关
+        if (replay_en) {
+            const uint64_t main_allocs = thread_alloc_count() - main_allocs_begin;
+            replay_scan_ms.push_back(scan_ms);
+            replay_main_allocs.push_back(main_allocs);
+            if (replay_fp != nullptr) {
+                fprintf(replay_fp, "%.6f,%zu,%d,%d,%.3f,%.3f,%lu,%lu,%lu\n", lidar_end_time,
+                    feats_undistort->points.size(), feats_down_size, kf.get_last_iter(), update_time * 1000.0, scan_ms,
+                    static_cast<unsigned long>(alloc_counts().count - scan_allocs),
+                    static_cast<unsigned long>(scan_update_allocs), static_cast<unsigned long>(main_allocs));
+            }
+        }
+        else {
+            rate.sleep();
+        }
+    }
+    if (replay_en) {
+        if (replay_fp != nullptr) {
+            fclose(replay_fp);
+        }
+        const double wall_time = (ros::WallTime::now() - t_replay).toSec();
+        const double data_time = last_lidar_time - first_lidar_time;
+        neal::logger(neal::LOG_INFO, "replay finished: " + replay_bag_file + ", scans: " + std::to_string(scan_count) +
+            ", data time: " + std::to_string(data_time) + "s, wall time: " + std::to_string(wall_time) +
+            "s, speed: " + std::to_string(wall_time > 0.0 ? data_time / wall_time : 0.0) + "x");
+        write_replay_summary(std::string(ROOT_DIR) + "PCD/replay_summary.txt", replay_scan_ms, data_time, wall_time,
+            scan_count > 0 ? total_update_time / scan_count : 0.0, alloc_counts().count - replay_allocs.count,
+            update_allocs, update_alloc_scans, replay_main_allocs);
+        if (replay_log.is_open()) {
+            replay_log.close();
+        }
+        else {
+            replay_bag.close();
+        }
+    }
+    sensor_log.close();
+    flight_recorder.stop();
+    if (flight_recorder.dumps_written() > 0 || flight_recorder.triggers_ignored() > 0) {
+        neal::logger(neal::LOG_INFO, "flight recorder dumps: " + std::to_string(flight_recorder.dumps_written()) +
+            ", triggers ignored: " + std::to_string(flight_recorder.triggers_ignored()));
+    }
+    // 先输出队列中剩余的日志，再输出统计信息
+    async_logger.stop();
+    if (async_logger.events_suppressed() > 0 || async_logger.events_dropped() > 0) {
+        neal::logger(neal::LOG_INFO, "async logger suppressed: " + std::to_string(async_logger.events_suppressed()) +
+            ", dropped: " + std::to_string(async_logger.events_dropped()));
+    }
+
+    if (scan_count > 0) {
+        std::string strout;
+        strout = std::string("update statistics") + (coarse_to_fine_en ? " (coarse-to-fine)" : "") +
+            ", scans: " + std::to_string(scan_count) +
+            ", mean iterations: " + std::to_string(double(total_iterations) / scan_count) +
+            ", mean update time: " + std::to_string(total_update_time / scan_count * 1000.0) + "ms";
+        neal::logger(neal::LOG_INFO, strout);
+        neal::logger(neal::LOG_INFO, "cloud pools, lidar: " + std::to_string(lidar_pool.size()) + " (" +
+            std::to_string(lidar_pool.memory_bytes() / 1024) + "KB), undistort: " + std::to_string(undistort_pool.size()) +
+            " (" + std::to_string(undistort_pool.memory_bytes() / 1024) + "KB), down: " +
+            std::to_string(down_pool.size()) + " (" + std::to_string(down_pool.memory_bytes() / 1024) + "KB)");
+    }
+    if (latency_en) {
+        neal::logger(neal::LOG_INFO, latency_stats.summary());
+        if (latency_save_en) {
+            latency_stats.write_csv(std::string(ROOT_DIR) + "PCD/latency.csv");
+        }
+    }
+    publish_stage.stop();
+    neal::logger(neal::LOG_INFO, "published scans: " + std::to_string(publish_stage.scans_published()) +
+        ", dropped: " + std::to_string(publish_stage.scans_dropped()) +
+        ", poses dropped from publishing: " + std::to_string(publish_stage.poses_dropped()));
+    occupancy_queue.close();
+    if (occ_thread.joinable()) {
+        occ_thread.join();
+    }
+    tsdf_queue.close();
+    if (tsdf_worker.joinable()) {
+        tsdf_worker.join();
+    }
+    flg_exit = true;
+    if (map_pub_thread.joinable()) {
+        map_pub_thread.join();
+    }
+    if (compact_map_en) {
+        const CompactMap &compact_map = lidar_map.compact();
+        neal::logger(neal::LOG_INFO, "compact map points: " + std::to_string(compact_map.size()) +
+            ", tiles: " + std::to_string(compact_map.num_tiles()) +
+            ", memory: " + std::to_string(compact_map.memory_bytes() / 1024) + "KB");
+    }
+    if (plane_map_en) {
+        const PlaneMap &plane_map = lidar_map.planes();
+        neal::logger(neal::LOG_INFO, "plane patches: " + std::to_string(plane_map.num_patches()) +
+            ", planar voxels: " + std::to_string(plane_map.num_planar_voxels()) +
+            ", points absorbed: " + std::to_string(plane_map.points_absorbed()) +
+            ", memory: " + std::to_string(plane_map.memory_bytes() / 1024) + "KB");
+        if (plane_save_en) {
+            plane_map.save(std::string(ROOT_DIR) + "PCD/planes.txt", p_imu->get_R_W_G());
+            save_plane_residual(std::string(ROOT_DIR) + "PCD/plane_residual.lim", p_imu->get_R_W_G());
+        }
+    }
+    // 写入索引，关闭地图文件
+    if (map_writer.is_open()) {
+        map_writer.set_R_W_G(p_imu->get_R_W_G());
+        map_writer.close();
     }
 
     /**************** save map ****************/
-    /* 1. make sure you have enough memories
-    /* 2. pcd save will largely influence the real-time performences **/
-    if (pcl_wait_save->size() > 0 && pcd_save_en) {
+    /* 点云已经在后台线程中写入，这里只写剩余的缓存和索引。
+    转成 ply：map_convert PCD/scans.lim PCD/scans.ply*/
+    if (scan_writer.is_open()) {
         V3D gravity = p_imu->get_mean_acc();
         std::string strout;
         strout = "gravity: x " + std::to_string(gravity(0)) +
             ", y " + std::to_string(gravity(1)) + ", z " + std::to_string(gravity(2));
         neal::logger(neal::LOG_INFO, strout);
-        string file_name = string("scans.ply");
-        string all_points_dir(string(string(ROOT_DIR) + "PCD/") + file_name);
-        pcl::PLYWriter writer;
-        std::cout << "current scan saved to /PCD/" << file_name<<endl;
-        writer.write(all_points_dir, *pcl_wait_save);
+        ros::WallTime t_close = ros::WallTime::now();
+        scan_writer.close(p_imu->get_R_W_G());
+        std::cout << "current scan saved to /PCD/scans.lim" << endl;
+        neal::logger(neal::LOG_INFO, "scan writer closed in " +
+            std::to_string((ros::WallTime::now() - t_close).toSec() * 1000.0) + "ms");
     }
 
     return 0;
@@ -0,0 +1,131 @@
+#include "latency_stats.h"
+
+#include <cmath>
+#include <cstdio>
+#include <file_logger.h>
+
+LatencyStats latency_stats;
+
+int LatencyHistogram::bucket_of(const uint64_t ns) {
+
+    if (ns < 2 * LATENCY_SUB_COUNT) {
+        return static_cast<int>(ns);
+    }
+    // 最高位 e，其后 SUB_BITS 位决定桶
+    const int e = 63 - __builtin_clzll(ns);
+    if (e >= LATENCY_MAX_EXP) {
+        return LATENCY_BUCKETS - 1;
+    }
+    const int sub = static_cast<int>(ns >> (e - LATENCY_SUB_BITS)) & (LATENCY_SUB_COUNT - 1);
+    return 2 * LATENCY_SUB_COUNT + (e - LATENCY_SUB_BITS - 1) * LATENCY_SUB_COUNT + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper(const int bucket) {
+
+    if (bucket < 2 * LATENCY_SUB_COUNT) {
+        return bucket;
+    }
+    const int e = (bucket - 2 * LATENCY_SUB_COUNT) / LATENCY_SUB_COUNT + LATENCY_SUB_BITS + 1;
+    const uint64_t sub = (bucket - 2 * LATENCY_SUB_COUNT) % LATENCY_SUB_COUNT;
+    const int shift = e - LATENCY_SUB_BITS;
+    return ((LATENCY_SUB_COUNT + sub) << shift) + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(const uint64_t ns) {
+
+    buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    num.fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t old_max = max_ns.load(std::memory_order_relaxed);
+    while (ns > old_max && !max_ns.compare_exchange_weak(old_max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+
+    for (std::atomic<uint64_t> &b : buckets) {
+        b.store(0, std::memory_order_relaxed);
+    }
+    num.store(0, std::memory_order_relaxed);
+    sum_ns.store(0, std::memory_order_relaxed);
+    max_ns.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+
+    const uint64_t n = count();
+    return n > 0 ? static_cast<double>(sum_ns.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+uint64_t LatencyHistogram::percentile(const double q) const {
+
+    const uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+    const uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * n)));
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return std::min(bucket_upper(i), max());
+        }
+    }
+    return max();
+}
+
+void LatencyStats::reset() {
+
+    for (LatencyHistogram &h : hist) {
+        h.reset();
+    }
+}
+
+const char *LatencyStats::stage_name(const LatencyStage stage) {
+
+    static const char *names[LATENCY_NUM_STAGES] = {
+        "sync_packages", "imu_process", "downsample", "h_share_model", "update", "map_incremental", "publish",
+        "end_to_end"
+    };
+    return names[stage];
+}
+
+bool LatencyStats::write_csv(const std::string &path) const {
+
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == nullptr) {
+        neal::logger(neal::LOG_ERROR, "cannot open " + path);
+        return false;
+    }
+    fprintf(fp, "stage,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n");
+    for (int i = 0; i < LATENCY_NUM_STAGES; i++) {
+        const LatencyHistogram &h = hist[i];
+        fprintf(fp, "%s,%lu,%.4f,%.4f,%.4f,%.4f,%.4f\n", stage_name(static_cast<LatencyStage>(i)),
+            static_cast<unsigned long>(h.count()), h.mean() * 1e-6, h.percentile(0.5) * 1e-6,
+            h.percentile(0.9) * 1e-6, h.percentile(0.99) * 1e-6, h.max() * 1e-6);
+    }
+    const bool ok = ferror(fp) == 0;
+    fclose(fp);
+    if (!ok) {
+        neal::logger(neal::LOG_ERROR, "failed to write " + path);
+        return false;
+    }
+    neal::logger(neal::LOG_INFO, "latency statistics saved: " + path);
+    return true;
+}
+
+std::string LatencyStats::summary() const {
+
+    std::string strout = "latency (p50/p99/max ms)";
+    char buf[128];
+    for (int i = 0; i < LATENCY_NUM_STAGES; i++) {
+        const LatencyHistogram &h = hist[i];
+        if (h.count() == 0) {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), ", %s: %.3f/%.3f/%.3f", stage_name(static_cast<LatencyStage>(i)),
+            h.percentile(0.5) * 1e-6, h.percentile(0.99) * 1e-6, h.max() * 1e-6);
+        strout += buf;
+    }
+    return strout;
+}
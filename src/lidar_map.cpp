@@ -0,0 +1,370 @@
+#include "lidar_map.h"
+
+#include <cmath>
+#include <algorithm>
+#include <file_logger.h>
+
+#include "point_transform.h"
+#include "latency_stats.h"
+#include "async_logger.h"
+
+Eigen::Matrix4f body_to_world(const state_ikfom &s) {
+
+    return make_transform(s.rot.toRotationMatrix() * s.offset_R_L_I.toRotationMatrix(), s.rot * s.offset_T_L_I + s.pos);
+}
+
+LidarMap::LidarMap() : filter_size(0.05f), compact_en(false), coarse_en(false), coarse_scale(2.0f),
+    coarse_iterations(1), plane_en(false), coarse_on(false), down_body(new PointCloudXYZI()),
+    down_world(new PointCloudXYZI()), coarse_body(new PointCloudXYZI()), coarse_world(new PointCloudXYZI()),
+    last_effect_num(0), laserCloudOri(new PointCloudXYZI()), corr_normvect(new PointCloudXYZI()),
+    normvec(new PointCloudXYZI()) {}
+
+void LidarMap::set_compact(const bool en, const float tile_size) {
+
+    compact_en = en;
+    if (en) {
+        compact_map.set_tile_size(tile_size);
+    }
+}
+
+void LidarMap::set_coarse_to_fine(const bool en, const float scan_leaf, const float scale, const int iterations) {
+
+    coarse_en = en;
+    coarse_scale = scale;
+    coarse_iterations = iterations;
+    const float leaf = scan_leaf * scale;
+    coarse_filter.set_leaf_size(leaf);
+}
+
+/* 地图接口，根据 compact_en 选择 ikd-Tree 或 CompactMap。
+开启由粗到精匹配时，同时维护一份低分辨率地图，coarse 为 true 时在低分辨率地图上搜索。*/
+bool LidarMap::initialized() const {
+
+    return compact_en ? !compact_map.empty() : ikdtree.Root_Node != nullptr;
+}
+
+void LidarMap::build(const PointVector &points) {
+
+    if (compact_en) {
+        compact_map.set_downsample_param(filter_size);
+        compact_map.build(points);
+    }
+    else {
+        ikdtree.set_downsample_param(filter_size);
+        ikdtree.Build(points);
+    }
+    if (plane_en) {
+        plane_map.add_points(points);
+        plane_map.update();
+    }
+    if (!coarse_en) {
+        return;
+    }
+    // 低分辨率地图需要降采样，用 add_points 代替 build
+    if (compact_en) {
+        compact_map_coarse.set_downsample_param(filter_size * coarse_scale);
+        compact_map_coarse.clear();
+        compact_map_coarse.add_points(points, true);
+        compact_map_coarse.publish();
+    }
+    else {
+        ikdtree_coarse.set_downsample_param(filter_size * coarse_scale);
+        PointVector first_point(points.begin(), points.begin() + 1);
+        ikdtree_coarse.Build(first_point);
+        PointVector rest_points(points.begin() + 1, points.end());
+        ikdtree_coarse.Add_Points(rest_points, true);
+    }
+}
+
+void LidarMap::build_from_scan(const state_ikfom &st) {
+
+    down_world->resize(down_body->points.size());
+    transform_points(down_body->points, down_world->points, body_to_world(st));
+    build(down_world->points);
+}
+
+void LidarMap::get_points(PointVector &out) {
+
+    out.clear();
+    if (compact_en) {
+        compact_map.snapshot()->get_points(out);
+    }
+    else if (ikdtree.Root_Node != nullptr) {
+        ikdtree.flatten(ikdtree.Root_Node, out, NOT_RECORD);
+    }
+}
+
+void LidarMap::set_scan(const PointCloudXYZI::Ptr &body) {
+
+    down_body = body;
+    const size_t n = body->points.size();
+    down_world->resize(n);
+    // 最近邻只用前 n 个，只增不减，保留每个点的容量
+    if (Nearest_Points.size() < n) {
+        Nearest_Points.resize(n);
+    }
+    // 由粗到精匹配的低分辨率点云
+    coarse_on = false;
+    if (coarse_en) {
+        coarse_filter.filter(*body, *coarse_body);
+        coarse_world->resize(coarse_body->points.size());
+        if (Nearest_Points_coarse.size() < coarse_body->points.size()) {
+            Nearest_Points_coarse.resize(coarse_body->points.size());
+        }
+        coarse_on = coarse_body->points.size() > 5;
+    }
+}
+
+/* 批量最近邻搜索，nearest[i]、dist2[i] 对应 points[i]（nearest 和 dist2 可能比 points 长），距离超过 MAX_MATCH_DIST2 的点不返回。
+查询按 Morton 序执行，相邻查询访问的地图节点相同，缓存命中率更高。*/
+void LidarMap::nearest_search_batch(const PointVector &points, std::vector<PointVector> &nearest,
+    std::vector<std::vector<float>> &dist2, const bool coarse) {
+
+    if (compact_en) {
+        CompactMap &m = coarse ? compact_map_coarse : compact_map;
+        m.nearest_search_batch(points, NUM_MATCH_POINTS, nearest, dist2, MAX_MATCH_DIST2);
+        return;
+    }
+    KD_TREE<PointType> &tree = coarse ? ikdtree_coarse : ikdtree;
+    morton_order(points, filter_size, search_order);
+    // 只增不减，缩小会释放内层 vector 的容量
+    if (nearest.size() < points.size()) {
+        nearest.resize(points.size());
+    }
+    if (dist2.size() < points.size()) {
+        dist2.resize(points.size());
+    }
+    // ikd-Tree 内部把 max_dist 平方之后再与平方距离比较，这里传入距离而不是平方距离
+    const float max_dist = std::sqrt(MAX_MATCH_DIST2);
+    for (int i : search_order) {
+        tree.Nearest_Search(points[i], NUM_MATCH_POINTS, nearest[i], dist2[i], max_dist);
+        // 与原来的判断保持一致，第 k 个最近邻超出范围的点不参与拟合
+        if (!dist2[i].empty() && dist2[i].back() > MAX_MATCH_DIST2) {
+            nearest[i].clear();
+        }
+    }
+}
+
+// to_plane_map 为 false 时只加入地图，点已经累积在 plane_map 中（解散的 patch 交还的点）
+void LidarMap::add_points(PointVector &points, const bool downsample, const bool to_plane_map) {
+
+    if (compact_en) {
+        compact_map.add_points(points, downsample);
+    }
+    else {
+        ikdtree.Add_Points(points, downsample);
+    }
+    if (plane_en && to_plane_map) {
+        plane_map.add_points(points);
+    }
+    // 低分辨率地图总是降采样
+    if (coarse_en) {
+        if (compact_en) {
+            compact_map_coarse.add_points(points, true);
+        }
+        else {
+            ikdtree_coarse.Add_Points(points, true);
+        }
+    }
+}
+
+// 对应 fast-lio2 公式 12 和 13。fast-lio 公式 14。
+void LidarMap::h_share_model(state_ikfom &st, esekfom::dyn_share_datastruct<double> &ekfom_data) {
+
+    LATENCY_SCOPE(LATENCY_H_SHARE);
+    // 由粗到精：前 coarse_iterations 次迭代使用低分辨率的点云和地图
+    const bool coarse = coarse_on && ekfom_data.iter_num < coarse_iterations;
+    ekfom_data.coarse = coarse;
+    const PointCloudXYZI::Ptr &cloud_body = coarse ? coarse_body : down_body;
+    const PointCloudXYZI::Ptr &cloud_world = coarse ? coarse_world : down_world;
+    std::vector<PointVector> &nearest_points = coarse ? Nearest_Points_coarse : Nearest_Points;
+    int feats_down_size = cloud_body->points.size();
+
+    // 中间结果使用成员缓冲区，容量保留
+    laserCloudOri->resize(feats_down_size);
+    corr_normvect->resize(feats_down_size);
+    point_selected_surf.resize(feats_down_size);
+    normvec->resize(feats_down_size);
+
+    /* 将点云坐标转换至世界坐标系下*/
+    transform_points(cloud_body->points, cloud_world->points, body_to_world(st));
+
+    /* 落在平面 patch 上的点直接使用 patch 的平面，其余点批量寻找最近邻点，搜索范围限制在 MAX_MATCH_DIST2 内*/
+    point_patch.assign(feats_down_size, -1);
+    if (plane_en && !coarse) {
+        search_points.clear();
+        search_index.clear();
+        for (int i = 0; i < feats_down_size; i++) {
+            point_patch[i] = plane_map.match(cloud_world->points[i]);
+            if (point_patch[i] < 0) {
+                search_points.push_back(cloud_world->points[i]);
+                search_index.push_back(i);
+            }
+        }
+        nearest_search_batch(search_points, search_nearest, pointSearchSqDis, false);
+        if (static_cast<int>(nearest_points.size()) < feats_down_size) {
+            nearest_points.resize(feats_down_size);
+        }
+        for (int i = 0; i < feats_down_size; i++) {
+            nearest_points[i].clear();
+        }
+        for (size_t j = 0; j < search_index.size(); j++) {
+            nearest_points[search_index[j]].swap(search_nearest[j]);
+        }
+    }
+    else {
+        nearest_search_batch(cloud_world->points, nearest_points, pointSearchSqDis, coarse);
+    }
+
+    /* 最近邻曲面拟合和残差计算*/
+    for (int i = 0; i < feats_down_size; i++) {
+        const PointType &point_world = cloud_world->points[i];
+        const PointType &point_body = cloud_body->points[i];
+        V3D p_body(point_body.x, point_body.y, point_body.z);
+        PointVector &points_near = nearest_points[i];  // 点云的最近点序列
+
+        /* 拟合平面方程 ax+by+cz+d=0 并求解点到平面距离*/
+        VF(4) pabcd;                     // 平面点信息
+        bool plane_found;
+        if (point_patch[i] >= 0) {
+            // patch 的平面
+            const PlaneMap::Plane &plane = plane_map.plane(point_patch[i]);
+            pabcd << plane.normal(0), plane.normal(1), plane.normal(2), plane.d;
+            plane_found = true;
+        }
+        else {
+            // 如果范围内的最近邻点数小于 NUM_MATCH_POINTS，则认为该点不是有效点
+            // common_lib.h 函数，寻找法向量
+            plane_found = points_near.size() >= NUM_MATCH_POINTS && esti_plane(pabcd, points_near, 0.1f);
+        }
+        point_selected_surf[i] = false;  // 先设为无效点
+        if (plane_found) {
+            // 计算点到平面的距离
+            float pd2 = pabcd(0) * point_world.x + pabcd(1) * point_world.y + pabcd(2) * point_world.z + pabcd(3);
+            float s = 1 - 0.9 * fabs(pd2) / sqrt(p_body.norm());
+            // 如果 s>0.9，则认为找到平面
+            if (s > 0.9) {
+                point_selected_surf[i] = true;       // 再次设为有效点
+                normvec->points[i].x = pabcd(0);     // 存储法向量
+                normvec->points[i].y = pabcd(1);
+                normvec->points[i].z = pabcd(2);
+                normvec->points[i].intensity = pd2;  // 存储点到平面的距离
+            }
+        }
+    }
+
+    /* 数据准备*/
+    int effct_feat_num = 0;  // 有效特征点数
+    for (int i = 0; i < feats_down_size; i++) {
+        // 如果是有效点
+        if (point_selected_surf[i]) {
+            // 将点云的 LiDAR 坐标存到 laserCloudOri 中
+            laserCloudOri->points[effct_feat_num] = cloud_body->points[i];
+            // 将拟合平面法向量存到 corr_normvect 中
+            corr_normvect->points[effct_feat_num] = normvec->points[i];
+            effct_feat_num ++;  // 有效特征点数 ++
+        }
+    }
+
+    last_effect_num = effct_feat_num;
+    if (effct_feat_num < 1) {
+        ekfom_data.valid = false;
+        ASYNC_LOG(neal::LOG_WARN, "No Effective Points!");
+        return;
+    }
+
+    /* 求解观测雅可比矩阵 H 和观测向量 h
+    按最大行数分配，点数增加时多留一半，迭代和帧之间复用，只有前 num_rows 行有效*/
+    if (ekfom_data.h_x.rows() < effct_feat_num || ekfom_data.h_x.cols() != 12) {
+        ekfom_data.h_x.resize(effct_feat_num * 3 / 2 + 1, 12);  // 观测雅可比矩阵 H
+        ekfom_data.h.resize(ekfom_data.h_x.rows());              // 观测向量 h
+    }
+    ekfom_data.num_rows = effct_feat_num;
+    for (int i = 0; i < effct_feat_num; i++) {
+        // 拿到有效点云的 LiDAR 坐标
+        const PointType &laser_p = laserCloudOri->points[i];
+        V3D point_this_be(laser_p.x, laser_p.y, laser_p.z);
+        M3D point_be_crossmat;  // LiDAR 中，点云的 ^ 矩阵
+        point_be_crossmat << SKEW_SYM_MATRX(point_this_be);
+        // 转换到 IMU 坐标系下
+        V3D point_this = st.offset_R_L_I * point_this_be + st.offset_T_L_I;
+        M3D point_crossmat;  // IMU 中，点云的 ^ 矩阵
+        point_crossmat << SKEW_SYM_MATRX(point_this);
+        // 拿到拟合平面的法向量，Global 系下。
+        const PointType &norm_p = corr_normvect->points[i];
+        V3D norm_vec(norm_p.x, norm_p.y, norm_p.z);
+        // 更新观测雅可比矩阵 H
+        V3D C(st.rot.conjugate() * norm_vec);                        // (G^R_I)^T * norm_vec，IMU 系下的法向量
+        V3D A(point_crossmat * C);                                   // IMU 系下，点叉乘法向量
+        V3D B(point_be_crossmat * st.offset_R_L_I.conjugate() * C);  // LiDAR 系下，点叉乘法向量
+        ekfom_data.h_x.block<1, 12>(i, 0) << norm_p.x, norm_p.y, norm_p.z, VEC_FROM_ARRAY(A), VEC_FROM_ARRAY(B), VEC_FROM_ARRAY(C);
+        // 更新观测向量 h = -z
+        ekfom_data.h(i) = -norm_p.intensity;
+    }
+}
+
+void LidarMap::incremental(const state_ikfom &st, const bool flg_EKF_inited) {
+
+    LATENCY_SCOPE(LATENCY_MAP_INCREMENTAL);
+    int feats_down_size = down_body->points.size();
+
+    PointToAdd.clear();
+    PointNoNeedDownsample.clear();
+    PointAbsorbed.clear();
+    /* transform to world frame */
+    transform_points(down_body->points, down_world->points, body_to_world(st));
+    for (int i = 0; i < feats_down_size; i++) {
+        if (plane_en && flg_EKF_inited && plane_map.match(down_world->points[i]) >= 0) {
+            plane_map.absorb_point(down_world->points[i]);
+            PointAbsorbed.push_back(down_world->points[i]);
+            continue;
+        }
+        /* decide if need add to map */
+        if (!Nearest_Points[i].empty() && flg_EKF_inited) {
+            const PointVector &points_near = Nearest_Points[i];
+            bool need_add = true;
+            BoxPointType Box_of_Point;
+            PointType downsample_result, mid_point; 
+            mid_point.x = floor(down_world->points[i].x/filter_size)*filter_size + 0.5 * filter_size;
+            mid_point.y = floor(down_world->points[i].y/filter_size)*filter_size + 0.5 * filter_size;
+            mid_point.z = floor(down_world->points[i].z/filter_size)*filter_size + 0.5 * filter_size;
+            float dist  = calc_dist(down_world->points[i],mid_point);
+            if (fabs(points_near[0].x - mid_point.x) > 0.5 * filter_size &&
+                fabs(points_near[0].y - mid_point.y) > 0.5 * filter_size &&
+                fabs(points_near[0].z - mid_point.z) > 0.5 * filter_size){
+                
+                PointNoNeedDownsample.push_back(down_world->points[i]);
+                continue;
+            }
+            for (int readd_i = 0; readd_i < NUM_MATCH_POINTS; readd_i ++) {
+                if (points_near.size() < NUM_MATCH_POINTS) {
+                    break;
+                }
+                if (calc_dist(points_near[readd_i], mid_point) < dist) {
+                    need_add = false;
+                    break;
+                }
+            }
+            if (need_add) {
+                PointToAdd.push_back(down_world->points[i]);
+            }
+        }
+        else {
+            PointToAdd.push_back(down_world->points[i]);
+        }
+    }
+    add_points(PointToAdd, true);
+    add_points(PointNoNeedDownsample, false);
+    if (plane_en) {
+        plane_map.update();
+        // 解散的 patch 保留的吸收点加入地图（吸收时已经作为 points_absorbed 输出过）
+        plane_map.take_released(PointReleased);
+        if (!PointReleased.empty()) {
+            add_points(PointReleased, true, false);
+        }
+    }
+    if (compact_en) {
+        compact_map.publish();  // 生成新版本，其他线程可见
+        compact_map_coarse.publish();
+    }
+}
@@ -0,0 +1,408 @@
+#include "map_io.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <file_logger.h>
+
+static const char LIM_HEADER_MAGIC[8] = {'L', 'I', 'M', 'M', 'A', 'P', '\0', '\0'};
+static const char LIM_FOOTER_MAGIC[8] = {'L', 'I', 'M', 'E', 'N', 'D', '\0', '\0'};
+
+TiledMapWriter::TiledMapWriter()
+    : fp(nullptr), write_failed(false), has_R_W_G(false), tile_size(10.0f), inv_tile_size(0.1f), chunk_points(4096),
+      max_buffered_points(1 << 20), num_buffered(0), file_offset(0), num_points_written(0) {
+
+    R_W_G = M3D::Identity();
+}
+
+bool TiledMapWriter::open(const std::string &path, const float tile, const uint32_t frame) {
+
+    close();
+    fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr) {
+        neal::logger(neal::LOG_ERROR, "cannot open map file: " + path);
+        return false;
+    }
+    file_path = path;
+    write_failed = false;
+    tile_size = tile;
+    inv_tile_size = 1.0f / tile;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LIM_HEADER_MAGIC, sizeof(header.magic));
+    header.version = LIM_VERSION;
+    header.frame = frame;
+    header.tile_size = tile_size;
+    // R_W_G 还不知道时全零占位，set_R_W_G 或 close 时回写
+    if (has_R_W_G) {
+        for (int i = 0; i < 9; i++) {
+            header.R_W_G[i] = R_W_G(i / 3, i % 3);
+        }
+        header.flags = LIM_FLAG_R_W_G;
+    }
+    if (!write(&header, sizeof(header), 1)) {
+        fclose(fp);
+        fp = nullptr;
+        return false;
+    }
+    file_offset = sizeof(header);
+
+    tiles.clear();
+    index.clear();
+    num_buffered = 0;
+    num_points_written = 0;
+    return true;
+}
+
+void TiledMapWriter::add_point(const PointType &p) {
+
+    if (fp == nullptr) {
+        return;
+    }
+    VoxelKey key = voxel_key(p.x, p.y, p.z, inv_tile_size);
+    std::vector<MapPoint> &tile = tiles[key];
+    if (tile.capacity() == 0) {
+        tile.reserve(chunk_points);
+    }
+    MapPoint mp;
+    mp.x = p.x;
+    mp.y = p.y;
+    mp.z = p.z;
+    mp.intensity = p.intensity;
+    tile.push_back(mp);
+    num_buffered ++;
+
+    // 单个 tile 攒满一个 chunk
+    if (static_cast<int>(tile.size()) >= chunk_points) {
+        num_buffered -= tile.size();
+        write_chunk(key, tile);
+    }
+    // 缓存总量超限
+    if (num_buffered >= max_buffered_points) {
+        flush();
+    }
+}
+
+void TiledMapWriter::add_points(const PointVector &points) {
+
+    for (const PointType &p : points) {
+        add_point(p);
+    }
+}
+
+void TiledMapWriter::add_points(const PointCloudXYZI &cloud) {
+
+    for (const PointType &p : cloud.points) {
+        add_point(p);
+    }
+}
+
+void TiledMapWriter::set_R_W_G(const M3D &R) {
+
+    R_W_G = R;
+    has_R_W_G = true;
+    if (fp != nullptr && !write_failed && write_header()) {
+        fflush(fp);
+    }
+}
+
+bool TiledMapWriter::write_header() {
+
+    if (has_R_W_G) {
+        for (int i = 0; i < 9; i++) {
+            header.R_W_G[i] = R_W_G(i / 3, i % 3);
+        }
+        header.flags |= LIM_FLAG_R_W_G;
+    }
+    if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1 || fseek(fp, 0, SEEK_END) != 0) {
+        neal::logger(neal::LOG_ERROR, "failed to write the header of map file " + file_path);
+        write_failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool TiledMapWriter::write(const void *data, const size_t size, const size_t count) {
+
+    if (write_failed) {
+        return false;
+    }
+    if (fwrite(data, size, count, fp) != count) {
+        neal::logger(neal::LOG_ERROR, "failed to write map file " + file_path + ", the remaining points are dropped");
+        write_failed = true;
+        return false;
+    }
+    return true;
+}
+
+void TiledMapWriter::write_chunk(const VoxelKey &key, std::vector<MapPoint> &points) {
+
+    if (points.empty()) {
+        return;
+    }
+    // 写入失败之后文件偏移不再可信，不再写 chunk，已写入的 chunk 仍然有效
+    if (write_failed) {
+        points.clear();
+        return;
+    }
+
+    MapChunkHeader chunk;
+    chunk.magic = LIM_CHUNK_MAGIC;
+    chunk.key[0] = key.x;
+    chunk.key[1] = key.y;
+    chunk.key[2] = key.z;
+    chunk.num_points = points.size();
+    chunk.reserved = 0;
+    if (!write(&chunk, sizeof(chunk), 1) || !write(points.data(), sizeof(MapPoint), points.size())) {
+        points.clear();
+        return;
+    }
+
+    MapChunkIndex idx;
+    idx.key[0] = key.x;
+    idx.key[1] = key.y;
+    idx.key[2] = key.z;
+    idx.num_points = points.size();
+    idx.offset = file_offset + sizeof(chunk);
+    for (int j = 0; j < 3; j++) {
+        idx.min[j] = std::numeric_limits<float>::max();
+        idx.max[j] = -std::numeric_limits<float>::max();
+    }
+    for (const MapPoint &p : points) {
+        idx.min[0] = std::min(idx.min[0], p.x); idx.max[0] = std::max(idx.max[0], p.x);
+        idx.min[1] = std::min(idx.min[1], p.y); idx.max[1] = std::max(idx.max[1], p.y);
+        idx.min[2] = std::min(idx.min[2], p.z); idx.max[2] = std::max(idx.max[2], p.z);
+    }
+    index.push_back(idx);
+
+    file_offset += sizeof(chunk) + sizeof(MapPoint) * points.size();
+    num_points_written += points.size();
+    points.clear();  // 保留容量，下一批继续使用
+}
+
+void TiledMapWriter::flush() {
+
+    if (fp == nullptr) {
+        return;
+    }
+    for (auto &tile : tiles) {
+        write_chunk(tile.first, tile.second);
+    }
+    num_buffered = 0;
+    fflush(fp);
+}
+
+void TiledMapWriter::close() {
+
+    if (fp == nullptr) {
+        return;
+    }
+    flush();
+
+    // 索引按 8 字节对齐，保证 mmap 后可以直接按结构体访问
+    // 写入失败时不写索引和 footer，读取端扫描已写入的完整 chunk 重建索引
+    static const char zeros[8] = {0};
+    size_t pad = (8 - file_offset % 8) % 8;
+    if (!write_failed && write(zeros, 1, pad)) {
+        file_offset += pad;
+        MapFileFooter footer;
+        footer.index_offset = file_offset;
+        footer.num_chunks = index.size();
+        footer.num_points = num_points_written;
+        memcpy(footer.magic, LIM_FOOTER_MAGIC, sizeof(footer.magic));
+        if (write(index.data(), sizeof(MapChunkIndex), index.size())) {
+            write(&footer, sizeof(footer), 1);
+        }
+    }
+
+    // 回写文件头中的 R_W_G
+    write_header();
+    if (fclose(fp) != 0) {
+        write_failed = true;
+    }
+    fp = nullptr;
+
+    if (write_failed) {
+        neal::logger(neal::LOG_ERROR, "map file " + file_path + " is incomplete, points written: " +
+            std::to_string(num_points_written));
+    }
+    else {
+        neal::logger(neal::LOG_INFO, "map saved to " + file_path + ", points: " + std::to_string(num_points_written) +
+            ", chunks: " + std::to_string(index.size()));
+    }
+    tiles.clear();
+    index.clear();
+}
+
+bool TiledMapReader::open(const std::string &path) {
+
+    close();
+    if (!file.open(path)) {
+        neal::logger(neal::LOG_ERROR, "cannot map file: " + path);
+        return false;
+    }
+    if (file.size() < sizeof(MapFileHeader) ||
+        memcmp(get_header().magic, LIM_HEADER_MAGIC, sizeof(LIM_HEADER_MAGIC)) != 0 ||
+        get_header().version != LIM_VERSION) {
+        neal::logger(neal::LOG_ERROR, "not a lim map file: " + path);
+        file.close();
+        return false;
+    }
+
+    // 优先使用文件末尾的索引
+    if (file.size() >= sizeof(MapFileHeader) + sizeof(MapFileFooter)) {
+        const MapFileFooter *footer = reinterpret_cast<const MapFileFooter *>(
+            file.data() + file.size() - sizeof(MapFileFooter));
+        if (memcmp(footer->magic, LIM_FOOTER_MAGIC, sizeof(LIM_FOOTER_MAGIC)) == 0) {
+            if (check_index(*footer)) {
+                index = reinterpret_cast<const MapChunkIndex *>(file.data() + footer->index_offset);
+                num_chunks_ = footer->num_chunks;
+                num_points_ = footer->num_points;
+                return true;
+            }
+            neal::logger(neal::LOG_WARN, "map file index is corrupt, scanning chunks: " + path);
+            return rebuild_index();
+        }
+    }
+
+    neal::logger(neal::LOG_WARN, "map file has no index, scanning chunks: " + path);
+    return rebuild_index();
+}
+
+/* footer 和索引是否可信：索引区在文件内（先比较个数，乘法不会溢出）、8 字节对齐，
+每个 chunk 的点都在文件头之后、索引区之前，点数之和与 footer 一致。*/
+bool TiledMapReader::check_index(const MapFileFooter &footer) const {
+
+    const uint64_t size = file.size();
+    const uint64_t data_begin = sizeof(MapFileHeader) + sizeof(MapChunkHeader);
+    if (footer.index_offset < sizeof(MapFileHeader) || footer.index_offset % 8 != 0 ||
+        footer.index_offset > size - sizeof(MapFileFooter) ||
+        footer.num_chunks > (size - sizeof(MapFileFooter) - footer.index_offset) / sizeof(MapChunkIndex) ||
+        footer.index_offset + footer.num_chunks * sizeof(MapChunkIndex) + sizeof(MapFileFooter) != size) {
+        return false;
+    }
+    const MapChunkIndex *entries = reinterpret_cast<const MapChunkIndex *>(file.data() + footer.index_offset);
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < footer.num_chunks; i++) {
+        const MapChunkIndex &idx = entries[i];
+        if (idx.offset < data_begin || idx.offset > footer.index_offset || idx.offset % alignof(MapPoint) != 0 ||
+            idx.num_points > (footer.index_offset - idx.offset) / sizeof(MapPoint)) {
+            return false;
+        }
+        total += idx.num_points;
+    }
+    return total == footer.num_points;
+}
+
+bool TiledMapReader::rebuild_index() {
+
+    rebuilt_index.clear();
+    num_points_ = 0;
+    size_t offset = sizeof(MapFileHeader);
+    while (offset + sizeof(MapChunkHeader) <= file.size()) {
+        MapChunkHeader chunk;
+        memcpy(&chunk, file.data() + offset, sizeof(chunk));
+        size_t bytes = sizeof(MapPoint) * static_cast<size_t>(chunk.num_points);
+        // 遇到不完整的 chunk（写到一半时退出）就停止
+        if (chunk.magic != LIM_CHUNK_MAGIC || offset + sizeof(chunk) + bytes > file.size()) {
+            break;
+        }
+        MapChunkIndex idx;
+        memcpy(idx.key, chunk.key, sizeof(idx.key));
+        idx.num_points = chunk.num_points;
+        idx.offset = offset + sizeof(chunk);
+        const MapPoint *pts = reinterpret_cast<const MapPoint *>(file.data() + idx.offset);
+        for (int j = 0; j < 3; j++) {
+            idx.min[j] = std::numeric_limits<float>::max();
+            idx.max[j] = -std::numeric_limits<float>::max();
+        }
+        for (uint32_t i = 0; i < chunk.num_points; i++) {
+            idx.min[0] = std::min(idx.min[0], pts[i].x); idx.max[0] = std::max(idx.max[0], pts[i].x);
+            idx.min[1] = std::min(idx.min[1], pts[i].y); idx.max[1] = std::max(idx.max[1], pts[i].y);
+            idx.min[2] = std::min(idx.min[2], pts[i].z); idx.max[2] = std::max(idx.max[2], pts[i].z);
+        }
+        rebuilt_index.push_back(idx);
+        num_points_ += chunk.num_points;
+        offset += sizeof(chunk) + bytes;
+    }
+
+    index = rebuilt_index.data();
+    num_chunks_ = rebuilt_index.size();
+    recovered = true;
+    return num_chunks_ > 0;
+}
+
+void TiledMapReader::close() {
+
+    file.close();
+    index = nullptr;
+    rebuilt_index.clear();
+    num_chunks_ = 0;
+    num_points_ = 0;
+    recovered = false;
+}
+
+bool TiledMapReader::has_R_W_G() const {
+
+    if (get_header().flags & LIM_FLAG_R_W_G) {
+        return true;
+    }
+    // 加入标志之前写的文件，close 时写入的是有效的旋转矩阵；异常退出的文件为全零
+    const M3D R = get_R_W_G();
+    return (R * R.transpose() - M3D::Identity()).norm() < 1e-3 && std::fabs(R.determinant() - 1.0) < 1e-3;
+}
+
+M3D TiledMapReader::get_R_W_G() const {
+
+    M3D R;
+    for (int i = 0; i < 9; i++) {
+        R(i / 3, i % 3) = get_header().R_W_G[i];
+    }
+    return R;
+}
+
+void TiledMapReader::load(PointVector &out) const {
+
+    out.clear();
+    out.reserve(num_points_);
+    PointType p;
+    for (size_t c = 0; c < num_chunks_; c++) {
+        const MapPoint *pts = chunk_points(c);
+        for (uint32_t i = 0; i < index[c].num_points; i++) {
+            p.x = pts[i].x;
+            p.y = pts[i].y;
+            p.z = pts[i].z;
+            p.intensity = pts[i].intensity;
+            out.push_back(p);
+        }
+    }
+}
+
+void TiledMapReader::load_box(const V3F &box_min, const V3F &box_max, PointVector &out) const {
+
+    out.clear();
+    PointType p;
+    for (size_t c = 0; c < num_chunks_; c++) {
+        const MapChunkIndex &idx = index[c];
+        // 包围盒不相交，整个 chunk 跳过
+        if (idx.max[0] < box_min(0) || idx.min[0] > box_max(0) ||
+            idx.max[1] < box_min(1) || idx.min[1] > box_max(1) ||
+            idx.max[2] < box_min(2) || idx.min[2] > box_max(2)) {
+            continue;
+        }
+        const MapPoint *pts = chunk_points(c);
+        for (uint32_t i = 0; i < idx.num_points; i++) {
+            if (pts[i].x < box_min(0) || pts[i].x > box_max(0) ||
+                pts[i].y < box_min(1) || pts[i].y > box_max(1) ||
+                pts[i].z < box_min(2) || pts[i].z > box_max(2)) {
+                continue;
+            }
+            p.x = pts[i].x;
+            p.y = pts[i].y;
+            p.z = pts[i].z;
+            p.intensity = pts[i].intensity;
+            out.push_back(p);
+        }
+    }
+}
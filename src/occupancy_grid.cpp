@@ -0,0 +1,438 @@
+#include "occupancy_grid.h"
+
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <cstring>
+
+// 体素所在的块，算术右移即向下取整
+static inline VoxelKey block_of(const VoxelKey &voxel) {
+
+    VoxelKey b = {voxel.x >> OCC_BLOCK_BITS, voxel.y >> OCC_BLOCK_BITS, voxel.z >> OCC_BLOCK_BITS};
+    return b;
+}
+
+// 体素在块内的索引，x + 8y + 64z
+static inline int local_index(const int32_t x, const int32_t y, const int32_t z) {
+
+    const int32_t mask = OCC_BLOCK_SIZE - 1;
+    return (x & mask) | ((y & mask) << OCC_BLOCK_BITS) | ((z & mask) << (2 * OCC_BLOCK_BITS));
+}
+
+// 块所在的分片
+static inline int shard_of(const VoxelKey &block) {
+
+    return VoxelKeyHash()(block) % OCC_SHARDS;
+}
+
+/* 射线生成的体素编码成 uint64：最高位为命中标志，其余每 21 位存一个坐标（加上偏移变成非负数），
+分辨率 0.1m 时坐标范围为 ±100km。*/
+#define OCC_CODE_BITS   (21)
+#define OCC_CODE_OFFSET (1 << (OCC_CODE_BITS - 1))
+#define OCC_CODE_MASK   ((1ull << OCC_CODE_BITS) - 1)
+#define OCC_CODE_HIT    (1ull << 63)
+
+static inline uint64_t encode_voxel(const int32_t x, const int32_t y, const int32_t z, const bool hit) {
+
+    return (hit ? OCC_CODE_HIT : 0) |
+        (static_cast<uint64_t>(x + OCC_CODE_OFFSET) & OCC_CODE_MASK) << (2 * OCC_CODE_BITS) |
+        (static_cast<uint64_t>(y + OCC_CODE_OFFSET) & OCC_CODE_MASK) << OCC_CODE_BITS |
+        (static_cast<uint64_t>(z + OCC_CODE_OFFSET) & OCC_CODE_MASK);
+}
+
+static inline VoxelKey decode_voxel(const uint64_t code) {
+
+    VoxelKey v;
+    v.x = static_cast<int32_t>((code >> (2 * OCC_CODE_BITS)) & OCC_CODE_MASK) - OCC_CODE_OFFSET;
+    v.y = static_cast<int32_t>((code >> OCC_CODE_BITS) & OCC_CODE_MASK) - OCC_CODE_OFFSET;
+    v.z = static_cast<int32_t>(code & OCC_CODE_MASK) - OCC_CODE_OFFSET;
+    return v;
+}
+
+OccupancyGrid::OccupancyGrid()
+    : log_hit(6), log_miss(-2), log_min(-20), log_max(40), project_min_z(-0.5f), project_max_z(1.0f),
+      max_range(30.0f), num_threads(1), track_voxels(false), scan_id(0), job_id(0), job_pending(0), pool_stop(false),
+      job_phase(JOB_CAST_RAYS), job_threads(1), job_points(nullptr), job_origin(V3F::Zero()), job_raycast(false) {
+
+    set_resolution(0.1f);
+}
+
+OccupancyGrid::~OccupancyGrid() {
+
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        pool_stop = true;
+    }
+    cv_work.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+size_t OccupancyGrid::num_blocks() const {
+
+    size_t n = 0;
+    for (int s = 0; s < OCC_SHARDS; s++) {
+        n += blocks[s].size();
+    }
+    return n;
+}
+
+size_t OccupancyGrid::memory_bytes() const {
+
+    size_t bytes = columns.size() * (sizeof(ColumnMap::value_type) + sizeof(void *)) +
+        columns.bucket_count() * sizeof(void *);
+    for (int s = 0; s < OCC_SHARDS; s++) {
+        bytes += blocks[s].size() * (sizeof(BlockMap::value_type) + sizeof(void *)) +
+            blocks[s].bucket_count() * sizeof(void *);
+    }
+    return bytes;
+}
+
+const OccupancyGrid::Block *OccupancyGrid::find_block(const VoxelKey &bk) const {
+
+    const BlockMap &shard = blocks[shard_of(bk)];
+    auto iter = shard.find(bk);
+    return iter == shard.end() ? nullptr : &iter->second;
+}
+
+void OccupancyGrid::integrate_hits(const PointVector &points) {
+
+    integrate(points, V3D::Zero(), false);
+}
+
+void OccupancyGrid::integrate_scan(const PointVector &points, const V3D &origin) {
+
+    integrate(points, origin, true);
+}
+
+void OccupancyGrid::integrate(const PointVector &points, const V3D &origin, const bool raycast) {
+
+    scan_id++;
+    // 点太少时不值得开线程
+    const int threads = static_cast<int>(std::min<size_t>(num_threads, std::max<size_t>(1, points.size() / 512)));
+    ray_voxels.resize(threads * OCC_SHARDS);
+    for (auto &voxels : ray_voxels) {
+        voxels.clear();
+    }
+
+    // 工作线程只在第一次更新时创建
+    while (static_cast<int>(workers.size()) + 1 < num_threads) {
+        workers.emplace_back(&OccupancyGrid::worker_loop, this, static_cast<int>(workers.size()) + 1);
+    }
+
+    // 1. 射线按点的顺序平均分给各线程，生成的体素按分片存放
+    job_points = &points;
+    job_origin = (origin.cast<float>() * inv_resolution).eval();
+    job_raycast = raycast;
+    job_phase = JOB_CAST_RAYS;
+    run_parallel(threads);
+
+    // 2. 分片分给各线程，每个分片只有一个线程写
+    job_phase = JOB_UPDATE_SHARDS;
+    run_parallel(threads);
+    job_points = nullptr;
+
+    for (int s = 0; s < OCC_SHARDS; s++) {
+        changed.insert(shard_changed[s].begin(), shard_changed[s].end());
+        changed_project.insert(shard_changed[s].begin(), shard_changed[s].end());
+        flipped.insert(flipped.end(), shard_flipped[s].begin(), shard_flipped[s].end());
+    }
+}
+
+void OccupancyGrid::run_job(const int t) {
+
+    if (job_phase == JOB_CAST_RAYS) {
+        const size_t n = job_points->size();
+        cast_rays(*job_points, n * t / job_threads, n * (t + 1) / job_threads, job_origin, job_raycast,
+            &ray_voxels[t * OCC_SHARDS]);
+    }
+    else {
+        for (int s = t; s < OCC_SHARDS; s += job_threads) {
+            update_shard(s);
+        }
+    }
+}
+
+void OccupancyGrid::run_parallel(const int threads) {
+
+    // 阶段参数在锁内发布，工作线程拿到锁之后才读
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        job_threads = threads;
+        job_pending = threads - 1;
+        job_id++;
+    }
+    if (threads > 1) {
+        cv_work.notify_all();
+    }
+    run_job(0);
+    if (threads > 1) {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        cv_done.wait(lock, [this] {return job_pending == 0;});
+    }
+}
+
+void OccupancyGrid::worker_loop(const int t) {
+
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            cv_work.wait(lock, [this, seen] {return pool_stop || job_id != seen;});
+            if (pool_stop) {
+                return;
+            }
+            seen = job_id;
+            // 点太少时只用前 job_threads 个线程，其余的继续等下一次分派
+            if (t >= job_threads) {
+                continue;
+            }
+        }
+        run_job(t);
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (--job_pending == 0) {
+            cv_done.notify_one();
+        }
+    }
+}
+
+void OccupancyGrid::take_voxel_changes(std::vector<VoxelKey> &occupied, std::vector<VoxelKey> &freed) {
+
+    occupied.clear();
+    freed.clear();
+    // 多次变化的体素只按当前状态输出一次
+    std::unordered_set<VoxelKey, VoxelKeyHash> seen;
+    for (const VoxelKey &voxel : flipped) {
+        if (!seen.insert(voxel).second) {
+            continue;
+        }
+        if (is_occupied(voxel)) {
+            occupied.push_back(voxel);
+        }
+        else {
+            freed.push_back(voxel);
+        }
+    }
+    flipped.clear();
+}
+
+/* 三维 DDA（Amanatides-Woo）：射线参数 t 从 0 到 1，t_max 为射线穿过下一个体素边界时的 t，
+每一步沿 t_max 最小的轴走一格，到达终点体素时总步数等于三个轴上的格数之和。
+起点到终点之前的体素为穿过，终点体素为命中。*/
+void OccupancyGrid::cast_rays(const PointVector &points, const size_t begin, const size_t end, const V3F &origin,
+    const bool raycast, std::vector<uint64_t> *out) const {
+
+    const float range = max_range * inv_resolution;
+    const float inf = std::numeric_limits<float>::infinity();
+    const int32_t start[3] = {static_cast<int32_t>(std::floor(origin(0))),
+        static_cast<int32_t>(std::floor(origin(1))), static_cast<int32_t>(std::floor(origin(2)))};
+    auto emit = [out](const int32_t x, const int32_t y, const int32_t z, const bool hit) {
+        VoxelKey bk = {x >> OCC_BLOCK_BITS, y >> OCC_BLOCK_BITS, z >> OCC_BLOCK_BITS};
+        out[shard_of(bk)].push_back(encode_voxel(x, y, z, hit));
+    };
+
+    for (size_t i = begin; i < end; i++) {
+        V3F e = points[i].getVector3fMap() * inv_resolution;
+        bool hit = true;
+        if (raycast) {
+            V3F d = e - origin;
+            const float len = d.norm();
+            if (len > range) {
+                d *= range / len;
+                e = origin + d;
+                hit = false;
+            }
+            int32_t cur[3] = {start[0], start[1], start[2]};
+            int32_t stop[3], step[3];
+            float t_max[3], t_delta[3];
+            int n = 0;
+            for (int a = 0; a < 3; a++) {
+                stop[a] = static_cast<int32_t>(std::floor(e(a)));
+                step[a] = stop[a] > cur[a] ? 1 : -1;
+                n += std::abs(stop[a] - cur[a]);
+                const float da = std::fabs(d(a));
+                t_delta[a] = da > 1e-9f ? 1.0f / da : inf;
+                t_max[a] = (step[a] > 0 ? cur[a] + 1 - origin(a) : origin(a) - cur[a]) * t_delta[a];
+            }
+            for (int k = 0; k < n; k++) {
+                emit(cur[0], cur[1], cur[2], false);
+                // 已经到达终点的轴不再走，避免浮点误差导致走过头
+                int a = -1;
+                for (int b = 0; b < 3; b++) {
+                    if (cur[b] != stop[b] && (a < 0 || t_max[b] < t_max[a])) {
+                        a = b;
+                    }
+                }
+                cur[a] += step[a];
+                t_max[a] += t_delta[a];
+            }
+            if (!hit) {
+                emit(cur[0], cur[1], cur[2], false);
+                continue;
+            }
+        }
+        emit(static_cast<int32_t>(std::floor(e(0))), static_cast<int32_t>(std::floor(e(1))),
+            static_cast<int32_t>(std::floor(e(2))), true);
+    }
+}
+
+// 先更新命中再更新穿过，同一帧内每个体素只更新一次，所以命中优先
+void OccupancyGrid::update_shard(const int shard) {
+
+    BlockMap &map = blocks[shard];
+    shard_changed[shard].clear();
+    shard_flipped[shard].clear();
+    const size_t threads = ray_voxels.size() / OCC_SHARDS;
+    for (int pass = 0; pass < 2; pass++) {
+        const bool hit_pass = pass == 0;
+        const int delta = hit_pass ? log_hit : log_miss;
+        Block *block = nullptr;
+        VoxelKey block_key = {0, 0, 0};
+        bool block_changed = false;
+        for (size_t t = 0; t < threads; t++) {
+            for (const uint64_t code : ray_voxels[t * OCC_SHARDS + shard]) {
+                if (((code & OCC_CODE_HIT) != 0) != hit_pass) {
+                    continue;
+                }
+                const VoxelKey v = decode_voxel(code);
+                const VoxelKey bk = block_of(v);
+                // 同一条射线上相邻的体素大多在同一块中
+                if (block == nullptr || !(bk == block_key)) {
+                    if (block_changed) {
+                        shard_changed[shard].push_back(block_key);
+                    }
+                    auto iter = map.find(bk);
+                    if (iter == map.end()) {
+                        iter = map.emplace(bk, Block()).first;
+                        memset(iter->second.logodds, OCC_UNKNOWN, sizeof(iter->second.logodds));
+                    }
+                    block = &iter->second;
+                    block_key = bk;
+                    block_changed = false;
+                    if (block->scan_id != scan_id) {
+                        block->scan_id = scan_id;
+                        memset(block->visited, 0, sizeof(block->visited));
+                    }
+                }
+                const int index = local_index(v.x, v.y, v.z);
+                const uint64_t bit = 1ull << (index & 63);
+                if (block->visited[index >> 6] & bit) {
+                    continue;
+                }
+                block->visited[index >> 6] |= bit;
+
+                int8_t &value = block->logodds[index];
+                const int old_value = value;
+                const int base = old_value == OCC_UNKNOWN ? 0 : old_value;
+                const int new_value = std::min(std::max(base + delta, log_min), log_max);
+                value = static_cast<int8_t>(new_value);
+                // 只有占据状态变化（或者第一次观测）才算块变化
+                const bool flipped = (old_value > 0) != (new_value > 0);
+                if (old_value == OCC_UNKNOWN || flipped) {
+                    block_changed = true;
+                }
+                if (flipped && track_voxels) {
+                    shard_flipped[shard].push_back(v);
+                }
+            }
+        }
+        if (block_changed) {
+            shard_changed[shard].push_back(block_key);
+        }
+    }
+}
+
+std::vector<VoxelKey> OccupancyGrid::all_blocks() const {
+
+    std::vector<VoxelKey> keys;
+    keys.reserve(num_blocks());
+    for (int s = 0; s < OCC_SHARDS; s++) {
+        for (const auto &block : blocks[s]) {
+            keys.push_back(block.first);
+        }
+    }
+    return keys;
+}
+
+bool OccupancyGrid::is_occupied(const VoxelKey &voxel) const {
+
+    const Block *block = find_block(block_of(voxel));
+    if (block == nullptr) {
+        return false;
+    }
+    return block->logodds[local_index(voxel.x, voxel.y, voxel.z)] > 0;
+}
+
+void OccupancyGrid::block_bits(const VoxelKey &bk, uint8_t *bits) const {
+
+    memset(bits, 0, OCC_BLOCK_VOXELS / 8);
+    const Block *block = find_block(bk);
+    if (block == nullptr) {
+        return;
+    }
+    for (int i = 0; i < OCC_BLOCK_VOXELS; i++) {
+        if (block->logodds[i] > 0) {
+            bits[i >> 3] |= 1 << (i & 7);
+        }
+    }
+}
+
+void OccupancyGrid::compute_column(const VoxelKey &column, Column &out) const {
+
+    const int32_t z_lo = static_cast<int32_t>(std::floor(project_min_z * inv_resolution));
+    const int32_t z_hi = static_cast<int32_t>(std::floor(project_max_z * inv_resolution));
+    std::fill(out.cells, out.cells + OCC_BLOCK_SIZE * OCC_BLOCK_SIZE, -1);
+
+    for (int32_t bz = z_lo >> OCC_BLOCK_BITS; bz <= (z_hi >> OCC_BLOCK_BITS); bz++) {
+        VoxelKey bk = {column.x, column.y, bz};
+        const Block *block = find_block(bk);
+        if (block == nullptr) {
+            continue;
+        }
+        const int32_t z_begin = std::max(z_lo, bz << OCC_BLOCK_BITS);
+        const int32_t z_end = std::min(z_hi, (bz << OCC_BLOCK_BITS) + OCC_BLOCK_SIZE - 1);
+        for (int cy = 0; cy < OCC_BLOCK_SIZE; cy++) {
+            for (int cx = 0; cx < OCC_BLOCK_SIZE; cx++) {
+                int8_t &cell = out.cells[cx + cy * OCC_BLOCK_SIZE];
+                if (cell == 100) {
+                    continue;
+                }
+                for (int32_t z = z_begin; z <= z_end; z++) {
+                    const int8_t v = block->logodds[local_index(cx, cy, z)];
+                    if (v > 0) {
+                        cell = 100;
+                        break;
+                    }
+                    if (v != OCC_UNKNOWN) {
+                        cell = 0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+const OccupancyGrid::ColumnMap &OccupancyGrid::update_projection(std::vector<VoxelKey> *changed_columns) {
+
+    const int32_t bz_lo = static_cast<int32_t>(std::floor(project_min_z * inv_resolution)) >> OCC_BLOCK_BITS;
+    const int32_t bz_hi = static_cast<int32_t>(std::floor(project_max_z * inv_resolution)) >> OCC_BLOCK_BITS;
+    std::unordered_set<VoxelKey, VoxelKeyHash> dirty;
+    for (const VoxelKey &bk : changed_project) {
+        // 不在投影高度范围内的块不影响二维投影
+        if (bk.z < bz_lo || bk.z > bz_hi) {
+            continue;
+        }
+        VoxelKey ck = {bk.x, bk.y, 0};
+        dirty.insert(ck);
+    }
+    changed_project.clear();
+
+    if (changed_columns != nullptr) {
+        changed_columns->assign(dirty.begin(), dirty.end());
+    }
+    for (const VoxelKey &ck : dirty) {
+        compute_column(ck, columns[ck]);
+    }
+    return columns;
+}
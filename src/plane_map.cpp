@@ -0,0 +1,307 @@
+#include "plane_map.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <file_logger.h>
+
+// patch 的残差超过 max_rms 的倍数时解散，留出余量，避免在界限附近反复解散和合并
+#define DISSOLVE_RATIO (1.5)
+
+PlaneMap::PlaneMap()
+    : min_points(10), max_rms(0.02), max_extent(5.0), max_point_dist(0.1f), max_kept(10), num_alive(0),
+      num_absorbed(0) {
+
+    set_voxel_size(0.5f);
+    set_max_angle(10.0);
+}
+
+void PlaneMap::set_max_angle(const double deg) {
+
+    min_cos = std::cos(deg / 180.0 * M_PI);
+}
+
+/* 协方差的特征值从小到大为 λ0 ≤ λ1 ≤ λ2：最小特征值对应的特征向量为法向量，
+sqrt(λ0) 为到平面距离的 RMS；按均匀分布估计平面内的尺寸为 sqrt(12 λ)。*/
+bool PlaneMap::fit(const Moments &m, Plane &plane) const {
+
+    if (m.n < 3) {
+        return false;
+    }
+    const V3D mean = m.sum / m.n;
+    const M3D cov = m.sum_sq / m.n - mean * mean.transpose();
+    Eigen::SelfAdjointEigenSolver<M3D> solver(cov);
+    const V3D lambda = solver.eigenvalues().cwiseMax(0.0);
+    plane.normal = solver.eigenvectors().col(0);
+    plane.d = -plane.normal.dot(mean);
+    plane.center = mean;
+    plane.rms = std::sqrt(lambda(0));
+    plane.extent = std::sqrt(12.0 * lambda(2));
+    plane.width = std::sqrt(12.0 * lambda(1));
+    plane.axis = solver.eigenvectors().col(2);
+    return true;
+}
+
+// 法向量接近，并且 b 的中心在 a 的平面上
+bool PlaneMap::compatible(const Plane &a, const Plane &b) const {
+
+    return std::fabs(a.normal.dot(b.normal)) >= min_cos &&
+        std::fabs(a.normal.dot(b.center) + a.d) <= DISSOLVE_RATIO * max_rms;
+}
+
+PlaneMap::Voxel &PlaneMap::add_point(const V3D &p, const VoxelKey &key) {
+
+    auto iter = voxels.find(key);
+    if (iter == voxels.end()) {
+        Voxel v;
+        v.patch = -1;
+        iter = voxels.emplace(key, v).first;
+    }
+    Voxel &v = iter->second;
+    v.moments.add(p);
+    if (v.patch >= 0) {
+        patches[v.patch].moments.add(p);
+        dirty_patches.insert(v.patch);
+    }
+    else {
+        dirty.insert(key);
+    }
+    return v;
+}
+
+void PlaneMap::add_points(const PointVector &points) {
+
+    for (const PointType &p : points) {
+        add_point(V3D(p.x, p.y, p.z), voxel_key(p.x, p.y, p.z, inv_voxel_size));
+    }
+}
+
+void PlaneMap::absorb_point(const PointType &p) {
+
+    Voxel &v = add_point(V3D(p.x, p.y, p.z), voxel_key(p.x, p.y, p.z, inv_voxel_size));
+    num_absorbed++;
+    // 与已保留的点间隔足够时保留，点在体素内分布均匀
+    if (static_cast<int>(v.kept.size()) >= max_kept) {
+        return;
+    }
+    for (const PointType &q : v.kept) {
+        if (calc_dist(p, q) < kept_spacing2) {
+            return;
+        }
+    }
+    v.kept.push_back(p);
+}
+
+void PlaneMap::take_released(PointVector &out) {
+
+    out.swap(released);
+    released.clear();
+}
+
+void PlaneMap::update() {
+
+    // 残差变大的 patch 解散，体素重新判断
+    for (const int id : dirty_patches) {
+        Patch &patch = patches[id];
+        if (!patch.alive) {
+            continue;
+        }
+        fit(patch.moments, patch.plane);
+        if (patch.plane.rms > DISSOLVE_RATIO * max_rms) {
+            dissolve(id);
+        }
+    }
+    dirty_patches.clear();
+
+    for (const VoxelKey &key : dirty) {
+        try_join(key);
+    }
+    dirty.clear();
+}
+
+void PlaneMap::try_join(const VoxelKey &key) {
+
+    Voxel &v = voxels[key];
+    Plane vp;
+    if (v.patch >= 0 || v.moments.n < static_cast<uint32_t>(min_points) || !fit(v.moments, vp) || vp.rms > max_rms) {
+        return;
+    }
+
+    // 相邻体素所属的 patch
+    std::vector<int> neighbors;
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dz = -1; dz <= 1; dz++) {
+                VoxelKey nk = {key.x + dx, key.y + dy, key.z + dz};
+                auto iter = voxels.find(nk);
+                if (iter != voxels.end() && iter->second.patch >= 0 &&
+                    std::find(neighbors.begin(), neighbors.end(), iter->second.patch) == neighbors.end()) {
+                    neighbors.push_back(iter->second.patch);
+                }
+            }
+        }
+    }
+
+    int joined = -1;
+    for (const int id : neighbors) {
+        Patch &candidate = patches[id];
+        if (!candidate.alive || id == joined) {
+            continue;
+        }
+        if (joined < 0) {
+            // 加入第一个满足条件的 patch
+            Moments m = candidate.moments;
+            m.add(v.moments);
+            Plane merged;
+            if (!compatible(candidate.plane, vp) || !fit(m, merged) || merged.rms > max_rms ||
+                merged.extent > max_extent) {
+                continue;
+            }
+            candidate.moments = m;
+            candidate.plane = merged;
+            candidate.voxels.push_back(key);
+            v.patch = id;
+            joined = id;
+        }
+        else {
+            // 已经加入了 patch，与其他相邻 patch 满足条件时合并
+            Patch &target = patches[joined];
+            Moments m = target.moments;
+            m.add(candidate.moments);
+            Plane merged;
+            if (!compatible(target.plane, candidate.plane) || !fit(m, merged) || merged.rms > max_rms ||
+                merged.extent > max_extent) {
+                continue;
+            }
+            merge_patches(joined, id);
+        }
+    }
+    if (joined >= 0) {
+        return;
+    }
+
+    // 没有可以加入的 patch，新建
+    int id;
+    if (!free_patches.empty()) {
+        id = free_patches.back();
+        free_patches.pop_back();
+    }
+    else {
+        id = patches.size();
+        patches.emplace_back();
+    }
+    Patch &patch = patches[id];
+    patch.moments = v.moments;
+    patch.plane = vp;
+    patch.voxels.assign(1, key);
+    patch.alive = true;
+    v.patch = id;
+    num_alive++;
+}
+
+void PlaneMap::merge_patches(const int into, const int from) {
+
+    Patch &target = patches[into];
+    Patch &source = patches[from];
+    for (const VoxelKey &key : source.voxels) {
+        voxels[key].patch = into;
+    }
+    target.voxels.insert(target.voxels.end(), source.voxels.begin(), source.voxels.end());
+    target.moments.add(source.moments);
+    fit(target.moments, target.plane);
+    source.alive = false;
+    std::vector<VoxelKey>().swap(source.voxels);
+    free_patches.push_back(from);
+    num_alive--;
+}
+
+void PlaneMap::dissolve(const int id) {
+
+    Patch &patch = patches[id];
+    for (const VoxelKey &key : patch.voxels) {
+        Voxel &v = voxels[key];
+        v.patch = -1;
+        // 吸收点没有加入地图，交还保留的点，否则这片区域没有点可以匹配
+        released.insert(released.end(), v.kept.begin(), v.kept.end());
+        PointVector().swap(v.kept);
+        dirty.insert(key);
+    }
+    patch.alive = false;
+    std::vector<VoxelKey>().swap(patch.voxels);
+    free_patches.push_back(id);
+    num_alive--;
+}
+
+int PlaneMap::match(const PointType &p) const {
+
+    auto iter = voxels.find(voxel_key(p.x, p.y, p.z, inv_voxel_size));
+    if (iter == voxels.end() || iter->second.patch < 0) {
+        return -1;
+    }
+    const Plane &plane = patches[iter->second.patch].plane;
+    const double dist = plane.normal(0) * p.x + plane.normal(1) * p.y + plane.normal(2) * p.z + plane.d;
+    return std::fabs(dist) <= max_point_dist ? iter->second.patch : -1;
+}
+
+bool PlaneMap::in_patch(const PointType &p) const {
+
+    auto iter = voxels.find(voxel_key(p.x, p.y, p.z, inv_voxel_size));
+    return iter != voxels.end() && iter->second.patch >= 0;
+}
+
+size_t PlaneMap::num_planar_voxels() const {
+
+    size_t n = 0;
+    for (const Patch &patch : patches) {
+        if (patch.alive) {
+            n += patch.voxels.size();
+        }
+    }
+    return n;
+}
+
+size_t PlaneMap::memory_bytes() const {
+
+    size_t bytes = voxels.size() * (sizeof(VoxelMap::value_type) + sizeof(void *)) +
+        voxels.bucket_count() * sizeof(void *) + patches.capacity() * sizeof(Patch);
+    for (const Patch &patch : patches) {
+        bytes += patch.voxels.capacity() * sizeof(VoxelKey);
+    }
+    for (const auto &item : voxels) {
+        bytes += item.second.kept.capacity() * sizeof(PointType);
+    }
+    return bytes;
+}
+
+bool PlaneMap::save(const std::string &path, const M3D &R_W_G) const {
+
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == nullptr) {
+        neal::logger(neal::LOG_ERROR, "cannot open " + path);
+        return false;
+    }
+    fprintf(fp, "# plane patches in world frame, R_W_G (row major): ");
+    for (int i = 0; i < 9; i++) {
+        fprintf(fp, "%.9f ", R_W_G(i / 3, i % 3));
+    }
+    fprintf(fp, "\n# cx cy cz nx ny nz ax ay az extent width num_points rms\n");
+    size_t num_saved = 0;
+    for (const Patch &patch : patches) {
+        if (!patch.alive) {
+            continue;
+        }
+        const Plane &p = patch.plane;
+        fprintf(fp, "%.4f %.4f %.4f %.6f %.6f %.6f %.6f %.6f %.6f %.4f %.4f %u %.5f\n",
+            p.center(0), p.center(1), p.center(2), p.normal(0), p.normal(1), p.normal(2),
+            p.axis(0), p.axis(1), p.axis(2), p.extent, p.width, patch.moments.n, p.rms);
+        num_saved++;
+    }
+    const bool ok = ferror(fp) == 0;
+    fclose(fp);
+    if (!ok) {
+        neal::logger(neal::LOG_ERROR, "failed to write " + path);
+        return false;
+    }
+    neal::logger(neal::LOG_INFO, "plane patches saved: " + path + ", patches: " + std::to_string(num_saved));
+    return true;
+}
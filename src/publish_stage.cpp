@@ -0,0 +1,256 @@
+#include "publish_stage.h"
+
+#include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf/transform_broadcaster.h>
+
+#include <file_logger.h>
+#include <lio/CompressedCloud.h>
+
+#include "point_transform.h"
+
+#define PUBLISH_MAX_POSES (100)  // 待发布位姿的上限
+
+PublishStage::PublishStage()
+    : path_count(0), path_step(10), path_max_poses(1000), traj_fp(nullptr), blocking(false), has_scan(false), stopped(true),
+      num_published(0), num_dropped(0), num_poses_dropped(0) {
+
+    path.header.frame_id = "camera_init";
+}
+
+bool PublishStage::open_trajectory(const std::string &file) {
+
+    traj_fp = fopen(file.c_str(), "w");
+    if (traj_fp == nullptr) {
+        neal::logger(neal::LOG_ERROR, "cannot open trajectory file: " + file);
+        return false;
+    }
+    fprintf(traj_fp, "# time x y z qx qy qz qw\n");
+    return true;
+}
+
+void PublishStage::start(const ros::Publisher &pub_cloud_, const ros::Publisher &pub_odom_,
+    const ros::Publisher &pub_path_, const ros::Publisher &pub_pose_) {
+
+    stop();
+    pub_cloud = pub_cloud_;
+    pub_odom = pub_odom_;
+    pub_path = pub_path_;
+    pub_pose = pub_pose_;
+    path.header.stamp = ros::Time::now();
+    stopped = false;
+    worker = std::thread(&PublishStage::run, this);
+}
+
+void PublishStage::stop() {
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (stopped) {
+            return;
+        }
+        stopped = true;
+    }
+    cv.notify_all();
+    cv_space.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+    if (traj_fp != nullptr) {
+        fclose(traj_fp);
+        traj_fp = nullptr;
+    }
+}
+
+void PublishStage::push_pose(const PoseFrame &pose) {
+
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (blocking) {
+            cv_space.wait(lock, [this] {return stopped || poses.size() < PUBLISH_MAX_POSES;});
+        }
+        if (stopped) {
+            return;
+        }
+        if (poses.size() >= PUBLISH_MAX_POSES) {
+            poses.pop_front();
+            num_poses_dropped ++;
+        }
+        poses.push_back(pose);
+        // 轨迹文件的队列不设上界，发布线程每次取走全部，只有写文件跟不上时才会增长
+        if (traj_fp != nullptr) {
+            traj_poses.push_back(pose);
+        }
+    }
+    cv.notify_one();
+}
+
+void PublishStage::push_scan(const ScanFrame &frame) {
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (stopped) {
+            return;
+        }
+        // 上一帧还没发布，直接丢弃
+        if (has_scan) {
+            num_dropped ++;
+        }
+        latest_scan = frame;
+        has_scan = true;
+    }
+    cv.notify_one();
+}
+
+void PublishStage::run() {
+
+    std::deque<PoseFrame, Eigen::aligned_allocator<PoseFrame>> pending_poses;
+    std::deque<PoseFrame, Eigen::aligned_allocator<PoseFrame>> pending_traj;
+    ScanFrame scan;
+    while (true) {
+        bool got_scan = false;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] {return stopped || !poses.empty() || !traj_poses.empty() || has_scan;});
+            if (stopped && poses.empty() && traj_poses.empty()) {
+                break;
+            }
+            pending_poses.swap(poses);
+            pending_traj.swap(traj_poses);
+            if (has_scan) {
+                scan = latest_scan;
+                latest_scan.cloud.reset();
+                has_scan = false;
+                got_scan = true;
+            }
+        }
+        cv_space.notify_all();
+
+        // 先发布位姿，位姿消息很小
+        for (const PoseFrame &pose : pending_poses) {
+            publish_pose(pose);
+        }
+        pending_poses.clear();
+        for (const PoseFrame &pose : pending_traj) {
+            write_trajectory(pose);
+        }
+        if (traj_fp != nullptr && !pending_traj.empty()) {
+            fflush(traj_fp);
+        }
+        pending_traj.clear();
+        if (got_scan) {
+            publish_scan(scan);
+            publish_compressed(scan);
+            scan.cloud.reset();
+        }
+    }
+}
+
+void PublishStage::publish_pose(const PoseFrame &pose) {
+
+    geometry_msgs::PoseStamped msg_body_pose;
+    msg_body_pose.header.stamp = ros::Time().fromSec(pose.time);
+    msg_body_pose.header.frame_id = "camera_init";
+    msg_body_pose.pose.position.x = pose.pos(0);
+    msg_body_pose.pose.position.y = pose.pos(1);
+    msg_body_pose.pose.position.z = pose.pos(2);
+    msg_body_pose.pose.orientation.x = pose.rot.x();
+    msg_body_pose.pose.orientation.y = pose.rot.y();
+    msg_body_pose.pose.orientation.z = pose.rot.z();
+    msg_body_pose.pose.orientation.w = pose.rot.w();
+
+    // 里程计和 TF
+    if (pub_odom) {
+        nav_msgs::Odometry odomAftMapped;
+        odomAftMapped.header = msg_body_pose.header;
+        odomAftMapped.child_frame_id = "body";
+        odomAftMapped.pose.pose = msg_body_pose.pose;
+        for (int i = 0; i < 6; i++) {
+            for (int j = 0; j < 6; j++) {
+                odomAftMapped.pose.covariance[i * 6 + j] = pose.cov(i, j);
+            }
+        }
+        pub_odom.publish(odomAftMapped);
+
+        static tf::TransformBroadcaster br;
+        tf::Transform transform;
+        transform.setOrigin(tf::Vector3(pose.pos(0), pose.pos(1), pose.pos(2)));
+        transform.setRotation(tf::Quaternion(pose.rot.x(), pose.rot.y(), pose.rot.z(), pose.rot.w()));
+        br.sendTransform(tf::StampedTransform(transform, msg_body_pose.header.stamp, "camera_init", "body"));
+    }
+
+    // 增量发布单个位姿
+    if (pub_pose && pub_pose.getNumSubscribers() > 0) {
+        pub_pose.publish(msg_body_pose);
+    }
+
+    /*** if path is too large, the rvis will crash ***/
+    if (pub_path && ++path_count % path_step == 0) {
+        path_poses.push_back(msg_body_pose);
+        while (path_poses.size() > path_max_poses) {
+            path_poses.pop_front();
+        }
+        // 只有发布时才拼成消息
+        if (pub_path.getNumSubscribers() > 0) {
+            path.poses.assign(path_poses.begin(), path_poses.end());
+            path.header.stamp = msg_body_pose.header.stamp;
+            pub_path.publish(path);
+        }
+    }
+}
+
+// 完整轨迹
+void PublishStage::write_trajectory(const PoseFrame &pose) {
+
+    if (traj_fp == nullptr) {
+        return;
+    }
+    fprintf(traj_fp, "%.6f %.6f %.6f %.6f %.9f %.9f %.9f %.9f\n", pose.time, pose.pos(0), pose.pos(1), pose.pos(2),
+        pose.rot.x(), pose.rot.y(), pose.rot.z(), pose.rot.w());
+}
+
+void PublishStage::publish_scan(const ScanFrame &frame) {
+
+    if (!pub_cloud || pub_cloud.getNumSubscribers() == 0) {
+        return;
+    }
+    // 转换到世界坐标系
+    PointCloudXYZI laserCloudWorld(frame.cloud->points.size(), 1);
+    transform_points(frame.cloud->points, laserCloudWorld.points, make_transform(frame.rot, frame.pos));
+    sensor_msgs::PointCloud2 laserCloudmsg;
+    pcl::toROSMsg(laserCloudWorld, laserCloudmsg);
+    laserCloudmsg.header.stamp = ros::Time().fromSec(frame.time);
+    laserCloudmsg.header.frame_id = "camera_init";
+    pub_cloud.publish(laserCloudmsg);
+    num_published ++;
+}
+
+void PublishStage::publish_compressed(const ScanFrame &frame) {
+
+    if (!pub_compressed || pub_compressed.getNumSubscribers() == 0) {
+        return;
+    }
+    // 坐标保持在 LiDAR 系，只附带位姿，相邻点的差分更小
+    encoder.reset();
+    for (const PointType &p : frame.cloud->points) {
+        encoder.add_point(p.x, p.y, p.z, p.intensity);
+    }
+    if (!encoder.finish(encoded)) {
+        return;
+    }
+    lio::CompressedCloud msg;
+    msg.header.stamp = ros::Time().fromSec(frame.time);
+    msg.header.frame_id = "camera_init";
+    Eigen::Quaterniond q(frame.rot);
+    msg.pose.position.x = frame.pos(0);
+    msg.pose.position.y = frame.pos(1);
+    msg.pose.position.z = frame.pos(2);
+    msg.pose.orientation.x = q.x();
+    msg.pose.orientation.y = q.y();
+    msg.pose.orientation.z = q.z();
+    msg.pose.orientation.w = q.w();
+    msg.resolution = encoder.get_resolution();
+    msg.num_points = encoder.size();
+    msg.data.assign(encoded.begin(), encoded.end());
+    pub_compressed.publish(msg);
+}
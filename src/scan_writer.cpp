@@ -0,0 +1,104 @@
+#include "scan_writer.h"
+
+#include <file_logger.h>
+
+#include "point_transform.h"
+
+ScanStreamWriter::ScanStreamWriter()
+    : tile_size(10.0f), voxel_size(0.0f), min_hits(1), checkpoint_period(30.0), running(false), blocking(false), num_dropped(0),
+      flush_period(1.0) {
+}
+
+bool ScanStreamWriter::open(const std::string &path, const float tile) {
+
+    close();
+    file_path = path;
+    tile_size = tile;
+    if (voxel_size > 0.0f) {
+        voxels.clear();
+        voxels.set_voxel_size(voxel_size);
+    }
+    else if (!writer.open(path, tile_size, LIM_FRAME_GROUND)) {
+        return false;
+    }
+    queue.reopen();
+    num_dropped = 0;
+    running = true;
+    worker = std::thread(&ScanStreamWriter::run, this);
+    return true;
+}
+
+bool ScanStreamWriter::push(const ScanFrame &frame) {
+
+    if (!running) {
+        return false;
+    }
+    if (blocking ? !queue.push(frame) : !queue.try_push(frame)) {
+        num_dropped ++;
+        return false;
+    }
+    return true;
+}
+
+void ScanStreamWriter::run() {
+
+    const bool voxel_mode = voxel_size > 0.0f;
+    const double period = voxel_mode ? checkpoint_period : flush_period;
+    std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now();
+    ScanFrame frame;
+    PointVector points;
+    while (true) {
+        if (queue.pop(frame, std::chrono::milliseconds(100))) {
+            transform_points(frame.cloud->points, points, make_transform(frame.rot, frame.pos));
+            if (voxel_mode) {
+                for (const PointType &p : points) {
+                    voxels.add_point(p);
+                }
+            }
+            else {
+                writer.add_points(points);
+            }
+            frame.cloud.reset();
+        }
+        else if (queue.is_closed()) {
+            break;  // 队列已关闭且为空
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (period > 0.0 && std::chrono::duration<double>(now - last_flush).count() >= period) {
+            if (voxel_mode) {
+                // 检查点，R_W_G 在关闭时写入
+                voxels.save(file_path, tile_size, M3D::Identity(), min_hits);
+            }
+            else {
+                writer.flush();
+            }
+            last_flush = now;
+        }
+    }
+}
+
+void ScanStreamWriter::close(const M3D &R_W_G) {
+
+    if (!running) {
+        return;
+    }
+    queue.close();
+    if (worker.joinable()) {
+        worker.join();
+    }
+    running = false;
+    if (voxel_size > 0.0f) {
+        voxels.save(file_path, tile_size, R_W_G, min_hits);
+        neal::logger(neal::LOG_INFO, "voxel map voxels: " + std::to_string(voxels.size()) +
+            ", memory: " + std::to_string(voxels.memory_bytes() / 1024) + "KB");
+        voxels.clear();
+    }
+    else {
+        writer.set_R_W_G(R_W_G);
+        writer.close();
+    }
+    if (num_dropped > 0) {
+        neal::logger(neal::LOG_WARN, "scan writer dropped " + std::to_string(num_dropped) + " frames");
+    }
+}
@@ -0,0 +1,330 @@
+#include "sensor_log.h"
+
+#include <cstring>
+#include <algorithm>
+#include <file_logger.h>
+
+static const char LSR_HEADER_MAGIC[8] = {'L', 'S', 'R', 'L', 'O', 'G', '\0', '\0'};
+static const char LSR_FOOTER_MAGIC[8] = {'L', 'S', 'R', 'E', 'N', 'D', '\0', '\0'};
+
+// chunk 数据补齐到 8 字节，下一个 chunk 头中的 double 保持对齐
+static size_t padded_bytes(const size_t bytes) {
+
+    return (bytes + 7) & ~static_cast<size_t>(7);
+}
+
+static size_t chunk_bytes(const uint32_t type, const uint32_t count) {
+
+    return padded_bytes((type == LSR_CHUNK_SCAN ? sizeof(SensorLogPoint) : sizeof(SensorLogImu)) * count);
+}
+
+SensorLogWriter::SensorLogWriter()
+    : fp(nullptr), imu_chunk_samples(200), file_offset(0), seek_time(0.0), num_scans(0), num_imu(0) {
+
+    memset(&header, 0, sizeof(header));
+}
+
+void SensorLogWriter::set_preprocess(const int point_filter_num, const int scan_line, const int reflect_thresh,
+    const double blind) {
+
+    header.point_filter_num = point_filter_num;
+    header.scan_line = scan_line;
+    header.reflect_thresh = reflect_thresh;
+    header.blind = blind;
+}
+
+bool SensorLogWriter::open(const std::string &path) {
+
+    close();
+    fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr) {
+        neal::logger(neal::LOG_ERROR, "cannot open sensor log: " + path);
+        return false;
+    }
+    file_path = path;
+
+    memcpy(header.magic, LSR_HEADER_MAGIC, sizeof(header.magic));
+    header.version = LSR_VERSION;
+    fwrite(&header, sizeof(header), 1, fp);
+    file_offset = sizeof(header);
+
+    imu_pending.clear();
+    index.clear();
+    seek_time = 0.0;
+    num_scans = 0;
+    num_imu = 0;
+    return true;
+}
+
+void SensorLogWriter::add_imu(const double time, const V3D &acc, const V3D &gyr) {
+
+    if (fp == nullptr) {
+        return;
+    }
+    SensorLogImu s;
+    s.time = time;
+    for (int j = 0; j < 3; j++) {
+        s.acc[j] = acc(j);
+        s.gyr[j] = gyr(j);
+    }
+    imu_pending.push_back(s);
+    if (static_cast<int>(imu_pending.size()) >= imu_chunk_samples) {
+        flush_imu();
+    }
+}
+
+void SensorLogWriter::add_scan(const double time, const PointCloudXYZI &cloud) {
+
+    if (fp == nullptr) {
+        return;
+    }
+    // 先写出扫描之前到达的 IMU，保持到达顺序
+    flush_imu();
+
+    scan_buffer.resize(cloud.points.size());
+    for (size_t i = 0; i < cloud.points.size(); i++) {
+        const PointType &p = cloud.points[i];
+        SensorLogPoint &sp = scan_buffer[i];
+        sp.x = p.x;
+        sp.y = p.y;
+        sp.z = p.z;
+        sp.intensity = p.intensity;
+        sp.curvature = p.curvature;
+    }
+    write_chunk(LSR_CHUNK_SCAN, scan_buffer.size(), time, scan_buffer.data(), sizeof(SensorLogPoint) * scan_buffer.size());
+    num_scans++;
+}
+
+void SensorLogWriter::flush_imu() {
+
+    if (imu_pending.empty()) {
+        return;
+    }
+    write_chunk(LSR_CHUNK_IMU, imu_pending.size(), imu_pending.front().time, imu_pending.data(),
+        sizeof(SensorLogImu) * imu_pending.size());
+    num_imu += imu_pending.size();
+    imu_pending.clear();
+}
+
+void SensorLogWriter::write_chunk(const uint32_t type, const uint32_t count, const double time, const void *data,
+    const size_t bytes) {
+
+    SensorLogChunkHeader chunk;
+    chunk.magic = LSR_CHUNK_MAGIC;
+    chunk.type = type;
+    chunk.count = count;
+    chunk.reserved = 0;
+    chunk.time = time;
+    fwrite(&chunk, sizeof(chunk), 1, fp);
+    if (bytes > 0) {
+        fwrite(data, 1, bytes, fp);
+    }
+    static const char zeros[8] = {0};
+    const size_t pad = padded_bytes(bytes) - bytes;
+    fwrite(zeros, 1, pad, fp);
+
+    // 时间回跳（传感器重启）时 seek_time 保持不变，索引仍然有序
+    seek_time = index.empty() ? time : std::max(seek_time, time);
+    SensorLogIndex idx;
+    idx.type = type;
+    idx.count = count;
+    idx.time = time;
+    idx.seek_time = seek_time;
+    idx.offset = file_offset + sizeof(chunk);
+    index.push_back(idx);
+    file_offset += sizeof(chunk) + bytes + pad;
+}
+
+void SensorLogWriter::flush() {
+
+    if (fp == nullptr) {
+        return;
+    }
+    flush_imu();
+    fflush(fp);
+}
+
+void SensorLogWriter::close() {
+
+    if (fp == nullptr) {
+        return;
+    }
+    flush_imu();
+
+    SensorLogFooter footer;
+    footer.index_offset = file_offset;
+    footer.num_chunks = index.size();
+    footer.num_scans = num_scans;
+    footer.num_imu = num_imu;
+    memcpy(footer.magic, LSR_FOOTER_MAGIC, sizeof(footer.magic));
+    if (!index.empty()) {
+        fwrite(index.data(), sizeof(SensorLogIndex), index.size(), fp);
+    }
+    fwrite(&footer, sizeof(footer), 1, fp);
+    const bool ok = ferror(fp) == 0;
+    fclose(fp);
+    fp = nullptr;
+
+    if (!ok) {
+        neal::logger(neal::LOG_ERROR, "failed to write sensor log " + file_path);
+    }
+    else {
+        neal::logger(neal::LOG_INFO, "sensor log saved to " + file_path + ", scans: " + std::to_string(num_scans) +
+            ", imu samples: " + std::to_string(num_imu));
+    }
+    index.clear();
+    std::vector<SensorLogPoint>().swap(scan_buffer);
+}
+
+bool SensorLogReader::open(const std::string &path) {
+
+    close();
+    if (!file.open(path)) {
+        neal::logger(neal::LOG_ERROR, "cannot map file: " + path);
+        return false;
+    }
+    if (file.size() < sizeof(SensorLogHeader) ||
+        memcmp(get_header().magic, LSR_HEADER_MAGIC, sizeof(LSR_HEADER_MAGIC)) != 0 ||
+        get_header().version != LSR_VERSION) {
+        neal::logger(neal::LOG_ERROR, "not a lsr sensor log: " + path);
+        file.close();
+        return false;
+    }
+
+    // 优先使用文件末尾的索引
+    if (file.size() >= sizeof(SensorLogHeader) + sizeof(SensorLogFooter)) {
+        const SensorLogFooter *footer = reinterpret_cast<const SensorLogFooter *>(
+            file.data() + file.size() - sizeof(SensorLogFooter));
+        if (memcmp(footer->magic, LSR_FOOTER_MAGIC, sizeof(LSR_FOOTER_MAGIC)) == 0) {
+            if (check_index(*footer)) {
+                index = reinterpret_cast<const SensorLogIndex *>(file.data() + footer->index_offset);
+                num_chunks_ = footer->num_chunks;
+                num_scans_ = footer->num_scans;
+                num_imu_ = footer->num_imu;
+                return true;
+            }
+            neal::logger(neal::LOG_WARN, "sensor log index is corrupt, scanning chunks: " + path);
+            return rebuild_index();
+        }
+    }
+
+    neal::logger(neal::LOG_WARN, "sensor log has no index, scanning chunks: " + path);
+    return rebuild_index();
+}
+
+/* footer 和索引是否可信：索引区在文件内（先比较个数，乘法不会溢出）、8 字节对齐；
+每一项的数据都在文件头之后、索引区之前，前面是类型和个数一致的 chunk 头；扫描数和 IMU 样本数与 footer 一致。*/
+bool SensorLogReader::check_index(const SensorLogFooter &footer) const {
+
+    const uint64_t size = file.size();
+    if (footer.index_offset < sizeof(SensorLogHeader) || footer.index_offset % 8 != 0 ||
+        footer.index_offset > size - sizeof(SensorLogFooter) ||
+        footer.num_chunks > (size - sizeof(SensorLogFooter) - footer.index_offset) / sizeof(SensorLogIndex) ||
+        footer.index_offset + footer.num_chunks * sizeof(SensorLogIndex) + sizeof(SensorLogFooter) != size) {
+        return false;
+    }
+    const SensorLogIndex *entries = reinterpret_cast<const SensorLogIndex *>(file.data() + footer.index_offset);
+    uint64_t scans = 0, imu = 0;
+    for (uint64_t i = 0; i < footer.num_chunks; i++) {
+        const SensorLogIndex &idx = entries[i];
+        if ((idx.type != LSR_CHUNK_SCAN && idx.type != LSR_CHUNK_IMU) ||
+            idx.offset < sizeof(SensorLogHeader) + sizeof(SensorLogChunkHeader) || idx.offset % 8 != 0 ||
+            idx.offset > footer.index_offset || chunk_bytes(idx.type, idx.count) > footer.index_offset - idx.offset) {
+            return false;
+        }
+        SensorLogChunkHeader chunk;
+        memcpy(&chunk, file.data() + idx.offset - sizeof(chunk), sizeof(chunk));
+        if (chunk.magic != LSR_CHUNK_MAGIC || chunk.type != idx.type || chunk.count != idx.count) {
+            return false;
+        }
+        if (idx.type == LSR_CHUNK_SCAN) {
+            scans++;
+        }
+        else {
+            imu += idx.count;
+        }
+    }
+    return scans == footer.num_scans && imu == footer.num_imu;
+}
+
+bool SensorLogReader::rebuild_index() {
+
+    rebuilt_index.clear();
+    num_scans_ = 0;
+    num_imu_ = 0;
+    double seek_time = 0.0;
+    size_t offset = sizeof(SensorLogHeader);
+    while (offset + sizeof(SensorLogChunkHeader) <= file.size()) {
+        SensorLogChunkHeader chunk;
+        memcpy(&chunk, file.data() + offset, sizeof(chunk));
+        // 遇到不完整的 chunk（写到一半时退出）就停止
+        if (chunk.magic != LSR_CHUNK_MAGIC || (chunk.type != LSR_CHUNK_SCAN && chunk.type != LSR_CHUNK_IMU) ||
+            offset + sizeof(chunk) + chunk_bytes(chunk.type, chunk.count) > file.size()) {
+            break;
+        }
+        seek_time = rebuilt_index.empty() ? chunk.time : std::max(seek_time, chunk.time);
+        SensorLogIndex idx;
+        idx.type = chunk.type;
+        idx.count = chunk.count;
+        idx.time = chunk.time;
+        idx.seek_time = seek_time;
+        idx.offset = offset + sizeof(chunk);
+        rebuilt_index.push_back(idx);
+        if (chunk.type == LSR_CHUNK_SCAN) {
+            num_scans_++;
+        }
+        else {
+            num_imu_ += chunk.count;
+        }
+        offset += sizeof(chunk) + chunk_bytes(chunk.type, chunk.count);
+    }
+
+    index = rebuilt_index.data();
+    num_chunks_ = rebuilt_index.size();
+    recovered = true;
+    return num_chunks_ > 0;
+}
+
+void SensorLogReader::close() {
+
+    file.close();
+    index = nullptr;
+    rebuilt_index.clear();
+    num_chunks_ = 0;
+    num_scans_ = 0;
+    num_imu_ = 0;
+    recovered = false;
+}
+
+void SensorLogReader::load_scan(const size_t i, PointCloudXYZI &out) const {
+
+    const SensorLogIndex &idx = index[i];
+    if (idx.type != LSR_CHUNK_SCAN) {
+        out.clear();
+        return;
+    }
+    const SensorLogPoint *pts = scan_points(i);
+    // 点数变化时只构造或析构多出来的部分
+    out.points.resize(idx.count);
+    for (uint32_t k = 0; k < idx.count; k++) {
+        PointType &p = out.points[k];
+        p.x = pts[k].x;
+        p.y = pts[k].y;
+        p.z = pts[k].z;
+        p.intensity = pts[k].intensity;
+        p.curvature = pts[k].curvature;
+        p.normal_x = 0.0f;
+        p.normal_y = 0.0f;
+        p.normal_z = 0.0f;
+    }
+    out.width = idx.count;
+    out.height = 1;
+}
+
+size_t SensorLogReader::seek(const double time) const {
+
+    const SensorLogIndex *end = index + num_chunks_;
+    const SensorLogIndex *iter = std::lower_bound(index, end, time,
+        [](const SensorLogIndex &idx, const double t) {return idx.seek_time < t;});
+    return iter - index;
+}
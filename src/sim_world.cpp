@@ -0,0 +1,378 @@
+#include "sim_world.h"
+
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <file_logger.h>
+
+#define SIM_WALL_THICKNESS  (0.2)
+#define SIM_DIFF_STEP       (1e-3)   // 数值微分的步长（s）
+#define SIM_STEP_RATE       (1.8)    // 手持行走的步频（Hz）
+
+void SimScene::reset(const V3D &o, const V3D &size, const float res) {
+
+    origin = o;
+    resolution = res;
+    inv_resolution = 1.0f / res;
+    for (int j = 0; j < 3; j++) {
+        dims[j] = std::max(1, static_cast<int>(std::ceil(size(j) * inv_resolution - 1e-3)));
+    }
+    occupied.assign(static_cast<size_t>(dims[0]) * dims[1] * dims[2], 0);
+}
+
+void SimScene::fill_box(const V3D &box_min, const V3D &box_max, const bool fill) {
+
+    int lo[3], hi[3];
+    for (int j = 0; j < 3; j++) {
+        // 体素中心落在包围盒内才算
+        lo[j] = std::max(0, static_cast<int>(std::ceil((box_min(j) - origin(j)) * inv_resolution - 0.5)));
+        hi[j] = std::min(dims[j], static_cast<int>(std::ceil((box_max(j) - origin(j)) * inv_resolution - 0.5)));
+    }
+    for (int x = lo[0]; x < hi[0]; x++) {
+        for (int y = lo[1]; y < hi[1]; y++) {
+            for (int z = lo[2]; z < hi[2]; z++) {
+                occupied[index(x, y, z)] = fill ? 1 : 0;
+            }
+        }
+    }
+}
+
+void SimScene::make_room(const V3D &size, const float res, const int num_boxes, const int num_pillars,
+    const double keep_out, const int seed) {
+
+    const double w = SIM_WALL_THICKNESS;
+    reset(V3D(-w, -w, -w), size + V3D(2 * w, 2 * w, 2 * w), res);
+    // 地面、天花板、四面墙
+    fill_box(V3D(-w, -w, -w), V3D(size(0) + w, size(1) + w, 0.0));
+    fill_box(V3D(-w, -w, size(2)), V3D(size(0) + w, size(1) + w, size(2) + w));
+    fill_box(V3D(-w, -w, 0.0), V3D(0.0, size(1) + w, size(2)));
+    fill_box(V3D(size(0), -w, 0.0), V3D(size(0) + w, size(1) + w, size(2)));
+    fill_box(V3D(-w, -w, 0.0), V3D(size(0) + w, 0.0, size(2)));
+    fill_box(V3D(-w, size(1), 0.0), V3D(size(0) + w, size(1) + w, size(2)));
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    // 家具贴墙摆放，深度不超过 keep_out，三成是离地的搁板
+    const double max_depth = std::max(0.2, std::min(0.8, keep_out - 0.2));
+    for (int i = 0; i < num_boxes; i++) {
+        const int side = rng() % 4;
+        const double width = 0.4 + 1.1 * u(rng);
+        const double depth = 0.2 + (max_depth - 0.2) * u(rng);
+        const bool shelf = u(rng) < 0.3;
+        const double z0 = shelf ? 0.8 + 0.8 * u(rng) : 0.0;
+        const double height = shelf ? 0.1 : std::min(0.4 + 1.6 * u(rng), size(2) - 0.3);
+        const int along = side < 2 ? 1 : 0;  // 沿墙的方向
+        const double s = (size(along) - width) * u(rng);
+        V3D box_min, box_max;
+        box_min(along) = s;
+        box_max(along) = s + width;
+        box_min(1 - along) = side % 2 == 0 ? 0.0 : size(1 - along) - depth;
+        box_max(1 - along) = box_min(1 - along) + depth;
+        box_min(2) = z0;
+        box_max(2) = z0 + height;
+        fill_box(box_min, box_max);
+    }
+    // 柱子在墙和中间区域之间
+    for (int i = 0; i < num_pillars; i++) {
+        const double margin = std::max(0.3, keep_out - 0.4);
+        V3D c(margin * u(rng), margin * u(rng), 0.0);
+        if (rng() % 2) c(0) = size(0) - c(0);
+        if (rng() % 2) c(1) = size(1) - c(1);
+        fill_box(V3D(c(0) - 0.15, c(1) - 0.15, 0.0), V3D(c(0) + 0.15, c(1) + 0.15, size(2)));
+    }
+}
+
+bool SimScene::load_occupy(const std::string &path, const float res) {
+
+    std::ifstream in(path);
+    std::string line;
+    if (!in.is_open() || !std::getline(in, line)) {
+        neal::logger(neal::LOG_ERROR, "cannot read " + path);
+        return false;
+    }
+    std::istringstream header(line);
+    std::string hash;
+    int d[3];
+    if (!(header >> hash >> d[0] >> d[1] >> d[2]) || hash != "#" || d[0] <= 0 || d[1] <= 0 || d[2] <= 0) {
+        neal::logger(neal::LOG_ERROR, "not an occupancy file: " + path);
+        return false;
+    }
+    reset(V3D::Zero(), V3D(d[0], d[1], d[2]) * res, res);
+    size_t n = 0;
+    char c;
+    while (in.get(c) && n < occupied.size()) {
+        if (c == '0' || c == '1') {
+            occupied[n++] = c == '1';
+        }
+    }
+    if (n != occupied.size()) {
+        neal::logger(neal::LOG_ERROR, "occupancy file is truncated: " + path);
+        return false;
+    }
+    return true;
+}
+
+bool SimScene::save_occupy(const std::string &path) const {
+
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == nullptr) {
+        neal::logger(neal::LOG_ERROR, "cannot open " + path);
+        return false;
+    }
+    fprintf(fp, "# %d %d %d\n", dims[0], dims[1], dims[2]);
+    for (int x = 0; x < dims[0]; x++) {
+        for (int y = 0; y < dims[1]; y++) {
+            for (int z = 0; z < dims[2]; z++) {
+                fprintf(fp, z + 1 < dims[2] ? "%d," : "%d\n", occupied[index(x, y, z)]);
+            }
+        }
+    }
+    const bool ok = ferror(fp) == 0;
+    fclose(fp);
+    if (!ok) {
+        neal::logger(neal::LOG_ERROR, "failed to write " + path);
+    }
+    return ok;
+}
+
+bool SimScene::is_occupied(const int x, const int y, const int z) const {
+
+    if (x < 0 || y < 0 || z < 0 || x >= dims[0] || y >= dims[1] || z >= dims[2]) {
+        return false;
+    }
+    return occupied[index(x, y, z)] != 0;
+}
+
+bool SimScene::is_occupied(const V3D &p) const {
+
+    const V3D g = (p - origin) * inv_resolution;
+    return is_occupied(static_cast<int>(std::floor(g(0))), static_cast<int>(std::floor(g(1))),
+        static_cast<int>(std::floor(g(2))));
+}
+
+size_t SimScene::num_occupied() const {
+
+    return std::count(occupied.begin(), occupied.end(), 1);
+}
+
+// Amanatides-Woo 三维 DDA，返回进入第一个占据体素时的距离
+bool SimScene::raycast(const V3D &o, const V3D &dir, const double max_range, double &range, uint32_t &voxel) const {
+
+    const V3D g = (o - origin) * inv_resolution;
+    int v[3], step[3];
+    double t_max[3], t_delta[3];
+    for (int j = 0; j < 3; j++) {
+        v[j] = static_cast<int>(std::floor(g(j)));
+        if (v[j] < 0 || v[j] >= dims[j]) {
+            return false;
+        }
+        if (std::fabs(dir(j)) < 1e-12) {
+            step[j] = 0;
+            t_max[j] = std::numeric_limits<double>::max();
+            t_delta[j] = std::numeric_limits<double>::max();
+            continue;
+        }
+        step[j] = dir(j) > 0 ? 1 : -1;
+        const double boundary = dir(j) > 0 ? v[j] + 1 : v[j];
+        t_max[j] = (boundary - g(j)) * resolution / dir(j);
+        t_delta[j] = resolution / std::fabs(dir(j));
+    }
+    // 起点在障碍物内部
+    if (occupied[index(v[0], v[1], v[2])]) {
+        return false;
+    }
+    while (true) {
+        const int axis = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+        const double t = t_max[axis];
+        if (t > max_range) {
+            return false;
+        }
+        v[axis] += step[axis];
+        if (v[axis] < 0 || v[axis] >= dims[axis]) {
+            return false;
+        }
+        t_max[axis] += t_delta[axis];
+        const size_t i = index(v[0], v[1], v[2]);
+        if (occupied[i]) {
+            range = t;
+            voxel = static_cast<uint32_t>(i);
+            return true;
+        }
+    }
+}
+
+SimTrajectory::SimTrajectory()
+    : type(SIM_CIRCLE), amplitude(2.0), speed(1.0), still_time(2.0), ramp_time(2.0) {
+
+    center = V3D(0.0, 0.0, 1.2);
+}
+
+bool SimTrajectory::parse_type(const std::string &name, SimTrajectoryType &type) {
+
+    static const char *names[] = {"static", "circle", "figure8", "handheld"};
+    for (int i = 0; i < 4; i++) {
+        if (name == names[i]) {
+            type = static_cast<SimTrajectoryType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* 速度按 smoothstep 从 0 加到 1，运动时间是它的积分：
+加速段 u = (t - still) / ramp，积分为 ramp * (u^3 - u^4 / 2)，加速度连续。*/
+double SimTrajectory::motion_time(const double t) const {
+
+    if (t <= still_time) {
+        return 0.0;
+    }
+    const double u = (t - still_time) / ramp_time;
+    if (u < 1.0) {
+        return ramp_time * (u * u * u - 0.5 * u * u * u * u);
+    }
+    return 0.5 * ramp_time + (t - still_time - ramp_time);
+}
+
+void SimTrajectory::pose(const double t, M3D &rot, V3D &pos) const {
+
+    const double tau = motion_time(t);
+    const double phi = speed * tau / amplitude;
+    const double a = amplitude;
+    double yaw = 0.0, pitch = 0.0, roll = 0.0;
+    switch (type) {
+        case SIM_CIRCLE:
+            pos = center + V3D(a * std::cos(phi), a * std::sin(phi), 0.05 * std::sin(2.0 * phi));
+            yaw = phi + M_PI / 2;
+            pitch = 0.05 * std::sin(3.0 * phi);
+            roll = 0.05 * std::sin(2.3 * phi);
+            break;
+        case SIM_FIGURE8:
+            pos = center + V3D(a * std::sin(phi), 0.5 * a * std::sin(2.0 * phi), 0.1 * std::sin(phi));
+            yaw = 0.8 * std::sin(phi);
+            pitch = 0.08 * std::sin(2.0 * phi);
+            roll = 0.05 * std::sin(1.7 * phi);
+            break;
+        case SIM_HANDHELD: {
+            const double step = 2.0 * M_PI * SIM_STEP_RATE * tau;
+            pos = center + V3D(a * (0.7 * std::sin(phi) + 0.3 * std::sin(2.3 * phi)),
+                a * (0.6 * std::sin(1.3 * phi) + 0.2 * std::cos(3.1 * phi) - 0.2),
+                0.03 * std::sin(step) + 0.1 * std::sin(0.4 * phi));
+            yaw = 0.9 * std::sin(0.7 * phi) + 0.4 * std::sin(1.9 * phi);
+            pitch = 0.12 * std::sin(1.1 * phi) + 0.02 * std::sin(step);
+            roll = 0.08 * std::sin(1.7 * phi) + 0.03 * std::sin(0.5 * step);
+            break;
+        }
+        default:
+            pos = center;
+    }
+    rot = (Eigen::AngleAxisd(yaw, V3D::UnitZ()) * Eigen::AngleAxisd(pitch, V3D::UnitY()) *
+        Eigen::AngleAxisd(roll, V3D::UnitX())).toRotationMatrix();
+}
+
+void SimTrajectory::derivatives(const double t, V3D &acc, V3D &gyr) const {
+
+    const double h = SIM_DIFF_STEP;
+    M3D R0, R1, R2;
+    V3D p0, p1, p2;
+    pose(t - h, R0, p0);
+    pose(t, R1, p1);
+    pose(t + h, R2, p2);
+    acc = (p2 - 2.0 * p1 + p0) / (h * h);
+    const Eigen::AngleAxisd delta(R0.transpose() * R2);
+    gyr = delta.axis() * delta.angle() / (2.0 * h);
+}
+
+SimLidar::SimLidar()
+    : point_rate(100000.0), min_range(0.1), max_range(90.0), range_noise(0.02) {
+
+    set_fov(70.4);
+    set_prism_rates(507.3, 486.7);
+    R_IL = M3D::Identity();
+    t_IL = V3D::Zero();
+}
+
+/* 两个光楔各偏转 half_fov / 2，反向旋转：偏转量 δ(e^{iω1 t} + e^{-iω2 t})，
+每 1 / (f1 + f2) 秒扫过一条过中心的直径，直径以 (f1 - f2) / 2 转每秒旋转，形成花瓣。*/
+V3D SimLidar::direction(const double t) const {
+
+    const double delta = 0.5 * half_fov;
+    const double a1 = 2.0 * M_PI * prism_rate[0] * t;
+    const double a2 = 2.0 * M_PI * prism_rate[1] * t;
+    const double u = delta * (std::cos(a1) + std::cos(a2));
+    const double v = delta * (std::sin(a1) - std::sin(a2));
+    const double rho = std::sqrt(u * u + v * v);
+    if (rho < 1e-9) {
+        return V3D(1.0, 0.0, 0.0);
+    }
+    const double s = std::sin(rho) / rho;
+    return V3D(std::cos(rho), s * u, s * v);
+}
+
+void SimLidar::scan(const SimScene &scene, const SimTrajectory &traj, const double t0, const double duration,
+    std::mt19937 &rng, std::vector<SimPoint> &out) const {
+
+    std::normal_distribution<double> noise(0.0, range_noise);
+    const int num = static_cast<int>(std::round(point_rate * duration));
+    out.clear();
+    out.reserve(num);
+    M3D R_WI;
+    V3D p_WI;
+    for (int i = 0; i < num; i++) {
+        const double offset = i / point_rate;
+        const double t = t0 + offset;
+        // 每个点按自己的时刻计算位姿，包含运动畸变
+        traj.pose(t, R_WI, p_WI);
+        const M3D R_WL = R_WI * R_IL;
+        const V3D p_WL = p_WI + R_WI * t_IL;
+        const V3D dir = direction(t);
+        double range;
+        uint32_t voxel;
+        if (!scene.raycast(p_WL, R_WL * dir, max_range, range, voxel)) {
+            continue;
+        }
+        range += noise(rng);
+        if (range < min_range) {
+            continue;
+        }
+        SimPoint p;
+        p.p = (dir * range).cast<float>();
+        // 同一个体素的反射率相同
+        p.intensity = 20.0f + static_cast<float>((voxel * 2654435761u) >> 24) * (200.0f / 256.0f);
+        p.offset = static_cast<float>(offset);
+        out.push_back(p);
+    }
+}
+
+SimImu::SimImu()
+    : acc_noise(0.05), gyr_noise(0.005), acc_walk(1e-4), gyr_walk(1e-5) {
+
+    acc_bias = V3D(0.02, -0.01, 0.03);
+    gyr_bias = V3D(0.002, -0.001, 0.0015);
+}
+
+SimImuSample SimImu::sample(const SimTrajectory &traj, const double t, const double dt, std::mt19937 &rng) {
+
+    std::normal_distribution<double> n(0.0, 1.0);
+    const double sdt = std::sqrt(std::max(dt, 0.0));
+    for (int j = 0; j < 3; j++) {
+        acc_bias(j) += acc_walk * sdt * n(rng);
+        gyr_bias(j) += gyr_walk * sdt * n(rng);
+    }
+    M3D R;
+    V3D p, acc_w, gyr;
+    traj.pose(t, R, p);
+    traj.derivatives(t, acc_w, gyr);
+
+    SimImuSample s;
+    s.time = t;
+    // 比力：body 系下的加速度减去重力（重力沿 -z）
+    s.acc = R.transpose() * (acc_w + V3D(0.0, 0.0, G_m_s2)) + acc_bias;
+    s.gyr = gyr + gyr_bias;
+    for (int j = 0; j < 3; j++) {
+        s.acc(j) += acc_noise * n(rng);
+        s.gyr(j) += gyr_noise * n(rng);
+    }
+    return s;
+}
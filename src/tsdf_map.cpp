@@ -0,0 +1,283 @@
+#include "tsdf_map.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <file_logger.h>
+
+#define MIN_WEIGHT (1e-4f)  // 权重小于该值的体素视为未观测
+
+// 体素所在的块，算术右移即向下取整
+static inline VoxelKey block_of(const VoxelKey &voxel) {
+
+    VoxelKey b = {voxel.x >> TSDF_BLOCK_BITS, voxel.y >> TSDF_BLOCK_BITS, voxel.z >> TSDF_BLOCK_BITS};
+    return b;
+}
+
+// 体素在块内的索引，x + 8y + 64z
+static inline int local_index(const VoxelKey &voxel) {
+
+    const int32_t mask = TSDF_BLOCK_SIZE - 1;
+    return (voxel.x & mask) | ((voxel.y & mask) << TSDF_BLOCK_BITS) | ((voxel.z & mask) << (2 * TSDF_BLOCK_BITS));
+}
+
+TsdfMap::TsdfMap()
+    : truncation(0.15f), max_range(20.0f), max_weight(100.0f) {
+
+    set_voxel_size(0.05f);
+}
+
+void TsdfMap::set_voxel_size(const float size) {
+
+    voxel_size = size;
+    inv_voxel_size = 1.0f / size;
+}
+
+size_t TsdfMap::memory_bytes() const {
+
+    size_t bytes = blocks.size() * (sizeof(BlockMap::value_type) + sizeof(void *)) +
+        blocks.bucket_count() * sizeof(void *);
+    for (const auto &mesh : meshes) {
+        bytes += sizeof(MeshMap::value_type) + sizeof(void *) + mesh.second.vertices.capacity() * sizeof(V3F) +
+            mesh.second.triangles.capacity() * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+const TsdfMap::Voxel *TsdfMap::find_voxel(const VoxelKey &voxel) const {
+
+    auto iter = blocks.find(block_of(voxel));
+    if (iter == blocks.end()) {
+        return nullptr;
+    }
+    const Voxel *v = &iter->second.voxels[local_index(voxel)];
+    return v->weight < MIN_WEIGHT ? nullptr : v;
+}
+
+TsdfMap::Voxel &TsdfMap::writable_voxel(const VoxelKey &voxel) {
+
+    const VoxelKey bk = block_of(voxel);
+    auto iter = blocks.find(bk);
+    if (iter == blocks.end()) {
+        iter = blocks.emplace(bk, Block()).first;
+        for (Voxel &v : iter->second.voxels) {
+            v.sdf = 0.0f;
+            v.weight = 0.0f;
+        }
+    }
+    dirty.insert(bk);
+    return iter->second.voxels[local_index(voxel)];
+}
+
+/* 沿射线在 [range - truncation, range + truncation] 内以半个体素的步长采样，连续落在同一体素的采样只更新一次。
+表面后方的权重随深度线性减小，减少薄物体背面被错误覆盖。*/
+void TsdfMap::integrate(const PointVector &points, const V3D &origin) {
+
+    const V3F o = origin.cast<float>();
+    const float step = 0.5f * voxel_size;
+    for (const PointType &p : points) {
+        const V3F ray = p.getVector3fMap() - o;
+        const float range = ray.norm();
+        if (range < 1e-3f || range > max_range) {
+            continue;
+        }
+        const V3F dir = ray / range;
+        VoxelKey last = {0, 0, 0};
+        bool has_last = false;
+        for (float t = std::max(0.0f, range - truncation); t <= range + truncation; t += step) {
+            const V3F s = o + dir * t;
+            const VoxelKey voxel = voxel_key(s(0), s(1), s(2), inv_voxel_size);
+            if (has_last && voxel == last) {
+                continue;
+            }
+            last = voxel;
+            has_last = true;
+
+            // 体素中心沿射线方向到点的距离
+            const V3F center((voxel.x + 0.5f) * voxel_size, (voxel.y + 0.5f) * voxel_size, (voxel.z + 0.5f) * voxel_size);
+            const float sdf = std::min(std::max(range - (center - o).dot(dir), -truncation), truncation);
+            const float w = sdf >= 0.0f ? 1.0f : std::max(1.0f + sdf / truncation, 0.05f);
+            Voxel &v = writable_voxel(voxel);
+            v.sdf = (v.sdf * v.weight + sdf * w) / (v.weight + w);
+            v.weight = std::min(v.weight + w, max_weight);
+        }
+    }
+}
+
+void TsdfMap::update_mesh(std::vector<VoxelKey> &changed) {
+
+    // 网格依赖相邻块边界上的体素，邻居也要重新提取
+    std::unordered_set<VoxelKey, VoxelKeyHash> todo;
+    for (const VoxelKey &bk : dirty) {
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dz = -1; dz <= 1; dz++) {
+                    VoxelKey nk = {bk.x + dx, bk.y + dy, bk.z + dz};
+                    if (blocks.count(nk)) {
+                        todo.insert(nk);
+                    }
+                }
+            }
+        }
+    }
+    dirty.clear();
+
+    changed.clear();
+    for (const VoxelKey &bk : todo) {
+        BlockMesh &mesh = meshes[bk];
+        extract_block(bk, mesh);
+        changed.push_back(bk);
+    }
+}
+
+/* surface nets。格子 c 的 8 个角为体素 c + {0,1}^3 的中心；
+块内体素 v 沿 a 轴的边 (v, v + e_a) 跨越表面时，共享这条边的 4 个格子 v、v - e_b、v - e_b - e_c、v - e_c 的顶点组成四边形，
+所以需要块内局部坐标 -1 到 7 的格子的顶点。*/
+void TsdfMap::extract_block(const VoxelKey &block, BlockMesh &mesh) const {
+
+    mesh.vertices.clear();
+    mesh.triangles.clear();
+    const int N = TSDF_BLOCK_SIZE + 1;  // 局部坐标 -1..7
+    const VoxelKey base = {block.x << TSDF_BLOCK_BITS, block.y << TSDF_BLOCK_BITS, block.z << TSDF_BLOCK_BITS};
+
+    // 局部坐标 -1..8 的体素，未观测为 nullptr
+    const Voxel *grid[N + 1][N + 1][N + 1];
+    for (int i = 0; i <= N; i++) {
+        for (int j = 0; j <= N; j++) {
+            for (int k = 0; k <= N; k++) {
+                VoxelKey v = {base.x + i - 1, base.y + j - 1, base.z + k - 1};
+                grid[i][j][k] = find_voxel(v);
+            }
+        }
+    }
+
+    // 每个格子的顶点索引，-1 为没有
+    int vertex[N][N][N];
+    static const int CORNERS[8][3] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0}, {0, 0, 1}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1}};
+    static const int EDGES[12][2] = {{0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            for (int k = 0; k < N; k++) {
+                vertex[i][j][k] = -1;
+                float sdf[8];
+                bool valid = true;
+                for (int c = 0; c < 8 && valid; c++) {
+                    const Voxel *v = grid[i + CORNERS[c][0]][j + CORNERS[c][1]][k + CORNERS[c][2]];
+                    valid = v != nullptr;
+                    sdf[c] = valid ? v->sdf : 0.0f;
+                }
+                if (!valid) {
+                    continue;
+                }
+                // 各条跨越表面的边上的过零点取平均
+                V3F sum = V3F::Zero();
+                int count = 0;
+                for (int e = 0; e < 12; e++) {
+                    const int a = EDGES[e][0], b = EDGES[e][1];
+                    if ((sdf[a] >= 0.0f) == (sdf[b] >= 0.0f)) {
+                        continue;
+                    }
+                    const float t = sdf[a] / (sdf[a] - sdf[b]);
+                    sum += V3F(CORNERS[a][0], CORNERS[a][1], CORNERS[a][2]) * (1.0f - t) +
+                        V3F(CORNERS[b][0], CORNERS[b][1], CORNERS[b][2]) * t;
+                    count++;
+                }
+                if (count == 0) {
+                    continue;
+                }
+                const V3F local = sum / count + V3F(i - 1 + 0.5f, j - 1 + 0.5f, k - 1 + 0.5f);
+                vertex[i][j][k] = mesh.vertices.size();
+                mesh.vertices.push_back((V3F(base.x, base.y, base.z) + local) * voxel_size);
+            }
+        }
+    }
+
+    // 块内体素（局部坐标 0..7，grid 中为 1..8）沿三个轴的边
+    for (int i = 1; i < N; i++) {
+        for (int j = 1; j < N; j++) {
+            for (int k = 1; k < N; k++) {
+                const Voxel *v0 = grid[i][j][k];
+                if (v0 == nullptr) {
+                    continue;
+                }
+                for (int a = 0; a < 3; a++) {
+                    const int d[3] = {a == 0, a == 1, a == 2};
+                    const Voxel *v1 = grid[i + d[0]][j + d[1]][k + d[2]];
+                    if (v1 == nullptr || (v0->sdf >= 0.0f) == (v1->sdf >= 0.0f)) {
+                        continue;
+                    }
+                    // 另外两个轴，格子坐标比体素坐标小 1
+                    const int b = (a + 1) % 3, c = (a + 2) % 3;
+                    int cell[3] = {i, j, k};
+                    int q[4];
+                    bool valid = true;
+                    for (int n = 0; n < 4 && valid; n++) {
+                        int idx[3] = {cell[0], cell[1], cell[2]};
+                        idx[b] -= (n == 1 || n == 2);
+                        idx[c] -= (n == 2 || n == 3);
+                        q[n] = vertex[idx[0]][idx[1]][idx[2]];
+                        valid = q[n] >= 0;
+                    }
+                    if (!valid) {
+                        continue;
+                    }
+                    // 法向量指向 sdf 为正（表面前方）的一侧
+                    if (v0->sdf >= 0.0f) {
+                        std::swap(q[1], q[3]);
+                    }
+                    const uint32_t tri[6] = {static_cast<uint32_t>(q[0]), static_cast<uint32_t>(q[1]),
+                        static_cast<uint32_t>(q[2]), static_cast<uint32_t>(q[0]), static_cast<uint32_t>(q[2]),
+                        static_cast<uint32_t>(q[3])};
+                    mesh.triangles.insert(mesh.triangles.end(), tri, tri + 6);
+                }
+            }
+        }
+    }
+}
+
+bool TsdfMap::save_mesh(const std::string &path, const M3D &R) const {
+
+    size_t num_vertices = 0, num_triangles = 0;
+    for (const auto &mesh : meshes) {
+        num_vertices += mesh.second.vertices.size();
+        num_triangles += mesh.second.triangles.size() / 3;
+    }
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr) {
+        neal::logger(neal::LOG_ERROR, "cannot open " + path);
+        return false;
+    }
+    fprintf(fp, "ply\nformat binary_little_endian 1.0\nelement vertex %zu\n"
+        "property float x\nproperty float y\nproperty float z\nelement face %zu\n"
+        "property list uchar int vertex_indices\nend_header\n", num_vertices, num_triangles);
+
+    const Eigen::Matrix3f Rf = R.cast<float>();
+    for (const auto &mesh : meshes) {
+        for (const V3F &v : mesh.second.vertices) {
+            const V3F p = Rf * v;
+            fwrite(p.data(), sizeof(float), 3, fp);
+        }
+    }
+    // 各块的顶点依次排列，三角形的索引加上块的顶点偏移
+    int32_t offset = 0;
+    for (const auto &mesh : meshes) {
+        const std::vector<uint32_t> &tri = mesh.second.triangles;
+        for (size_t i = 0; i < tri.size(); i += 3) {
+            const uint8_t n = 3;
+            const int32_t face[3] = {offset + static_cast<int32_t>(tri[i]), offset + static_cast<int32_t>(tri[i + 1]),
+                offset + static_cast<int32_t>(tri[i + 2])};
+            fwrite(&n, 1, 1, fp);
+            fwrite(face, sizeof(int32_t), 3, fp);
+        }
+        offset += mesh.second.vertices.size();
+    }
+    const bool ok = ferror(fp) == 0;
+    fclose(fp);
+    if (!ok) {
+        neal::logger(neal::LOG_ERROR, "failed to write " + path);
+        return false;
+    }
+    neal::logger(neal::LOG_INFO, "mesh saved: " + path + ", vertices: " + std::to_string(num_vertices) +
+        ", triangles: " + std::to_string(num_triangles));
+    return true;
+}
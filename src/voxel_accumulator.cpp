@@ -0,0 +1,81 @@
+#include "voxel_accumulator.h"
+
+#include <cstdio>
+#include <file_logger.h>
+
+#include "map_io.h"
+
+void VoxelAccumulator::add_point(const PointType &p) {
+
+    Voxel &v = voxels[voxel_key(p.x, p.y, p.z, inv_voxel_size)];
+    // 新建的体素 hits 为 0
+    if (v.hits == 0) {
+        v.centroid = p.getVector3fMap();
+        v.intensity = p.intensity;
+        v.hits = 1;
+        return;
+    }
+    // 增量更新均值
+    v.hits ++;
+    const float w = 1.0f / v.hits;
+    v.centroid += (p.getVector3fMap() - v.centroid) * w;
+    v.intensity += (p.intensity - v.intensity) * w;
+}
+
+size_t VoxelAccumulator::memory_bytes() const {
+
+    // 哈希表节点：键值对加上链表指针
+    return voxels.bucket_count() * sizeof(void *) +
+        voxels.size() * (sizeof(std::pair<const VoxelKey, Voxel>) + sizeof(void *));
+}
+
+void VoxelAccumulator::get_points(PointVector &out, const uint32_t min_hits) const {
+
+    out.clear();
+    out.reserve(voxels.size());
+    PointType p;
+    for (const auto &voxel : voxels) {
+        const Voxel &v = voxel.second;
+        if (v.hits < min_hits) {
+            continue;
+        }
+        p.x = v.centroid(0);
+        p.y = v.centroid(1);
+        p.z = v.centroid(2);
+        p.intensity = v.intensity;
+        out.push_back(p);
+    }
+}
+
+bool VoxelAccumulator::save(const std::string &path, const float tile_size, const M3D &R_W_G,
+    const uint32_t min_hits) const {
+
+    const std::string tmp_path = path + ".tmp";
+    TiledMapWriter writer;
+    if (!writer.open(tmp_path, tile_size, LIM_FRAME_GROUND)) {
+        return false;
+    }
+    PointType p;
+    for (const auto &voxel : voxels) {
+        const Voxel &v = voxel.second;
+        if (v.hits < min_hits) {
+            continue;
+        }
+        p.x = v.centroid(0);
+        p.y = v.centroid(1);
+        p.z = v.centroid(2);
+        p.intensity = v.intensity;
+        writer.add_point(p);
+    }
+    writer.set_R_W_G(R_W_G);
+    writer.close();
+    // 写入失败时保留原来的文件
+    if (writer.failed()) {
+        return false;
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        neal::logger(neal::LOG_ERROR, "cannot rename " + tmp_path + " to " + path);
+        return false;
+    }
+    return true;
+}
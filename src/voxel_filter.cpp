@@ -0,0 +1,75 @@
+#include "voxel_filter.h"
+
+#include <cmath>
+#include <algorithm>
+
+#define VOXEL_FILTER_BITS (21)
+
+static inline uint64_t axis_key(const float v, const float inv_leaf) {
+
+    const int64_t offset = int64_t(1) << (VOXEL_FILTER_BITS - 1);
+    const int64_t max_key = (int64_t(1) << VOXEL_FILTER_BITS) - 1;
+    const int64_t k = static_cast<int64_t>(std::floor(v * inv_leaf)) + offset;
+    return static_cast<uint64_t>(std::min(std::max(k, int64_t(0)), max_key));
+}
+
+void VoxelFilter::filter(const PointCloudXYZI &in, PointCloudXYZI &out) {
+
+    entries.clear();
+    const size_t n = in.points.size();
+    if (entries.capacity() < n) {
+        entries.reserve(n);
+    }
+    for (size_t i = 0; i < n; i++) {
+        const PointType &p = in.points[i];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+            continue;
+        }
+        Entry e;
+        e.key = (axis_key(p.z, inv_leaf) << (2 * VOXEL_FILTER_BITS)) | (axis_key(p.y, inv_leaf) << VOXEL_FILTER_BITS) |
+            axis_key(p.x, inv_leaf);
+        e.index = static_cast<uint32_t>(i);
+        entries.push_back(e);
+    }
+    // 下标参与比较，结果与输入顺序有关、与排序实现无关
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.key != b.key ? a.key < b.key : a.index < b.index;
+    });
+
+    out.header = in.header;
+    out.points.clear();
+    size_t begin = 0;
+    while (begin < entries.size()) {
+        size_t end = begin + 1;
+        while (end < entries.size() && entries[end].key == entries[begin].key) {
+            end++;
+        }
+        float sum[8] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        for (size_t k = begin; k < end; k++) {
+            const PointType &p = in.points[entries[k].index];
+            sum[0] += p.x;
+            sum[1] += p.y;
+            sum[2] += p.z;
+            sum[3] += p.intensity;
+            sum[4] += p.normal_x;
+            sum[5] += p.normal_y;
+            sum[6] += p.normal_z;
+            sum[7] += p.curvature;
+        }
+        const float inv = 1.0f / static_cast<float>(end - begin);
+        PointType q;
+        q.x = sum[0] * inv;
+        q.y = sum[1] * inv;
+        q.z = sum[2] * inv;
+        q.intensity = sum[3] * inv;
+        q.normal_x = sum[4] * inv;
+        q.normal_y = sum[5] * inv;
+        q.normal_z = sum[6] * inv;
+        q.curvature = sum[7] * inv;
+        out.points.push_back(q);
+        begin = end;
+    }
+    out.width = out.points.size();
+    out.height = 1;
+    out.is_dense = true;
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string>
+#include <pcl/io/ply_io.h>
+
+#include "common_lib.h"
+#include "map_io.h"
+#include "point_transform.h"
+
+/* .ply 与 .lim 地图互相转换。
+map_convert in.ply out.lim [tile_size]  ：ply 点云按 tile 写成 .lim（视为 ground 系）
+map_convert in.lim out.ply [--ground]   ：.lim 转 ply，--ground 表示把 world 系地图转到 ground 系*/
+
+static bool ends_with(const std::string &s, const std::string &suffix) {
+
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static int ply_to_lim(const std::string &in, const std::string &out, const float tile_size) {
+
+    PointCloudXYZI cloud;
+    pcl::PLYReader reader;
+    if (reader.read(in, cloud) != 0) {
+        std::cerr << "cannot read " << in << std::endl;
+        return 1;
+    }
+    TiledMapWriter writer;
+    if (!writer.open(out, tile_size, LIM_FRAME_GROUND)) {
+        std::cerr << "cannot write " << out << std::endl;
+        return 1;
+    }
+    writer.add_points(cloud);
+    writer.close();
+    if (writer.failed()) {
+        std::cerr << "failed to write " << out << std::endl;
+        return 1;
+    }
+    std::cout << in << " -> " << out << ", " << cloud.size() << " points" << std::endl;
+    return 0;
+}
+
+static int lim_to_ply(const std::string &in, const std::string &out, const bool to_ground) {
+
+    TiledMapReader reader;
+    if (!reader.open(in)) {
+        std::cerr << "cannot read " << in << std::endl;
+        return 1;
+    }
+    if (reader.is_recovered()) {
+        std::cout << "warning: " << in << " has no index, recovered " << reader.num_chunks() << " chunks" << std::endl;
+    }
+
+    if (to_ground && reader.get_header().frame == LIM_FRAME_WORLD && !reader.has_R_W_G()) {
+        std::cerr << in << " has no R_W_G (the writer exited before it was known), "
+            "cannot convert to the ground frame" << std::endl;
+        return 1;
+    }
+
+    PointVector points;
+    reader.load(points);
+    // world 系地图转到 ground 系
+    if (to_ground && reader.get_header().frame == LIM_FRAME_WORLD) {
+        transform_points(points.data(), points.data(), points.size(), make_transform(reader.get_R_W_G(), V3D::Zero()));
+    }
+
+    PointCloudXYZI cloud;
+    cloud.points.assign(points.begin(), points.end());
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    pcl::PLYWriter writer;
+    writer.write(out, cloud, true);
+    std::cout << in << " -> " << out << ", " << cloud.size() << " points" << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    if (argc < 3) {
+        std::cout << "usage: map_convert in.ply out.lim [tile_size]" << std::endl;
+        std::cout << "       map_convert in.lim out.ply [--ground]" << std::endl;
+        return 1;
+    }
+    const std::string in(argv[1]);
+    const std::string out(argv[2]);
+
+    if (ends_with(in, ".ply") && ends_with(out, ".lim")) {
+        float tile_size = argc > 3 ? std::stof(argv[3]) : 10.0f;
+        return ply_to_lim(in, out, tile_size);
+    }
+    if (ends_with(in, ".lim") && ends_with(out, ".ply")) {
+        bool to_ground = argc > 3 && std::string(argv[3]) == "--ground";
+        return lim_to_ply(in, out, to_ground);
+    }
+    std::cout << "unsupported conversion: " << in << " -> " << out << std::endl;
+    return 1;
+}
@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""精度和吞吐量的回归测试。
+
+对 tools/regression.yaml 中的每个序列：
+1. 合成序列用 sim_generate 生成 .lsr 和真值（已存在时复用，--regenerate 重新生成）；
+2. roslaunch lio replay_mid70.launch 离线回放，收集 PCD/ 下的 trajectory.txt、replay_timing.csv、
+   replay_summary.txt 和 latency.csv；
+3. traj_eval 计算 ATE/RPE；
+4. 与绝对上限和基准（tools/regression_baseline.yaml）比较，超出容差即失败，返回值非 0。
+
+基准中的耗时、内存和分配次数只在同一台机器上有意义：基准记录了主机名，主机不同时只检查精度。
+修改 esekfom.hpp、IMU_Processing.cpp、laserMapping.cpp 后运行：
+    python3 tools/regression.py                     # 检查
+    python3 tools/regression.py --update-baseline   # 确认结果后更新基准
+需要先 source 工作空间的 devel/setup.bash，sim_generate、traj_eval 在 devel/lib/lio 下。
+lio_node 需要用 catkin_make -DALLOC_STATS=ON 编译（默认关闭），否则分配次数无法检查，直接失败。
+每帧并不是零分配（ROS 消息、地图的写时复制和 ikd-Tree 都会分配），检查的是：所有序列主线程每帧的分配次数
+不随地图增长、不超过基准；alloc_free 的序列中迭代更新在稳态下不分配。
+没有基准的序列也算失败（--update-baseline 时除外），避免相对容差被悄悄跳过。
+"""
+
+import argparse
+import os
+import shlex
+import shutil
+import socket
+import subprocess
+import sys
+
+import yaml
+
+PKG_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+PCD_DIR = os.path.join(PKG_DIR, 'PCD')
+OUTPUTS = ['trajectory.txt', 'replay_timing.csv', 'replay_summary.txt', 'latency.csv']
+ACCURACY = ['ate_rmse', 'rpe_trans', 'rpe_rot_deg']
+# 主线程的分配次数只与代码和数据有关，与主机无关，主机不同时也和基准比较
+HOST_INDEPENDENT = ACCURACY + ['main_allocs_per_scan']
+BASELINE_KEYS = ACCURACY + ['scan_ms_mean', 'scan_ms_p99', 'peak_rss_mb', 'allocs_per_scan',
+                            'update_allocs_per_scan', 'main_allocs_per_scan']
+
+
+def find_executable(name):
+    # catkin 的 devel 空间在 CMAKE_PREFIX_PATH 中
+    for prefix in os.environ.get('CMAKE_PREFIX_PATH', '').split(os.pathsep):
+        path = os.path.join(prefix, 'lib', 'lio', name)
+        if prefix and os.access(path, os.X_OK):
+            return path
+    path = shutil.which(name)
+    if path is None:
+        sys.exit('cannot find %s, source devel/setup.bash first' % name)
+    return path
+
+
+def read_kv(text):
+    values = {}
+    for line in text.splitlines():
+        key, sep, value = line.partition(':')
+        if not sep:
+            continue
+        try:
+            values[key.strip()] = float(value)
+        except ValueError:
+            pass
+    return values
+
+
+def run(cmd, log_path, timeout, cwd=PKG_DIR):
+    with open(log_path, 'w') as log:
+        try:
+            return subprocess.run(cmd, cwd=cwd, stdout=log, stderr=subprocess.STDOUT, timeout=timeout).returncode
+        except subprocess.TimeoutExpired:
+            log.write('\ntimeout after %ds\n' % timeout)
+            return -1
+
+
+def prepare(seq, out_dir, regenerate, timeout):
+    """返回 (传感器数据, 真值)，实录数据不存在时返回 None。"""
+    if 'args' in seq:
+        data = os.path.join(out_dir, seq['name'] + '.lsr')
+        gt = os.path.join(out_dir, seq['name'] + '_gt.txt')
+        if regenerate or not os.path.exists(data) or not os.path.exists(gt):
+            cmd = [find_executable('sim_generate'), data, '--gt', gt] + shlex.split(seq['args'])
+            if run(cmd, os.path.join(out_dir, seq['name'], 'generate.log'), timeout) != 0:
+                raise RuntimeError('sim_generate failed')
+        return data, gt
+    data, gt = seq['file'], seq['groundtruth']
+    if not os.path.exists(data) or not os.path.exists(gt):
+        return None
+    return data, gt
+
+
+def replay(seq, data, gt, seq_dir, manifest):
+    os.makedirs(PCD_DIR, exist_ok=True)
+    for name in OUTPUTS:
+        path = os.path.join(PCD_DIR, name)
+        if os.path.exists(path):
+            os.remove(path)
+    cmd = ['roslaunch', 'lio', 'replay_mid70.launch', 'bag:=' + os.path.abspath(data)]
+    # 序列的参数覆盖 mid70.yaml
+    if seq.get('params'):
+        params = os.path.join(seq_dir, 'params.yaml')
+        with open(params, 'w') as f:
+            yaml.safe_dump(seq['params'], f, default_flow_style=False)
+        cmd.append('params:=' + params)
+    code = run(cmd, os.path.join(seq_dir, 'replay.log'), manifest.get('timeout', 1800))
+    for name in OUTPUTS:
+        path = os.path.join(PCD_DIR, name)
+        if os.path.exists(path):
+            shutil.copy(path, os.path.join(seq_dir, name))
+    traj = os.path.join(seq_dir, 'trajectory.txt')
+    summary = os.path.join(seq_dir, 'replay_summary.txt')
+    if code != 0 or not os.path.exists(traj) or not os.path.exists(summary):
+        raise RuntimeError('replay failed, see %s' % os.path.join(seq_dir, 'replay.log'))
+
+    metrics = {}
+    with open(summary) as f:
+        metrics.update(read_kv(f.read()))
+    cmd = [find_executable('traj_eval'), traj, gt, '--delta', str(manifest.get('rpe_delta', 1.0))]
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0:
+        raise RuntimeError('traj_eval failed: ' + result.stdout.strip())
+    metrics.update(read_kv(result.stdout))
+    return metrics
+
+
+def check(seq, metrics, baseline, manifest, same_host, require_baseline):
+    failures = []
+    limits = manifest.get('limits', {})
+    for key in ACCURACY:
+        if key in limits and metrics.get(key, float('inf')) > limits[key]:
+            failures.append('%s %.4f > limit %.4f' % (key, metrics.get(key, float('inf')), limits[key]))
+    if metrics.get('coverage', 0.0) < limits.get('min_coverage', 0.0):
+        failures.append('coverage %.3f < %.3f' % (metrics.get('coverage', 0.0), limits['min_coverage']))
+    # 迭代更新的分配次数只在主线程统计，与主机无关；只检查稳态下不分配内存的配置（alloc_free）
+    if seq.get('alloc_free'):
+        value = metrics.get('update_alloc_scans', -1)
+        if value < 0:
+            failures.append('update_alloc_scans unavailable, build with -DALLOC_STATS=ON')
+        elif value > limits.get('update_alloc_scans', 0):
+            failures.append('update_alloc_scans %d > limit %d' % (value, limits.get('update_alloc_scans', 0)))
+    if metrics.get('allocs_per_scan', -1) < 0:
+        failures.append('allocation counts unavailable, rebuild lio_node with catkin_make -DALLOC_STATS=ON')
+    # 所有序列：主线程每帧的分配不随地图增长，后四分之一的均值不超过第二个四分之一的 (1 + tol) 倍加 slack
+    early, late = metrics.get('main_allocs_early', -1), metrics.get('main_allocs_late', -1)
+    if early >= 0 and late >= 0 and 'main_allocs_growth' in limits:
+        tol, slack = limits['main_allocs_growth']
+        if late > early * (1.0 + tol) + slack:
+            failures.append('main_allocs_late %.1f > %.1f (early %.1f), per-scan allocations grow with the map' % (
+                late, early * (1.0 + tol) + slack, early))
+    if baseline is None:
+        if require_baseline:
+            failures.append('no baseline, record one with --update-baseline')
+        return failures
+    for key, (tol, slack) in manifest.get('tolerance', {}).items():
+        if key not in baseline or key not in metrics or (key not in HOST_INDEPENDENT and not same_host):
+            continue
+        # 基准没有编译 ALLOC_STATS 时为 -1
+        if baseline[key] < 0 or metrics[key] < 0:
+            continue
+        bound = baseline[key] * (1.0 + tol) + slack
+        if metrics[key] > bound:
+            failures.append('%s %.4f > %.4f (baseline %.4f)' % (key, metrics[key], bound, baseline[key]))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='accuracy and throughput regression for lio')
+    parser.add_argument('--manifest', default=os.path.join(PKG_DIR, 'tools', 'regression.yaml'))
+    parser.add_argument('--baseline', default=os.path.join(PKG_DIR, 'tools', 'regression_baseline.yaml'))
+    parser.add_argument('--out', default='/tmp/lio_regression', help='generated data and per-sequence results')
+    parser.add_argument('--only', nargs='*', help='run only these sequences')
+    parser.add_argument('--regenerate', action='store_true', help='regenerate synthetic sequences')
+    parser.add_argument('--update-baseline', action='store_true', help='write the results as the new baseline')
+    args = parser.parse_args()
+    args.out = os.path.abspath(args.out)
+
+    with open(args.manifest) as f:
+        manifest = yaml.safe_load(f)
+    baseline_all = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline_all = yaml.safe_load(f) or {}
+    host = socket.gethostname()
+    same_host = baseline_all.get('host') == host
+    if baseline_all.get('sequences') and not same_host:
+        print('baseline was recorded on %s, checking accuracy only' % baseline_all.get('host'))
+
+    results = {}
+    failed = False
+    for seq in manifest['sequences']:
+        name = seq['name']
+        if args.only and name not in args.only:
+            continue
+        seq_dir = os.path.join(args.out, name)
+        os.makedirs(seq_dir, exist_ok=True)
+        try:
+            inputs = prepare(seq, args.out, args.regenerate, manifest.get('timeout', 1800))
+            if inputs is None:
+                print('%-16s skipped, data not found' % name)
+                continue
+            metrics = replay(seq, inputs[0], inputs[1], seq_dir, manifest)
+        except RuntimeError as e:
+            print('%-16s FAIL %s' % (name, e))
+            failed = True
+            continue
+        # 记录基准时不要求已有基准
+        failures = check(seq, metrics, (baseline_all.get('sequences') or {}).get(name), manifest, same_host,
+                         not args.update_baseline)
+        results[name] = metrics
+        failed = failed or bool(failures)
+        print('%-16s %s ate %.4fm, rpe %.4fm / %.3fdeg, scan %.2fms (p99 %.2fms), speed %.1fx, '
+              'rss %.0fMB, allocs/scan %.0f (main thread %.0f)' % (
+                  name, 'FAIL' if failures else 'ok  ', metrics.get('ate_rmse', -1), metrics.get('rpe_trans', -1),
+                  metrics.get('rpe_rot_deg', -1), metrics.get('scan_ms_mean', -1), metrics.get('scan_ms_p99', -1),
+                  metrics.get('speed', -1), metrics.get('peak_rss_mb', -1), metrics.get('allocs_per_scan', -1),
+                  metrics.get('main_allocs_per_scan', -1)))
+        for failure in failures:
+            print('    ' + failure)
+
+    with open(os.path.join(args.out, 'report.yaml'), 'w') as f:
+        yaml.safe_dump({'host': host, 'sequences': results}, f, default_flow_style=False)
+    if args.update_baseline:
+        baseline_all = {'host': host, 'sequences': (baseline_all.get('sequences') or {}) if same_host else {}}
+        for name, metrics in results.items():
+            baseline_all['sequences'][name] = {key: metrics[key] for key in BASELINE_KEYS if key in metrics}
+        with open(args.baseline, 'w') as f:
+            yaml.safe_dump(baseline_all, f, default_flow_style=False)
+        print('baseline updated: ' + args.baseline)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,221 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+
+#include "common_lib.h"
+#include "sensor_log.h"
+#include "sim_world.h"
+
+/* 生成合成的室内 LiDAR-惯导数据，写成 .lsr 传感器记录，可以直接用 replay/bag_file 回放。
+sim_generate out.lsr [--option value] ...
+  --gt FILE              真值轨迹（IMU 位姿，相对第一帧，与 PCD/trajectory.txt 格式相同），默认 out.lsr 换成 _gt.txt
+  --duration 60          时长（s），包含开头的静止段
+  --trajectory circle    static / circle / figure8 / handheld
+  --speed 1.0            平均速度（m/s）
+  --amplitude 0          水平运动幅度（m），0 表示按房间大小自动选择
+  --still 2.0            开头静止的时间（s），用于 IMU 初始化
+  --room 10,8,3          程序生成的房间内部尺寸（m）
+  --boxes 12 --pillars 2 家具和柱子的数量
+  --scene FILE           改为读取 occupy.txt 格式的体素房间（back_up/occupy.txt）
+  --scene_res            体素边长，程序生成的房间默认 0.05，occupy.txt 默认 0.1
+  --center x,y,z         运动中心，默认房间中心、离地 1.2m
+  --save_scene FILE      把场景写成 occupy.txt 格式
+  --point_rate 100000    每秒点数（Mid-70 为 100000），可以设到几十万测试节点的处理上限
+  --scan_rate 10         LiDAR 帧率（Hz）
+  --imu_rate 200         IMU 频率（Hz）
+  --range_noise 0.02     测距噪声（m）
+  --acc_noise 0.05 --gyr_noise 0.005           IMU 白噪声（每个样本的标准差）
+  --acc_walk 1e-4 --gyr_walk 1e-5              零偏随机游走（每 sqrt(s)）
+  --point_filter_num 1 --blind 0.05            与 Preprocess 相同的降采样和盲区，写入记录的文件头
+  --start_time 1000      第一帧的时间戳（s）
+  --seed 1
+外参与 config/mid70.yaml 相同（R_I_L = I，t_I_L = [0.0078, 0.13, 0.0509]）。*/
+
+static bool parse_vector(const std::string &s, V3D &v) {
+
+    return sscanf(s.c_str(), "%lf,%lf,%lf", &v(0), &v(1), &v(2)) == 3;
+}
+
+static std::string replace_suffix(const std::string &path, const std::string &suffix) {
+
+    const size_t dot = path.rfind('.');
+    return (dot == std::string::npos ? path : path.substr(0, dot)) + suffix;
+}
+
+int main(int argc, char **argv) {
+
+    if (argc < 2 || argv[1][0] == '-') {
+        std::cout << "usage: sim_generate out.lsr [--trajectory circle|figure8|handheld|static] [--duration 60] "
+            "[--point_rate 100000] [--room 10,8,3 | --scene occupy.txt --scene_res 0.1] ..." << std::endl;
+        return 1;
+    }
+    const std::string out(argv[1]);
+    std::unordered_map<std::string, std::string> opts;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (std::string(argv[i]).compare(0, 2, "--") != 0) {
+            std::cerr << "unexpected argument " << argv[i] << std::endl;
+            return 1;
+        }
+        opts[argv[i] + 2] = argv[i + 1];
+    }
+    auto opt = [&opts](const std::string &key, const std::string &def) {
+        auto iter = opts.find(key);
+        return iter == opts.end() ? def : iter->second;
+    };
+
+    const double duration = std::stod(opt("duration", "60"));
+    const double scan_rate = std::stod(opt("scan_rate", "10"));
+    const double imu_rate = std::stod(opt("imu_rate", "200"));
+    const double start_time = std::stod(opt("start_time", "1000"));
+    const int point_filter_num = std::max(1, std::stoi(opt("point_filter_num", "1")));
+    const double blind = std::stod(opt("blind", "0.05"));
+    const int seed = std::stoi(opt("seed", "1"));
+    const std::string gt_file = opt("gt", replace_suffix(out, "_gt.txt"));
+
+    /* 场景。*/
+    SimScene scene;
+    const double keep_out = 1.5;
+    const float scene_res = std::stof(opt("scene_res", opts.count("scene") ? "0.1" : "0.05"));
+    if (opts.count("scene")) {
+        if (!scene.load_occupy(opts["scene"], scene_res)) {
+            return 1;
+        }
+    }
+    else {
+        V3D room;
+        if (!parse_vector(opt("room", "10,8,3"), room)) {
+            std::cerr << "--room expects x,y,z" << std::endl;
+            return 1;
+        }
+        scene.make_room(room, scene_res, std::stoi(opt("boxes", "12")), std::stoi(opt("pillars", "2")), keep_out, seed);
+    }
+    if (opts.count("save_scene")) {
+        scene.save_occupy(opts["save_scene"]);
+    }
+
+    /* 轨迹，运动中心默认在房间中心、离地 1.2m。*/
+    SimTrajectory traj;
+    SimTrajectoryType type;
+    if (!SimTrajectory::parse_type(opt("trajectory", "circle"), type)) {
+        std::cerr << "unknown trajectory " << opt("trajectory", "") << std::endl;
+        return 1;
+    }
+    const V3D size = scene.get_size();
+    V3D center = scene.get_center();
+    center(2) = opts.count("scene") ? center(2) : 1.2;
+    if (opts.count("center") && !parse_vector(opts["center"], center)) {
+        std::cerr << "--center expects x,y,z" << std::endl;
+        return 1;
+    }
+    double amplitude = std::stod(opt("amplitude", "0"));
+    if (amplitude <= 0.0) {
+        amplitude = std::max(0.5, 0.5 * std::min(size(0), size(1)) - keep_out);
+    }
+    traj.set_type(type);
+    traj.set_center(center);
+    traj.set_amplitude(amplitude);
+    traj.set_speed(std::stod(opt("speed", "1.0")));
+    traj.set_still_time(std::stod(opt("still", "2.0")));
+
+    /* 传感器。*/
+    const M3D R_I_L = M3D::Identity();
+    const V3D t_I_L(0.0078, 0.13, 0.0509);
+    SimLidar lidar;
+    lidar.set_point_rate(std::stod(opt("point_rate", "100000")));
+    lidar.set_range_noise(std::stod(opt("range_noise", "0.02")));
+    lidar.set_extrinsic(R_I_L, t_I_L);
+    SimImu imu;
+    imu.set_noise(std::stod(opt("acc_noise", "0.05")), std::stod(opt("gyr_noise", "0.005")));
+    imu.set_bias_walk(std::stod(opt("acc_walk", "1e-4")), std::stod(opt("gyr_walk", "1e-5")));
+
+    // 轨迹上的 LiDAR 原点必须在空闲空间内
+    for (double t = 0.0; t <= duration; t += 0.05) {
+        M3D R;
+        V3D p;
+        traj.pose(t, R, p);
+        if (scene.is_occupied(p + R * t_I_L)) {
+            std::cerr << "trajectory passes through an obstacle at t = " << t << "s, position " << p.transpose() <<
+                ", adjust --center / --amplitude" << std::endl;
+            return 1;
+        }
+    }
+
+    SensorLogWriter writer;
+    writer.set_preprocess(point_filter_num, 1, 10, blind);
+    if (!writer.open(out)) {
+        return 1;
+    }
+    FILE *gt_fp = fopen(gt_file.c_str(), "w");
+    if (gt_fp == nullptr) {
+        std::cerr << "cannot open " << gt_file << std::endl;
+        return 1;
+    }
+    fprintf(gt_fp, "# time x y z qx qy qz qw\n");
+
+    // 真值相对第一个 IMU 位姿，与 LIO 的 world 系一致
+    M3D R0;
+    V3D p0;
+    traj.pose(0.0, R0, p0);
+
+    std::mt19937 rng(seed);
+    std::vector<SimPoint> points;
+    PointCloudXYZI cloud;
+    const double scan_time = 1.0 / scan_rate;
+    const int num_scans = static_cast<int>(duration * scan_rate);
+    int imu_index = 0;
+    size_t raw_points = 0;
+    auto t_begin = std::chrono::steady_clock::now();
+    for (int k = 0; k < num_scans; k++) {
+        const double t0 = k * scan_time;
+        // 按到达顺序，先写本帧结束之前的 IMU
+        while (imu_index / imu_rate <= t0 + scan_time) {
+            const double t = imu_index / imu_rate;
+            SimImuSample s = imu.sample(traj, t, imu_index > 0 ? 1.0 / imu_rate : 0.0, rng);
+            writer.add_imu(start_time + t, s.acc, s.gyr);
+
+            M3D R;
+            V3D p;
+            traj.pose(t, R, p);
+            const Eigen::Quaterniond q(R0.transpose() * R);
+            const V3D pos = R0.transpose() * (p - p0);
+            fprintf(gt_fp, "%.6f %.6f %.6f %.6f %.9f %.9f %.9f %.9f\n", start_time + t, pos(0), pos(1), pos(2),
+                q.x(), q.y(), q.z(), q.w());
+            imu_index++;
+        }
+
+        lidar.scan(scene, traj, t0, scan_time, rng, points);
+        raw_points += points.size();
+        // 与 Preprocess::process 相同的筛选和等间隔采样
+        cloud.clear();
+        int valid_num = 0;
+        for (const SimPoint &sp : points) {
+            if (sp.p(0) <= 0.1f) {
+                continue;
+            }
+            if (valid_num++ % point_filter_num != 0 || sp.p(0) * sp.p(0) + sp.p(1) * sp.p(1) <= blind) {
+                continue;
+            }
+            PointType p;
+            p.x = sp.p(0);
+            p.y = sp.p(1);
+            p.z = sp.p(2);
+            p.intensity = sp.intensity;
+            p.curvature = sp.offset * 1000.0f;
+            cloud.push_back(p);
+        }
+        writer.add_scan(start_time + t0, cloud);
+    }
+    writer.close();
+    fclose(gt_fp);
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_begin).count();
+    std::cout << out << ": " << num_scans << " scans, " << imu_index << " imu samples, " <<
+        (num_scans > 0 ? raw_points / num_scans : 0) << " returns per scan (" <<
+        static_cast<size_t>(lidar.get_point_rate() * scan_time) << " beams), occupied voxels: " <<
+        scene.num_occupied() << ", generated in " << elapsed << "s" << std::endl;
+    std::cout << "ground truth: " << gt_file << std::endl;
+    return 0;
+}
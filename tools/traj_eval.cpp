@@ -0,0 +1,168 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+/* 轨迹精度评估，输入两条 TUM 格式的轨迹（time x y z qx qy qz qw，# 开头为注释），
+例如 PCD/trajectory.txt 和 sim_generate 输出的真值。
+traj_eval estimate.txt groundtruth.txt [--delta 1.0] [--no_align]
+1. 估计的每个位姿在真值中按时间线性插值（旋转 slerp），真值相邻两项间隔超过 max_gap 的不参与；
+2. ATE：位置用 Umeyama 求刚体变换（无尺度）对齐后的误差，--no_align 时直接比较；
+3. RPE：间隔 delta 秒的相对位姿误差，平移（m）和旋转（度）取 RMSE，与对齐无关。
+输出为 key: value，每行一项，便于脚本读取。*/
+
+struct Pose {
+    double time;
+    Eigen::Vector3d pos;
+    Eigen::Quaterniond rot;
+};
+
+static bool load_tum(const std::string &path, std::vector<Pose> &poses) {
+
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        std::cerr << "cannot read " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream ss(line);
+        Pose p;
+        double qx, qy, qz, qw;
+        if (!(ss >> p.time >> p.pos(0) >> p.pos(1) >> p.pos(2) >> qx >> qy >> qz >> qw)) {
+            continue;
+        }
+        p.rot = Eigen::Quaterniond(qw, qx, qy, qz).normalized();
+        poses.push_back(p);
+    }
+    std::sort(poses.begin(), poses.end(), [](const Pose &a, const Pose &b) {return a.time < b.time;});
+    return true;
+}
+
+// 在真值中插值 t 时刻的位姿
+static bool interpolate(const std::vector<Pose> &gt, const double t, const double max_gap, Pose &out) {
+
+    auto iter = std::lower_bound(gt.begin(), gt.end(), t, [](const Pose &p, const double time) {return p.time < time;});
+    if (iter == gt.end() || (iter == gt.begin() && iter->time > t)) {
+        return false;
+    }
+    if (iter->time == t) {
+        out = *iter;
+        return true;
+    }
+    const Pose &b = *iter;
+    const Pose &a = *(iter - 1);
+    if (b.time - a.time > max_gap) {
+        return false;
+    }
+    const double s = (t - a.time) / (b.time - a.time);
+    out.time = t;
+    out.pos = (1.0 - s) * a.pos + s * b.pos;
+    out.rot = a.rot.slerp(s, b.rot);
+    return true;
+}
+
+int main(int argc, char **argv) {
+
+    if (argc < 3) {
+        std::cout << "usage: traj_eval estimate.txt groundtruth.txt [--delta 1.0] [--no_align]" << std::endl;
+        return 1;
+    }
+    double delta = 1.0;
+    bool align = true;
+    const double max_gap = 0.1;
+    for (int i = 3; i < argc; i++) {
+        const std::string arg(argv[i]);
+        if (arg == "--delta" && i + 1 < argc) {
+            delta = std::stod(argv[++i]);
+        }
+        else if (arg == "--no_align") {
+            align = false;
+        }
+    }
+
+    std::vector<Pose> est, gt;
+    if (!load_tum(argv[1], est) || !load_tum(argv[2], gt)) {
+        return 1;
+    }
+    // 配对
+    std::vector<Pose> est_m, gt_m;
+    for (const Pose &p : est) {
+        Pose g;
+        if (interpolate(gt, p.time, max_gap, g)) {
+            est_m.push_back(p);
+            gt_m.push_back(g);
+        }
+    }
+    const size_t n = est_m.size();
+    if (n < 3) {
+        std::cerr << "too few matched poses: " << n << std::endl;
+        return 1;
+    }
+
+    /* ATE。*/
+    Eigen::Matrix3d R = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d t = Eigen::Vector3d::Zero();
+    if (align) {
+        Eigen::Matrix<double, 3, Eigen::Dynamic> src(3, n), dst(3, n);
+        for (size_t i = 0; i < n; i++) {
+            src.col(i) = est_m[i].pos;
+            dst.col(i) = gt_m[i].pos;
+        }
+        const Eigen::Matrix4d T = Eigen::umeyama(src, dst, false);
+        R = T.block<3, 3>(0, 0);
+        t = T.block<3, 1>(0, 3);
+    }
+    double ate_sum2 = 0.0, ate_sum = 0.0, ate_max = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        const double e = (R * est_m[i].pos + t - gt_m[i].pos).norm();
+        ate_sum2 += e * e;
+        ate_sum += e;
+        ate_max = std::max(ate_max, e);
+    }
+
+    /* RPE。*/
+    double rpe_t2 = 0.0, rpe_r2 = 0.0;
+    size_t num_pairs = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+        j = std::max(j, i + 1);
+        while (j < n && est_m[j].time < est_m[i].time + delta) {
+            j++;
+        }
+        if (j >= n) {
+            break;
+        }
+        const Eigen::Quaterniond dq_est = est_m[i].rot.conjugate() * est_m[j].rot;
+        const Eigen::Vector3d dp_est = est_m[i].rot.conjugate() * (est_m[j].pos - est_m[i].pos);
+        const Eigen::Quaterniond dq_gt = gt_m[i].rot.conjugate() * gt_m[j].rot;
+        const Eigen::Vector3d dp_gt = gt_m[i].rot.conjugate() * (gt_m[j].pos - gt_m[i].pos);
+        // E = ΔG^-1 ΔP
+        const Eigen::Quaterniond dq_err = dq_gt.conjugate() * dq_est;
+        const Eigen::Vector3d dp_err = dq_gt.conjugate() * (dp_est - dp_gt);
+        rpe_t2 += dp_err.squaredNorm();
+        const double angle = Eigen::AngleAxisd(dq_err).angle();
+        rpe_r2 += angle * angle;
+        num_pairs++;
+    }
+
+    // 估计的轨迹覆盖真值的比例，发散或提前退出时变小
+    const double coverage = (est_m.back().time - est_m.front().time) / std::max(1e-9, gt.back().time - gt.front().time);
+    printf("matched: %zu\n", n);
+    printf("coverage: %.4f\n", coverage);
+    printf("ate_rmse: %.6f\n", std::sqrt(ate_sum2 / n));
+    printf("ate_mean: %.6f\n", ate_sum / n);
+    printf("ate_max: %.6f\n", ate_max);
+    printf("rpe_pairs: %zu\n", num_pairs);
+    printf("rpe_trans: %.6f\n", num_pairs > 0 ? std::sqrt(rpe_t2 / num_pairs) : 0.0);
+    printf("rpe_rot_deg: %.6f\n", num_pairs > 0 ? std::sqrt(rpe_r2 / num_pairs) * 180.0 / M_PI : 0.0);
+    return 0;
+}